@@ -7,8 +7,19 @@
 #include "rage/grcore/texturepc.h"
 #include "helpers/format.h"
 #include "texpresets.h"
+#include "txdmanifest.h"
 
-#include <semaphore>
+namespace
+{
+	struct TextureCompileJob
+	{
+		u32								TuneIndex;
+		u32								OptionsHash;
+		u64								ModifyTime;
+		u64								SrcFileSize;	// Used to schedule largest textures first
+		rageam::asset::TexturePresetPtr	UsedPreset;
+	};
+}
 
 void rageam::asset::TextureOptions::SerializeChanged(const XmlHandle& node, const TextureOptions& options) const
 {
@@ -17,6 +28,7 @@ void rageam::asset::TextureOptions::SerializeChanged(const XmlHandle& node, cons
 
 	TEX_SET_IF_CHANGED(Format);
 	TEX_SET_IF_CHANGED(MipFilter);
+	TEX_SET_IF_CHANGED(MipGammaCorrect);
 	TEX_SET_IF_CHANGED(Quality);
 	TEX_SET_IF_CHANGED(MaxResolution);
 	TEX_SET_IF_CHANGED(GenerateMipMaps);
@@ -27,6 +39,15 @@ void rageam::asset::TextureOptions::SerializeChanged(const XmlHandle& node, cons
 	TEX_SET_IF_CHANGED(AlphaTestCoverage);
 	TEX_SET_IF_CHANGED(AlphaTestThreshold);
 	TEX_SET_IF_CHANGED(AllowRecompress);
+	TEX_SET_IF_CHANGED(SwizzleR);
+	TEX_SET_IF_CHANGED(SwizzleG);
+	TEX_SET_IF_CHANGED(SwizzleB);
+	TEX_SET_IF_CHANGED(SwizzleA);
+	TEX_SET_IF_CHANGED(Rdo);
+	TEX_SET_IF_CHANGED(RdoLambda);
+	TEX_SET_IF_CHANGED(RdoWindow);
+	TEX_SET_IF_CHANGED(AdaptiveQuality);
+	TEX_SET_IF_CHANGED(AdaptiveMaxError);
 
 #undef TEX_SET_IF_CHANGED
 }
@@ -35,6 +56,7 @@ void rageam::asset::TextureOptions::Serialize(XmlHandle& node) const
 {
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.Format);
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.MipFilter);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.MipGammaCorrect);
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.Quality);
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.MaxResolution);
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.GenerateMipMaps);
@@ -45,12 +67,22 @@ void rageam::asset::TextureOptions::Serialize(XmlHandle& node) const
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.AlphaTestCoverage);
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.AlphaTestThreshold);
 	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.AllowRecompress);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleR);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleG);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleB);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleA);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.Rdo);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.RdoLambda);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.RdoWindow);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.AdaptiveQuality);
+	XML_SET_CHILD_VALUE_ATTR(node, CompressorOptions.AdaptiveMaxError);
 }
 
 void rageam::asset::TextureOptions::Deserialize(const XmlHandle& node)
 {
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.Format);
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.MipFilter);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.MipGammaCorrect);
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.Quality);
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.MaxResolution);
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.GenerateMipMaps);
@@ -61,6 +93,15 @@ void rageam::asset::TextureOptions::Deserialize(const XmlHandle& node)
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.AlphaTestCoverage);
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.AlphaTestThreshold);
 	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.AllowRecompress);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleR);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleG);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleB);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.SwizzleA);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.Rdo);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.RdoLambda);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.RdoWindow);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.AdaptiveQuality);
+	XML_GET_CHILD_VALUE_ATTR(node, CompressorOptions.AdaptiveMaxError);
 }
 
 rageam::asset::TextureTune::TextureTune(AssetBase* parent, ConstWString fileName) : AssetSource(parent, fileName)
@@ -128,72 +169,142 @@ bool rageam::asset::TxdAsset::CompileToGame(rage::grcTextureDictionary* object)
 	ReportProgress(L"Compressing textures", 0);
 
 	rage::grcTextureDictionary& txd = *object;
-
-	std::counting_semaphore<ASSET_TXD_BACKGROUND_THREADS_MAX> sema(ASSET_TXD_BACKGROUND_THREADS_MAX);
 	std::mutex mutex;
 
 	u32 textureCount = m_TextureTunes.GetSize();
 	u32 texturesDoneCount = 0; // For progress reporting
 
-	Tasks tasks;
-	tasks.Reserve(textureCount);
+	// Flag is thread local, textures are compiled on worker threads
+	bool useMissingTextures = UseMissingTexturesInsteadOfFailing;
 
-	for (u32 i = 0; i < m_TextureTunes.GetSize(); i++)
-	{
-		tasks.Emplace(BackgroundWorker::Run([&, i]
+	// Textures that didn't change since the last build are spliced from manifest without loading and compressing
+	file::WPath manifestPath = GetDirectoryPath() / ASSET_TXD_MANIFEST_NAME;
+	TxdBuildManifest manifest;
+	manifest.Load(manifestPath);
+
+	// Inserts texture in dictionary and reports progress, thread-safe
+	auto addTexture = [&](rage::grcTexture* gameTexture, const TexturePresetPtr& usedPreset, bool isSpliced)
+		{
+			std::unique_lock lock(mutex);
+
+			// For sanity check, we must ensure that there are no multiple textures with the same name
+			if (txd.Contains(gameTexture->GetName()))
 			{
-				TextureTune& tune = m_TextureTunes[i];
+				AM_ERRF("TxdAsset::CompileToGame() -> Found 2 textures with the same name ('%s'), this cannot continue.",
+					gameTexture->GetName());
+				return false;
+			}
 
-				sema.acquire();
-				TexturePresetPtr usedPreset;
-				rage::grcTexture* gameTexture = CompileSingleTexture(tune, true, &usedPreset);
-				sema.release();
+			// Insert baked texture into dictionary
+			txd.Insert(gameTexture->GetName(), gameTexture);
 
-				if (!gameTexture)
-				{
-					if (!UseMissingTexturesInsteadOfFailing)
-						return false;
+			// Progress report
+			if (CompileCallback)
+			{
+				ConstString presetName = usedPreset ? usedPreset->Name.GetCStr() : "-";
+				texturesDoneCount++;
+				double progress = static_cast<double>(texturesDoneCount) / textureCount;
+				ConstWString message = String::FormatTemp(L"%i/%u %hs (size: %hs, preset: %hs%ls)",
+					texturesDoneCount,
+					textureCount,
+					gameTexture->GetName(),
+					FormatSize(gameTexture->GetPhysicalSize()),
+					presetName,
+					isSpliced ? L", unchanged" : L"");
+				CompileCallback(message, progress);
+			}
+			return true;
+		};
 
-					file::Path textureName;
-					if (!tune.GetValidatedTextureName(textureName, false))
-						return false;
+	// Unchanged textures are added right away, everything else is queued for compression
+	List<TextureCompileJob> jobs;
+	for (u32 i = 0; i < textureCount; i++)
+	{
+		TextureTune& tune = m_TextureTunes[i];
+		ConstWString texturePath = tune.GetFilePath();
+
+		// Modify time is taken before compiling, if file is changed while we compile it, it will be recompiled next time
+		TextureCompileJob job = {};
+		job.TuneIndex = i;
+		const TextureOptions& options = tune.GetCustomOptionsOrFromPreset(&job.UsedPreset);
+		job.OptionsHash = TxdBuildManifest::ComputeOptionsHash(options.CompressorOptions, job.UsedPreset ? job.UsedPreset->Name.GetCStr() : "");
+		job.ModifyTime = file::GetFileModifyTime(texturePath);
+
+		file::Path textureName;
+		if (tune.GetValidatedTextureName(textureName, false))
+		{
+			rage::grcTexture* gameTexture = manifest.TryCreateTexture(texturePath, job.ModifyTime, job.OptionsHash, textureName);
+			if (gameTexture)
+			{
+				if (!addTexture(gameTexture, job.UsedPreset, true))
+					return false;
+				continue;
+			}
+		}
 
-					gameTexture = CreateMissingTexture(textureName);
-				}
+		job.SrcFileSize = file::GetFileSize64(texturePath);
+		jobs.Emplace(std::move(job));
+	}
 
-				std::unique_lock lock(mutex);
+	// Largest first - small textures fill the gaps at the end, instead of single huge texture compressing at the very end
+	jobs.Sort([](const TextureCompileJob& lhs, const TextureCompileJob& rhs)
+		{
+			return lhs.SrcFileSize > rhs.SrcFileSize;
+		});
 
-				// For sanity check, we must ensure that there are no multiple textures with the same name
-				if (txd.Contains(gameTexture->GetName()))
-				{
-					AM_ERRF("TxdAsset::CompileToGame() -> Found 2 textures with the same name ('%s'), this cannot continue.",
-						gameTexture->GetName());
-					return false;
-				}
+	// Fixed number of lanes pull textures from the shared queue, this bounds amount of textures (and their pixel data) in flight
+	// without parking worker threads. Mips and block rows of every texture are scheduled on the same worker, lane that waits
+	// for its texture helps encoding regions and idle threads steal them, so the whole pool works on the largest textures first
+	int laneCount = MIN(BackgroundWorker::GetInstance()->GetThreadCount(), ASSET_TXD_BACKGROUND_THREADS_MAX);
+	laneCount = MIN(laneCount, static_cast<int>(jobs.GetSize()));
 
-				// Insert baked texture into dictionary
-				txd.Insert(gameTexture->GetName(), gameTexture);
+	std::atomic_int  nextJob = 0;
+	std::atomic_bool failed = false;
 
-				// Progress report
-				if (CompileCallback)
+	Tasks lanes;
+	lanes.Reserve(laneCount);
+	for (int i = 0; i < laneCount; i++)
+	{
+		lanes.Emplace(BackgroundWorker::Run([&]
+			{
+				int jobIndex;
+				while (!failed && (jobIndex = nextJob++) < static_cast<int>(jobs.GetSize()))
 				{
-					ConstString presetName = usedPreset ? usedPreset->Name.GetCStr() : "-";
-					texturesDoneCount++;
-					double progress = static_cast<double>(texturesDoneCount) / textureCount;
-					ConstWString message = String::FormatTemp(L"%i/%u %hs (size: %hs, preset: %hs)",
-						texturesDoneCount,
-						textureCount,
-						gameTexture->GetName(),
-						FormatSize(gameTexture->GetPhysicalSize()),
-						presetName);
-					CompileCallback(message, progress);
+					TextureCompileJob& job = jobs[jobIndex];
+					TextureTune& tune = m_TextureTunes[job.TuneIndex];
+
+					rage::grcTexture* gameTexture = CompileSingleTexture(tune, true);
+					if (gameTexture)
+					{
+						manifest.Add(tune.GetFilePath(), job.ModifyTime, job.OptionsHash, static_cast<rage::grcTextureDX11*>(gameTexture));
+					}
+					else
+					{
+						file::Path textureName;
+						if (!useMissingTextures || !tune.GetValidatedTextureName(textureName, false))
+						{
+							failed = true;
+							return false;
+						}
+
+						gameTexture = CreateMissingTexture(textureName);
+					}
+
+					if (!addTexture(gameTexture, job.UsedPreset, false))
+					{
+						failed = true;
+						return false;
+					}
 				}
-
-				return true;
-			}));
+				return !failed;
+			}, L"Compile TXD lane #%i", i));
 	}
 
-	return BackgroundWorker::WaitFor(tasks);
+	if (!BackgroundWorker::WaitFor(lanes))
+		return false;
+
+	manifest.Save(manifestPath);
+	return true;
 }
 
 void rageam::asset::TxdAsset::ParseFromGame(rage::grcTextureDictionary* object)
@@ -349,6 +460,12 @@ rage::grcTexture* rageam::asset::TxdAsset::CompileSingleTexture(TextureTune& tun
 	if (!compressedImage)
 		return nullptr;
 
+	if (encodedInfo.RdoDeflatedSizeBefore != 0)
+	{
+		AM_TRACEF(L"TxdAsset::CompileSingleTexture() -> '%ls' RDO deflated size %hs -> %hs",
+			file::GetFileName(filePath), FormatSize(encodedInfo.RdoDeflatedSizeBefore), FormatSize(encodedInfo.RdoDeflatedSizeAfter));
+	}
+
 	graphics::ImageInfo& imageInfo = encodedInfo.ImageInfo;
 	rage::grcTextureDX11* gameTexture = new rage::grcTextureDX11(
 		imageInfo.Width,
@@ -13,8 +13,10 @@
 
 namespace rageam::asset
 {
-	// Maximum num of texture compressing in background in parallel
+	// Maximum num of textures compressing in parallel, block rows of every texture are encoded on all worker threads
 	static constexpr int ASSET_TXD_BACKGROUND_THREADS_MAX = 12;
+	// Build manifest in asset directory, holds textures of the last compilation (see TxdBuildManifest)
+	static constexpr ConstWString ASSET_TXD_MANIFEST_NAME = L"build.manifest";
 
 	// Version History:
 	// 0: Initial
@@ -0,0 +1,189 @@
+#include "txdmanifest.h"
+
+#include "common/logger.h"
+#include "helpers/format.h"
+
+rageam::asset::TxdBuildManifest::~TxdBuildManifest()
+{
+	Unload();
+}
+
+void rageam::asset::TxdBuildManifest::Load(const file::WPath& path)
+{
+	Unload();
+
+	if (!IsFileExists(path))
+		return;
+
+	if (!file::MapFileView(path, m_View))
+		return;
+
+	const Header* header = reinterpret_cast<const Header*>(m_View.Data);
+	if (m_View.Size < sizeof Header ||
+		header->Magic != MAGIC ||
+		header->Version != VERSION ||
+		header->RecordCount > UINT16_MAX ||
+		m_View.Size < sizeof Header + static_cast<u64>(header->RecordCount) * sizeof Record)
+	{
+		AM_WARNINGF(L"TxdBuildManifest::Load() -> File '%ls' is not valid, all textures will be compiled.", path.GetCStr());
+		Unload();
+		return;
+	}
+
+	const Record* records = reinterpret_cast<const Record*>(m_View.Data + sizeof Header);
+	m_Records.InitAndAllocate(static_cast<u16>(header->RecordCount));
+	for (u32 i = 0; i < header->RecordCount; i++)
+	{
+		// Truncated file, texture will be simply recompiled
+		if (records[i].DataOffset + records[i].DataSize > m_View.Size)
+			continue;
+
+		m_Records.InsertAt(records[i].PathHash, records[i]);
+	}
+}
+
+bool rageam::asset::TxdBuildManifest::Save(const file::WPath& path)
+{
+	// Textures in the build own copy of pixel data, view is not needed anymore and file can be overwritten
+	bool sameTextureSet = m_Entries.GetSize() == m_Records.GetNumUsedSlots();
+	Unload();
+
+	if (!m_Dirty && sameTextureSet)
+		return true;
+
+	Header header = {};
+	header.Magic = MAGIC;
+	header.Version = VERSION;
+	header.RecordCount = m_Entries.GetSize();
+
+	List<Record> records;
+	records.Reserve(m_Entries.GetSize());
+	u64 dataOffset = sizeof Header + static_cast<u64>(m_Entries.GetSize()) * sizeof Record;
+	for (const Entry& entry : m_Entries)
+	{
+		Record& record = records.Add(entry.TextureRecord);
+		record.DataOffset = dataOffset;
+		dataOffset += record.DataSize;
+	}
+
+	HANDLE hFile = file::CreateNew(path);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		AM_ERRF(L"TxdBuildManifest::Save() -> Failed to create '%ls', last error: %u", path.GetCStr(), GetLastError());
+		return false;
+	}
+
+	DWORD written;
+	DWORD recordsSize = records.GetSize() * sizeof Record;
+	bool success =
+		WriteFile(hFile, &header, sizeof Header, &written, NULL) && written == sizeof Header &&
+		WriteFile(hFile, records.GetItems(), recordsSize, &written, NULL) && written == recordsSize;
+	for (u32 i = 0; success && i < m_Entries.GetSize(); i++)
+	{
+		const Entry& entry = m_Entries[i];
+		DWORD dataSize = entry.TextureRecord.DataSize;
+		success = WriteFile(hFile, entry.Texture->GetBackingStore(), dataSize, &written, NULL) && written == dataSize;
+	}
+	CloseHandle(hFile);
+
+	if (!success)
+	{
+		AM_ERRF("TxdBuildManifest::Save() -> Failed to write manifest, last error: %u", GetLastError());
+		DeleteFileW(path);
+		return false;
+	}
+
+	AM_DEBUGF(L"TxdBuildManifest::Save() -> Saved %u textures (%hs) to '%ls'",
+		header.RecordCount, FormatSize(dataOffset), path.GetCStr());
+	m_Dirty = false;
+	return true;
+}
+
+void rageam::asset::TxdBuildManifest::Unload()
+{
+	m_Records.Destroy();
+	if (m_View.Data)
+	{
+		file::UnmapFileView(m_View.Data);
+		m_View = {};
+	}
+}
+
+rage::grcTextureDX11* rageam::asset::TxdBuildManifest::TryCreateTexture(
+	ConstWString texturePath, u64 modifyTime, u32 optionsHash, ConstString textureName)
+{
+	const Record* record = m_Records.TryGetAt(PathHash(texturePath));
+	if (!record || modifyTime == 0 || record->ModifyTime != modifyTime || record->OptionsHash != optionsHash)
+		return nullptr;
+
+	rage::grcTextureDX11* texture = new rage::grcTextureDX11(
+		record->Width, record->Height, record->MipCount, static_cast<DXGI_FORMAT>(record->Format),
+		m_View.Data + record->DataOffset, true);
+
+	// Texture layout computed differently than when manifest was saved
+	if (texture->GetPhysicalSize() != record->DataSize)
+	{
+		delete texture;
+		return nullptr;
+	}
+	texture->SetName(textureName);
+
+	std::unique_lock lock(m_EntriesMutex);
+	m_Entries.Add({ *record, texture });
+	return texture;
+}
+
+void rageam::asset::TxdBuildManifest::Add(ConstWString texturePath, u64 modifyTime, u32 optionsHash, const rage::grcTextureDX11* texture)
+{
+	if (modifyTime == 0 || !texture->GetBackingStore())
+		return;
+
+	Entry entry = {};
+	entry.Texture = texture;
+	Record& record = entry.TextureRecord;
+	record.PathHash = PathHash(texturePath);
+	record.OptionsHash = optionsHash;
+	record.ModifyTime = modifyTime;
+	record.DataSize = texture->GetPhysicalSize();
+	record.Format = texture->GetDXGIFormat();
+	record.Width = texture->GetWidth();
+	record.Height = texture->GetHeight();
+	record.MipCount = texture->GetMipMapCount();
+
+	std::unique_lock lock(m_EntriesMutex);
+	m_Entries.Add(entry);
+	m_Dirty = true;
+}
+
+u32 rageam::asset::TxdBuildManifest::ComputeOptionsHash(const graphics::ImageCompressorOptions& options, ConstString presetName)
+{
+	// Options are hashed field by field because struct padding is not initialized
+	u32 hash = Hash(presetName, VERSION);
+#define HASH_OPTION(field) hash = DataHash(&options.field, sizeof options.field, hash)
+	HASH_OPTION(CompressorImpl);
+	HASH_OPTION(Format);
+	HASH_OPTION(MipFilter);
+	HASH_OPTION(MipGammaCorrect);
+	HASH_OPTION(Quality);
+	HASH_OPTION(MaxResolution);
+	HASH_OPTION(GenerateMipMaps);
+	HASH_OPTION(CutoutAlpha);
+	HASH_OPTION(CutoutAlphaThreshold);
+	HASH_OPTION(AlphaTestCoverage);
+	HASH_OPTION(AlphaTestThreshold);
+	HASH_OPTION(Brightness);
+	HASH_OPTION(Contrast);
+	HASH_OPTION(PadToPowerOfTwo);
+	HASH_OPTION(AllowRecompress);
+	HASH_OPTION(SwizzleR);
+	HASH_OPTION(SwizzleG);
+	HASH_OPTION(SwizzleB);
+	HASH_OPTION(SwizzleA);
+	HASH_OPTION(Rdo);
+	HASH_OPTION(RdoLambda);
+	HASH_OPTION(RdoWindow);
+	HASH_OPTION(AdaptiveQuality);
+	HASH_OPTION(AdaptiveMaxError);
+#undef HASH_OPTION
+	return hash;
+}
@@ -0,0 +1,83 @@
+//
+// File: txdmanifest.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "am/file/fileutils.h"
+#include "am/graphics/image/bc.h"
+#include "am/types.h"
+#include "rage/grcore/texturepc.h"
+
+#include <mutex>
+
+namespace rageam::asset
+{
+	/**
+	 * \brief Persistent build manifest of texture dictionary, holds pixel data of every texture compiled in the last build.
+	 * \remarks Texture is spliced from manifest as is (without loading and compressing the image) if texture file modify time,
+	 * compressor options and preset match the record. Manifest file is rewritten after successful build only if anything changed.
+	 */
+	class TxdBuildManifest
+	{
+		static constexpr u32 MAGIC = 0x4D445854; // TXDM
+		static constexpr u32 VERSION = 0;
+
+		struct Record
+		{
+			u32 PathHash;
+			u32 OptionsHash;
+			u64 ModifyTime;
+			u64 DataOffset;	// From the beginning of manifest file
+			u32 DataSize;
+			u32 Format;		// DXGI_FORMAT
+			u16 Width;
+			u16 Height;
+			u8  MipCount;
+			u8  Reserved[3];
+		};
+
+		struct Header
+		{
+			u32 Magic;
+			u32 Version;
+			u32 RecordCount;
+			u32 Reserved;
+		};
+
+		// Texture of the current build, pixel data is taken from texture backing store on saving
+		struct Entry
+		{
+			Record						TextureRecord;
+			const rage::grcTextureDX11*	Texture;
+		};
+
+		file::FileView		m_View;
+		HashSet<Record>		m_Records;	// Loaded from file, data is in mapped view
+		List<Entry>			m_Entries;
+		std::mutex			m_EntriesMutex;
+		bool				m_Dirty = false;
+
+	public:
+		TxdBuildManifest() = default;
+		TxdBuildManifest(const TxdBuildManifest&) = delete;
+		~TxdBuildManifest();
+
+		void Load(const file::WPath& path);
+		// Writes textures added during this build, does nothing if they all were spliced from the loaded manifest
+		bool Save(const file::WPath& path);
+		void Unload();
+
+		// Creates texture from the record if texture file and options didn't change since the last build, NULL otherwise
+		// Texture is added to the current build and it's pixel data must stay alive until Save
+		rage::grcTextureDX11* TryCreateTexture(ConstWString texturePath, u64 modifyTime, u32 optionsHash, ConstString textureName);
+		// Adds freshly compiled texture to the current build, thread-safe
+		void Add(ConstWString texturePath, u64 modifyTime, u32 optionsHash, const rage::grcTextureDX11* texture);
+
+		// Options hash must change whenever output of the compressor could change
+		static u32 ComputeOptionsHash(const graphics::ImageCompressorOptions& options, ConstString presetName);
+	};
+}
@@ -56,6 +56,50 @@ bool rageam::ui::RenderCompressOptionsControls(graphics::ImageCompressorOptions&
 	if (ImGui::Checkbox("Generate Mips", &options.GenerateMipMaps))
 		needRecompress = true;
 
+	// Only box and triangle filters support linear space averaging
+	bool gammaCorrectAvailable = options.MipFilter == graphics::ResizeFilter_Box || options.MipFilter == graphics::ResizeFilter_Triangle;
+	if (!gammaCorrectAvailable) ImGui::BeginDisabled();
+	if (ImGui::Checkbox("Gamma Correct Mips", &options.MipGammaCorrect))
+		needRecompress = true;
+	if (!gammaCorrectAvailable) ImGui::EndDisabled();
+
+	// Rate-distortion optimization
+	bool rdoAvailable = graphics::IMAGE_RDO_FORMATS & (1 << options.Format);
+	if (!rdoAvailable) ImGui::BeginDisabled();
+	if (ImGui::Checkbox("RDO", &options.Rdo))
+		needRecompress = true;
+	ImGui::SameLine();
+	ImGui::HelpMarker("Makes texture compress better in resource (smaller size on disk and faster streaming) at the cost of quality.\n"
+		"Lambda - higher value gives smaller size and worse quality.\n"
+		"Window - how far back (in bytes) blocks are looked up for a match.");
+	if (!options.Rdo) ImGui::BeginDisabled();
+	ImGui::SetNextItemWidth(itemWidth);
+	ImGui::SliderFloat("Lambda", &options.RdoLambda, 0.0f, 4.0f);
+	if (ImGui::IsItemDeactivated())
+		needRecompress = true;
+	ImGui::SetNextItemWidth(itemWidth);
+	ImGui::SliderInt("Window", &options.RdoWindow, 16, 4096);
+	if (ImGui::IsItemDeactivated())
+		needRecompress = true;
+	if (!options.Rdo) ImGui::EndDisabled();
+	if (!rdoAvailable) ImGui::EndDisabled();
+
+	// Adaptive quality
+	bool adaptiveAvailable = options.Format != graphics::BlockFormat_None;
+	if (!adaptiveAvailable) ImGui::BeginDisabled();
+	if (ImGui::Checkbox("Adaptive Quality", &options.AdaptiveQuality))
+		needRecompress = true;
+	ImGui::SameLine();
+	ImGui::HelpMarker("Flat and smooth regions of texture are encoded with faster settings, greatly reduces compression time on mixed content.\n"
+		"Max Error - how far (mean squared error) pixels may be from a line through block colors for block to be considered smooth.");
+	if (!options.AdaptiveQuality) ImGui::BeginDisabled();
+	ImGui::SetNextItemWidth(itemWidth);
+	ImGui::SliderFloat("Max Error", &options.AdaptiveMaxError, 0.0f, 16.0f);
+	if (ImGui::IsItemDeactivated())
+		needRecompress = true;
+	if (!options.AdaptiveQuality) ImGui::EndDisabled();
+	if (!adaptiveAvailable) ImGui::EndDisabled();
+
 	SlGui::CategoryText("Post Processing");
 
 	// Max size
@@ -101,6 +145,22 @@ bool rageam::ui::RenderCompressOptionsControls(graphics::ImageCompressorOptions&
 		needRecompress = true;
 	if (!options.AlphaTestCoverage) ImGui::EndDisabled();
 
+	// Channel swizzle
+	static constexpr ConstString s_Swizzles[] = { "R", "G", "B", "A" };
+	graphics::ImageSwizzle* swizzles[] = { &options.SwizzleR, &options.SwizzleG, &options.SwizzleB, &options.SwizzleA };
+	float swizzleWidth = (itemWidth - ImGui::GetStyle().ItemInnerSpacing.x * 3) / 4;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i != 0) ImGui::SameLine(0, ImGui::GetStyle().ItemInnerSpacing.x);
+		ImGui::PushID(i);
+		ImGui::SetNextItemWidth(swizzleWidth);
+		if (ImGui::Combo("###SWIZZLE", (int*)swizzles[i], s_Swizzles, IM_ARRAYSIZE(s_Swizzles)))
+			needRecompress = true;
+		ImGui::PopID();
+	}
+	ImGui::SameLine();
+	ImGui::Text("Swizzle");
+
 	return needRecompress;
 }
 
@@ -608,6 +668,14 @@ void rageam::ui::TextureVM::RenderImageProperties()
 	if (RenderCompressOptionsControls(m_CompressOptionsPending, canCompress, itemWidth))
 		needRecompress = true;
 
+	// Only known if image was encoded just now, cache doesn't store it
+	const graphics::CompressedImageInfo& compInfo = im->CompressedInfo;
+	if (m_DisplayCompressed && compInfo.RdoDeflatedSizeBefore != 0)
+	{
+		ImGui::Text("RDO Deflated Size: %s -> %s",
+			FormatSize(compInfo.RdoDeflatedSizeBefore), FormatSize(compInfo.RdoDeflatedSizeAfter));
+	}
+
 	if (uiDisabled) ImGui::EndDisabled();
 
 	im->Mutex.unlock();
@@ -711,13 +779,22 @@ void rageam::ui::TextureVM::RenderImageInfo(const graphics::ImagePtr& image) con
 
 void rageam::ui::TextureVM::RenderLoadingProgress(const amUPtr<AsyncImage>& im) const
 {
-	double percent = 0;
-	// Block processing not started yet, avoid division by zero
-	if (im->LoadToken.TotalBlockLines > 0)
+	graphics::ImageCompressorProgress progress = im->LoadToken.GetProgress();
+	ImGui::Text("Loading %.02f%%", progress.GetFraction() * 100.0);
+	// Estimate is too noisy until some blocks were encoded
+	if (progress.ProcessedBlocks == 0)
+		return;
+
+	ImGui::SameLine();
+	ImGui::Text("ETA %.01fs", static_cast<double>(progress.GetEtaMilliseconds()) / 1000.0);
+	for (int i = 0; i < progress.MipCount; i++)
 	{
-		percent = static_cast<double>(im->LoadToken.ProcessedBlockLines) / im->LoadToken.TotalBlockLines * 100.0;
+		if (progress.MipProcessedBlocks[i] == progress.MipTotalBlocks[i])
+			continue;
+
+		ImGui::Text("Mip %i %.02f%% ETA %.01fs", i, progress.GetMipFraction(i) * 100.0,
+			static_cast<double>(progress.GetMipEtaMilliseconds(i)) / 1000.0);
 	}
-	ImGui::Text("Loading %.02f%%", percent);
 }
 
 void rageam::ui::TextureVM::RenderImageViewport()
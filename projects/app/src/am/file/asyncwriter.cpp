@@ -0,0 +1,83 @@
+#include "asyncwriter.h"
+
+#include "am/system/asserts.h"
+
+void rageam::file::AsyncWriter::WriterLoop()
+{
+	std::unique_lock lock(m_Mutex);
+	while (true)
+	{
+		m_Condition.wait(lock, [this] { return m_ExitRequested || !m_Requests.empty(); });
+		if (m_Requests.empty()) // Exit is only requested after everything was written
+			return;
+
+		Request request = m_Requests.front();
+		m_Requests.pop_front();
+
+		// Don't block submission while disk is busy
+		bool failed = m_Failed;
+		lock.unlock();
+		if (!failed && !m_WriteFn(request.Data, request.Size))
+			failed = true;
+		lock.lock();
+
+		m_Failed = failed;
+		m_CompletedCount++;
+		m_Condition.notify_all();
+	}
+}
+
+rageam::file::AsyncWriter::AsyncWriter(AsyncWriteFn writeFn) : m_WriteFn(std::move(writeFn))
+{
+	m_Thread = std::thread(&AsyncWriter::WriterLoop, this);
+}
+
+#ifdef _WIN32
+rageam::file::AsyncWriter::AsyncWriter(HANDLE hFile) : AsyncWriter([hFile](const char* data, u32 size)
+	{
+		DWORD dwBytesWritten;
+		WriteFile(hFile, data, size, &dwBytesWritten, NULL);
+		return AM_VERIFY(dwBytesWritten == size,
+			"AsyncWriter -> Tried to write %u bytes, but only %u been written! Last error: %u", size, dwBytesWritten, GetLastError());
+	})
+{
+
+}
+#endif
+
+rageam::file::AsyncWriter::~AsyncWriter()
+{
+	Flush();
+	{
+		std::unique_lock lock(m_Mutex);
+		m_ExitRequested = true;
+	}
+	m_Condition.notify_all();
+	m_Thread.join();
+}
+
+rageam::file::AsyncWriter::Ticket rageam::file::AsyncWriter::Write(const char* data, u32 size)
+{
+	{
+		std::unique_lock lock(m_Mutex);
+		m_Requests.push_back({ data, size });
+		m_SubmittedCount++;
+	}
+	m_Condition.notify_all();
+	return m_SubmittedCount;
+}
+
+bool rageam::file::AsyncWriter::WaitFor(Ticket ticket)
+{
+	AM_ASSERT(ticket <= m_SubmittedCount, "AsyncWriter::WaitFor() -> Ticket %llu was not submitted yet.", ticket);
+
+	std::unique_lock lock(m_Mutex);
+	m_Condition.wait(lock, [this, ticket] { return m_CompletedCount >= ticket; });
+	return !m_Failed;
+}
+
+bool rageam::file::AsyncWriter::HasFailed()
+{
+	std::unique_lock lock(m_Mutex);
+	return m_Failed;
+}
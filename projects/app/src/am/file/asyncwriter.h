@@ -0,0 +1,72 @@
+//
+// File: asyncwriter.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "common/types.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace rageam::file
+{
+	// Writes given data to destination, returns false on failure
+	using AsyncWriteFn = std::function<bool(const char* data, u32 size)>;
+
+	/**
+	 * \brief Writes buffers in submission order on a dedicated thread, so caller can prepare next buffer while previous one is flushed.
+	 * \remarks Buffers are not copied, they must stay alive until the write is waited for. After the first failed write the rest
+	 * of the queue is dropped and every wait returns false.
+	 */
+	class AsyncWriter
+	{
+		struct Request
+		{
+			const char* Data;
+			u32			Size;
+		};
+
+		AsyncWriteFn			m_WriteFn;
+		std::thread				m_Thread;
+		std::mutex				m_Mutex;
+		std::condition_variable	m_Condition;
+		std::deque<Request>		m_Requests;
+		u64						m_SubmittedCount = 0;
+		u64						m_CompletedCount = 0;
+		bool					m_Failed = false;
+		bool					m_ExitRequested = false;
+
+		void WriterLoop();
+
+	public:
+		// Identifies submitted write, tickets are increasing in submission order
+		using Ticket = u64;
+
+		AsyncWriter(AsyncWriteFn writeFn);
+#ifdef _WIN32
+		// Appends to file at current file pointer, handle must stay open until writer is destroyed
+		AsyncWriter(HANDLE hFile);
+#endif
+		// Waits for all pending writes
+		~AsyncWriter();
+
+		AsyncWriter(const AsyncWriter&) = delete;
+		AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+		Ticket Write(const char* data, u32 size);
+		// Blocks until given and all previously submitted writes are finished, returns false if any of them failed
+		bool WaitFor(Ticket ticket);
+		bool Flush() { return WaitFor(m_SubmittedCount); }
+		bool HasFailed();
+	};
+}
@@ -1,6 +1,7 @@
 #include "fileutils.h"
 
 #include "am/system/asserts.h"
+#include "common/logger.h"
 #include "path.h"
 #include "helpers/win32.h"
 #include "rage/paging/resourceheader.h"
@@ -133,6 +134,57 @@ u64 rageam::file::GetFileModifyTime(const wchar_t* path)
 	return TODWORD64(modifyTime.dwLowDateTime, modifyTime.dwHighDateTime);
 }
 
+bool rageam::file::MapFileView(const wchar_t* path, FileView& outView, u64 maxSize)
+{
+	outView = {};
+
+	// Allow file to be replaced (renamed over) while it's mapped, many editors save files this way
+	HANDLE hFile = CreateFileW(
+		path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	// Empty files can't be mapped
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	// View keeps reference to the mapping and file, we don't need handles anymore
+	HANDLE hMapping = CreateFileMappingW(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if (!hMapping)
+	{
+		AM_ERRF(L"MapFileView() -> Failed to create mapping for %ls, last error: %u", path, GetLastError());
+		return false;
+	}
+
+	u64 viewSize = fileSize.QuadPart;
+	if (maxSize != 0 && maxSize < viewSize)
+		viewSize = maxSize;
+
+	pVoid view = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, viewSize);
+	CloseHandle(hMapping);
+	if (!view)
+	{
+		AM_ERRF(L"MapFileView() -> Failed to map view of %ls, last error: %u", path, GetLastError());
+		return false;
+	}
+
+	outView.Data = static_cast<char*>(view);
+	outView.Size = viewSize;
+	outView.FileSize = fileSize.QuadPart;
+	return true;
+}
+
+void rageam::file::UnmapFileView(pVoid data)
+{
+	if (data)
+		UnmapViewOfFile(data);
+}
+
 FILE* rageam::file::OpenFileStream(const wchar_t* path, const wchar_t* mode)
 {
 	FILE* file = nullptr;
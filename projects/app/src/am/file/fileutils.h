@@ -39,6 +39,19 @@ namespace rageam::file
 	bool IsDirectory(const wchar_t* path);
 	u64 GetFileModifyTime(const wchar_t* path);
 
+	struct FileView
+	{
+		char*	Data = nullptr;
+		u64		Size = 0;		// Mapped bytes, may be less than file size if view was limited
+		u64		FileSize = 0;
+	};
+
+	// Maps file in memory, pages are read from disk only when accessed
+	// View is copy-on-write, writing to it is allowed but changes never reach the file
+	// If max size is not zero, only that many first bytes of file are mapped
+	bool MapFileView(const wchar_t* path, FileView& outView, u64 maxSize = 0);
+	void UnmapFileView(pVoid data);
+
 	// Stream I/O Helpers
 	FILE* OpenFileStream(const wchar_t* path, const wchar_t* mode);
 	size_t ReadFileStream(pVoid buffer, size_t bufferSize, size_t readSize, FILE* fs);
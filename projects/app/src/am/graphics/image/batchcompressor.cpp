@@ -0,0 +1,252 @@
+#include "batchcompressor.h"
+
+#include "am/file/fileutils.h"
+#include "am/system/timer.h"
+#include "am/system/worker.h"
+#include "helpers/ranges.h"
+
+#include <easy/profiler.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace
+{
+	// Next image is loaded once queue has less regions than this per thread, so threads don't wait for disk
+	constexpr int BATCH_MIN_QUEUED_REGIONS_PER_THREAD = 2;
+
+	struct BatchRegion
+	{
+		u32 ItemIndex;
+		int RegionIndex;
+	};
+
+	struct BatchJob
+	{
+		rageam::graphics::ImageCompressor::JobPtr	Job;
+		std::atomic_int								PendingRegions = 0;
+	};
+}
+
+double rageam::graphics::ImageBatchStats::GetMegaPixelsPerSecond() const
+{
+	if (ElapsedMicroseconds == 0)
+		return 0.0;
+	// Pixels per microsecond is the same as megapixels per second
+	return static_cast<double>(PixelCount) / static_cast<double>(ElapsedMicroseconds);
+}
+
+double rageam::graphics::ImageBatchStats::GetBlocksPerSecond() const
+{
+	if (ElapsedMicroseconds == 0)
+		return 0.0;
+	return static_cast<double>(BlockCount) * 1000000.0 / static_cast<double>(ElapsedMicroseconds);
+}
+
+void rageam::graphics::ImageBatchCompressor::AddImage(ConstWString srcPath, ConstWString dstPath, const ImageCompressorOptions& options)
+{
+	ImageBatchItem& item = m_Items.Construct();
+	item.SrcPath = srcPath;
+	item.DstPath = dstPath ? dstPath : L"";
+	item.Options = options;
+	item.SrcFileSize = file::GetFileSize64(srcPath);
+}
+
+void rageam::graphics::ImageBatchCompressor::AddDirectory(ConstWString srcDir, ConstWString dstDir, const ImageCompressorOptions& options, bool recurse)
+{
+	bool saveImages = !String::IsNullOrEmpty(dstDir);
+	if (saveImages)
+		CreateDirectoryW(dstDir, NULL);
+
+	file::EnumerateDirectory(srcDir, recurse, [&](const WIN32_FIND_DATAW& findData, ConstWString fullPath)
+		{
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				return;
+
+			if (!ImageFactory::IsSupportedImageFormat(fullPath))
+				return;
+
+			file::WPath dstPath;
+			if (saveImages)
+			{
+				dstPath = dstDir;
+				dstPath /= file::GetFileName(fullPath);
+				dstPath = dstPath.GetFilePathWithoutExtension() + L".dds";
+			}
+
+			ImageBatchItem& item = m_Items.Construct();
+			item.SrcPath = fullPath;
+			item.DstPath = dstPath;
+			item.Options = options;
+			item.SrcFileSize = static_cast<u64>(findData.nFileSizeHigh) << 32 | findData.nFileSizeLow;
+		});
+}
+
+bool rageam::graphics::ImageBatchCompressor::Run(ImageBatchStats* outStats)
+{
+	EASY_FUNCTION();
+
+	ImageBatchStats stats = {};
+	stats.ImageCount = m_Items.GetSize();
+
+	// Largest first - small images fill the gaps at the end of the batch
+	m_Items.Sort([](const ImageBatchItem& lhs, const ImageBatchItem& rhs)
+		{
+			return lhs.SrcFileSize > rhs.SrcFileSize;
+		});
+
+	std::atomic_uint32_t failedCount = 0;
+	std::atomic_uint64_t pixelCount = 0;
+	std::atomic_uint64_t blockCount = 0;
+
+	u32 itemCount = m_Items.GetSize();
+	amUPtr<BatchJob[]> jobs = amUPtr<BatchJob[]>(new BatchJob[itemCount]);
+
+	// Loads image and prepares mip maps, images that don't need encoding are returned as finished job
+	auto beginItem = [&](u32 index) -> ImageCompressor::JobPtr
+		{
+			ImageBatchItem& item = m_Items[index];
+			if (ImageFactory::IsLoadedAsCompressed(item.SrcPath, item.Options))
+			{
+				CompressedImageInfo compInfo;
+				ImagePtr image = ImageFactory::LoadFromPathAndCompress(item.SrcPath, item.Options, &compInfo);
+				return image ? std::make_unique<ImageCompressor::Job>(image, compInfo) : nullptr;
+			}
+
+			u32 pixelHash;
+			ImagePtr image = ImageFactory::LoadFromPathForCompress(item.SrcPath, pixelHash);
+			if (!image)
+				return nullptr;
+			return ImageCompressor::BeginCompress(image, item.Options, &pixelHash);
+		};
+
+	// Called by thread that compressed the last region of the image
+	auto endItem = [&](u32 index)
+		{
+			ImageBatchItem& item = m_Items[index];
+
+			CompressedImageInfo compInfo;
+			ImagePtr image = ImageCompressor::EndCompress(*jobs[index].Job, &compInfo);
+			jobs[index].Job = nullptr; // Mip maps are not needed anymore
+			if (!image)
+			{
+				AM_ERRF(L"ImageBatchCompressor::Run() -> Failed to compress '%ls'", item.SrcPath.GetCStr());
+				++failedCount;
+				return;
+			}
+
+			// DDS that was returned as is, nothing was encoded
+			bool encoded = !compInfo.IsSourceCompressed || item.Options.AllowRecompress;
+			if (encoded)
+			{
+				const ImageInfo& info = compInfo.ImageInfo;
+				bool blockCompressed = ImageIsCompressedFormat(info.PixelFormat);
+				u64 mipPixels = 0;
+				u64 mipBlocks = 0;
+				for (int k = 0; k < info.MipCount; k++)
+				{
+					u64 mipWidth = MAX(1, info.Width >> k);
+					u64 mipHeight = MAX(1, info.Height >> k);
+					mipPixels += mipWidth * mipHeight;
+					if (blockCompressed)
+						mipBlocks += MAX(1, (mipWidth + 3) / 4) * MAX(1, (mipHeight + 3) / 4);
+				}
+				pixelCount += mipPixels;
+				blockCount += mipBlocks;
+			}
+
+			if (!item.DstPath.IsEmpty() && !ImageFactory::SaveImage(image, item.DstPath, ImageKind_DDS))
+			{
+				AM_ERRF(L"ImageBatchCompressor::Run() -> Failed to save '%ls'", item.DstPath.GetCStr());
+				++failedCount;
+			}
+		};
+
+	std::mutex				mutex;
+	std::condition_variable	condition;
+	std::deque<BatchRegion>	regionQueue;
+	u32						nextItem = 0;
+	u32						loadingCount = 0;
+
+	int threadCount = BackgroundWorker::GetInstance()->GetThreadCount();
+	size_t minQueuedRegions = static_cast<size_t>(threadCount) * BATCH_MIN_QUEUED_REGIONS_PER_THREAD;
+
+	Timer timer = Timer::StartNew();
+
+	// Every thread runs the same loop: refill the queue with the next image if it gets short, otherwise encode
+	// the oldest queued region. Regions are queued largest mip first, so small mips fill the gaps at the end
+	Tasks tasks;
+	tasks.Reserve(threadCount);
+	for (int i = 0; i < threadCount; i++)
+	{
+		tasks.Emplace(BackgroundWorker::Run([&]
+			{
+				std::unique_lock lock(mutex);
+				while (true)
+				{
+					if (nextItem < itemCount && regionQueue.size() < minQueuedRegions)
+					{
+						u32 index = nextItem++;
+						loadingCount++;
+						lock.unlock();
+
+						ImageCompressor::JobPtr job = beginItem(index);
+						if (!job)
+						{
+							AM_ERRF(L"ImageBatchCompressor::Run() -> Failed to load '%ls'", m_Items[index].SrcPath.GetCStr());
+							++failedCount;
+						}
+
+						int regionCount = job ? job->GetRegionCount() : 0;
+						jobs[index].Job = std::move(job);
+						jobs[index].PendingRegions = regionCount;
+						if (jobs[index].Job && regionCount == 0)
+							endItem(index);
+
+						lock.lock();
+						loadingCount--;
+						for (int k = 0; k < regionCount; k++)
+							regionQueue.push_back({ index, k });
+						condition.notify_all();
+						continue;
+					}
+
+					if (!regionQueue.empty())
+					{
+						BatchRegion region = regionQueue.front();
+						regionQueue.pop_front();
+						lock.unlock();
+
+						BatchJob& job = jobs[region.ItemIndex];
+						job.Job->CompressRegion(region.RegionIndex);
+						if (--job.PendingRegions == 0)
+							endItem(region.ItemIndex);
+
+						lock.lock();
+						continue;
+					}
+
+					// Image that is being loaded will add more regions
+					if (loadingCount > 0)
+					{
+						condition.wait(lock);
+						continue;
+					}
+
+					return true;
+				}
+			}, L"Batch Compress"));
+	}
+
+	BackgroundWorker::WaitFor(tasks);
+	timer.Stop();
+
+	stats.FailedCount = failedCount;
+	stats.PixelCount = pixelCount;
+	stats.BlockCount = blockCount;
+	stats.ElapsedMicroseconds = timer.GetElapsedMicroseconds();
+
+	if (outStats) *outStats = stats;
+
+	return stats.FailedCount == 0;
+}
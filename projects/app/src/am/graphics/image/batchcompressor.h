@@ -0,0 +1,59 @@
+//
+// File: batchcompressor.h
+//
+// Copyright (C) 2023 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "bc.h"
+#include "am/file/path.h"
+
+namespace rageam::graphics
+{
+	struct ImageBatchItem
+	{
+		file::WPath				SrcPath;
+		// If empty, image is only compressed (warms up the cache / measures throughput) but not written
+		file::WPath				DstPath;
+		ImageCompressorOptions	Options;
+		// Used to schedule largest images first, so we don't end up with a single huge texture compressing at the very end
+		u64						SrcFileSize = 0;
+	};
+
+	struct ImageBatchStats
+	{
+		u32	ImageCount;		// Total number of images in batch
+		u32	FailedCount;	// Images that failed to load / compress / save
+		u64	PixelCount;		// Total pixels encoded, including mip maps
+		u64	BlockCount;		// Total 4x4 blocks encoded, including mip maps
+		u64	ElapsedMicroseconds;
+
+		double GetMegaPixelsPerSecond() const;
+		double GetBlocksPerSecond() const;
+	};
+
+	/**
+	 * \brief Headless compressor for large sets of images.
+	 * \remarks Block row regions of all mips of all images go through a single queue that every worker thread
+	 * takes from, next image is loaded as soon as queue gets short, so while one texture is loading from disk
+	 * or being saved, threads are busy encoding regions of other ones. Must be run from non-worker thread.
+	 */
+	class ImageBatchCompressor
+	{
+		List<ImageBatchItem> m_Items;
+
+	public:
+		void AddImage(ConstWString srcPath, ConstWString dstPath, const ImageCompressorOptions& options);
+		// Adds every supported image in given directory, compressed images are written as .dds to output directory
+		// If output directory is null or empty, images are not saved
+		void AddDirectory(ConstWString srcDir, ConstWString dstDir, const ImageCompressorOptions& options, bool recurse = false);
+
+		u32  GetItemCount() const { return m_Items.GetSize(); }
+		void Clear() { m_Items.Clear(); }
+
+		// Returns false if at least one image failed
+		bool Run(ImageBatchStats* outStats = nullptr);
+	};
+}
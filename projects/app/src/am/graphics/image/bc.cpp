@@ -7,13 +7,12 @@
 #include "am/system/worker.h"
 #include "rage/math/math.h"
 #include "imagecache.h"
+#include "imagehash.h"
 
 #include <rgbcx.h>
 #include <icbc.h>
-#include <bc7decomp.h>
 #include <easy/profiler.h>
-
-rageam::BackgroundWorker* rageam::graphics::ImageCompressor::sm_RegionWorker = nullptr;
+#include <numeric>
 
 rageam::graphics::BlockFormat rageam::graphics::ImagePixelFormatToBlockFormat(ImagePixelFormat fmt)
 {
@@ -32,53 +31,326 @@ rageam::graphics::BlockFormat rageam::graphics::ImagePixelFormatToBlockFormat(Im
 
 rageam::graphics::PixelDataOwner rageam::graphics::ImageDecodeBCToRGBA(const PixelDataOwner& pixels, int width, int height, ImagePixelFormat format)
 {
+	EASY_FUNCTION();
+
 	AM_ASSERT(ImageIsCompressedFormat(format) || format == ImagePixelFormat_U32, "ImageDecodeBCToRGBA() -> Pixel format must be BC or RGBA!");
 
 	// Already RGBA
 	if (format == ImagePixelFormat_U32)
 		return pixels;
 
-	char* mipBytes = pixels.Data()->Bytes;
-	int mipWidth = width;
-	int mipHeight = height;
-	int blocksX = mipWidth / 4;
-	int blocksY = mipHeight / 4;
-	u32 blockWidth = BlockFormatToBlockSize[ImagePixelFormatToBlockFormat(format)];
-	u32 encodedRowPitch = blocksX * blockWidth;
-	u32 decodedRowPitch = mipWidth * IMAGE_RGBA_PITCH;
+	const char* encodedPixels = pixels.Data()->Bytes;
+	int blocksX = width / 4;
+	int blocksY = height / 4;
+	u32 encodedRowPitch = ImageComputeRowPitch(width, format);
+	u32 decodedRowPitch = ImageComputeRowPitch(width, ImagePixelFormat_U32);
 
-	PixelDataOwner decodedDataOwner = PixelDataOwner::AllocateForImage(mipWidth, mipHeight, ImagePixelFormat_U32);
+	PixelDataOwner decodedDataOwner = PixelDataOwner::AllocateForImage(width, height, ImagePixelFormat_U32);
 	char* decodedPixels = decodedDataOwner.Data()->Bytes;
 
-	for (int blockY = 0; blockY < blocksY; blockY++)
-	{
-		int y = blockY * 4;
-		for (int blockX = 0; blockX < blocksX; blockX++)
+	auto decodeRegion = [=](int firstBlockY, int blockRowCount)
 		{
-			int x = blockX * 4;
+			const char* src = encodedPixels + static_cast<size_t>(encodedRowPitch) * firstBlockY;
+			char*       dst = decodedPixels + static_cast<size_t>(decodedRowPitch) * firstBlockY * 4;
+			for (int i = 0; i < blockRowCount; i++)
+			{
+				ImageDecodeBCBlockRow(src, blocksX, dst, decodedRowPitch, format);
+				src += encodedRowPitch;
+				dst += static_cast<size_t>(decodedRowPitch) * 4;
+			}
+		};
 
-			// Decode 4x4 pixels block
-			char decodedBlock[IMAGE_BC_BLOCK_SLICE_PITCH];
-			char* encodedBlock = mipBytes + static_cast<size_t>(blockY * encodedRowPitch + blockX * blockWidth);
-			ImageCompressor::DecompressBlock(encodedBlock, decodedBlock, format);
+	// Small image, process on calling thread
+	if (blocksY <= IMAGE_BC_MULTITHREAD_DECODE_REGION_SIZE)
+	{
+		decodeRegion(0, blocksY);
+		return decodedDataOwner;
+	}
 
-			// Copy it line by line to the decoded pixel array
-			char* dstRow = decodedPixels + static_cast<size_t>(decodedRowPitch) * y + IMAGE_RGBA_PITCH * x;
-			for (int i = 0; i < 4; i++)
+	Tasks regionTasks;
+	for (int blockY = 0; blockY < blocksY; blockY += IMAGE_BC_MULTITHREAD_DECODE_REGION_SIZE)
+	{
+		int blockRowCount = MIN(IMAGE_BC_MULTITHREAD_DECODE_REGION_SIZE, blocksY - blockY);
+		regionTasks.Emplace(BackgroundWorker::Run([&decodeRegion, blockY, blockRowCount]
 			{
-				char* srcRow = decodedBlock + i * IMAGE_BC_BLOCK_ROW_PITCH;
+				decodeRegion(blockY, blockRowCount);
+				return true;
+			}));
+	}
+	BackgroundWorker::WaitFor(regionTasks);
 
-				memcpy(dstRow, srcRow, IMAGE_RGBA_PITCH * 4);
+	return decodedDataOwner;
+}
 
-				dstRow += decodedRowPitch;
-			}
-		}
+// Pixel processing that is applied on the source pixels while gathering them in 4x4 blocks for encoder,
+// all steps are done in registers on 4 (SSE) or 8 (AVX2) pixels at the time
+struct PreEncodeTransform
+{
+	bool	HasColorLut;
+	bool	HasCutout;
+	bool	HasAlphaScale;
+	bool	HasSwizzle;
+	u8		CutoutThreshold;
+	float	AlphaScale;
+	u8		Swizzle[4];
+	u8		ColorLut[256];	// Brightness and contrast
+
+	bool IsIdentity() const { return !HasColorLut && !HasCutout && !HasAlphaScale && !HasSwizzle; }
+};
+
+static PreEncodeTransform CreatePreEncodeTransform(const rageam::graphics::CompressedImageInfo& encodeInfo, float alphaCoverageScale)
+{
+	using namespace rageam::graphics;
+
+	PreEncodeTransform transform = {};
+	// The same table as in ImageAdjustBrightnessAndContrastRGBA, so BC and RGBA output round exactly the same
+	transform.HasColorLut = encodeInfo.Brightness != 0 || encodeInfo.Contrast != 0;
+	if (transform.HasColorLut)
+		ImageComputeBrightnessContrastLut(encodeInfo.Brightness, encodeInfo.Contrast, transform.ColorLut);
+	transform.HasCutout = encodeInfo.CutoutAlpha;
+	transform.CutoutThreshold = static_cast<u8>(encodeInfo.CutoutAlphaThreshold);
+	transform.HasAlphaScale = encodeInfo.AlphaTestCoverage && alphaCoverageScale != 1.0f;
+	transform.AlphaScale = alphaCoverageScale;
+	transform.Swizzle[0] = static_cast<u8>(encodeInfo.SwizzleR);
+	transform.Swizzle[1] = static_cast<u8>(encodeInfo.SwizzleG);
+	transform.Swizzle[2] = static_cast<u8>(encodeInfo.SwizzleB);
+	transform.Swizzle[3] = static_cast<u8>(encodeInfo.SwizzleA);
+	transform.HasSwizzle =
+		encodeInfo.SwizzleR != ImageSwizzle_R ||
+		encodeInfo.SwizzleG != ImageSwizzle_G ||
+		encodeInfo.SwizzleB != ImageSwizzle_B ||
+		encodeInfo.SwizzleA != ImageSwizzle_A;
+	return transform;
+}
+
+#ifdef AM_IMAGE_USE_AVX2
+using PreEncodeVec = __m256i;
+using PreEncodeVecF = __m256;
+#define PRE_ENCODE_OP(name) _mm256_##name
+#define PRE_ENCODE_SI(name) _mm256_##name##_si256
+#define PRE_ENCODE_LUT rageam::graphics::ImageApplyLut32
+#else
+using PreEncodeVec = __m128i;
+using PreEncodeVecF = __m128;
+#define PRE_ENCODE_OP(name) _mm_##name
+#define PRE_ENCODE_SI(name) _mm_##name##_si128
+#define PRE_ENCODE_LUT rageam::graphics::ImageApplyLut16
+#endif
+
+// All transform constants broadcast to vector registers once per region
+struct PreEncodeConstants
+{
+	PreEncodeVec  AlphaMask;
+	PreEncodeVec  RgbMask;
+	PreEncodeVec  CutoutThreshold;
+	PreEncodeVec  Swizzle;
+	PreEncodeVec  ColorLut[16];	// Split in 16 byte parts, see ImageApplyLut16
+	PreEncodeVecF AlphaScale;
+	PreEncodeVecF Float255;
+};
+
+static void CreatePreEncodeConstants(const PreEncodeTransform& transform, PreEncodeConstants& constants)
+{
+	const u8* swz = transform.Swizzle;
+
+	constants.AlphaMask = PRE_ENCODE_OP(set1_epi32)(static_cast<int>(0xFF000000));
+	constants.RgbMask = PRE_ENCODE_OP(set1_epi32)(0x00FFFFFF);
+	constants.CutoutThreshold = PRE_ENCODE_OP(set1_epi32)(transform.CutoutThreshold << 24);
+	// Shuffle indices are relative to 128 bit lane so the same pattern works for both SSE and AVX2
+	constants.Swizzle = PRE_ENCODE_OP(set_epi8)(
+#ifdef AM_IMAGE_USE_AVX2
+		char(swz[3] + 12), char(swz[2] + 12), char(swz[1] + 12), char(swz[0] + 12),
+		char(swz[3] + 8), char(swz[2] + 8), char(swz[1] + 8), char(swz[0] + 8),
+		char(swz[3] + 4), char(swz[2] + 4), char(swz[1] + 4), char(swz[0] + 4),
+		char(swz[3] + 0), char(swz[2] + 0), char(swz[1] + 0), char(swz[0] + 0),
+#endif
+		char(swz[3] + 12), char(swz[2] + 12), char(swz[1] + 12), char(swz[0] + 12),
+		char(swz[3] + 8), char(swz[2] + 8), char(swz[1] + 8), char(swz[0] + 8),
+		char(swz[3] + 4), char(swz[2] + 4), char(swz[1] + 4), char(swz[0] + 4),
+		char(swz[3] + 0), char(swz[2] + 0), char(swz[1] + 0), char(swz[0] + 0));
+	constants.AlphaScale = PRE_ENCODE_OP(set1_ps)(transform.AlphaScale);
+	constants.Float255 = PRE_ENCODE_OP(set1_ps)(255.0f);
+	for (int k = 0; k < 16; k++)
+	{
+		__m128i lutPart = _mm_loadu_si128(reinterpret_cast<const __m128i*>(transform.ColorLut + k * 16));
+#ifdef AM_IMAGE_USE_AVX2
+		constants.ColorLut[k] = _mm256_broadcastsi128_si256(lutPart);
+#else
+		constants.ColorLut[k] = lutPart;
+#endif
 	}
+}
 
-	return decodedDataOwner;
+static PreEncodeVec PreEncodePixels(PreEncodeVec pixels, const PreEncodeTransform& transform, const PreEncodeConstants& constants)
+{
+	if (transform.HasColorLut)
+	{
+		// Brightness and contrast don't affect alpha
+		PreEncodeVec mapped = PRE_ENCODE_LUT(pixels, constants.ColorLut);
+		pixels = PRE_ENCODE_SI(or)(
+			PRE_ENCODE_SI(and)(mapped, constants.RgbMask),
+			PRE_ENCODE_SI(and)(pixels, constants.AlphaMask));
+	}
+
+	if (transform.HasCutout)
+	{
+		// Alpha >= threshold (unsigned compare via max) becomes 255, otherwise 0
+		PreEncodeVec mask = PRE_ENCODE_OP(cmpeq_epi8)(PRE_ENCODE_OP(max_epu8)(pixels, constants.CutoutThreshold), pixels);
+		mask = PRE_ENCODE_SI(and)(mask, constants.AlphaMask);
+		pixels = PRE_ENCODE_SI(or)(PRE_ENCODE_SI(and)(pixels, constants.RgbMask), mask);
+	}
+
+	if (transform.HasAlphaScale)
+	{
+		PreEncodeVecF alpha = PRE_ENCODE_OP(cvtepi32_ps)(PRE_ENCODE_OP(srli_epi32)(pixels, 24));
+		alpha = PRE_ENCODE_OP(mul_ps)(alpha, constants.AlphaScale);
+		alpha = PRE_ENCODE_OP(min_ps)(alpha, constants.Float255);
+		PreEncodeVec scaledAlpha = PRE_ENCODE_OP(slli_epi32)(PRE_ENCODE_OP(cvttps_epi32)(alpha), 24);
+		pixels = PRE_ENCODE_SI(or)(PRE_ENCODE_SI(and)(pixels, constants.RgbMask), scaledAlpha);
+	}
+
+	if (transform.HasSwizzle)
+	{
+		pixels = PRE_ENCODE_OP(shuffle_epi8)(pixels, constants.Swizzle);
+	}
+
+	return pixels;
 }
 
-void rageam::graphics::ImageCompressor::CompressBlocks(const EncoderState& encoderState, int numBlocks, char* dstBlocks, char* srcBlocks)
+// Gathers 4x4 pixel block from source image rows to continuous block buffer and applies transform
+static void PreEncodeBlock(char* dstBlock, const char* srcBlock, u32 srcRowPitch,
+	const PreEncodeTransform& transform, const PreEncodeConstants& constants)
+{
+#ifdef AM_IMAGE_USE_AVX2
+	// Two 4 pixel rows of the block in one register
+	for (int y = 0; y < 4; y += 2)
+	{
+		__m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcBlock + static_cast<size_t>(srcRowPitch) * y));
+		__m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcBlock + static_cast<size_t>(srcRowPitch) * (y + 1)));
+		__m256i rows = _mm256_inserti128_si256(_mm256_castsi128_si256(row0), row1, 1);
+		rows = PreEncodePixels(rows, transform, constants);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(dstBlock + IMAGE_BC_BLOCK_ROW_PITCH * y), rows);
+	}
+#else
+	for (int y = 0; y < 4; y++)
+	{
+		__m128i row = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcBlock + static_cast<size_t>(srcRowPitch) * y));
+		row = PreEncodePixels(row, transform, constants);
+		_mm_store_si128(reinterpret_cast<__m128i*>(dstBlock + IMAGE_BC_BLOCK_ROW_PITCH * y), row);
+	}
+#endif
+}
+
+#undef PRE_ENCODE_OP
+#undef PRE_ENCODE_SI
+#undef PRE_ENCODE_LUT
+
+void rageam::graphics::ImagePreEncodeBlockRow(
+	char* dstBlocks, const char* srcPixels, u32 srcRowPitch, int blockCount, const CompressedImageInfo& encodeInfo, float alphaCoverageScale)
+{
+	PreEncodeTransform transform = CreatePreEncodeTransform(encodeInfo, alphaCoverageScale);
+	PreEncodeConstants constants;
+	CreatePreEncodeConstants(transform, constants);
+
+	// Block is written with aligned stores
+	alignas(32) char block[IMAGE_BC_BLOCK_SLICE_PITCH];
+	for (int i = 0; i < blockCount; i++)
+	{
+		PreEncodeBlock(block, srcPixels + static_cast<size_t>(i) * IMAGE_BC_BLOCK_ROW_PITCH, srcRowPitch, transform, constants);
+		memcpy(dstBlocks + static_cast<size_t>(i) * IMAGE_BC_BLOCK_SLICE_PITCH, block, IMAGE_BC_BLOCK_SLICE_PITCH);
+	}
+}
+
+// Encoder effort for flat and smooth blocks, detailed blocks use settings from options
+static constexpr int ADAPTIVE_SMOOTH_BC7_QUALITY = 1; // very-fast
+static constexpr u32 ADAPTIVE_SMOOTH_RGBX_LEVEL = 4;
+static constexpr int ADAPTIVE_SMOOTH_ICBC_QUALITY = icbc::Quality_Level1; // Box fit + least squares fit
+// Blocks sampled in the first mip to decide whether per group analysis is worth running at all
+static constexpr int ADAPTIVE_SAMPLE_BLOCK_COUNT = 1024;
+
+static void InitBc7encRdoParams(int quality, ispc::bc7e_compress_block_params* params)
+{
+	switch (quality)
+	{
+	case 0: bc7e_compress_block_params_init_ultrafast(params, false);	break;
+	case 1: bc7e_compress_block_params_init_veryfast(params, false);	break;
+	case 2: bc7e_compress_block_params_init_fast(params, false);		break;
+	case 3: bc7e_compress_block_params_init_basic(params, false);		break;
+	case 4: bc7e_compress_block_params_init_slow(params, false);		break;
+	case 5: bc7e_compress_block_params_init_veryslow(params, false);	break;
+	case 6: bc7e_compress_block_params_init_slowest(params, false);		break;
+
+	default: AM_UNREACHABLE("InitBc7encRdoParams() -> Invalid BC7 quality '%i' for bc7enc_rdo", quality);
+	}
+}
+
+u64 rageam::graphics::ImageCompressorProgress::GetEtaMilliseconds() const
+{
+	if (ProcessedBlocks == 0)
+		return 0;
+	return static_cast<u64>(static_cast<double>(ElapsedMilliseconds) * (TotalBlocks - ProcessedBlocks) / ProcessedBlocks);
+}
+
+u64 rageam::graphics::ImageCompressorProgress::GetMipEtaMilliseconds(int mip) const
+{
+	if (ProcessedBlocks == 0)
+		return 0;
+	return static_cast<u64>(static_cast<double>(ElapsedMilliseconds) * (MipTotalBlocks[mip] - MipProcessedBlocks[mip]) / ProcessedBlocks);
+}
+
+void rageam::graphics::ImageCompressorToken::Reset()
+{
+	Canceled = false;
+	m_MipCount = 0;
+	m_StartTicks = 0;
+	for (ProgressSlot& slot : m_ProgressSlots)
+	{
+		for (std::atomic<int>& processed : slot.MipProcessedBlocks)
+			processed.store(0, std::memory_order_relaxed);
+	}
+	for (std::atomic<int>& total : m_MipTotalBlocks)
+		total.store(0, std::memory_order_relaxed);
+}
+
+void rageam::graphics::ImageCompressorToken::BeginEncoding(int mipCount, const int* mipTotalBlocks)
+{
+	AM_ASSERT(mipCount <= IMAGE_MAX_MIP_MAPS, "ImageCompressorToken::BeginEncoding() -> Too many mip maps (%i)", mipCount);
+
+	for (int i = 0; i < mipCount; i++)
+		m_MipTotalBlocks[i].store(mipTotalBlocks[i], std::memory_order_relaxed);
+	m_StartTicks.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	// Publishes totals and start time to GetProgress
+	m_MipCount.store(mipCount, std::memory_order_release);
+}
+
+rageam::graphics::ImageCompressorProgress rageam::graphics::ImageCompressorToken::GetProgress() const
+{
+	ImageCompressorProgress progress = {};
+	progress.MipCount = m_MipCount.load(std::memory_order_acquire);
+	if (progress.MipCount == 0)
+		return progress;
+
+	for (int i = 0; i < progress.MipCount; i++)
+	{
+		int processed = 0;
+		for (const ProgressSlot& slot : m_ProgressSlots)
+			processed += slot.MipProcessedBlocks[i].load(std::memory_order_relaxed);
+
+		progress.MipProcessedBlocks[i] = processed;
+		progress.MipTotalBlocks[i] = m_MipTotalBlocks[i].load(std::memory_order_relaxed);
+		progress.ProcessedBlocks += processed;
+		progress.TotalBlocks += progress.MipTotalBlocks[i];
+	}
+
+	using namespace std::chrono;
+	steady_clock::duration elapsed = steady_clock::now().time_since_epoch() - steady_clock::duration(m_StartTicks.load(std::memory_order_relaxed));
+	progress.ElapsedMilliseconds = duration_cast<milliseconds>(elapsed).count();
+
+	return progress;
+}
+
+void rageam::graphics::ImageCompressor::CompressBlocks(
+	const EncoderState& encoderState, int numBlocks, char* dstBlocks, char* srcBlocks, ImageBlockComplexity complexity)
 {
 	for (int i = 0; i < numBlocks; i++)
 	{
@@ -91,7 +363,9 @@ void rageam::graphics::ImageCompressor::CompressBlocks(const EncoderState& encod
 			const EncoderData_bc7enc_rdo& rdoData = encoderState.EncodeInfo.EncoderData_bc7enc_rdo;
 
 			auto rgbxLevel = rdoData.RgbxLevel;
-			auto useHq = rdoData.RgbxHq345;
+			auto useHq = rdoData.RgbxHq345 && complexity == ImageBlockComplexity_Detailed;
+			if (complexity == ImageBlockComplexity_Flat)	rgbxLevel = 0;
+			if (complexity == ImageBlockComplexity_Smooth)	rgbxLevel = MIN(rgbxLevel, ADAPTIVE_SMOOTH_RGBX_LEVEL);
 
 			switch (encoderState.DstPixelFormat)
 			{
@@ -120,7 +394,10 @@ void rageam::graphics::ImageCompressor::CompressBlocks(const EncoderState& encod
 		}
 		case BlockCompressorImpl::icbc:
 		{
-			icbc::Quality icbcQuality = icbc::Quality(encoderState.EncodeInfo.EncoderData_icbc.Quality);
+			int icbcLevel = encoderState.EncodeInfo.EncoderData_icbc.Quality;
+			if (complexity == ImageBlockComplexity_Flat)	icbcLevel = icbc::Quality_Level0;
+			if (complexity == ImageBlockComplexity_Smooth)	icbcLevel = MIN(icbcLevel, ADAPTIVE_SMOOTH_ICBC_QUALITY);
+			icbc::Quality icbcQuality = icbc::Quality(icbcLevel);
 #define ICBC_U8_TO_FLOAT_UNORM(value) ((float)(value) / 255.0f)
 			// For ICBC we have to convert 4x4 pixel block from U32 to FLOAT4
 			alignas(32) float srcBlockFloat4[16 * 4];
@@ -172,9 +449,11 @@ void rageam::graphics::ImageCompressor::CompressMipRegion(const EncoderState& en
 	char* dstPixels = region.DstPixels;
 
 	int blockCountX = encoderState.BlockCountX;
-	int regionCount = encoderState.RegionBlocksCount;
+	int regionCount = region.BlockRowCount;
 
-	const CompressedImageInfo& encodeInfo = encoderState.EncodeInfo;
+	PreEncodeTransform transform = CreatePreEncodeTransform(encoderState.EncodeInfo, encoderState.AlphaCoverageScale);
+	PreEncodeConstants constants;
+	CreatePreEncodeConstants(transform, constants);
 
 	// According to bc7enc_rdo comments, 64 blocks at a time is ideal for efficient SIMD processing
 	// One block is 4x4 pixels, 64 blocks is 256x4 pixels
@@ -182,6 +461,14 @@ void rageam::graphics::ImageCompressor::CompressMipRegion(const EncoderState& en
 
 	alignas(32) char srcBlockGroupBuffer[IMAGE_BC_BLOCK_SLICE_PITCH * BLOCK_GROUP_SIZE];
 
+	// RDO needs source pixels of all blocks in region to measure error, so instead of reusing group buffer we gather whole region
+	bool rdo = encoderState.EncodeInfo.Rdo;
+	int  regionBlockCount = blockCountX * regionCount;
+	amUPtr<char[]> rdoSrcBlocks;
+	if (rdo)
+		rdoSrcBlocks = amUPtr<char[]>(new char[static_cast<size_t>(regionBlockCount) * IMAGE_BC_BLOCK_SLICE_PITCH]);
+	char* rdoSrcBlock = rdoSrcBlocks.get();
+
 	for (int blockY = 0; blockY < regionCount; blockY++)
 	{
 		char* srcBlockRowPixels = srcPixels;
@@ -189,146 +476,149 @@ void rageam::graphics::ImageCompressor::CompressMipRegion(const EncoderState& en
 		// We compress image by rows of 64 block groups
 		for (int blockX = 0; blockX < blockCountX; blockX += BLOCK_GROUP_SIZE)
 		{
-			if (encoderState.Token && encoderState.Token->Canceled)
+			if (encoderState.Token && encoderState.Token->IsCanceled())
 				return;
 
-			char* dstBlockPixels = srcBlockGroupBuffer;
+			char* srcBlockGroup = rdo ? rdoSrcBlock : srcBlockGroupBuffer;
+			char* dstBlockPixels = srcBlockGroup;
 
 			// Then we have to fill pixel row in 64 block group
 			int numBlocks = MIN(blockCountX - blockX, BLOCK_GROUP_SIZE);
 
-			// For each block in group
-			for (int block = 0; block < numBlocks; block++)
+			// Gather blocks of the group and apply pixel post-processing in one go
+			if (transform.IsIdentity())
 			{
-				char* srcBlockPixels = srcBlockRowPixels;
-
-				// For each row of block group
-				for (int blockPixelY = 0; blockPixelY < 4; blockPixelY++)
+				for (int block = 0; block < numBlocks; block++)
 				{
-					// Copy 4 pixels to destination block row
-					memcpy(dstBlockPixels, srcBlockPixels, IMAGE_BC_BLOCK_ROW_PITCH);
-
-					// Apply coverage + cutout alpha on those 4 pixels that we just copied
-					if (encodeInfo.CutoutAlpha || encodeInfo.AlphaTestCoverage)
+					char* srcBlockPixels = srcBlockRowPixels;
+					for (int blockPixelY = 0; blockPixelY < 4; blockPixelY++)
 					{
-						// It is faster to do this inline than calling ImageCutoutAlpha
-						ColorU32* pixels = reinterpret_cast<ColorU32*>(dstBlockPixels);
-						for (int i = 0; i < 4; i++)
-						{
-							if (encodeInfo.CutoutAlpha)
-							{
-								if (pixels[i].A < static_cast<u8>(encodeInfo.CutoutAlphaThreshold))
-									pixels[i].A = 0;
-								else
-									pixels[i].A = 255;
-							}
-
-							if (encodeInfo.AlphaTestCoverage)
-							{
-								float scaledAlpha = static_cast<float>(pixels[i].A) * encoderState.AlphaCoverageScale;
-								if (scaledAlpha > 255.0f) scaledAlpha = 255.0f;
-								pixels[i].A = static_cast<u8>(scaledAlpha);
-							}
-						}
+						memcpy(dstBlockPixels, srcBlockPixels, IMAGE_BC_BLOCK_ROW_PITCH);
+						srcBlockPixels += encoderState.SrcRowPitch;
+						dstBlockPixels += IMAGE_BC_BLOCK_ROW_PITCH;
 					}
-
-					// Shift to next row
-					srcBlockPixels += encoderState.SrcRowPitch;
-					dstBlockPixels += IMAGE_BC_BLOCK_ROW_PITCH;
+					srcBlockRowPixels += IMAGE_BC_BLOCK_ROW_PITCH;
+				}
+			}
+			else
+			{
+				for (int block = 0; block < numBlocks; block++)
+				{
+					PreEncodeBlock(dstBlockPixels, srcBlockRowPixels, encoderState.SrcRowPitch, transform, constants);
+					dstBlockPixels += IMAGE_BC_BLOCK_SLICE_PITCH;
+					srcBlockRowPixels += IMAGE_BC_BLOCK_ROW_PITCH;
 				}
+			}
 
-				// Shift to beginning of next block on this line
-				srcBlockRowPixels += IMAGE_BC_BLOCK_ROW_PITCH;
+			// Group is as complex as its most complex block, so we stop on the first detailed one
+			ImageBlockComplexity complexity = ImageBlockComplexity_Detailed;
+			if (encoderState.Adaptive)
+			{
+				complexity = ImageBlockComplexity_Flat;
+				for (int block = 0; block < numBlocks && complexity != ImageBlockComplexity_Detailed; block++)
+				{
+					ImageBlockComplexity blockComplexity = ImageEstimateBlockComplexity(
+						srcBlockGroup + static_cast<size_t>(block) * IMAGE_BC_BLOCK_SLICE_PITCH, encoderState.ComplexityParams);
+					complexity = MAX(complexity, blockComplexity);
+				}
 			}
 
 			// Finally, compress block group
 			if (encoderState.EncoderImpl == BlockCompressorImpl::bc7enc_rdo &&
 				encoderState.DstPixelFormat == ImagePixelFormat_BC7)
 			{
-				bc7e_compress_blocks(numBlocks, reinterpret_cast<u64*>(dstPixels), reinterpret_cast<u32*>(srcBlockGroupBuffer),
-					&encoderState.bc7enc_rdo_params);
+				bc7e_compress_blocks(numBlocks, reinterpret_cast<u64*>(dstPixels), reinterpret_cast<u32*>(srcBlockGroup),
+					&encoderState.bc7enc_rdo_params[complexity]);
 			}
 			else
 			{
-				CompressBlocks(encoderState, numBlocks, dstPixels, srcBlockGroupBuffer);
+				CompressBlocks(encoderState, numBlocks, dstPixels, srcBlockGroup, complexity);
 			}
 
 			dstPixels += static_cast<size_t>(numBlocks * encoderState.DstPixelPitch);
+			if (rdo)
+				rdoSrcBlock += static_cast<size_t>(numBlocks * IMAGE_BC_BLOCK_SLICE_PITCH);
 		}
 
 		// We compressed all 4x4 pixel blocks, move to next block row 4 lines below
 		srcPixels += static_cast<size_t>(4 * encoderState.SrcRowPitch);
 
 		if (encoderState.Token)
-		{
-			std::unique_lock lock(encoderState.Token->Mutex);
-			encoderState.Token->ProcessedBlockLines++;
-		}
+			encoderState.Token->AddProcessedBlocks(region.Index, encoderState.MipIndex, blockCountX);
+	}
+
+	// Region is large enough (or the whole mip) for deflate window, so measuring it alone gives close estimate of the gain
+	if (rdo)
+	{
+		u32 regionSize = encoderState.DstRowPitch * regionCount;
+		u32 sizeBefore = ImageComputeDeflatedSize(region.DstPixels, regionSize);
+		ImageRdoBCBlocks(region.DstPixels, rdoSrcBlocks.get(), regionBlockCount, encoderState.DstPixelFormat,
+			encoderState.EncodeInfo.RdoLambda, encoderState.EncodeInfo.RdoWindow);
+		u32 sizeAfter = ImageComputeDeflatedSize(region.DstPixels, regionSize);
+
+		encoderState.RdoSizes->DeflatedBefore += sizeBefore;
+		encoderState.RdoSizes->DeflatedAfter += sizeAfter;
 	}
 }
 
-void rageam::graphics::ImageCompressor::CompressMip(EncoderState& imgEncData)
+bool rageam::graphics::ImageCompressor::HasLowComplexityBlocks(const EncoderState& encoderState)
 {
 	EASY_FUNCTION();
 
-	ImageInfo imgInfo = imgEncData.Image->GetInfo();
+	int blockCountX = encoderState.BlockCountX;
+	int blockCount = blockCountX * encoderState.BlockCountY;
 
-	char* srcPixels = imgEncData.Image->GetPixelDataBytes();
-	char* dstPixels = imgEncData.DstPixels;
+	PreEncodeTransform transform = CreatePreEncodeTransform(encoderState.EncodeInfo, encoderState.AlphaCoverageScale);
+	PreEncodeConstants constants;
+	CreatePreEncodeConstants(transform, constants);
 
-	int blockCountY = imgEncData.BlockCountY;
+	// Stride is made co-prime to row width, otherwise all samples would line up in a few columns
+	int stride = MAX(blockCount / ADAPTIVE_SAMPLE_BLOCK_COUNT, 1);
+	while (stride > 1 && std::gcd(stride, blockCountX) != 1)
+		stride++;
 
-	// Small image, process on main thread
-	if (blockCountY < IMAGE_BC_MULTITHREAD_MIN_REGION_SIZE)
+	const char* srcPixels = encoderState.Image->GetPixelDataBytes();
+	alignas(32) char block[IMAGE_BC_BLOCK_SLICE_PITCH];
+	for (int i = 0; i < blockCount; i += stride)
 	{
-		imgEncData.RegionBlocksCount = blockCountY;
-
-		Region& regEncData = imgEncData.Regions[0];
-		regEncData.SrcPixels = srcPixels;
-		regEncData.DstPixels = dstPixels;
-		CompressMipRegion(imgEncData, regEncData);
-		return;
+		int blockX = i % blockCountX;
+		int blockY = i / blockCountX;
+		const char* srcBlock = srcPixels +
+			static_cast<size_t>(blockY) * 4 * encoderState.SrcRowPitch + static_cast<size_t>(blockX) * IMAGE_BC_BLOCK_ROW_PITCH;
+		PreEncodeBlock(block, srcBlock, encoderState.SrcRowPitch, transform, constants);
+
+		if (ImageEstimateBlockComplexity(block, encoderState.ComplexityParams) != ImageBlockComplexity_Detailed)
+			return true;
 	}
+	return false;
+}
 
-	// Compute thread count
-	int regionCount = blockCountY / IMAGE_BC_MULTITHREAD_MIN_REGION_SIZE;
-	regionCount = MIN(regionCount, IMAGE_BC_MULTITHREAD_MAX_REGIONS);
-	int regionBlocksCount = blockCountY / regionCount; // We have to recompute size after clamping count
-	int regionPixelRows = imgInfo.Height / regionCount;
-
-	imgEncData.RegionBlocksCount = regionBlocksCount;
-
-	// Create background task for every region
-	amPtr<BackgroundTask> regionTasks[IMAGE_BC_MULTITHREAD_MAX_REGIONS];
+void rageam::graphics::ImageCompressor::SplitMipInRegions(const EncoderState& encoderState, List<Region>& outRegions)
+{
+	char* srcPixels = encoderState.Image->GetPixelDataBytes();
+	char* dstPixels = encoderState.DstPixels;
 
-	u32 srcRegionSlicePitch = imgEncData.SrcRowPitch * regionPixelRows;
-	u32 dstRegionSlicePitch = imgEncData.DstRowPitch * regionBlocksCount;
+	// Small mips are not split and go as single region, they fill the gaps while large mips are being processed
+	int blockCountY = encoderState.BlockCountY;
+	int regionBlocksCount = IMAGE_BC_MULTITHREAD_MIN_REGION_SIZE;
+	int regionCount = (blockCountY + regionBlocksCount - 1) / regionBlocksCount;
 
-	BackgroundWorker::Push(sm_RegionWorker);
+	u32 srcRegionSlicePitch = encoderState.SrcRowPitch * regionBlocksCount * 4;
+	u32 dstRegionSlicePitch = encoderState.DstRowPitch * regionBlocksCount;
 
 	for (int i = 0; i < regionCount; i++)
 	{
-		Region& regEncData = imgEncData.Regions[i];
-		regEncData.SrcPixels = srcPixels;
-		regEncData.DstPixels = dstPixels;
-
-		regionTasks[i] = BackgroundWorker::Run([&]
-			{
-				CompressMipRegion(imgEncData, regEncData);
-				return true;
-			});
+		Region region;
+		region.SrcPixels = srcPixels;
+		region.DstPixels = dstPixels;
+		region.BlockRowCount = MIN(regionBlocksCount, blockCountY - i * regionBlocksCount);
+		region.MipIndex = encoderState.MipIndex;
+		region.Index = static_cast<int>(outRegions.GetSize());
+		outRegions.Add(region);
 
 		srcPixels += srcRegionSlicePitch;
 		dstPixels += dstRegionSlicePitch;
 	}
-
-	// Wait for parallel tasks to finish the job
-	for (int k = 0; k < regionCount; k++)
-	{
-		regionTasks[k]->Wait();
-	}
-
-	BackgroundWorker::Pop();
 }
 
 rageam::graphics::CompressedImageInfo rageam::graphics::ImageCompressor::GetInfoAndHash(
@@ -375,6 +665,7 @@ rageam::graphics::CompressedImageInfo rageam::graphics::ImageCompressor::GetInfo
 
 	CompressedImageInfo encodeInfo = {};
 	encodeInfo.MipFilter = options.MipFilter;
+	encodeInfo.MipGammaCorrect = options.MipGammaCorrect && ImageCanGenerateMipChain(options.MipFilter, ImagePixelFormat_U32);
 	encodeInfo.CutoutAlpha = options.CutoutAlpha;
 	encodeInfo.CutoutAlphaThreshold = options.CutoutAlpha ? options.CutoutAlphaThreshold : 0;
 	encodeInfo.AlphaTestCoverage = options.AlphaTestCoverage;
@@ -382,6 +673,15 @@ rageam::graphics::CompressedImageInfo rageam::graphics::ImageCompressor::GetInfo
 	encodeInfo.IsSourceCompressed = ImageIsCompressedFormat(imgInfo.PixelFormat);
 	encodeInfo.Brightness = options.Brightness;
 	encodeInfo.Contrast = options.Contrast;
+	encodeInfo.SwizzleR = options.SwizzleR;
+	encodeInfo.SwizzleG = options.SwizzleG;
+	encodeInfo.SwizzleB = options.SwizzleB;
+	encodeInfo.SwizzleA = options.SwizzleA;
+	encodeInfo.Rdo = options.Rdo && (IMAGE_RDO_FORMATS & (1 << options.Format)) != 0;
+	encodeInfo.RdoLambda = encodeInfo.Rdo ? options.RdoLambda : 0.0f;
+	encodeInfo.RdoWindow = encodeInfo.Rdo ? options.RdoWindow : 0;
+	encodeInfo.AdaptiveQuality = options.AdaptiveQuality && options.Format != BlockFormat_None;
+	encodeInfo.AdaptiveMaxError = encodeInfo.AdaptiveQuality ? options.AdaptiveMaxError : 0.0f;
 
 	// Threshold 0 causes weird artifacts (because whole image turned opaque), clamp to 1
 	if (encodeInfo.CutoutAlphaThreshold == 0)
@@ -447,13 +747,21 @@ rageam::graphics::CompressedImageInfo rageam::graphics::ImageCompressor::GetInfo
 	return encodeInfo;
 }
 
-rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Compress(
-	const ImagePtr& img, const ImageCompressorOptions& options, const u32* pixelHashOverride, CompressedImageInfo* outCompInfo, ImageCompressorToken* token)
+rageam::graphics::ImageCompressor::JobPtr rageam::graphics::ImageCompressor::BeginCompress(
+	const ImagePtr& img, const ImageCompressorOptions& options, const u32* pixelHashOverride, ImageCompressorToken* token, bool useCache)
 {
 	EASY_FUNCTION();
 
 	if (token) token->Reset();
 
+	// Content hash is known if image was decoded from file, otherwise pixels are hashed once and remembered in the image
+	u32 contentHash;
+	if (!pixelHashOverride && img->HasPixelData())
+	{
+		contentHash = ImageHasher::Fold(img->ComputeContentHash());
+		pixelHashOverride = &contentHash;
+	}
+
 	u32 cacheHash;
 	CompressedImageInfo encodeInfo = GetInfoAndHash(
 		img->GetInfo(), options, cacheHash, pixelHashOverride, img->GetPixelData().Data(), img->ComputeSlicePitch());
@@ -463,16 +771,17 @@ rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Compress(
 		encodeInfo.UV2 = img->ComputePadExtent();
 	}
 
-	if (outCompInfo) *outCompInfo = encodeInfo;
-
 	ImageInfo& encodedImageInfo = encodeInfo.ImageInfo;
 	ImageInfo imageInfo = img->GetInfo();
 
 	// Attempt to retrieve image from cache
 	ImageCache* cache = ImageCache::GetInstance();
-	amPtr<Image> compressedImage = cache->GetFromCache(cacheHash, &encodeInfo.UV2);
-	if (compressedImage)
-		return compressedImage;
+	if (useCache)
+	{
+		amPtr<Image> compressedImage = cache->GetFromCache(cacheHash, &encodeInfo.UV2);
+		if (compressedImage)
+			return std::make_unique<Job>(compressedImage, encodeInfo);
+	}
 
 	// Previously we needed only metadata to locate image in cache, now we need pixel data too to compress it
 	if (!img->EnsurePixelDataLoaded())
@@ -482,7 +791,12 @@ rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Compress(
 	}
 
 	// Image was not in cache, compress it. We compute compress time to cache only expensive images
-	Timer timer = Timer::StartNew();
+	JobPtr job = std::make_unique<Job>();
+	job->m_Timer.Start();
+	job->m_CompInfo = encodeInfo;
+	job->m_CacheHash = cacheHash;
+	job->m_UseCache = useCache;
+	job->m_Token = token;
 
 	// Image can be converted to RGBA + rescaled, we hold separate pointer
 	ImagePtr preparedImage = img;
@@ -507,14 +821,7 @@ rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Compress(
 		encodeInfo = GetInfoAndHash(
 			imageInfo, options, unusedHash, pixelHashOverride, preparedImage->GetPixelData().Data(), preparedImage->ComputeSlicePitch());
 
-		if (outCompInfo)
-		{
-			outCompInfo->UV2 = uv2;
-		}
-		else
-		{
-			AM_WARNINGF("ImageCompressor::Compress() -> Padded to power of two but outCompInfo is NULL.");
-		}
+		job->m_CompInfo.UV2 = uv2;
 	}
 
 	// Now that we know image is not in cache, we can resize it (size depends on options.MaxResolution)
@@ -527,6 +834,7 @@ rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Compress(
 	// Skip encoders initialization for RGBA
 	EncoderState encoderState = {};
 	encoderState.Token = token;
+	encoderState.RdoSizes = &job->m_RdoSizes;
 	if (options.Format != BlockFormat_None)
 	{
 		encoderState.SrcPixelPitch = ImagePixelFormatBitsPerPixel[imageInfo.PixelFormat] / 8;
@@ -536,144 +844,219 @@ rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Compress(
 
 		if (encodeInfo.EncoderImpl == BlockCompressorImpl::None)
 		{
-			if (outCompInfo) *outCompInfo = {};
 			AM_ERRF("ImageCompressor::Compress() -> Encoder was not resolved to any implementation, returning NULL.");
 			return nullptr;
 		}
 
-		// Initialize block encoders
-		static bool s_CompressorsInitialized = false;
-		if (!s_CompressorsInitialized)
-		{
-			ispc::bc7e_compress_block_init();
-			rgbcx::init();
-			icbc::init();
-			s_CompressorsInitialized = true;
-		}
-
 		if (options.Format == BlockFormat_BC1 || options.Format == BlockFormat_BC4)
 			encoderState.DstPixelPitch = IMAGE_BC_1_4_BLOCK_SIZE;
 		else
 			encoderState.DstPixelPitch = IMAGE_BC_2_3_5_7_BLOCK_SIZE;
 
-		// Choose encoder quality for bc7enc_rdo
+		// Choose encoder quality for bc7enc_rdo, flat and smooth groups never use higher quality than requested
 		if (encodeInfo.EncoderImpl == BlockCompressorImpl::bc7enc_rdo && options.Format == BlockFormat_BC7)
 		{
-			switch (encodeInfo.EncoderData_bc7enc_rdo.Bc7Quality)
-			{
-			case 0: bc7e_compress_block_params_init_ultrafast(&encoderState.bc7enc_rdo_params, false);	break;
-			case 1: bc7e_compress_block_params_init_veryfast(&encoderState.bc7enc_rdo_params, false);	break;
-			case 2: bc7e_compress_block_params_init_fast(&encoderState.bc7enc_rdo_params, false);		break;
-			case 3: bc7e_compress_block_params_init_basic(&encoderState.bc7enc_rdo_params, false);		break;
-			case 4: bc7e_compress_block_params_init_slow(&encoderState.bc7enc_rdo_params, false);		break;
-			case 5: bc7e_compress_block_params_init_veryslow(&encoderState.bc7enc_rdo_params, false);	break;
-			case 6: bc7e_compress_block_params_init_slowest(&encoderState.bc7enc_rdo_params, false);	break;
-
-			default: AM_UNREACHABLE("ImageCompressor::Compress() -> Invalid BC7 quality '%i' for bc7enc_rdo",
-				encodeInfo.EncoderData_bc7enc_rdo.Bc7Quality);
-			}
+			int bc7Quality = encodeInfo.EncoderData_bc7enc_rdo.Bc7Quality;
+			InitBc7encRdoParams(0, &encoderState.bc7enc_rdo_params[ImageBlockComplexity_Flat]);
+			InitBc7encRdoParams(MIN(bc7Quality, ADAPTIVE_SMOOTH_BC7_QUALITY), &encoderState.bc7enc_rdo_params[ImageBlockComplexity_Smooth]);
+			InitBc7encRdoParams(bc7Quality, &encoderState.bc7enc_rdo_params[ImageBlockComplexity_Detailed]);
 		}
+
+		encoderState.ComplexityParams = ImageGetBlockComplexityParams(encodedImageInfo.PixelFormat, encodeInfo.AdaptiveMaxError);
 	}
 
 	// Allocate continuous block of memory for all mip maps
 	u32 encodedDataSize = ImageComputeTotalSizeWithMips(compWidth, compHeight, mipCount, encodedImageInfo.PixelFormat);
-	PixelDataOwner encodedDataOwner = PixelDataOwner::AllocateWithSize(encodedDataSize);
-	pChar encodedPixels = encodedDataOwner.Data()->Bytes;
+	job->m_EncodedData = PixelDataOwner::AllocateWithSize(encodedDataSize);
+	pChar encodedPixels = job->m_EncodedData.Data()->Bytes;
+
+	// Build the whole mip chain first, every mip gets its own encoder state so regions of
+	// all mips can be scheduled at once instead of waiting for each mip to finish
+	AM_ASSERT(mipCount <= IMAGE_MAX_MIP_MAPS, "ImageCompressor::Compress() -> Too many mip maps (%i)", mipCount);
+	EncoderState* mipStates = job->m_MipStates;
+	float desiredAlphaCoverage = 0.0f;
+	ImageInfo mipInfo;
 
-	// Compute total amount of rows for progress report
-	if (encoderState.Token)
+	// Box and triangle mips are built at once in a single pass over the first mip, other filters go through resizer mip by mip
+	ImagePtr& mipChain = job->m_MipChain;
+	if (mipCount > 1 && ImageCanGenerateMipChain(options.MipFilter, preparedImage->GetPixelFormat()))
 	{
-		std::unique_lock lock(encoderState.Token->Mutex);
-		for (int i = 0; i < mipCount; i++)
-		{
-			encoderState.Token->TotalBlockLines += (imageInfo.Height >> i) / 4;
-		}
+		mipChain = preparedImage->GenerateMipMaps(options.MipFilter, options.MipGammaCorrect);
+		AM_ASSERT(mipChain->GetMipCount() == mipCount, "ImageCompressor::Compress() -> Mip chain has %i mips, expected %i",
+			mipChain->GetMipCount(), mipCount);
 	}
 
-	// We compress every mip layer by downsampling image by factor of 2 every time
-	ImageInfo mipInfo;
 	for (int i = 0; i < mipCount; i++)
 	{
-		// NOTE: We keep mipImage as separate copy so post-processing doesn't stack up...
+		// Post-processing is not applied on the image itself, so it doesn't stack up on downsampled mips
 		ImagePtr  mipImage = preparedImage;
+		if (mipChain)
+		{
+			// References pixel data of the chain, which is alive until all mips are compressed
+			mipImage = ImageFactory::Create(
+				mipChain->GetPixelData(i), ImagePixelFormat_U32, mipChain->GetWidth() >> i, mipChain->GetHeight() >> i);
+		}
 		mipInfo = mipImage->GetInfo();
 
 		u32 encodedMipSlicePitch = ImageComputeSlicePitch(mipInfo.Width, mipInfo.Height, encodedImageInfo.PixelFormat);
 
 		// Compute scaling factor to preserve alpha coverage
+		float alphaCoverageScale = 1.0f;
 		if (encodeInfo.AlphaTestCoverage)
 		{
-			float alphaCoverage = ImageAlphaTestCoverageRGBA(
-				mipImage->GetPixelDataBytes(), mipInfo.Width, mipInfo.Height, encodeInfo.AlphaTestThreshold);
-
 			// Compute alpha coverage if we're on the first mip (as reference) and then
 			if (i == 0)
 			{
-				encoderState.DesiredAlphaCoverage = alphaCoverage;
-				encoderState.AlphaCoverageScale = 1.0f;
+				desiredAlphaCoverage = ImageAlphaTestCoverageRGBA(
+					mipImage->GetPixelDataBytes(), mipInfo.Width, mipInfo.Height, encodeInfo.AlphaTestThreshold);
 			}
 			else
 			{
-				encoderState.AlphaCoverageScale = ImageAlphaTestFindBestScaleRGBA(
+				alphaCoverageScale = ImageAlphaTestFindBestScaleRGBA(
 					mipImage->GetPixelDataBytes(), mipInfo.Width, mipInfo.Height, encodeInfo.AlphaTestThreshold,
-					encoderState.DesiredAlphaCoverage);
+					desiredAlphaCoverage);
 			}
 		}
 
-		// Post-processing, we do it per mip because it's very fast
-		// If we do processing on the first mip, it will invalidate caching for Image::Resize...
-		if (encodeInfo.Brightness != 0 || encodeInfo.Contrast != 0)
-		{
-			mipImage = mipImage->AdjustBrightnessAndContrast(encodeInfo.Brightness, encodeInfo.Contrast);
-		}
-
 		if (options.Format != BlockFormat_None)
 		{
-			encoderState.Image = mipImage;
-			encoderState.DstPixels = encodedPixels;
-			encoderState.DstPixelFormat = encodeInfo.ImageInfo.PixelFormat;
-			encoderState.SrcRowPitch = ImageComputeRowPitch(mipInfo.Width, mipInfo.PixelFormat);
-			encoderState.DstRowPitch = ImageComputeRowPitch(mipInfo.Width, encodedImageInfo.PixelFormat);
-			encoderState.BlockCountX = mipInfo.Width / 4;
-			encoderState.BlockCountY = mipInfo.Height / 4;
-			CompressMip(encoderState);
+			EncoderState& mipState = mipStates[i];
+			mipState = encoderState;
+			mipState.Image = mipImage;
+			mipState.DstPixels = encodedPixels;
+			mipState.DstPixelFormat = encodeInfo.ImageInfo.PixelFormat;
+			mipState.SrcRowPitch = ImageComputeRowPitch(mipInfo.Width, mipInfo.PixelFormat);
+			mipState.DstRowPitch = ImageComputeRowPitch(mipInfo.Width, encodedImageInfo.PixelFormat);
+			mipState.BlockCountX = mipInfo.Width / 4;
+			mipState.BlockCountY = mipInfo.Height / 4;
+			mipState.AlphaCoverageScale = alphaCoverageScale;
+			mipState.MipIndex = i;
 		}
 		else
 		{
 			// For RGBA we just need to copy pixels
 			memcpy(encodedPixels, mipImage->GetPixelDataBytes(), encodedMipSlicePitch);
 
-			// For BC we process this in compress block function
+			// For BC post-processing is done while gathering blocks in compress region function
+			ImageAdjustBrightnessAndContrastRGBA(encodedPixels, mipInfo.Width, mipInfo.Height, encodeInfo.Brightness, encodeInfo.Contrast);
 			if (encodeInfo.CutoutAlpha)
 				ImageCutoutAlphaRGBA(encodedPixels, mipInfo.Width, mipInfo.Height, encodeInfo.CutoutAlphaThreshold);
 			// First mip doesn't require alpha scaling
 			if (i != 0 && encodeInfo.AlphaTestCoverage)
-				ImageScaleAlphaRGBA(encodedPixels, mipInfo.Width, mipInfo.Height, encoderState.AlphaCoverageScale);
+				ImageScaleAlphaRGBA(encodedPixels, mipInfo.Width, mipInfo.Height, alphaCoverageScale);
+			ImageDoSwizzle(encodedPixels, mipInfo.Width, mipInfo.Height,
+				encodeInfo.SwizzleR, encodeInfo.SwizzleG, encodeInfo.SwizzleB, encodeInfo.SwizzleA);
 		}
 
-		if (token && token->Canceled)
-			return nullptr;
-
 		// Move to next compressed mip map pixel data
 		encodedPixels += encodedMipSlicePitch;
 
 		// Downsample to next mip map
-		preparedImage = preparedImage->Resize(mipInfo.Width / 2, mipInfo.Height / 2, options.MipFilter);
+		if (!mipChain && i + 1 < mipCount)
+			preparedImage = preparedImage->Resize(mipInfo.Width / 2, mipInfo.Height / 2, options.MipFilter);
 	}
 
+	// Per group analysis is cheap but not free, images where none of sampled blocks is flat or smooth are encoded as is
+	if (options.Format != BlockFormat_None && encodeInfo.AdaptiveQuality && HasLowComplexityBlocks(mipStates[0]))
+	{
+		for (int i = 0; i < mipCount; i++)
+			mipStates[i].Adaptive = true;
+	}
+
+	// Only block encoding reports progress, RGBA mips are copied above
+	if (token && options.Format != BlockFormat_None)
+	{
+		int mipTotalBlocks[IMAGE_MAX_MIP_MAPS];
+		for (int i = 0; i < mipCount; i++)
+			mipTotalBlocks[i] = mipStates[i].BlockCountX * mipStates[i].BlockCountY;
+		token->BeginEncoding(mipCount, mipTotalBlocks);
+	}
+
+	// Mips are added from largest to smallest, so small ones are picked up by threads that finished earlier
+	if (options.Format != BlockFormat_None)
+	{
+		for (int i = 0; i < mipCount; i++)
+			SplitMipInRegions(mipStates[i], job->m_Regions);
+	}
+	job->m_EncodedImageInfo = encodedImageInfo;
+
+	return job;
+}
+
+rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::EndCompress(Job& job, CompressedImageInfo* outCompInfo)
+{
+	EASY_FUNCTION();
+
+	if (job.m_Result)
+	{
+		if (outCompInfo) *outCompInfo = job.m_CompInfo;
+		return job.m_Result;
+	}
+
+	if (job.m_CompInfo.Rdo)
+	{
+		job.m_CompInfo.RdoDeflatedSizeBefore = job.m_RdoSizes.DeflatedBefore;
+		job.m_CompInfo.RdoDeflatedSizeAfter = job.m_RdoSizes.DeflatedAfter;
+	}
+	if (outCompInfo) *outCompInfo = job.m_CompInfo;
+
+	if (job.m_Token && job.m_Token->IsCanceled())
+		return nullptr;
+
 	// Create DDS image from compressed pixel data
-	ImagePtr compImage = std::make_shared<Image>(encodedDataOwner, encodedImageInfo);
+	const ImageInfo& info = job.m_EncodedImageInfo;
+	ImagePtr compImage = std::make_shared<Image>(job.m_EncodedData, info);
 
 	// See if image compression took long enough to compress it
-	timer.Stop();
-	if (cache->ShouldStore(timer.GetElapsedMilliseconds()))
+	job.m_Timer.Stop();
+	ImageCache* cache = ImageCache::GetInstance();
+	if (job.m_UseCache && cache->ShouldStore(job.m_Timer.GetElapsedMilliseconds()))
 	{
-		cache->Cache(compImage, cacheHash, encodedDataSize, ImageCacheEntryFlags_StoreInFileSystem, outCompInfo->UV2);
+		u32 encodedDataSize = ImageComputeTotalSizeWithMips(info.Width, info.Height, info.MipCount, info.PixelFormat);
+		cache->Cache(compImage, job.m_CacheHash, encodedDataSize, ImageCacheEntryFlags_StoreInFileSystem, job.m_CompInfo.UV2);
 	}
 
 	return compImage;
 }
 
+rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Compress(
+	const ImagePtr& img, const ImageCompressorOptions& options, const u32* pixelHashOverride, CompressedImageInfo* outCompInfo, ImageCompressorToken* token,
+	bool useCache)
+{
+	EASY_FUNCTION();
+
+	JobPtr job = BeginCompress(img, options, pixelHashOverride, token, useCache);
+	if (!job)
+		return nullptr;
+
+	int regionCount = job->GetRegionCount();
+
+	// Small image, process on calling thread
+	if (regionCount > 0 && job->m_MipStates[0].BlockCountY < IMAGE_BC_MULTITHREAD_MIN_REGION_SIZE)
+	{
+		for (int i = 0; i < regionCount; i++)
+			job->CompressRegion(i);
+	}
+	else if (regionCount > 0)
+	{
+		// If we're on worker thread, regions will be picked up by this thread while waiting
+		const Job& regionJob = *job;
+		Tasks regionTasks;
+		regionTasks.Reserve(regionCount);
+		for (int i = 0; i < regionCount; i++)
+		{
+			regionTasks.Emplace(BackgroundWorker::Run([&regionJob, i]
+				{
+					regionJob.CompressRegion(i);
+					return true;
+				}));
+		}
+		BackgroundWorker::WaitFor(regionTasks);
+	}
+
+	return EndCompress(*job, outCompInfo);
+}
+
 rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Decompress(const ImagePtr& img, int mipIndex)
 {
 	ImageInfo info = img->GetInfo();
@@ -687,44 +1070,13 @@ rageam::graphics::ImagePtr rageam::graphics::ImageCompressor::Decompress(const I
 
 void rageam::graphics::ImageCompressor::DecompressBlock(const char* inBlock, char* outPixels, ImagePixelFormat fmt)
 {
-
-	switch (fmt)
-	{
-	case ImagePixelFormat_BC1: rgbcx::unpack_bc1(inBlock, outPixels);		return;
-	case ImagePixelFormat_BC3: rgbcx::unpack_bc3(inBlock, outPixels);		return;
-	case ImagePixelFormat_BC4:
-		memcpy(outPixels, &IMAGE_RGBA_ALPHA_MASK, IMAGE_BC_BLOCK_SLICE_PITCH); // unpack_bc4 only sets R component
-		rgbcx::unpack_bc4(inBlock, (u8*)outPixels);	return;
-	case ImagePixelFormat_BC5:
-		memset(outPixels, 0, IMAGE_BC_BLOCK_SLICE_PITCH); // unpack_bc4 only sets R and G components
-		rgbcx::unpack_bc5(inBlock, outPixels);
-		// For some reason decoder messes up alpha channel (sets to random garbage) so we have to set it manually
-		// out pixels is 64 byte array, we can use 4 128bit lanes to speed it up
-		for (int i = 0; i < 4; i++)
-		{
-			char* lane = &outPixels[i * IMAGE_BC_BLOCK_ROW_PITCH];
-			__m128i fourPixels;
-			fourPixels = _mm_loadu_epi8(lane);
-			fourPixels = _mm_or_epi32(fourPixels, IMAGE_RGBA_ALPHA_MASK);
-			_mm_storeu_epi8(lane, fourPixels);
-		}
-		return;
-
-	case ImagePixelFormat_BC7:
-		bc7decomp_ref::unpack_bc7(inBlock, (bc7decomp::color_rgba*)outPixels);
-		return;
-
-	default: AM_UNREACHABLE("DecompressBlock() -> Unsupported format '%s'", Enum::GetName(fmt));
-	}
+	ImageDecodeBCBlockRow(inBlock, 1, outPixels, IMAGE_BC_BLOCK_ROW_PITCH, fmt);
 }
 
 void rageam::graphics::ImageCompressor::InitClass()
 {
-	sm_RegionWorker = new BackgroundWorker("Img BC", IMAGE_BC_MULTITHREAD_MAX_REGIONS);
-}
-
-void rageam::graphics::ImageCompressor::ShutdownClass()
-{
-	delete sm_RegionWorker;
-	sm_RegionWorker = nullptr;
+	// Block encoders initialization is not thread-safe, do it once before any compression
+	ispc::bc7e_compress_block_init();
+	rgbcx::init();
+	icbc::init();
 }
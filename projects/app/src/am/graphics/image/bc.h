@@ -8,6 +8,8 @@
 #pragma once
 
 #include "image.h"
+#include "am/system/timer.h"
+#include "am/system/worker.h"
 
 #ifdef AM_IMAGE_USE_AVX2
 #include <bc7e_ispc_avx2.h>
@@ -15,10 +17,8 @@
 #include <bc7e_ispc_sse2.h>
 #endif
 
-namespace rageam
-{
-	class BackgroundWorker;
-}
+#include <atomic>
+#include <chrono>
 
 namespace rageam::graphics
 {
@@ -39,11 +39,11 @@ namespace rageam::graphics
 #define IMAGE_BC_USE_MULTITHREADING
 
 #ifdef IMAGE_BC_USE_MULTITHREADING // Must be power of 2!
-	static constexpr int IMAGE_BC_MULTITHREAD_MAX_REGIONS = 16;		// Max threads
-	static constexpr int IMAGE_BC_MULTITHREAD_MIN_REGION_SIZE = 16;	// Num of Y blocks per one region
+	static constexpr int IMAGE_BC_MULTITHREAD_MIN_REGION_SIZE = 16;	// Num of Y blocks per one region (task)
+	static constexpr int IMAGE_BC_MULTITHREAD_DECODE_REGION_SIZE = 64; // Num of Y blocks per one decoding region (task)
 #else
-	static constexpr int IMAGE_BC_MULTITHREAD_MAX_REGIONS = 1;
 	static constexpr int IMAGE_BC_MULTITHREAD_MIN_REGION_SIZE = IMAGE_MAX_RESOLUTION / 4;
+	static constexpr int IMAGE_BC_MULTITHREAD_DECODE_REGION_SIZE = IMAGE_MAX_RESOLUTION / 4;
 #endif
 
 	enum BlockFormat // We keep it as separate enumeration from pixel formats to prevent using non-compressed formats in compressor
@@ -115,13 +115,46 @@ namespace rageam::graphics
 	// Only BC1
 	static constexpr int IMAGE_ICBC_FORMATS = 1 << BlockFormat_BC1;
 
+	// Formats that can be post-processed with RDO, all except BC2
+	static constexpr int IMAGE_RDO_FORMATS =
+		1 << BlockFormat_BC1 | 1 << BlockFormat_BC3 | 1 << BlockFormat_BC4 | 1 << BlockFormat_BC5 | 1 << BlockFormat_BC7;
+
+	// Decodes BC pixels to RGBA, large images are split in bands of block rows and decoded in parallel
 	PixelDataOwner ImageDecodeBCToRGBA(const PixelDataOwner& pixels, int width, int height, ImagePixelFormat format);
+	// Decodes row of 4x4 blocks straight to 4 rows of RGBA pixels with given destination row pitch
+	void ImageDecodeBCBlockRow(const char* blocks, int blockCount, char* dst, u32 dstRowPitch, ImagePixelFormat format);
+	// Rate-distortion optimization of encoded blocks, replaces whole blocks or their endpoints / selectors with ones
+	// from earlier blocks in the window if error increase is worth saved deflate bits, weighted by lambda
+	// Source blocks are 4x4 RGBA pixels of every encoded block one after another, returns number of modified blocks
+	int ImageRdoBCBlocks(char* blocks, const char* srcBlocks, int blockCount, ImagePixelFormat format, float lambda, int windowSize);
+	// Size of data compressed with the same deflate settings as resources
+	u32 ImageComputeDeflatedSize(const char* data, u32 dataSize);
+
+	// How much effort encoder has to spend on 4x4 block to reach low error, estimated without encoding it
+	enum ImageBlockComplexity
+	{
+		ImageBlockComplexity_Flat,		// Every channel is nearly constant, the fastest encoder settings give the same result
+		ImageBlockComplexity_Smooth,	// Pixels lie close to a single line in color space, one pair of endpoints fits them well
+		ImageBlockComplexity_Detailed,	// Needs full effort (partitions, cluster fit)
+	};
+
+	struct ImageBlockComplexityParams
+	{
+		u32 FlatChannelMask;	// Bytes of RGBA pixel that must be constant for block to be flat
+		u32 LineChannelMask;	// Bytes of RGBA pixel the line is fitted to, 0 for formats that encode channels independently
+		u32 MaxLineError;		// Sum of squared distances of 16 pixels to the line, block is detailed above it
+	};
+	// Max error is mean squared error of single pixel channel
+	ImageBlockComplexityParams ImageGetBlockComplexityParams(ImagePixelFormat fmt, float maxError);
+	// Fits a line through the block, bails out as soon as the error gets above the max one
+	ImageBlockComplexity ImageEstimateBlockComplexity(const char* block, const ImageBlockComplexityParams& params);
 
 	struct ImageCompressorOptions
 	{
 		BlockCompressorImpl CompressorImpl = BlockCompressorImpl::None;
 		BlockFormat			Format = BlockFormat_BC7;
 		ResizeFilter		MipFilter = ResizeFilter_Box;
+		bool				MipGammaCorrect = false;	// Mips are averaged in linear space, only for box and triangle filters
 		float				Quality = 0.65f;			// 0 - Worst, fastest; 1 - Best, slowest
 		int					MaxResolution = 0;			// Down-scales base image resolution to specified one, 0 to use original
 		bool				GenerateMipMaps = true;		// Creates mip maps up to 4x4
@@ -133,6 +166,19 @@ namespace rageam::graphics
 		int					Contrast = 0;
 		bool				PadToPowerOfTwo = false;
 		bool				AllowRecompress = false; 	// For users that want to re-compress .dds for their own reasons
+		// Post-processes blocks to compress better with deflate in resource, trading a bit of quality for smaller size
+		bool				Rdo = false;
+		float				RdoLambda = 1.0f;			// Error allowed per saved bit, higher gives smaller size and worse quality
+		int					RdoWindow = 256;			// How far back (in bytes) blocks are looked up for a match
+		// Encodes flat and smooth tiles of blocks with faster encoder settings, images without such tiles are not affected
+		// Opt-in because output of images with such tiles is different, which also changes their cache hash
+		bool				AdaptiveQuality = false;
+		float				AdaptiveMaxError = 2.0f;	// Mean squared error per pixel channel of the line fitted through smooth block
+		// Source component for every output channel, applied after all other post-processing
+		ImageSwizzle		SwizzleR = ImageSwizzle_R;
+		ImageSwizzle		SwizzleG = ImageSwizzle_G;
+		ImageSwizzle		SwizzleB = ImageSwizzle_B;
+		ImageSwizzle		SwizzleA = ImageSwizzle_A;
 
 		bool operator==(const ImageCompressorOptions&) const = default;
 	};
@@ -161,12 +207,17 @@ namespace rageam::graphics
 	{
 		ImageInfo				ImageInfo;
 		ResizeFilter			MipFilter;
+		bool					MipGammaCorrect;
 		bool					CutoutAlpha;
 		int						CutoutAlphaThreshold;
 		bool					AlphaTestCoverage;
 		int						AlphaTestThreshold;
 		int						Brightness;
 		int						Contrast;
+		ImageSwizzle			SwizzleR;
+		ImageSwizzle			SwizzleG;
+		ImageSwizzle			SwizzleB;
+		ImageSwizzle			SwizzleA;
 		BlockCompressorImpl		EncoderImpl;
 		EncoderData_bc7enc_rdo	EncoderData_bc7enc_rdo;
 		EncoderData_icbc		EncoderData_icbc;
@@ -174,24 +225,81 @@ namespace rageam::graphics
 		// if ImageCompressorOptions::AllowRecompress was set to true, this flag
 		// indicates if source DDS image was recompressed
 		bool					IsSourceCompressed;
+		bool					Rdo;
+		float					RdoLambda;
+		int						RdoWindow;
+		// Deflated size of all mips before and after RDO, only set if image was encoded with RDO and not retrieved from cache
+		u32						RdoDeflatedSizeBefore;
+		u32						RdoDeflatedSizeAfter;
+		bool					AdaptiveQuality;
+		float					AdaptiveMaxError;
 	};
 
+	// Gathers row of 4x4 blocks from RGBA image to continuous blocks and applies pixel post-processing of encode info on the way
+	// (brightness, contrast, cutout, alpha scale and swizzle), the same as encoder does. Result is identical to processing
+	// whole image with RGBA functions (see ImageAdjustBrightnessAndContrastRGBA) and gathering blocks after
+	void ImagePreEncodeBlockRow(
+		char* dstBlocks, const char* srcPixels, u32 srcRowPitch, int blockCount, const CompressedImageInfo& encodeInfo, float alphaCoverageScale = 1.0f);
+
+	// Snapshot of compression progress, block counts are used instead of block rows because
+	// rows of smaller mips contain less blocks and take proportionally less time to encode
+	struct ImageCompressorProgress
+	{
+		int MipCount;
+		int MipProcessedBlocks[IMAGE_MAX_MIP_MAPS];
+		int MipTotalBlocks[IMAGE_MAX_MIP_MAPS];
+		int ProcessedBlocks;
+		int TotalBlocks;
+		u64 ElapsedMilliseconds; // Since encoding of the first block started
+
+		double GetFraction() const { return TotalBlocks > 0 ? static_cast<double>(ProcessedBlocks) / TotalBlocks : 0.0; }
+		double GetMipFraction(int mip) const { return MipTotalBlocks[mip] > 0 ? static_cast<double>(MipProcessedBlocks[mip]) / MipTotalBlocks[mip] : 0.0; }
+		// Estimated time left assuming encoding throughput stays the same, 0 if nothing was encoded yet
+		u64 GetEtaMilliseconds() const;
+		// Mips are encoded in parallel, this is the time left if whole texture throughput was spent on this mip
+		u64 GetMipEtaMilliseconds(int mip) const;
+	};
+
+	/**
+	 * \brief Progress report and cancellation of single ImageCompressor::Compress call.
+	 * \remarks Encoder threads never synchronize on the token: every region adds processed blocks to its own
+	 * cache line (picked by region index within the image) with a relaxed atomic add, counters are summed up on read.
+	 */
 	struct ImageCompressorToken
 	{
-		// Mutex is not required for reading and for canceling
+		static constexpr int PROGRESS_SLOT_COUNT = 16; // Must be power of 2
 
+		// Per mip block counters of regions that map to this slot, whole slot takes a single cache line
+		struct alignas(64) ProgressSlot
+		{
+			std::atomic<int> MipProcessedBlocks[IMAGE_MAX_MIP_MAPS];
+		};
+		static_assert(sizeof(ProgressSlot) == 64);
+
+	private:
+		ProgressSlot	 m_ProgressSlots[PROGRESS_SLOT_COUNT];
+		std::atomic<int> m_MipTotalBlocks[IMAGE_MAX_MIP_MAPS];
+		std::atomic<int> m_MipCount;
+		std::atomic<s64> m_StartTicks; // Of steady_clock, set in BeginEncoding
+
+	public:
 		// If set to true, compressor will attempt to stop processing as soon as possible
-		bool		Canceled;
-		int			ProcessedBlockLines;
-		int			TotalBlockLines;
-		std::mutex	Mutex;
+		std::atomic<bool> Canceled;
+
+		ImageCompressorToken() { Reset(); }
 
-		void Reset()
+		void Reset();
+		// Called by compressor once before encoding first block, totals of mips that are not encoded must be zero
+		void BeginEncoding(int mipCount, const int* mipTotalBlocks);
+		void AddProcessedBlocks(int regionIndex, int mipIndex, int blockCount)
 		{
-			Canceled = false;
-			ProcessedBlockLines = 0;
-			TotalBlockLines = 0;
+			ProgressSlot& slot = m_ProgressSlots[regionIndex & (PROGRESS_SLOT_COUNT - 1)];
+			slot.MipProcessedBlocks[mipIndex].fetch_add(blockCount, std::memory_order_relaxed);
 		}
+		bool IsCanceled() const { return Canceled.load(std::memory_order_relaxed); }
+
+		// Safe to call from any thread while compressor is running
+		ImageCompressorProgress GetProgress() const;
 	};
 	using ImageCompressorTokenPtr = ImageCompressorToken*;
 
@@ -200,17 +308,29 @@ namespace rageam::graphics
 	 */
 	class ImageCompressor
 	{
+		// Range of block rows in single mip map, this is the smallest unit of work scheduled on background worker
 		struct Region
 		{
 			pChar SrcPixels;
 			pChar DstPixels;
+			int	  BlockRowCount;
+			int	  MipIndex;
+			int	  Index;		// Within the image, regions of all mips are numbered together so they spread over token progress slots
+		};
+
+		// Deflated sizes summed up from all regions of all mips
+		struct RdoSizeCounters
+		{
+			std::atomic<u32> DeflatedBefore;
+			std::atomic<u32> DeflatedAfter;
 		};
 
-		// Note: the way this struct is designed, only one mip allowed to be compressed at the time!
-		// No multithreaded mip compression is possible
+		// Encoding state of single mip map, every mip has its own state so all mips of
+		// the image can be split in regions and compressed in parallel
 		struct EncoderState
 		{
 			ImageCompressorTokenPtr				Token;
+			int									MipIndex;
 			ImagePtr							Image;
 			ImageInfo							ImageInfo;
 			CompressedImageInfo					EncodeInfo;
@@ -222,19 +342,23 @@ namespace rageam::graphics
 			u32									SrcRowPitch;
 			u32									DstRowPitch;
 			BlockCompressorImpl					EncoderImpl;
-			// Storage for all regions shared by parallel threads
-			Region								Regions[IMAGE_BC_MULTITHREAD_MAX_REGIONS];
 			int									BlockCountX;
 			int									BlockCountY;
-			int									RegionBlocksCount;
-			float								DesiredAlphaCoverage;
 			float								AlphaCoverageScale;
-			ispc::bc7e_compress_block_params	bc7enc_rdo_params;
+			RdoSizeCounters*					RdoSizes;
+			// Block groups are classified and encoded with settings of their complexity if set, otherwise all are detailed
+			bool								Adaptive;
+			ImageBlockComplexityParams			ComplexityParams;
+			// Indexed by ImageBlockComplexity
+			ispc::bc7e_compress_block_params	bc7enc_rdo_params[3];
 		};
 
-		static void CompressBlocks(const EncoderState& encoderState, int numBlocks, char* dstBlocks, char* srcBlocks);
+		static void CompressBlocks(const EncoderState& encoderState, int numBlocks, char* dstBlocks, char* srcBlocks, ImageBlockComplexity complexity);
 		static void CompressMipRegion(const EncoderState& encoderState, const Region& region);
-		static void CompressMip(EncoderState& imgEncData);
+		// Samples blocks of the first mip, returns false if none of them is flat or smooth so per group analysis can be skipped
+		static bool HasLowComplexityBlocks(const EncoderState& encoderState);
+		// Splits mip into block row regions, small mips are not split and go as single region
+		static void SplitMipInRegions(const EncoderState& encoderState, List<Region>& outRegions);
 
 		// Does not perform actual compression but only computes metadata of (potential) compressed image
 		// NOTE: Either pixelHashOverride or pixelData must be provided!
@@ -246,21 +370,64 @@ namespace rageam::graphics
 			ImagePixelData pixelData = nullptr,
 			u32 pixelDataSize = 0);
 
-		// We have separate from system worker because:
-		// - Need more threads
-		// - Scenario when all system worker threads are used would cause deadlock
-		static BackgroundWorker* sm_RegionWorker;
-
 	public:
+		/**
+		 * \brief Image that is prepared for encoding by BeginCompress.
+		 * \remarks Regions of all mips can be compressed in any order and from any thread, this allows caller to put
+		 * regions of many images in a single queue. Job must not be moved, encoder states point to its counters.
+		 */
+		class Job
+		{
+			friend class ImageCompressor;
+
+			ImagePtr				m_Result;			// Set if nothing has to be encoded, for e.g. image was taken from cache
+			CompressedImageInfo		m_CompInfo;
+			ImageInfo				m_EncodedImageInfo;
+			PixelDataOwner			m_EncodedData;
+			u32						m_CacheHash = 0;
+			bool					m_UseCache = false;
+			ImageCompressorTokenPtr	m_Token = nullptr;
+			ImagePtr				m_MipChain;			// Mip images reference its pixel data
+			EncoderState			m_MipStates[IMAGE_MAX_MIP_MAPS];
+			List<Region>			m_Regions;			// Largest mip first
+			RdoSizeCounters			m_RdoSizes = {};
+			Timer					m_Timer;
+
+		public:
+			Job() = default;
+			// Job that doesn't need encoding, result is returned by EndCompress as is
+			Job(const ImagePtr& result, const CompressedImageInfo& compInfo) : m_Result(result), m_CompInfo(compInfo) {}
+			Job(const Job&) = delete;
+			Job& operator=(const Job&) = delete;
+
+			int  GetRegionCount() const { return m_Regions.GetSize(); }
+			int  GetRegionBlockCount(int index) const { return m_Regions[index].BlockRowCount * m_MipStates[m_Regions[index].MipIndex].BlockCountX; }
+			void CompressRegion(int index) const { CompressMipRegion(m_MipStates[m_Regions[index].MipIndex], m_Regions[index]); }
+		};
+		using JobPtr = amUPtr<Job>;
+
+		// Does everything Compress does before encoding blocks: looks up image in cache, converts, resizes and builds mip maps
+		// Returns NULL if image failed to load or can't be compressed with given options
+		static JobPtr BeginCompress(
+			const ImagePtr& img,
+			const ImageCompressorOptions& options,
+			const u32* pixelHashOverride = nullptr,
+			ImageCompressorToken* token = nullptr,
+			bool useCache = true);
+		// Must be called once all regions of the job are compressed, returns NULL if token was canceled
+		static ImagePtr EndCompress(Job& job, CompressedImageInfo* outCompInfo = nullptr);
+
 		// Compresses given image with given options and returns newly created image
-		// pixelHashOverride is used to compute the final hash sum of the image, iterating over pixel data is a bit expensive,
-		// so something else (such as hash sum of image modify time + path) can be provided instead, as long as it is unique to the image
+		// pixelHashOverride is used to compute the final hash sum of the image, if not provided, content hash of the image is used
+		// (see Image::ComputeContentHash). It allows to look up image in cache without loading pixel data, as long as it is unique to the image
+		// If useCache is false, image is always encoded and result is not stored in cache (for benchmarking)
 		static ImagePtr Compress(
 			const ImagePtr& img,
 			const ImageCompressorOptions& options,
 			const u32* pixelHashOverride = nullptr,
 			CompressedImageInfo* outCompInfo = nullptr,
-			ImageCompressorToken* token = nullptr);
+			ImageCompressorToken* token = nullptr,
+			bool useCache = true);
 
 		// Decodes BC pixels to RGBA
 		// If given image format is already RGBA32, a reference to original pixel data will be returned
@@ -270,6 +437,5 @@ namespace rageam::graphics
 		static void DecompressBlock(const char* inBlock, char* outPixels, ImagePixelFormat fmt);
 
 		static void InitClass();
-		static void ShutdownClass();
 	};
 }
@@ -0,0 +1,128 @@
+#include "bc.h"
+
+namespace
+{
+	// Max difference between lightest and darkest value of every channel in flat block, BC endpoints are
+	// stored in 5-7 bits so encoders can't do better than this even with the slowest settings
+	constexpr int FLAT_BLOCK_RANGE = 2;
+
+	int GetChannelCount(u32 channelMask)
+	{
+		int count = 0;
+		for (int channel = 0; channel < 4; channel++)
+		{
+			if (channelMask & (0xFFu << (channel * 8)))
+				count++;
+		}
+		return count;
+	}
+}
+
+rageam::graphics::ImageBlockComplexity rageam::graphics::ImageEstimateBlockComplexity(
+	const char* block, const ImageBlockComplexityParams& params)
+{
+	u32 flatChannelMask = params.FlatChannelMask;
+	u32 lineChannelMask = params.LineChannelMask;
+	const u8* pixels = reinterpret_cast<const u8*>(block);
+
+	int minValue[4] = { 255, 255, 255, 255 };
+	int maxValue[4] = {};
+	int sum[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int channel = 0; channel < 4; channel++)
+		{
+			int value = pixels[i * 4 + channel];
+			minValue[channel] = MIN(minValue[channel], value);
+			maxValue[channel] = MAX(maxValue[channel], value);
+			sum[channel] += value;
+		}
+	}
+
+	bool isFlat = true;
+	for (int channel = 0; channel < 4; channel++)
+	{
+		if ((flatChannelMask & (0xFFu << (channel * 8))) && maxValue[channel] - minValue[channel] > FLAT_BLOCK_RANGE)
+			isFlat = false;
+	}
+	if (isFlat)
+		return ImageBlockComplexity_Flat;
+
+	if (lineChannelMask == 0)
+		return ImageBlockComplexity_Detailed;
+
+	// Pixels are centered around block mean, scaled by 16 to stay in integers
+	int lineChannels[4];
+	int lineChannelCount = 0;
+	int refChannel = -1;
+	for (int channel = 0; channel < 4; channel++)
+	{
+		if (!(lineChannelMask & (0xFFu << (channel * 8))))
+			continue;
+
+		lineChannels[lineChannelCount++] = channel;
+		if (refChannel == -1 || maxValue[channel] - minValue[channel] > maxValue[refChannel] - minValue[refChannel])
+			refChannel = channel;
+	}
+
+	auto centered = [&](int pixel, int channel) { return pixels[pixel * 4 + channel] * 16 - sum[channel]; };
+
+	// Bounding box diagonal is a good enough approximation of principal axis, but direction of every channel
+	// must be flipped if it goes down while channel with the largest range goes up
+	s64 axis[4] = {};
+	s64 axisLengthSquared = 0;
+	for (int k = 0; k < lineChannelCount; k++)
+	{
+		int channel = lineChannels[k];
+		s64 covariance = 0;
+		for (int i = 0; i < 16; i++)
+			covariance += static_cast<s64>(centered(i, channel)) * centered(i, refChannel);
+
+		axis[k] = maxValue[channel] - minValue[channel];
+		if (covariance < 0)
+			axis[k] = -axis[k];
+		axisLengthSquared += axis[k] * axis[k];
+	}
+
+	// Squared distance to the line, summed for all pixels, in units scaled by 16^2
+	s64 maxError = static_cast<s64>(params.MaxLineError) * 256;
+	s64 error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		s64 lengthSquared = 0;
+		s64 dot = 0;
+		for (int k = 0; k < lineChannelCount; k++)
+		{
+			s64 value = centered(i, lineChannels[k]);
+			lengthSquared += value * value;
+			dot += value * axis[k];
+		}
+		error += lengthSquared;
+		if (axisLengthSquared != 0)
+			error -= dot * dot / axisLengthSquared;
+
+		if (error > maxError)
+			return ImageBlockComplexity_Detailed;
+	}
+	return ImageBlockComplexity_Smooth;
+}
+
+rageam::graphics::ImageBlockComplexityParams rageam::graphics::ImageGetBlockComplexityParams(ImagePixelFormat fmt, float maxError)
+{
+	ImageBlockComplexityParams params;
+	switch (fmt)
+	{
+	// Alpha is ignored by BC1 encoders, BC3 encodes alpha separately
+	case ImagePixelFormat_BC1: params.FlatChannelMask = 0x00FFFFFF; params.LineChannelMask = 0x00FFFFFF; break;
+	case ImagePixelFormat_BC3: params.FlatChannelMask = 0xFFFFFFFF; params.LineChannelMask = 0x00FFFFFF; break;
+	// Channels are encoded independently, there's no line to fit
+	case ImagePixelFormat_BC4: params.FlatChannelMask = 0x000000FF; params.LineChannelMask = 0;			 break;
+	case ImagePixelFormat_BC5: params.FlatChannelMask = 0x0000FFFF; params.LineChannelMask = 0;			 break;
+	case ImagePixelFormat_BC7: params.FlatChannelMask = 0xFFFFFFFF; params.LineChannelMask = 0xFFFFFFFF; break;
+
+	default: params.FlatChannelMask = 0xFFFFFFFF; params.LineChannelMask = 0; break;
+	}
+	// Error is given per pixel channel
+	params.MaxLineError = static_cast<u32>(maxError * 16.0f * static_cast<float>(GetChannelCount(params.LineChannelMask)));
+	return params;
+}
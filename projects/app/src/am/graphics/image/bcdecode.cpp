@@ -0,0 +1,245 @@
+#include "bc.h"
+
+#include "am/system/enum.h"
+
+#include <bc7decomp.h>
+#include <array>
+
+namespace
+{
+	struct alignas(16) ShuffleMask
+	{
+		u8 Bytes[16];
+	};
+
+	// Picks 4 colors from BC1 palette (4 RGBA colors in 128 bit register), indexed by byte of 4 packed 2 bit selectors
+	constexpr std::array<ShuffleMask, 256> MakeSelectorShuffles()
+	{
+		std::array<ShuffleMask, 256> masks = {};
+		for (int i = 0; i < 256; i++)
+		{
+			for (int x = 0; x < 4; x++)
+			{
+				int selector = (i >> (x * 2)) & 3;
+				for (int c = 0; c < 4; c++)
+					masks[i].Bytes[x * 4 + c] = static_cast<u8>(selector * 4 + c);
+			}
+		}
+		return masks;
+	}
+
+	// Moves 4 bytes of given block row (16 bytes, one per pixel) to given RGBA channel, other channels are zeroed
+	constexpr std::array<std::array<ShuffleMask, 4>, 4> MakeChannelShuffles()
+	{
+		std::array<std::array<ShuffleMask, 4>, 4> masks = {};
+		for (int y = 0; y < 4; y++)
+		{
+			for (int channel = 0; channel < 4; channel++)
+			{
+				for (int i = 0; i < 16; i++)
+					masks[y][channel].Bytes[i] = i % 4 == channel ? static_cast<u8>(y * 4 + i / 4) : 0x80;
+			}
+		}
+		return masks;
+	}
+
+	// BC4 has 16 3 bit selectors starting at byte 2, puts two bytes that hold each selector in 16 bit lane (8 selectors per mask)
+	constexpr std::array<ShuffleMask, 2> MakeBC4SelectorGathers()
+	{
+		std::array<ShuffleMask, 2> masks = {};
+		for (int i = 0; i < 16; i++)
+		{
+			int byte = 2 + i * 3 / 8;
+			masks[i / 8].Bytes[i % 8 * 2 + 0] = static_cast<u8>(byte);
+			masks[i / 8].Bytes[i % 8 * 2 + 1] = byte + 1 < 8 ? static_cast<u8>(byte + 1) : 0x80; // Last selectors fit in one byte
+		}
+		return masks;
+	}
+
+	constexpr std::array<ShuffleMask, 256> SELECTOR_SHUFFLES = MakeSelectorShuffles();
+	constexpr std::array<std::array<ShuffleMask, 4>, 4> CHANNEL_SHUFFLES = MakeChannelShuffles();
+	constexpr std::array<ShuffleMask, 2> BC4_SELECTOR_GATHERS = MakeBC4SelectorGathers();
+
+	__m128i LoadMask(const ShuffleMask& mask)
+	{
+		return _mm_load_si128(reinterpret_cast<const __m128i*>(mask.Bytes));
+	}
+
+	// Returns 4 RGBA colors of BC1 block, three color mode with transparent black is only used in actual BC1,
+	// color part of BC2 and BC3 is always interpolated between 4 colors
+	__m128i DecodeBC1Palette(const u8* block, bool allowThreeColor)
+	{
+		u16 c0 = static_cast<u16>(block[0] | block[1] << 8);
+		u16 c1 = static_cast<u16>(block[2] | block[3] << 8);
+
+		// Expand 565 endpoints to 8 bits per channel, { c0, c1 } in 16 bit lanes:
+		// 5 bit - (v << 3) | (v >> 2); 6 bit - (v << 2) | (v >> 4); shifts are done via multiplication
+		__m128i endpoints = _mm_setr_epi16(
+			c0 >> 11, c0 >> 5 & 63, c0 & 31, 255,
+			c1 >> 11, c1 >> 5 & 63, c1 & 31, 255);
+		endpoints = _mm_or_si128(
+			_mm_mullo_epi16(endpoints, _mm_setr_epi16(8, 4, 8, 1, 8, 4, 8, 1)),
+			_mm_mulhi_epu16(endpoints, _mm_setr_epi16(1 << 14, 1 << 12, 1 << 14, 0, 1 << 14, 1 << 12, 1 << 14, 0)));
+		__m128i endpointsSwapped = _mm_shuffle_epi32(endpoints, _MM_SHUFFLE(1, 0, 3, 2));
+
+		__m128i interpolated;
+		if (c0 > c1 || !allowThreeColor)
+		{
+			// { (c0 * 2 + c1) / 3, (c1 * 2 + c0) / 3 }, multiplication by 2^16 / 3 is exact division for sums up to 765
+			interpolated = _mm_add_epi16(_mm_add_epi16(endpoints, endpoints), endpointsSwapped);
+			interpolated = _mm_mulhi_epu16(interpolated, _mm_set1_epi16(21846));
+		}
+		else
+		{
+			// { (c0 + c1) / 2, transparent black }
+			interpolated = _mm_srli_epi16(_mm_add_epi16(endpoints, endpointsSwapped), 1);
+			interpolated = _mm_and_si128(interpolated, _mm_setr_epi32(-1, -1, 0, 0));
+		}
+		return _mm_packus_epi16(endpoints, interpolated);
+	}
+
+	// Returns values of all 16 pixels of BC4 block, one byte per pixel
+	__m128i DecodeBC4Values(const u8* block)
+	{
+		int l = block[0];
+		int h = block[1];
+
+		// All 8 values are interpolated at once, multiplication by 2^16 / 7 and 2^16 / 5 is exact division for sums up to 1785
+		__m128i values;
+		if (l > h)
+		{
+			values = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_set1_epi16(static_cast<short>(l)), _mm_setr_epi16(7, 0, 6, 5, 4, 3, 2, 1)),
+				_mm_mullo_epi16(_mm_set1_epi16(static_cast<short>(h)), _mm_setr_epi16(0, 7, 1, 2, 3, 4, 5, 6)));
+			values = _mm_mulhi_epu16(values, _mm_set1_epi16(9363));
+		}
+		else
+		{
+			// Last two values are 0 and 255
+			values = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_set1_epi16(static_cast<short>(l)), _mm_setr_epi16(5, 0, 4, 3, 2, 1, 0, 0)),
+				_mm_mullo_epi16(_mm_set1_epi16(static_cast<short>(h)), _mm_setr_epi16(0, 5, 1, 2, 3, 4, 0, 0)));
+			values = _mm_mulhi_epu16(values, _mm_set1_epi16(13108));
+			values = _mm_or_si128(values, _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, 255));
+		}
+		__m128i palette = _mm_packus_epi16(values, values);
+
+		// Unpack 16 3 bit selectors to bytes, selector is shifted to bits 8-10 of its 16 bit lane
+		// by multiplication with 2^(8 - bit offset in lane) and then moved to the low byte
+		__m128i bits = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block));
+		__m128i selectorsLo = _mm_shuffle_epi8(bits, LoadMask(BC4_SELECTOR_GATHERS[0]));
+		__m128i selectorsHi = _mm_shuffle_epi8(bits, LoadMask(BC4_SELECTOR_GATHERS[1]));
+		selectorsLo = _mm_srli_epi16(_mm_mullo_epi16(selectorsLo, _mm_setr_epi16(256, 32, 4, 128, 16, 2, 64, 8)), 8);
+		selectorsHi = _mm_srli_epi16(_mm_mullo_epi16(selectorsHi, _mm_setr_epi16(256, 32, 4, 128, 16, 2, 64, 8)), 8);
+		__m128i selectors = _mm_and_si128(_mm_packus_epi16(selectorsLo, selectorsHi), _mm_set1_epi8(7));
+
+		return _mm_shuffle_epi8(palette, selectors);
+	}
+
+	// Returns values of all 16 pixels of BC2 explicit alpha block, one byte per pixel
+	__m128i DecodeBC2Alpha(const u8* block)
+	{
+		__m128i bits = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block));
+		__m128i nibbleMask = _mm_set1_epi8(0x0F);
+		__m128i lo = _mm_and_si128(bits, nibbleMask);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(bits, 4), nibbleMask);
+		__m128i alpha = _mm_unpacklo_epi8(lo, hi);
+		// Expand 4 bits to 8, n * 17
+		return _mm_or_si128(_mm_slli_epi16(alpha, 4), alpha);
+	}
+
+	void StoreRow(u8* dst, __m128i row)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), row);
+	}
+
+	void DecodeBC1Block(const u8* block, u8* dst, u32 dstRowPitch)
+	{
+		__m128i palette = DecodeBC1Palette(block, true);
+		for (int y = 0; y < 4; y++, dst += dstRowPitch)
+			StoreRow(dst, _mm_shuffle_epi8(palette, LoadMask(SELECTOR_SHUFFLES[block[4 + y]])));
+	}
+
+	// BC2 and BC3 blocks, alpha is 8 bytes followed by BC1 color block
+	void DecodeColorAlphaBlock(const u8* block, __m128i alpha, u8* dst, u32 dstRowPitch)
+	{
+		const u8* colorBlock = block + 8;
+		__m128i palette = DecodeBC1Palette(colorBlock, false);
+		__m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+		for (int y = 0; y < 4; y++, dst += dstRowPitch)
+		{
+			__m128i color = _mm_shuffle_epi8(palette, LoadMask(SELECTOR_SHUFFLES[colorBlock[4 + y]]));
+			__m128i rowAlpha = _mm_shuffle_epi8(alpha, LoadMask(CHANNEL_SHUFFLES[y][3]));
+			StoreRow(dst, _mm_or_si128(_mm_and_si128(color, rgbMask), rowAlpha));
+		}
+	}
+
+	// Single channel goes in R, alpha is opaque
+	void DecodeBC4Block(const u8* block, u8* dst, u32 dstRowPitch)
+	{
+		__m128i red = DecodeBC4Values(block);
+		__m128i alphaMask = _mm_set1_epi32(0xFF000000);
+		for (int y = 0; y < 4; y++, dst += dstRowPitch)
+			StoreRow(dst, _mm_or_si128(_mm_shuffle_epi8(red, LoadMask(CHANNEL_SHUFFLES[y][0])), alphaMask));
+	}
+
+	// Two channels go in R and G, alpha is opaque
+	void DecodeBC5Block(const u8* block, u8* dst, u32 dstRowPitch)
+	{
+		__m128i red = DecodeBC4Values(block);
+		__m128i green = DecodeBC4Values(block + 8);
+		__m128i alphaMask = _mm_set1_epi32(0xFF000000);
+		for (int y = 0; y < 4; y++, dst += dstRowPitch)
+		{
+			__m128i row = _mm_or_si128(
+				_mm_shuffle_epi8(red, LoadMask(CHANNEL_SHUFFLES[y][0])),
+				_mm_shuffle_epi8(green, LoadMask(CHANNEL_SHUFFLES[y][1])));
+			StoreRow(dst, _mm_or_si128(row, alphaMask));
+		}
+	}
+
+	void DecodeBC7Block(const u8* block, u8* dst, u32 dstRowPitch)
+	{
+		alignas(16) bc7decomp::color_rgba pixels[16];
+		bc7decomp::unpack_bc7(block, pixels);
+		for (int y = 0; y < 4; y++, dst += dstRowPitch)
+			StoreRow(dst, _mm_load_si128(reinterpret_cast<const __m128i*>(pixels + y * 4)));
+	}
+}
+
+void rageam::graphics::ImageDecodeBCBlockRow(const char* blocks, int blockCount, char* dst, u32 dstRowPitch, ImagePixelFormat format)
+{
+	const u8* block = reinterpret_cast<const u8*>(blocks);
+	u8*       dstPixels = reinterpret_cast<u8*>(dst);
+
+	// Format is resolved once per row, each block goes straight to the destination rows
+	switch (format)
+	{
+	case ImagePixelFormat_BC1:
+		for (int i = 0; i < blockCount; i++, block += 8, dstPixels += IMAGE_BC_BLOCK_ROW_PITCH)
+			DecodeBC1Block(block, dstPixels, dstRowPitch);
+		return;
+	case ImagePixelFormat_BC2:
+		for (int i = 0; i < blockCount; i++, block += 16, dstPixels += IMAGE_BC_BLOCK_ROW_PITCH)
+			DecodeColorAlphaBlock(block, DecodeBC2Alpha(block), dstPixels, dstRowPitch);
+		return;
+	case ImagePixelFormat_BC3:
+		for (int i = 0; i < blockCount; i++, block += 16, dstPixels += IMAGE_BC_BLOCK_ROW_PITCH)
+			DecodeColorAlphaBlock(block, DecodeBC4Values(block), dstPixels, dstRowPitch);
+		return;
+	case ImagePixelFormat_BC4:
+		for (int i = 0; i < blockCount; i++, block += 8, dstPixels += IMAGE_BC_BLOCK_ROW_PITCH)
+			DecodeBC4Block(block, dstPixels, dstRowPitch);
+		return;
+	case ImagePixelFormat_BC5:
+		for (int i = 0; i < blockCount; i++, block += 16, dstPixels += IMAGE_BC_BLOCK_ROW_PITCH)
+			DecodeBC5Block(block, dstPixels, dstRowPitch);
+		return;
+	case ImagePixelFormat_BC7:
+		for (int i = 0; i < blockCount; i++, block += 16, dstPixels += IMAGE_BC_BLOCK_ROW_PITCH)
+			DecodeBC7Block(block, dstPixels, dstRowPitch);
+		return;
+
+	default: AM_UNREACHABLE("ImageDecodeBCBlockRow() -> Unsupported format '%s'", Enum::GetName(format));
+	}
+}
@@ -0,0 +1,228 @@
+#include "bc.h"
+
+#include "rage/zlib/stream.h"
+
+namespace
+{
+	// Rough cost of deflate symbols, a match is length + distance code with extra bits
+	constexpr float LITERAL_BITS = 8.0f;
+	constexpr float MATCH_BITS = 20.0f;
+	// Candidate is never accepted if its error is this many times higher than error of the original block
+	constexpr float MAX_ERROR_INCREASE_RATIO = 16.0f;
+	// Errors in flat blocks are much more visible (banding on gradients), they're weighted up to this value
+	constexpr float MAX_SMOOTH_BLOCK_ERROR_SCALE = 10.0f;
+	// Standard deviation of block channel above which block is not considered smooth anymore
+	constexpr float SMOOTH_BLOCK_STD_DEV = 18.0f;
+	// Deflate can't look further than 32KB back
+	constexpr int MAX_WINDOW_SIZE = 32768;
+
+	// Byte range of the block that can be copied from earlier block without touching the rest
+	struct RdoSegment
+	{
+		u32 Offset;
+		u32 Size;
+	};
+
+	struct RdoFormatInfo
+	{
+		u32			BlockSize;
+		u32			ChannelMask;	// Bytes of RGBA pixel that format stores
+		int			ChannelCount;
+		int			SegmentCount;
+		RdoSegment	Segments[4];
+	};
+
+	bool GetRdoFormatInfo(ImagePixelFormat format, RdoFormatInfo& outInfo)
+	{
+		switch (format)
+		{
+		// Endpoints | Selectors, alpha is checked separately
+		case ImagePixelFormat_BC1: outInfo = { 8, 0x00FFFFFF, 3, 2, { { 0, 4 }, { 4, 4 } } };						return true;
+		// Alpha Block | Alpha Selectors | Color Endpoints | Color Selectors
+		case ImagePixelFormat_BC3: outInfo = { 16, 0xFFFFFFFF, 4, 4, { { 0, 8 }, { 2, 6 }, { 8, 8 }, { 12, 4 } } };	return true;
+		// Endpoints | Selectors, 2 byte endpoints are too short for deflate match
+		case ImagePixelFormat_BC4: outInfo = { 8, 0x000000FF, 1, 1, { { 2, 6 } } };								return true;
+		// Red | Red Selectors | Green | Green Selectors
+		case ImagePixelFormat_BC5: outInfo = { 16, 0x0000FFFF, 2, 4, { { 0, 8 }, { 2, 6 }, { 8, 8 }, { 10, 6 } } };	return true;
+		// Second half is mostly index bits in all modes
+		case ImagePixelFormat_BC7: outInfo = { 16, 0xFFFFFFFF, 4, 1, { { 8, 8 } } };								return true;
+
+		default: return false;
+		}
+	}
+
+	// BC1 in 3 color mode (c0 <= c1) decodes selector 3 as transparent black, alpha is not in the error though
+	bool IsSameAlpha(const u8* decoded, const u8* otherDecoded)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			if (decoded[i * 4 + 3] != otherDecoded[i * 4 + 3])
+				return false;
+		}
+		return true;
+	}
+
+	// Sum of squared differences of 16 pixels on masked channels
+	u32 ComputeBlockError(const u8* decoded, const u8* src, u32 channelMask)
+	{
+		__m128i mask = _mm_set1_epi32(static_cast<int>(channelMask));
+		__m128i zero = _mm_setzero_si128();
+		__m128i acc = zero;
+		for (int i = 0; i < 4; i++)
+		{
+			__m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(decoded + i * 16)), mask);
+			__m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 16)), mask);
+			__m128i diffLo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i diffHi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(diffLo, diffLo));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(diffHi, diffHi));
+		}
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+		return static_cast<u32>(_mm_cvtsi128_si32(acc));
+	}
+
+	// Scales error of flat source blocks up, blocks with a lot of detail mask the error
+	float ComputeSmoothBlockErrorScale(const u8* src, const RdoFormatInfo& formatInfo)
+	{
+		float maxStdDev = 0.0f;
+		for (int channel = 0; channel < 4; channel++)
+		{
+			if (!(formatInfo.ChannelMask & (0xFFu << (channel * 8))))
+				continue;
+
+			float sum = 0.0f;
+			float sumSquared = 0.0f;
+			for (int i = 0; i < 16; i++)
+			{
+				float value = src[i * 4 + channel];
+				sum += value;
+				sumSquared += value * value;
+			}
+			float mean = sum / 16.0f;
+			float variance = MAX(sumSquared / 16.0f - mean * mean, 0.0f);
+			maxStdDev = MAX(maxStdDev, sqrtf(variance));
+		}
+		float t = MIN(maxStdDev / SMOOTH_BLOCK_STD_DEV, 1.0f);
+		return MAX_SMOOTH_BLOCK_ERROR_SCALE + (1.0f - MAX_SMOOTH_BLOCK_ERROR_SCALE) * t;
+	}
+}
+
+int rageam::graphics::ImageRdoBCBlocks(
+	char* blocks, const char* srcBlocks, int blockCount, ImagePixelFormat format, float lambda, int windowSize)
+{
+	RdoFormatInfo formatInfo;
+	if (!GetRdoFormatInfo(format, formatInfo))
+		return 0;
+
+	u32 blockSize = formatInfo.BlockSize;
+	int windowBlocks = MAX(static_cast<int>(MIN(windowSize, MAX_WINDOW_SIZE) / blockSize), 1);
+
+	alignas(16) u8 decoded[IMAGE_BC_BLOCK_SLICE_PITCH];
+	alignas(16) u8 originalDecoded[IMAGE_BC_BLOCK_SLICE_PITCH];
+	alignas(16) char candidate[IMAGE_BC_2_3_5_7_BLOCK_SIZE];
+	alignas(16) char bestBlock[IMAGE_BC_2_3_5_7_BLOCK_SIZE];
+
+	int changedBlocks = 0;
+	for (int i = 0; i < blockCount; i++)
+	{
+		char*     block = blocks + static_cast<size_t>(i) * blockSize;
+		const u8* src = reinterpret_cast<const u8*>(srcBlocks) + static_cast<size_t>(i) * IMAGE_BC_BLOCK_SLICE_PITCH;
+		int       firstBlock = MAX(i - windowBlocks, 0);
+
+		// Block is already repeated within the window, deflate will match it anyway
+		bool isRepeated = false;
+		for (int k = i - 1; k >= firstBlock && !isRepeated; k--)
+			isRepeated = memcmp(block, blocks + static_cast<size_t>(k) * blockSize, blockSize) == 0;
+		if (isRepeated)
+			continue;
+
+		// Cost is mean squared error of the block + lambda per bit of deflate output
+		float errorScale = ComputeSmoothBlockErrorScale(src, formatInfo) / static_cast<float>(16 * formatInfo.ChannelCount);
+		auto computeError = [&](const char* blockToDecode)
+			{
+				ImageDecodeBCBlockRow(blockToDecode, 1, reinterpret_cast<char*>(decoded), IMAGE_BC_BLOCK_ROW_PITCH, format);
+				return static_cast<float>(ComputeBlockError(decoded, src, formatInfo.ChannelMask));
+			};
+
+		float originalError = computeError(block);
+		memcpy(originalDecoded, decoded, sizeof decoded);
+		float maxError = MAX(originalError, static_cast<float>(16 * formatInfo.ChannelCount)) * MAX_ERROR_INCREASE_RATIO;
+		float bestCost = originalError * errorScale + lambda * static_cast<float>(blockSize) * LITERAL_BITS;
+		bool  found = false;
+
+		auto tryCandidate = [&](const char* candidateBlock, float rateBits)
+			{
+				float rateCost = lambda * rateBits;
+				if (rateCost >= bestCost) // Can't win even with zero error
+					return;
+
+				float error = computeError(candidateBlock);
+
+				// Candidate must not punch transparent holes in opaque pixels or remove ones that encoder put in cutout
+				if (format == ImagePixelFormat_BC1 && !IsSameAlpha(decoded, originalDecoded))
+					return;
+
+				float cost = error * errorScale + rateCost;
+				if (error > maxError || cost >= bestCost)
+					return;
+
+				memcpy(bestBlock, candidateBlock, blockSize);
+				bestCost = cost;
+				found = true;
+			};
+
+		// Closest blocks go first, they're cheaper to reference on equal cost
+		for (int k = i - 1; k >= firstBlock; k--)
+		{
+			const char* prevBlock = blocks + static_cast<size_t>(k) * blockSize;
+
+			tryCandidate(prevBlock, MATCH_BITS);
+
+			for (int s = 0; s < formatInfo.SegmentCount; s++)
+			{
+				const RdoSegment& segment = formatInfo.Segments[s];
+				if (memcmp(block + segment.Offset, prevBlock + segment.Offset, segment.Size) == 0)
+					continue;
+
+				memcpy(candidate, block, blockSize);
+				memcpy(candidate + segment.Offset, prevBlock + segment.Offset, segment.Size);
+				tryCandidate(candidate, static_cast<float>(blockSize - segment.Size) * LITERAL_BITS + MATCH_BITS);
+			}
+		}
+
+		if (found)
+		{
+			memcpy(block, bestBlock, blockSize);
+			changedBlocks++;
+		}
+	}
+	return changedBlocks;
+}
+
+u32 rageam::graphics::ImageComputeDeflatedSize(const char* data, u32 dataSize)
+{
+	// Compressed data is not needed, output buffer is simply overwritten until stream is finished
+	static constexpr u32 OUT_BUFFER_SIZE = 0x4000;
+	u8 outBuffer[OUT_BUFFER_SIZE];
+
+	zStream_t stream = {};
+	int status = Z_DEFLATE_INIT2(&stream, ZLIB_COMPRESSION_LEVEL, Z_DEFLATED, ZLIB_WINDOW_BITS, ZLIB_MEMORY_LEVEL, Z_DEFAULT_STRATEGY);
+	AM_ASSERT(status >= 0, "ImageComputeDeflatedSize() -> Init failed with status %i", status);
+
+	stream.next_in = reinterpret_cast<zBuffer_t>(const_cast<char*>(data));
+	stream.avail_in = dataSize;
+
+	u32 totalSize = 0;
+	do
+	{
+		stream.next_out = reinterpret_cast<zBuffer_t>(outBuffer);
+		stream.avail_out = OUT_BUFFER_SIZE;
+		status = Z_DEFLATE(&stream, Z_FINISH);
+		totalSize += OUT_BUFFER_SIZE - stream.avail_out;
+	} while (status == Z_OK);
+	AM_ASSERT(status == Z_STREAM_END, "ImageComputeDeflatedSize() -> Failed with status %i", status);
+
+	Z_DEFLATE_END(&stream);
+	return totalSize;
+}
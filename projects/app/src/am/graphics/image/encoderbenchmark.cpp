@@ -0,0 +1,357 @@
+#include "encoderbenchmark.h"
+
+#include "am/file/fileutils.h"
+#include "am/system/enum.h"
+#include "am/system/timer.h"
+#include "am/system/worker.h"
+#include "am/xml/doc.h"
+#include "am/xml/exception.h"
+
+#include <easy/profiler.h>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+	using namespace rageam::graphics;
+
+	// SSIM is computed on overlapping 8x8 windows with uniform weights
+	constexpr int SSIM_WINDOW_SIZE = 8;
+	constexpr int SSIM_WINDOW_STEP = 4;
+	// Standard stabilization constants for 8 bit signal, (0.01 * 255)^2 and (0.03 * 255)^2
+	constexpr double SSIM_C1 = 6.5025;
+	constexpr double SSIM_C2 = 58.5225;
+	// Reported for lossless result instead of infinity
+	constexpr double PSNR_MAX = 100.0;
+
+	struct QualityStats
+	{
+		double SquaredError = 0.0;
+		u64    SampleCount = 0;
+		double SsimSum = 0.0;
+		u64    SsimWindowCount = 0;
+
+		double GetPsnr() const
+		{
+			if (SampleCount == 0)
+				return 0.0;
+			double mse = SquaredError / static_cast<double>(SampleCount);
+			if (mse == 0.0)
+				return PSNR_MAX;
+			return MIN(10.0 * log10(255.0 * 255.0 / mse), PSNR_MAX);
+		}
+
+		double GetSsim() const
+		{
+			if (SsimWindowCount == 0)
+				return 0.0;
+			return SsimSum / static_cast<double>(SsimWindowCount);
+		}
+	};
+
+	// Channels that are actually stored by the block format, RGBA bits
+	u32 GetFormatChannelMask(BlockFormat format)
+	{
+		switch (format)
+		{
+		case BlockFormat_BC1: return 0b0111; // Alpha is 1 bit punch-through, not worth measuring
+		case BlockFormat_BC4: return 0b0001;
+		case BlockFormat_BC5: return 0b0011;
+
+		default: return 0b1111;
+		}
+	}
+
+	void AccumulateQuality(const u8* srcPixels, const u8* decodedPixels, int width, int height, u32 channelMask, QualityStats& stats)
+	{
+		for (int channel = 0; channel < 4; channel++)
+		{
+			if (!(channelMask & 1 << channel))
+				continue;
+
+			u64 squaredError = 0;
+			for (int i = 0; i < width * height; i++)
+			{
+				int diff = srcPixels[i * 4 + channel] - decodedPixels[i * 4 + channel];
+				squaredError += diff * diff;
+			}
+			stats.SquaredError += static_cast<double>(squaredError);
+			stats.SampleCount += static_cast<u64>(width) * height;
+
+			for (int y = 0; y + SSIM_WINDOW_SIZE <= height; y += SSIM_WINDOW_STEP)
+			{
+				for (int x = 0; x + SSIM_WINDOW_SIZE <= width; x += SSIM_WINDOW_STEP)
+				{
+					int sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+					for (int wy = 0; wy < SSIM_WINDOW_SIZE; wy++)
+					{
+						int rowOffset = ((y + wy) * width + x) * 4 + channel;
+						for (int wx = 0; wx < SSIM_WINDOW_SIZE; wx++)
+						{
+							int a = srcPixels[rowOffset + wx * 4];
+							int b = decodedPixels[rowOffset + wx * 4];
+							sumA += a;
+							sumB += b;
+							sumAA += a * a;
+							sumBB += b * b;
+							sumAB += a * b;
+						}
+					}
+
+					constexpr double n = SSIM_WINDOW_SIZE * SSIM_WINDOW_SIZE;
+					double meanA = sumA / n;
+					double meanB = sumB / n;
+					double varianceA = sumAA / n - meanA * meanA;
+					double varianceB = sumBB / n - meanB * meanB;
+					double covariance = sumAB / n - meanA * meanB;
+
+					stats.SsimSum +=
+						(2.0 * meanA * meanB + SSIM_C1) * (2.0 * covariance + SSIM_C2) /
+						((meanA * meanA + meanB * meanB + SSIM_C1) * (varianceA + varianceB + SSIM_C2));
+					stats.SsimWindowCount++;
+				}
+			}
+		}
+	}
+
+	u64 ComputePixelCountWithMips(const ImageInfo& info)
+	{
+		u64 pixelCount = 0;
+		for (int i = 0; i < info.MipCount; i++)
+			pixelCount += static_cast<u64>(MAX(1, info.Width >> i)) * MAX(1, info.Height >> i);
+		return pixelCount;
+	}
+}
+
+double rageam::graphics::ImageEncoderBenchmarkResult::GetMegaPixelsPerSecond() const
+{
+	if (ElapsedMicroseconds == 0)
+		return 0.0;
+	// Pixels per microsecond is the same as megapixels per second
+	return static_cast<double>(PixelCount) / static_cast<double>(ElapsedMicroseconds);
+}
+
+double rageam::graphics::ImageEncoderBenchmarkResult::GetMegaPixelsPerSecondPerThread() const
+{
+	return GetMegaPixelsPerSecond() / static_cast<double>(ThreadCount);
+}
+
+bool rageam::graphics::ImageEncoderBenchmark::AddImage(ConstWString path)
+{
+	ImagePtr image = ImageFactory::LoadFromPath(path);
+	if (!image)
+	{
+		AM_ERRF(L"ImageEncoderBenchmark::AddImage() -> Failed to load '%ls'", path);
+		return false;
+	}
+
+	if (ImageIsCompressedFormat(image->GetPixelFormat()))
+		image = ImageCompressor::Decompress(image);
+	else if (image->GetPixelFormat() != ImagePixelFormat_U32)
+		image = image->ConvertPixelFormat(ImagePixelFormat_U32);
+
+	if (!image->CanBeCompressed())
+	{
+		Vec2S uvExtent;
+		image = image->PadToPowerOfTwo(uvExtent);
+	}
+
+	CorpusImage& corpusImage = m_Corpus.Construct();
+	corpusImage.Path = path;
+	corpusImage.Image = image;
+	return true;
+}
+
+void rageam::graphics::ImageEncoderBenchmark::AddDirectory(ConstWString dir, bool recurse)
+{
+	file::EnumerateDirectory(dir, recurse, [&](const WIN32_FIND_DATAW& findData, ConstWString fullPath)
+		{
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				return;
+
+			if (ImageFactory::IsSupportedImageFormat(fullPath))
+				AddImage(fullPath);
+		});
+}
+
+void rageam::graphics::ImageEncoderBenchmark::Run(const ImageEncoderBenchmarkOptions& options)
+{
+	EASY_FUNCTION();
+
+	m_Results.Clear();
+	if (!m_Corpus.Any())
+	{
+		AM_WARNINGF("ImageEncoderBenchmark::Run() -> No images to encode.");
+		return;
+	}
+
+	int maxThreadCount = options.MaxThreadCount > 0 ? options.MaxThreadCount : static_cast<int>(std::thread::hardware_concurrency());
+	List<int> threadCounts;
+	for (int threadCount = 1; threadCount < maxThreadCount; threadCount *= 2)
+		threadCounts.Add(threadCount);
+	threadCounts.Add(maxThreadCount);
+
+	// Every format with every encoder that supports it
+	struct Configuration
+	{
+		BlockFormat			Format;
+		BlockCompressorImpl	EncoderImpl;
+		float				Quality;
+	};
+	List<Configuration> configurations;
+	int qualityStepCount = MAX(options.QualityStepCount, 2);
+	for (int format = BlockFormat_BC1; format <= BlockFormat_BC7; format++)
+	{
+		for (BlockCompressorImpl encoderImpl : { BlockCompressorImpl::bc7enc_rdo, BlockCompressorImpl::icbc })
+		{
+			int supportedFormats = encoderImpl == BlockCompressorImpl::bc7enc_rdo ? IMAGE_BC7ENC_RDO_FORMATS : IMAGE_ICBC_FORMATS;
+			if (!(supportedFormats & 1 << format))
+				continue;
+
+			for (int i = 0; i < qualityStepCount; i++)
+			{
+				float quality = static_cast<float>(i) / static_cast<float>(qualityStepCount - 1);
+				configurations.Add({ static_cast<BlockFormat>(format), encoderImpl, quality });
+			}
+		}
+	}
+
+	u64 corpusPixelCount = 0;
+	for (const CorpusImage& corpusImage : m_Corpus)
+		corpusPixelCount += static_cast<u64>(corpusImage.Image->GetWidth()) * corpusImage.Image->GetHeight();
+	AM_TRACEF("ImageEncoderBenchmark::Run() -> %u images, %.2f megapixels, %u configurations, up to %i threads",
+		m_Corpus.GetSize(), static_cast<double>(corpusPixelCount) / 1000000.0, configurations.GetSize(), maxThreadCount);
+
+	m_Results.Reserve(configurations.GetSize() * threadCounts.GetSize());
+	List<ImagePtr> compressedImages;
+	compressedImages.Resize(m_Corpus.GetSize());
+	for (u32 threadIndex = 0; threadIndex < threadCounts.GetSize(); threadIndex++)
+	{
+		// Compressor schedules block regions on the current worker, so thread count is controlled by pushing our own
+		int threadCount = threadCounts[threadIndex];
+		BackgroundWorker worker("Benchmark", threadCount);
+		BackgroundWorker::Push(&worker);
+
+		for (u32 configurationIndex = 0; configurationIndex < configurations.GetSize(); configurationIndex++)
+		{
+			const Configuration& configuration = configurations[configurationIndex];
+
+			ImageCompressorOptions compressorOptions;
+			compressorOptions.Format = configuration.Format;
+			compressorOptions.CompressorImpl = configuration.EncoderImpl;
+			compressorOptions.Quality = configuration.Quality;
+
+			ImageEncoderBenchmarkResult result = {};
+			result.Format = configuration.Format;
+			result.EncoderImpl = configuration.EncoderImpl;
+			result.Quality = configuration.Quality;
+			result.ThreadCount = threadCount;
+			result.ElapsedMicroseconds = UINT64_MAX;
+
+			for (int run = 0; run < MAX(options.RunCount, 1); run++)
+			{
+				u64 pixelCount = 0;
+				Timer timer = Timer::StartNew();
+				for (u32 i = 0; i < m_Corpus.GetSize(); i++)
+				{
+					CompressedImageInfo compInfo;
+					compressedImages[i] = ImageCompressor::Compress(
+						m_Corpus[i].Image, compressorOptions, nullptr, &compInfo, nullptr, false);
+					if (!compressedImages[i])
+					{
+						AM_ERRF(L"ImageEncoderBenchmark::Run() -> Failed to compress '%ls'", m_Corpus[i].Path.GetCStr());
+						continue;
+					}
+
+					pixelCount += ComputePixelCountWithMips(compInfo.ImageInfo);
+					result.EncoderData_bc7enc_rdo = compInfo.EncoderData_bc7enc_rdo;
+					result.EncoderData_icbc = compInfo.EncoderData_icbc;
+				}
+				timer.Stop();
+
+				result.PixelCount = pixelCount;
+				result.ElapsedMicroseconds = MIN(result.ElapsedMicroseconds, timer.GetElapsedMicroseconds());
+			}
+
+			// Output is the same regardless of thread count
+			if (threadIndex == 0)
+			{
+				QualityStats qualityStats;
+				u32 channelMask = GetFormatChannelMask(configuration.Format);
+				for (u32 i = 0; i < m_Corpus.GetSize(); i++)
+				{
+					const ImagePtr& compressedImage = compressedImages[i];
+					if (!compressedImage)
+						continue;
+
+					int width = compressedImage->GetWidth();
+					int height = compressedImage->GetHeight();
+					PixelDataOwner decodedPixels = ImageDecodeBCToRGBA(
+						compressedImage->GetPixelData(), width, height, compressedImage->GetPixelFormat());
+					AccumulateQuality(
+						reinterpret_cast<const u8*>(m_Corpus[i].Image->GetPixelDataBytes()),
+						reinterpret_cast<const u8*>(decodedPixels.Data()->Bytes), width, height, channelMask, qualityStats);
+				}
+				result.Psnr = qualityStats.GetPsnr();
+				result.Ssim = qualityStats.GetSsim();
+			}
+			else
+			{
+				result.Psnr = m_Results[configurationIndex].Psnr;
+				result.Ssim = m_Results[configurationIndex].Ssim;
+			}
+
+			AM_TRACEF("%s %s Q%.2f %i threads: %.2f MP/s, %.2f MP/s per thread, PSNR %.2f dB, SSIM %.4f",
+				Enum::GetName(result.Format), Enum::GetName(result.EncoderImpl), result.Quality, threadCount,
+				result.GetMegaPixelsPerSecond(), result.GetMegaPixelsPerSecondPerThread(), result.Psnr, result.Ssim);
+
+			m_Results.Add(result);
+		}
+
+		BackgroundWorker::Pop();
+	}
+}
+
+bool rageam::graphics::ImageEncoderBenchmark::SaveResults(ConstWString path) const
+{
+	try
+	{
+		XmlDoc xDoc("EncoderBenchmark");
+		XmlHandle xRoot = xDoc.Root();
+		xRoot.SetAttribute("Version", 0);
+		xRoot.SetAttribute("ImageCount", m_Corpus.GetSize());
+
+		for (const ImageEncoderBenchmarkResult& result : m_Results)
+		{
+			XmlHandle xResult = xRoot.AddChild("Result");
+			xResult.SetAttribute("Format", result.Format);
+			xResult.SetAttribute("Encoder", result.EncoderImpl);
+			xResult.SetAttribute("Quality", result.Quality);
+			if (result.EncoderImpl == BlockCompressorImpl::bc7enc_rdo)
+			{
+				xResult.SetAttribute("RgbxLevel", result.EncoderData_bc7enc_rdo.RgbxLevel);
+				xResult.SetAttribute("RgbxHq345", result.EncoderData_bc7enc_rdo.RgbxHq345);
+				xResult.SetAttribute("Bc7Quality", result.EncoderData_bc7enc_rdo.Bc7Quality);
+			}
+			if (result.EncoderImpl == BlockCompressorImpl::icbc)
+			{
+				xResult.SetAttribute("IcbcQuality", result.EncoderData_icbc.Quality);
+			}
+			xResult.SetAttribute("Threads", result.ThreadCount);
+			xResult.SetAttribute("PixelCount", result.PixelCount);
+			xResult.SetAttribute("ElapsedMicroseconds", result.ElapsedMicroseconds);
+			xResult.SetAttribute("MegaPixelsPerSecond", result.GetMegaPixelsPerSecond());
+			xResult.SetAttribute("MegaPixelsPerSecondPerThread", result.GetMegaPixelsPerSecondPerThread());
+			xResult.SetAttribute("Psnr", result.Psnr);
+			xResult.SetAttribute("Ssim", result.Ssim);
+		}
+
+		xDoc.SaveToFile(path);
+	}
+	catch (const XmlException& ex)
+	{
+		ex.Print();
+		return false;
+	}
+	return true;
+}
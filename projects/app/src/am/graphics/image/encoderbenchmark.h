@@ -0,0 +1,70 @@
+//
+// File: encoderbenchmark.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "bc.h"
+#include "am/file/path.h"
+
+namespace rageam::graphics
+{
+	struct ImageEncoderBenchmarkOptions
+	{
+		int QualityStepCount = 5;	// Qualities are evenly spaced from 0.0 to 1.0, including both
+		int MaxThreadCount = 0;		// Thread counts go in powers of two up to this one, 0 to use all hardware threads
+		int RunCount = 3;			// Every configuration is encoded this many times and the fastest run is reported
+	};
+
+	// Single format / encoder / quality / thread count combination
+	struct ImageEncoderBenchmarkResult
+	{
+		BlockFormat				Format;
+		BlockCompressorImpl		EncoderImpl;
+		float					Quality;
+		// Encoder parameters that quality was mapped to
+		EncoderData_bc7enc_rdo	EncoderData_bc7enc_rdo;
+		EncoderData_icbc		EncoderData_icbc;
+		int						ThreadCount;
+		u64						PixelCount;				// Encoded in a single run, including mip maps
+		u64						ElapsedMicroseconds;	// Of the fastest run
+		// Measured on the first mip against source pixels, only on channels that format stores
+		double					Psnr;
+		double					Ssim;
+
+		double GetMegaPixelsPerSecond() const;
+		double GetMegaPixelsPerSecondPerThread() const;
+	};
+
+	/**
+	 * \brief Measures throughput and quality of every block encoder implementation on a fixed set of images.
+	 * \remarks Images are encoded bypassing image cache, on a separate background worker for every thread count.
+	 * Quality does not depend on thread count and is only measured once per configuration.
+	 */
+	class ImageEncoderBenchmark
+	{
+		struct CorpusImage
+		{
+			file::WPath Path;
+			ImagePtr	Image;
+		};
+
+		List<CorpusImage>					m_Corpus;
+		List<ImageEncoderBenchmarkResult>	m_Results;
+
+	public:
+		// Image is decoded to RGBA up front so file loading is not measured, resolution is padded to power of two if needed
+		bool AddImage(ConstWString path);
+		void AddDirectory(ConstWString dir, bool recurse = false);
+		u32  GetImageCount() const { return m_Corpus.GetSize(); }
+
+		void Run(const ImageEncoderBenchmarkOptions& options);
+
+		const List<ImageEncoderBenchmarkResult>& GetResults() const { return m_Results; }
+		// Writes results to XML file, one element per result
+		bool SaveResults(ConstWString path) const;
+	};
+}
@@ -7,47 +7,18 @@
 #include "am/system/enum.h"
 #include "helpers/dx11.h"
 #include "imagecache.h"
+#include "imagehash.h"
+#include "imageresample.h"
 #include "bc.h"
 
 #include <webp/decode.h>
 #include <webp/encode.h>
 #include <stb_image_write.h>
-#include <stb_image_resize2.h>
 #include <stb_image.h>
 #include <ddraw.h> // DDS
 #include <lunasvg.h>
 #include <easy/profiler.h>
 
-pVoid rageam::graphics::ImageAlloc(u32 size)
-{
-	return malloc(size);
-}
-
-pVoid rageam::graphics::ImageAllocTemp(u32 size)
-{
-	return ImageAlloc(size);
-}
-
-pVoid rageam::graphics::ImageReAlloc(pVoid block, u32 newSize)
-{
-	return realloc(block, newSize);
-}
-
-pVoid rageam::graphics::ImageReAllocTemp(pVoid block, u32 newSize)
-{
-	return ImageReAlloc(block, newSize);
-}
-
-void rageam::graphics::ImageFree(pVoid block)
-{
-	free(block);
-}
-
-void rageam::graphics::ImageFreeTemp(pVoid block)
-{
-	ImageFree(block);
-}
-
 void rageam::graphics::ImageScaleResolution(int wIn, int hIn, int wTo, int hTo, int& wOut, int& hOut, ResolutionScalingMode mode)
 {
 	// Prevent division by zero
@@ -542,7 +513,7 @@ bool rageam::graphics::ImageWriteDDS(ConstWString path, int w, int h, int mips,
 	return true;
 }
 
-bool rageam::graphics::ImageReadStb(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels)
+bool rageam::graphics::ImageReadStb(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels, ImageHasher* pixelHasher)
 {
 	FILE* fs = file::OpenFileStream(path, L"rb");
 	if (!fs)
@@ -569,6 +540,10 @@ bool rageam::graphics::ImageReadStb(ConstWString path, int& w, int& h, ImagePixe
 		}
 		else
 		{
+			// stb doesn't let us hook into decoding scanlines, hash right after while at least the tail is still in cache
+			if (pixelHasher)
+				pixelHasher->Update(pixelData, static_cast<u64>(w) * h * channelCount);
+
 			PixelDataOwner stbiPixelOwner = PixelDataOwner::CreateOwned(pixelData);
 			stbiPixelOwner.DeleteFn = stbi_image_free;
 			*pixels = std::move(stbiPixelOwner);
@@ -589,7 +564,7 @@ bool rageam::graphics::ImageReadStb(ConstWString path, int& w, int& h, ImagePixe
 	return success;
 }
 
-bool rageam::graphics::ImageReadWebp(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels)
+bool rageam::graphics::ImageReadWebp(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels, ImageHasher* pixelHasher)
 {
 	fmt = ImagePixelFormat_U32;
 
@@ -637,12 +612,40 @@ bool rageam::graphics::ImageReadWebp(ConstWString path, int& w, int& h, ImagePix
 	PixelDataOwner pixelDataOwner = PixelDataOwner::AllocateWithSize(slicePitch);
 	char* pixelData = pixelDataOwner.Data()->Bytes;
 
-	if (!WebPDecodeRGBAInto(blobData, blob.Size, reinterpret_cast<u8*>(pixelData), slicePitch, static_cast<int>(rowPitch)))
+	// File is fed to decoder in chunks so we can hash rows right after they were decoded
+	WebPIDecoder* decoder = WebPINewRGB(MODE_RGBA, reinterpret_cast<u8*>(pixelData), slicePitch, static_cast<int>(rowPitch));
+	if (!decoder)
+	{
+		AM_ERRF("ImageReadWebp() -> Failed to create decoder");
+		return false;
+	}
+
+	static constexpr u32 DECODE_CHUNK_SIZE = 64u * 1024u;
+
+	int			 hashedRows = 0;
+	VP8StatusCode status = VP8_STATUS_SUSPENDED;
+	for (u32 offset = 0; offset < blob.Size && status == VP8_STATUS_SUSPENDED; offset += DECODE_CHUNK_SIZE)
+	{
+		status = WebPIAppend(decoder, blobData + offset, MIN(blob.Size - offset, DECODE_CHUNK_SIZE));
+
+		int decodedRows;
+		if (pixelHasher && WebPIDecGetRGB(decoder, &decodedRows, nullptr, nullptr, nullptr) && decodedRows > hashedRows)
+		{
+			pixelHasher->Update(pixelData + static_cast<u64>(hashedRows) * rowPitch, static_cast<u64>(decodedRows - hashedRows) * rowPitch);
+			hashedRows = decodedRows;
+		}
+	}
+	WebPIDelete(decoder);
+
+	if (status != VP8_STATUS_OK)
 	{
 		AM_ERRF("ImageReadWebp() -> Failed to decode pixel data");
 		return false;
 	}
 
+	if (pixelHasher && hashedRows < h)
+		pixelHasher->Update(pixelData + static_cast<u64>(hashedRows) * rowPitch, static_cast<u64>(h - hashedRows) * rowPitch);
+
 	*pixels = pixelDataOwner;
 
 	return true;
@@ -855,22 +858,24 @@ static DXGI_FORMAT GetDDSDXGIFormat(const DDS_PIXELFORMAT& ddpf)
 }
 #undef DDS_ISBITMASK
 
-bool rageam::graphics::ImageReadDDS(ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels)
+// Parses DDS headers from mapped file, pixel data offset is set to the first byte after headers
+static bool ReadDDSHeader(const rageam::file::FileView& view, int& w, int& h, int& mips, rageam::graphics::ImagePixelFormat& fmt, u64& pixelDataOffset)
 {
-	w = 0;
-	h = 0;
-	mips = 0;
-	fmt = ImagePixelFormat_None;
+	using namespace rageam;
+	using namespace rageam::graphics;
 
-	file::FSHandle fs = file::OpenFileStream(path, L"rb");
-	if (!fs)
-	{
-		AM_ERRF("ReadImageDDS() -> Failed to open image file.");
-		return false;
-	}
+	u64 offset = 0;
+	auto readBytes = [&](pVoid dst, u64 size)
+		{
+			if (offset + size > view.Size)
+				return false;
+			memcpy(dst, view.Data + offset, size);
+			offset += size;
+			return true;
+		};
 
 	int magic = 0;
-	file::ReadFileStream(&magic, 4, 4, fs.Get());
+	readBytes(&magic, 4);
 
 	if (magic != FOURCC('D', 'D', 'S', ' '))
 	{
@@ -879,7 +884,7 @@ bool rageam::graphics::ImageReadDDS(ConstWString path, int& w, int& h, int& mips
 	}
 
 	DDS_HEADER header = {};
-	if (!file::ReadFileStream(&header, sizeof DDS_HEADER, sizeof DDS_HEADER, fs.Get()))
+	if (!readBytes(&header, sizeof DDS_HEADER))
 	{
 		AM_ERRF("ReadImageDDS() -> Failed to read header.");
 		return false;
@@ -908,7 +913,7 @@ bool rageam::graphics::ImageReadDDS(ConstWString path, int& w, int& h, int& mips
 	if ((header.ddspf.dwFlags & DDPF_FOURCC) && header.ddspf.dwFourCC == FOURCC('D', 'X', '1', '0'))
 	{
 		DDS_HEADER_DXT10 header10 = {};
-		if (!file::ReadFileStream(&header10, sizeof DDS_HEADER_DXT10, sizeof DDS_HEADER_DXT10, fs.Get()))
+		if (!readBytes(&header10, sizeof DDS_HEADER_DXT10))
 		{
 			AM_ERRF("ReadImageDDS() -> Failed to read extended DX10 header.");
 			return false;
@@ -939,25 +944,64 @@ bool rageam::graphics::ImageReadDDS(ConstWString path, int& w, int& h, int& mips
 		return false;
 	}
 
+	pixelDataOffset = offset;
+	return true;
+}
+
+bool rageam::graphics::ImageReadDDS(ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels, ImageHasher* pixelHasher)
+{
+	w = 0;
+	h = 0;
+	mips = 0;
+	fmt = ImagePixelFormat_None;
+
+	// File is mapped instead of read through stream, for metadata we map only the first page, headers are always there
+	file::FileView view;
+	if (!file::MapFileView(path, view, onlyMeta ? 4096 : 0))
+	{
+		AM_ERRF("ReadImageDDS() -> Failed to open image file.");
+		return false;
+	}
+
+	u64 pixelDataOffset;
+	if (!ReadDDSHeader(view, w, h, mips, fmt, pixelDataOffset))
+	{
+		file::UnmapFileView(view.Data);
+		return false;
+	}
+
 	// No pixel data is required
 	if (onlyMeta)
+	{
+		file::UnmapFileView(view.Data);
 		return true;
+	}
 
 	u32 totalSize = ImageComputeTotalSizeWithMips(w, h, mips, fmt);
-	PixelDataOwner pixelDataOwner = PixelDataOwner::AllocateWithSize(totalSize);
-
-	if (file::ReadFileStream(pixelDataOwner.Data()->Bytes, totalSize, totalSize, fs.Get()) != totalSize)
+	if (pixelDataOffset + totalSize > view.Size)
 	{
 		AM_ERRF("ReadImageDDS() -> Failed to read pixel data, file is corrupted.");
+		file::UnmapFileView(view.Data);
 		return false;
 	}
 
+	if (pixelHasher)
+		pixelHasher->Update(view.Data + pixelDataOffset, ImageComputeSlicePitch(w, h, fmt));
+
+	// Pixel data is copied out and view is unmapped right away, image may live in cache for long time and mapped
+	// file can't be overwritten by external editors (ERROR_USER_MAPPED_FILE)
+	PixelDataOwner pixelDataOwner = PixelDataOwner::AllocateWithSize(totalSize);
+	memcpy(pixelDataOwner.Data()->Bytes, view.Data + pixelDataOffset, totalSize);
+	file::UnmapFileView(view.Data);
+
 	*pixels = pixelDataOwner;
 
 	return true;
 }
 
-bool rageam::graphics::ImageRead(ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, ImageFileKind* outKind, bool onlyMeta, PixelDataOwner* outPixels)
+bool rageam::graphics::ImageRead(
+	ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, ImageFileKind* outKind, bool onlyMeta, PixelDataOwner* outPixels,
+	ImageHasher* pixelHasher)
 {
 	EASY_FUNCTION();
 
@@ -978,17 +1022,17 @@ bool rageam::graphics::ImageRead(ConstWString path, int& w, int& h, int& mips, I
 	case Hash("bmp"):	kind = ImageKind_BMP;	goto stb;
 	case Hash("psd"):	kind = ImageKind_PSD;	goto stb;
 	stb:
-		success = ImageReadStb(path, w, h, fmt, onlyMeta, outPixels);
+		success = ImageReadStb(path, w, h, fmt, onlyMeta, outPixels, pixelHasher);
 		break;
 
 	case Hash("webp"):
 		kind = ImageKind_WEBP;
-		success = ImageReadWebp(path, w, h, fmt, onlyMeta, outPixels);
+		success = ImageReadWebp(path, w, h, fmt, onlyMeta, outPixels, pixelHasher);
 		break;
 
 	case Hash("dds"):
 		kind = ImageKind_DDS;
-		success = ImageReadDDS(path, w, h, mips, fmt, onlyMeta, outPixels);
+		success = ImageReadDDS(path, w, h, mips, fmt, onlyMeta, outPixels, pixelHasher);
 		break;
 
 	default:
@@ -1001,6 +1045,13 @@ bool rageam::graphics::ImageRead(ConstWString path, int& w, int& h, int& mips, I
 	return success;
 }
 
+u64 rageam::graphics::ImageComputeContentHash(u64 pixelHash, int w, int h, ImagePixelFormat fmt)
+{
+	// Mip count is not included, mips are generated from the first one anyway
+	int info[] = { w, h, fmt };
+	return ImageHasher::Compute(info, sizeof info, pixelHash);
+}
+
 bool rageam::graphics::ImageWrite(ConstWString path, int w, int h, int mips, ImagePixelFormat fmt, const PixelDataOwner& pixelData, ImageFileKind kind, float quality)
 {
 	EASY_FUNCTION();
@@ -1057,255 +1108,385 @@ void rageam::graphics::ImageResize(
 		return;
 	}
 
-	stbir_filter irFilter;
-	switch (filter)
-	{
-	case ResizeFilter_Box:			irFilter = STBIR_FILTER_BOX;			break;
-	case ResizeFilter_Triangle:		irFilter = STBIR_FILTER_TRIANGLE;		break;
-	case ResizeFilter_CubicBSpline: irFilter = STBIR_FILTER_CUBICBSPLINE;	break;
-	case ResizeFilter_CatmullRom:	irFilter = STBIR_FILTER_CATMULLROM;		break;
-	case ResizeFilter_Mitchell:		irFilter = STBIR_FILTER_MITCHELL;		break;
-	case ResizeFilter_Point:		irFilter = STBIR_FILTER_POINT_SAMPLE;	break;
-
-	default: AM_UNREACHABLE("ResizeImagePixels() -> Filter %s is not implemented.", Enum::GetName(filter));
-	}
-
-	stbir_pixel_layout irPixelLayout;
+	int channelCount;
 	switch (fmt)
 	{
-	case ImagePixelFormat_U32:	irPixelLayout = hasAlphaPixels ? STBIR_RGBA : STBIR_4CHANNEL;	break;
-	case ImagePixelFormat_U24:	irPixelLayout = STBIR_RGB;										break;
-	case ImagePixelFormat_U16:	irPixelLayout = hasAlphaPixels ? STBIR_RA : STBIR_2CHANNEL;		break;
-	case ImagePixelFormat_U8:	irPixelLayout = STBIR_1CHANNEL;									break;
+	case ImagePixelFormat_U32:	channelCount = 4;	break;
+	case ImagePixelFormat_U24:	channelCount = 3;	break;
+	case ImagePixelFormat_U16:	channelCount = 2;	break;
+	case ImagePixelFormat_U8:	channelCount = 1;	break;
 
 	default: AM_UNREACHABLE("ResizeImagePixels() -> Pixel format '%s' is not supported.", Enum::GetName(fmt));
 	}
 
-	stbir_resize(src, xFrom, yFrom, 0, dst, xTo, yTo, 0, irPixelLayout, STBIR_TYPE_UINT8, STBIR_EDGE_CLAMP, irFilter);
+	// Colors are weighted by alpha only if there's any transparency, otherwise it's just waste of time
+	ImageResample(
+		static_cast<u8*>(dst), static_cast<const u8*>(src), channelCount, xFrom, yFrom, xTo, yTo, filter, hasAlphaPixels);
 }
 
-char* rageam::graphics::ImageGetPixel(char* pixelData, int x, int y, int width, ImagePixelFormat fmt)
+bool rageam::graphics::ImageCanGenerateMipChain(ResizeFilter filter, ImagePixelFormat fmt)
 {
-	AM_ASSERT(!ImageIsCompressedFormat(fmt), "ImageGetPixel() -> Compressed format '%s' is not supported.", Enum::GetName(fmt));
-	u32 pixelPitch = ImagePixelFormatBitsPerPixel[fmt] / 8;
-	u32 rowPitch = width * pixelPitch;
-	return pixelData + static_cast<size_t>(rowPitch * y + x * pixelPitch);
+	return fmt == ImagePixelFormat_U32 && (filter == ResizeFilter_Box || filter == ResizeFilter_Triangle);
 }
 
-rageam::graphics::ColorU32 rageam::graphics::ImageGetPixelColor(char* pixelData, int x, int y, int width, ImagePixelFormat fmt)
+// Weight of fully transparent pixel when colors are weighted by alpha, keeps color defined in fully transparent areas
+static constexpr float IMAGE_MIP_ALPHA_WEIGHT_BIAS = 1.0f / 256.0f;
+// Linear to sRGB table resolution, enough to keep the error below half of 8 bit step
+static constexpr int IMAGE_MIP_LINEAR_TO_SRGB_SIZE = 4096;
+
+struct ImageMipSrgbTables
 {
-	if (!ImageIsCompressedFormat(fmt))
+	float SrgbToLinear[256];
+	u8	  LinearToSrgb[IMAGE_MIP_LINEAR_TO_SRGB_SIZE];
+
+	ImageMipSrgbTables()
 	{
-		u8* pixels = reinterpret_cast<u8*>(ImageGetPixel(pixelData, x, y, width, fmt));
-		switch (fmt)
+		for (int i = 0; i < 256; i++)
 		{
-		case ImagePixelFormat_U32:	return *reinterpret_cast<u32*>(pixels);
-		case ImagePixelFormat_U24:	return ColorU32(pixels[0], pixels[1], pixels[2]);
-		case ImagePixelFormat_U16:	return ColorU32(pixels[0], pixels[0], pixels[0], pixels[1]);
-		case ImagePixelFormat_U8:	return ColorU32(pixels[0], pixels[0], pixels[0]);
-		case ImagePixelFormat_A8:	return ColorU32(pixels[0], pixels[0], pixels[0], pixels[0]);
-
-		default: return 0;
+			float c = static_cast<float>(i) / 255.0f;
+			SrgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < IMAGE_MIP_LINEAR_TO_SRGB_SIZE; i++)
+		{
+			float c = static_cast<float>(i) / static_cast<float>(IMAGE_MIP_LINEAR_TO_SRGB_SIZE - 1);
+			float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+			LinearToSrgb[i] = static_cast<u8>(s * 255.0f + 0.5f);
 		}
 	}
 
-	// For compressed formats we have to decode whole 4x4 block and lookup our pixel from there
-	int blockX = x / 4;
-	int blockY = y / 4;
-	int subX = x % 4;
-	int subY = y % 4;
-
-	int totalBlocksX = width / 4;
+	static const ImageMipSrgbTables& Get()
+	{
+		static const ImageMipSrgbTables s_Tables;
+		return s_Tables;
+	}
+};
 
-	u32 blockWidth = BlockFormatToBlockSize[ImagePixelFormatToBlockFormat(fmt)];
-	u32 rowPitch = totalBlocksX * blockWidth;
+struct ImageMipLevel
+{
+	u8* Pixels;
+	int	Width;
+	int	Height;
+	int	ReadyRows;	// Rows that were already computed and can be sampled by the next mip
+};
 
-	char* encodedBlock = pixelData + static_cast<size_t>(blockY * rowPitch + blockX * blockWidth);
+struct ImageMipChain
+{
+	rageam::graphics::ImageMipChainOptions	Options;
+	ImageMipLevel							Levels[rageam::graphics::IMAGE_MAX_MIP_MAPS];
+	int										LevelCount;
+	const ImageMipSrgbTables*				SrgbTables;
+	float*									RowBuffer;	// Vertically filtered source row, 4 floats per pixel
+	bool									Fast;		// Plain 2x2 box on 8 bit values, no conversion to floats
+};
 
-	ColorU32 decodedPixels[16];
-	ImageCompressor::DecompressBlock(encodedBlock, reinterpret_cast<char*>(decodedPixels), fmt);
+// Tent filter for exact 2x reduction is [1 3 3 1] / 8, box is [1 1] / 2
+// Source row / column indices for destination pixel are clamped to the edge
+static int ImageMipGetTaps(const ImageMipChain& chain, int dstIndex, int srcSize, int* outIndices, float* outWeights)
+{
+	if (chain.Options.Filter == rageam::graphics::ResizeFilter_Triangle)
+	{
+		static constexpr float weights[] = { 1.0f / 8.0f, 3.0f / 8.0f, 3.0f / 8.0f, 1.0f / 8.0f };
+		for (int i = 0; i < 4; i++)
+		{
+			outIndices[i] = std::clamp(dstIndex * 2 - 1 + i, 0, srcSize - 1);
+			outWeights[i] = weights[i];
+		}
+		return 4;
+	}
 
-	return decodedPixels[subY * 4 + subX];
+	outIndices[0] = MIN(dstIndex * 2, srcSize - 1);
+	outIndices[1] = MIN(dstIndex * 2 + 1, srcSize - 1);
+	outWeights[0] = 0.5f;
+	outWeights[1] = 0.5f;
+	return 2;
 }
 
-void rageam::graphics::ImageConvertPixelFormat(pVoid dst, pVoid src, ImagePixelFormat fromFmt, ImagePixelFormat toFmt, int width, int height)
+// Exact rounded average of 2x2 pixels, processes whole row of destination mip
+static void ImageMipDownsampleRowBox(u8* dst, const u8* srcRow0, const u8* srcRow1, int srcWidth, int dstWidth)
 {
-	EASY_FUNCTION();
-
-	AM_ASSERT(!ImageIsCompressedFormat(fromFmt) && !ImageIsCompressedFormat(toFmt), "ConvertImagePixels() -> BC Formats are not supported!");
-
-	ImagePixelData srcData = static_cast<ImagePixelData>(src);
-	ImagePixelData dstData = static_cast<ImagePixelData>(dst);
-
-	int totalPixels = width * height;
-
-	char* srcXmm = srcData->Bytes;
-	char* dstXmm = dstData->Bytes;
-
-	int remainderPixels = totalPixels;
-	int pixelsXmm = 0;
+	int x = 0;
 
-	// RGBA -> RGB
-	if (fromFmt == ImagePixelFormat_U32 && toFmt == ImagePixelFormat_U24)
+	// Source width is always twice the destination here unless mip is 1 pixel wide, which falls to scalar loop
+	if (srcWidth == dstWidth * 2)
 	{
 #ifdef AM_IMAGE_USE_AVX2
-		if (totalPixels > 8) // We can't process less than 8 pixels with xmm
+		const __m256i zero256 = _mm256_setzero_si256();
+		const __m256i two256 = _mm256_set1_epi16(2);
+		for (; x + 8 <= dstWidth; x += 8)
 		{
-			remainderPixels = totalPixels % 8;
-			pixelsXmm = totalPixels - remainderPixels;
-
-			// We convert every 8 RGBA pixels (256 bits) to 8 RGB pixels (192 bits)
-			// xmm store function will still write all 256 bits with 64 bit padding at the end
-			if (remainderPixels < 2)
-			{
-				pixelsXmm -= 8;
-				remainderPixels += 8;
-			}
+			const u8* src0 = srcRow0 + static_cast<size_t>(x) * 8;
+			const u8* src1 = srcRow1 + static_cast<size_t>(x) * 8;
 
-			// Load 8 pixels at a time
-			int xmmGroupCount = pixelsXmm / 8;
-			for (int i = 0; i < xmmGroupCount; i++)
+			__m256i sums[2];
+			for (int i = 0; i < 2; i++)
 			{
-				__m256i eightPixelsRGBA = _mm256_loadu_si256(reinterpret_cast<__m256i*>(srcXmm));
-				__m256i eightPixelsRGB = _mm256_shuffle_epi8(eightPixelsRGBA, IMAGE_RGBA_TO_RGB_SHUFFLE_256);
-
-				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dstXmm), eightPixelsRGB);
-
-				srcXmm += 32; // sizeof(RGBA) * 8 pixels
-				dstXmm += 24; // sizeof(RGB) * 8 pixels
+				__m256i row0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src0 + i * 32));
+				__m256i row1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1 + i * 32));
+				// Per 128 bit lane: [p0 p1 | p4 p5] and [p2 p3 | p6 p7] as U16, summed vertically
+				__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(row0, zero256), _mm256_unpacklo_epi8(row1, zero256));
+				__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(row0, zero256), _mm256_unpackhi_epi8(row1, zero256));
+				// Horizontal pairs: [p0+p1 p2+p3 | p4+p5 p6+p7]
+				__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+				sums[i] = _mm256_srli_epi16(_mm256_add_epi16(sum, two256), 2);
 			}
+			// Pack works per lane, giving [d0 d1 d4 d5 | d2 d3 d6 d7], restore the order
+			__m256i packed = _mm256_packus_epi16(sums[0], sums[1]);
+			packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + static_cast<size_t>(x) * 4), packed);
 		}
-#elif defined AM_IMAGE_USE_SIMD
-		if (totalPixels > 4) // We can't process less than 8 pixels with xmm
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (; x + 4 <= dstWidth; x += 4)
 		{
-			remainderPixels = totalPixels % 4;
-			pixelsXmm = totalPixels - remainderPixels;
+			const u8* src0 = srcRow0 + static_cast<size_t>(x) * 8;
+			const u8* src1 = srcRow1 + static_cast<size_t>(x) * 8;
 
-			// We convert every 4 RGBA pixels (128 bits) to 4 RGB pixels (96 bits)
-			// xmm store function will still write all 128 bits with 32 bit padding at the end
-			if (remainderPixels < 1)
+			__m128i sums[2];
+			for (int i = 0; i < 2; i++)
 			{
-				pixelsXmm -= 4;
-				remainderPixels += 4;
-			}
-
-			// Load 4 pixels at a time
-			int xmmGroupCount = pixelsXmm / 4;
-			for (int i = 0; i < xmmGroupCount; i++)
-			{
-				__m128i eightPixelsRGBA = _mm_loadu_si128(reinterpret_cast<__m128i*>(srcXmm));
-				__m128i eightPixelsRGB = _mm_shuffle_epi8(eightPixelsRGBA, IMAGE_RGBA_TO_RGB_SHUFFLE);
-
-				_mm_storeu_si128(reinterpret_cast<__m128i*>(dstXmm), eightPixelsRGB);
-
-				srcXmm += 16; // sizeof(RGBA) * 4 pixels
-				dstXmm += 12; // sizeof(RGB) * 4 pixels
+				__m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + i * 16));
+				__m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + i * 16));
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				sums[i] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
 			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + static_cast<size_t>(x) * 4), _mm_packus_epi16(sums[0], sums[1]));
 		}
 #endif
+	}
 
-		// And then remainders without intrinsics (or all if intrinsics weren't enabled)
-		for (int i = 0; i < remainderPixels; i++)
-		{
-			int k = pixelsXmm + i;
-			dstData->U24[k][0] = srcData->U32[k][0];	// R
-			dstData->U24[k][1] = srcData->U32[k][1];	// G
-			dstData->U24[k][2] = srcData->U32[k][2];	// B
-		}
+	for (; x < dstWidth; x++)
+	{
+		int x0 = MIN(x * 2, srcWidth - 1) * 4;
+		int x1 = MIN(x * 2 + 1, srcWidth - 1) * 4;
+		for (int c = 0; c < 4; c++)
+			dst[x * 4 + c] = static_cast<u8>((srcRow0[x0 + c] + srcRow0[x1 + c] + srcRow1[x0 + c] + srcRow1[x1 + c] + 2) >> 2);
+	}
+}
 
-		return;
+// Converts pixel to linear float RGBA, with color weighted by alpha if needed
+static __m128 ImageMipLoadPixel(const ImageMipChain& chain, const u8* pixel)
+{
+	__m128 value;
+	if (chain.Options.GammaCorrect)
+	{
+		const float* toLinear = chain.SrgbTables->SrgbToLinear;
+		value = _mm_set_ps(static_cast<float>(pixel[3]) / 255.0f, toLinear[pixel[2]], toLinear[pixel[1]], toLinear[pixel[0]]);
+	}
+	else
+	{
+		u32 packed;
+		memcpy(&packed, pixel, sizeof u32);
+		__m128i zero = _mm_setzero_si128();
+		__m128i value32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(packed)), zero), zero);
+		value = _mm_mul_ps(_mm_cvtepi32_ps(value32), _mm_set1_ps(1.0f / 255.0f));
 	}
 
-	// RGB - RGBA
-	if (fromFmt == ImagePixelFormat_U24 && toFmt == ImagePixelFormat_U32)
+	if (chain.Options.AlphaWeighted)
 	{
-#ifdef AM_IMAGE_USE_SIMD
-		// We load 4 RGB pixels and shuffle them with white alpha to RGBA
-		if (totalPixels > 4)
-		{
-			remainderPixels = totalPixels % 4;
-			pixelsXmm = totalPixels - remainderPixels;
+		float weight = static_cast<float>(pixel[3]) / 255.0f + IMAGE_MIP_ALPHA_WEIGHT_BIAS;
+		value = _mm_mul_ps(value, _mm_set_ps(1.0f, weight, weight, weight));
+	}
+	return value;
+}
 
-			int xmmGroupCount = pixelsXmm / 4;
-			for (int i = 0; i < xmmGroupCount; i++)
-			{
-				__m128i fourPixelsRGB = _mm_loadu_epi8(srcXmm);
-				__m128i fourPixelsRGBA = _mm_shuffle_epi8(fourPixelsRGB, IMAGE_RGB_TO_RGBA_SHUFFLE);
-				// Set RGBA alpha to 255
-				fourPixelsRGBA = _mm_or_epi32(fourPixelsRGBA, IMAGE_RGBA_ALPHA_MASK);
+static void ImageMipStorePixel(const ImageMipChain& chain, u8* pixel, __m128 value)
+{
+	alignas(16) float rgba[4];
+	_mm_store_ps(rgba, value);
 
-				_mm_storeu_si128(reinterpret_cast<__m128i*>(dstXmm), fourPixelsRGBA);
+	// Weights of all taps add up to 1, so sum of color weights is (average alpha + bias)
+	if (chain.Options.AlphaWeighted)
+	{
+		float invWeight = 1.0f / (rgba[3] + IMAGE_MIP_ALPHA_WEIGHT_BIAS);
+		rgba[0] *= invWeight;
+		rgba[1] *= invWeight;
+		rgba[2] *= invWeight;
+	}
 
-				srcXmm += 12; // sizeof(RGB) * 4 pixels
-				dstXmm += 16; // sizeof(RGBA) * 4 pixels
-			}
+	if (chain.Options.GammaCorrect)
+	{
+		const u8* toSrgb = chain.SrgbTables->LinearToSrgb;
+		for (int c = 0; c < 3; c++)
+		{
+			int index = static_cast<int>(rgba[c] * (IMAGE_MIP_LINEAR_TO_SRGB_SIZE - 1) + 0.5f);
+			pixel[c] = toSrgb[std::clamp(index, 0, IMAGE_MIP_LINEAR_TO_SRGB_SIZE - 1)];
 		}
+	}
+	else
+	{
+		for (int c = 0; c < 3; c++)
+			pixel[c] = static_cast<u8>(std::clamp(static_cast<int>(rgba[c] * 255.0f + 0.5f), 0, 255));
+	}
+	pixel[3] = static_cast<u8>(std::clamp(static_cast<int>(rgba[3] * 255.0f + 0.5f), 0, 255));
+}
 
-#endif
-		// And then remainders without intrinsics
-		for (int i = 0; i < remainderPixels; i++)
-		{
-			int k = pixelsXmm + i;
-			dstData->U32[k][0] = srcData->U24[k][0];	// R
-			dstData->U32[k][1] = srcData->U24[k][1];	// G
-			dstData->U32[k][2] = srcData->U24[k][2];	// B
-			dstData->U32[k][3] = 255;					// A
-		}
+// Tent filter and gamma / alpha weighted averaging, separable: source rows are filtered vertically first, then horizontally
+static void ImageMipDownsampleRowFloat(const ImageMipChain& chain, const ImageMipLevel& src, ImageMipLevel& dst, int dstY)
+{
+	int	  tapIndices[4];
+	float tapWeights[4];
+	int	  rowTapCount = ImageMipGetTaps(chain, dstY, src.Height, tapIndices, tapWeights);
 
-		return;
+	const u8* srcRows[4];
+	__m128	  rowWeights[4];
+	for (int i = 0; i < rowTapCount; i++)
+	{
+		srcRows[i] = src.Pixels + static_cast<size_t>(tapIndices[i]) * src.Width * 4;
+		rowWeights[i] = _mm_set1_ps(tapWeights[i]);
+	}
+
+	float* rowBuffer = chain.RowBuffer;
+	for (int x = 0; x < src.Width; x++)
+	{
+		__m128 sum = _mm_setzero_ps();
+		for (int i = 0; i < rowTapCount; i++)
+			sum = _mm_add_ps(sum, _mm_mul_ps(ImageMipLoadPixel(chain, srcRows[i] + static_cast<size_t>(x) * 4), rowWeights[i]));
+		_mm_storeu_ps(rowBuffer + static_cast<size_t>(x) * 4, sum);
 	}
 
-	// Gray Alpha -> RGBA
-	if (fromFmt == ImagePixelFormat_U16 && toFmt == ImagePixelFormat_U32)
+	u8* dstRow = dst.Pixels + static_cast<size_t>(dstY) * dst.Width * 4;
+	for (int x = 0; x < dst.Width; x++)
 	{
-		for (int i = 0; i < remainderPixels; i++)
+		int columnTapCount = ImageMipGetTaps(chain, x, src.Width, tapIndices, tapWeights);
+		__m128 sum = _mm_setzero_ps();
+		for (int i = 0; i < columnTapCount; i++)
 		{
-			int k = pixelsXmm + i;
-			dstData->U32[k][0] = srcData->U16[k][0];	// R
-			dstData->U32[k][1] = srcData->U16[k][0];	// G
-			dstData->U32[k][2] = srcData->U16[k][0];	// B
-			dstData->U32[k][3] = srcData->U16[k][1];	// A
+			__m128 column = _mm_loadu_ps(rowBuffer + static_cast<size_t>(tapIndices[i]) * 4);
+			sum = _mm_add_ps(sum, _mm_mul_ps(column, _mm_set1_ps(tapWeights[i])));
 		}
-		return;
+		ImageMipStorePixel(chain, dstRow + static_cast<size_t>(x) * 4, sum);
 	}
+}
+
+// Computes every row of the next mip that depends only on rows of this mip that are ready,
+// this way rows that were just written are sampled right away while they're still in cache
+static void ImageMipOnRowsReady(ImageMipChain& chain, int levelIndex)
+{
+	if (levelIndex + 1 >= chain.LevelCount)
+		return;
 
-	// Gray -> RGB
-	if (fromFmt == ImagePixelFormat_U8 && toFmt == ImagePixelFormat_U24)
+	ImageMipLevel& src = chain.Levels[levelIndex];
+	ImageMipLevel& dst = chain.Levels[levelIndex + 1];
+	int lastTapOffset = chain.Options.Filter == rageam::graphics::ResizeFilter_Triangle ? 2 : 1;
+	while (dst.ReadyRows < dst.Height)
 	{
-		for (int i = 0; i < remainderPixels; i++)
+		int dstY = dst.ReadyRows;
+		int lastSrcY = MIN(dstY * 2 + lastTapOffset, src.Height - 1);
+		if (lastSrcY >= src.ReadyRows)
+			break;
+
+		if (chain.Fast)
 		{
-			int k = pixelsXmm + i;
-			dstData->U24[k][0] = srcData->U8[k][0];	// R
-			dstData->U24[k][1] = srcData->U8[k][0];	// G
-			dstData->U24[k][2] = srcData->U8[k][0];	// B
+			const u8* srcRow0 = src.Pixels + static_cast<size_t>(MIN(dstY * 2, src.Height - 1)) * src.Width * 4;
+			const u8* srcRow1 = src.Pixels + static_cast<size_t>(MIN(dstY * 2 + 1, src.Height - 1)) * src.Width * 4;
+			u8*		  dstRow = dst.Pixels + static_cast<size_t>(dstY) * dst.Width * 4;
+			ImageMipDownsampleRowBox(dstRow, srcRow0, srcRow1, src.Width, dst.Width);
 		}
+		else
+		{
+			ImageMipDownsampleRowFloat(chain, src, dst, dstY);
+		}
+
+		dst.ReadyRows++;
+		ImageMipOnRowsReady(chain, levelIndex + 1);
+	}
+}
+
+void rageam::graphics::ImageGenerateMipChainRGBA(char* pixels, int width, int height, int mipCount, const ImageMipChainOptions& options)
+{
+	EASY_FUNCTION();
+
+	AM_ASSERT(ImageCanGenerateMipChain(options.Filter, ImagePixelFormat_U32),
+		"ImageGenerateMipChainRGBA() -> Filter %s is not supported.", Enum::GetName(options.Filter));
+	AM_ASSERT(mipCount <= IMAGE_MAX_MIP_MAPS, "ImageGenerateMipChainRGBA() -> Too many mip maps (%i)", mipCount);
+
+	if (mipCount <= 1)
 		return;
+
+	ImageScratchScope scratchScope;
+
+	ImageMipChain chain;
+	chain.Options = options;
+	chain.LevelCount = mipCount;
+	chain.Fast = options.Filter == ResizeFilter_Box && !options.GammaCorrect && !options.AlphaWeighted;
+	chain.SrgbTables = options.GammaCorrect ? &ImageMipSrgbTables::Get() : nullptr;
+	chain.RowBuffer = chain.Fast ? nullptr : static_cast<float*>(ImageAllocTemp(width * 4 * sizeof(float)));
+
+	u8* levelPixels = reinterpret_cast<u8*>(pixels);
+	for (int i = 0; i < mipCount; i++)
+	{
+		ImageMipLevel& level = chain.Levels[i];
+		level.Pixels = levelPixels;
+		level.Width = MAX(width >> i, 1);
+		level.Height = MAX(height >> i, 1);
+		level.ReadyRows = 0;
+		levelPixels += static_cast<size_t>(level.Width) * level.Height * 4;
+	}
+
+	// First mip is already there, feed it row by row
+	ImageMipLevel& firstLevel = chain.Levels[0];
+	for (int y = 0; y < height; y++)
+	{
+		firstLevel.ReadyRows++;
+		ImageMipOnRowsReady(chain, 0);
 	}
+}
+
+char* rageam::graphics::ImageGetPixel(char* pixelData, int x, int y, int width, ImagePixelFormat fmt)
+{
+	AM_ASSERT(!ImageIsCompressedFormat(fmt), "ImageGetPixel() -> Compressed format '%s' is not supported.", Enum::GetName(fmt));
+	u32 pixelPitch = ImagePixelFormatBitsPerPixel[fmt] / 8;
+	u32 rowPitch = width * pixelPitch;
+	return pixelData + static_cast<size_t>(rowPitch * y + x * pixelPitch);
+}
 
-	// Gray -> RGBA
-	if (fromFmt == ImagePixelFormat_U8 && toFmt == ImagePixelFormat_U32)
+rageam::graphics::ColorU32 rageam::graphics::ImageGetPixelColor(char* pixelData, int x, int y, int width, ImagePixelFormat fmt)
+{
+	if (!ImageIsCompressedFormat(fmt))
 	{
-		for (int i = 0; i < remainderPixels; i++)
+		u8* pixels = reinterpret_cast<u8*>(ImageGetPixel(pixelData, x, y, width, fmt));
+		switch (fmt)
 		{
-			int k = pixelsXmm + i;
-			dstData->U32[k][0] = srcData->U8[k][0];	// R
-			dstData->U32[k][1] = srcData->U8[k][0];	// G
-			dstData->U32[k][2] = srcData->U8[k][0];	// B
-			dstData->U32[k][3] = srcData->U8[k][0];	// A
+		case ImagePixelFormat_U32:	return *reinterpret_cast<u32*>(pixels);
+		case ImagePixelFormat_U24:	return ColorU32(pixels[0], pixels[1], pixels[2]);
+		case ImagePixelFormat_U16:	return ColorU32(pixels[0], pixels[0], pixels[0], pixels[1]);
+		case ImagePixelFormat_U8:	return ColorU32(pixels[0], pixels[0], pixels[0]);
+		case ImagePixelFormat_A8:	return ColorU32(pixels[0], pixels[0], pixels[0], pixels[0]);
+
+		default: return 0;
 		}
-		return;
 	}
 
-	AM_UNREACHABLE("ConvertImagePixels() -> Conversion from '%s' to '%s' is not implemented.",
-		Enum::GetName(fromFmt), Enum::GetName(toFmt));
+	// For compressed formats we have to decode whole 4x4 block and lookup our pixel from there
+	int blockX = x / 4;
+	int blockY = y / 4;
+	int subX = x % 4;
+	int subY = y % 4;
+
+	int totalBlocksX = width / 4;
+
+	u32 blockWidth = BlockFormatToBlockSize[ImagePixelFormatToBlockFormat(fmt)];
+	u32 rowPitch = totalBlocksX * blockWidth;
+
+	char* encodedBlock = pixelData + static_cast<size_t>(blockY * rowPitch + blockX * blockWidth);
+
+	ColorU32 decodedPixels[16];
+	ImageCompressor::DecompressBlock(encodedBlock, reinterpret_cast<char*>(decodedPixels), fmt);
+
+	return decodedPixels[subY * 4 + subX];
 }
 
 void rageam::graphics::ImageFlipY(char* pixels, int width, int height, ImagePixelFormat fmt)
 {
 	EASY_FUNCTION();
 
+	ImageScratchScope scratchScope;
 	size_t rowPitch = ImageComputeRowPitch(width, fmt);
-	pVoid scanlineBuffer = ImageAlloc(rowPitch);
+	pVoid scanlineBuffer = ImageAllocTemp(rowPitch);
 
 	int halfHeight = height / 2;
 	for (int y = 0; y < halfHeight; y++)
@@ -1317,8 +1498,6 @@ void rageam::graphics::ImageFlipY(char* pixels, int width, int height, ImagePixe
 		memcpy(topLine, endLine, rowPitch);
 		memcpy(endLine, scanlineBuffer, rowPitch);
 	}
-
-	ImageFree(scanlineBuffer);
 }
 
 void rageam::graphics::ImageDoSwizzle(
@@ -1377,136 +1556,6 @@ void rageam::graphics::ImageDoSwizzle(
 	}
 }
 
-void rageam::graphics::ImageAdjustBrightnessAndContrastRGBA(char* pixelData, int width, int height, int brightness, int contrast)
-{
-	EASY_FUNCTION();
-
-	if (brightness == 0 && contrast == 0)
-		return;
-
-	// Contrast equation:
-	// ContrastFactor = (259 * (Color + 255)) / (255 * (259 -c))
-	// Color = ContrastFactor * (Color - 128) + 128
-
-	bool  hasContrast = contrast != 0;
-	bool  hasBrightness = brightness != 0;
-	float contrastFactor = 259.0f * ((float)contrast + 255.0f) / (255.0f * (259.0f - (float)contrast));
-
-	ColorU32* pixels = reinterpret_cast<ColorU32*>(pixelData);
-
-	int totalPixels = width * height;
-	int remainderPixels = totalPixels;
-	int pixelsXmm = 0;
-
-#ifdef AM_IMAGE_USE_SIMD
-	if (totalPixels > 4)
-	{
-		remainderPixels = totalPixels % 4;
-		pixelsXmm = totalPixels - remainderPixels;
-
-		// Shuffle for unpacking every U32 pixel to 4 floats
-		__m128i _bytesToFloatsShuffle[4] =
-		{
-			_mm_set_epi8(-128, -128, -128, 3,  /**/ -128, -128, -128, 2,  /**/ -128, -128, -128, 1,  /**/ -128, -128, -128, 0),
-			_mm_set_epi8(-128, -128, -128, 7,  /**/ -128, -128, -128, 6,  /**/ -128, -128, -128, 5,  /**/ -128, -128, -128, 4),
-			_mm_set_epi8(-128, -128, -128, 11, /**/ -128, -128, -128, 10, /**/ -128, -128, -128, 9,  /**/ -128, -128, -128, 8),
-			_mm_set_epi8(-128, -128, -128, 15, /**/ -128, -128, -128, 14, /**/ -128, -128, -128, 13, /**/ -128, -128, -128, 12),
-		};
-		__m128i _floatsToBytesShuffle[4] =
-		{
-			_mm_set_epi8(-128, -128, -128, -128, /**/ -128, -128, -128, -128, /**/ -128, -128, -128, -128, /**/ 12, 8, 4, 0),
-			_mm_set_epi8(-128, -128, -128, -128, /**/ -128, -128, -128, -128, /**/ 12, 8, 4, 0,            /**/ -128, -128, -128, -128),
-			_mm_set_epi8(-128, -128, -128, -128, /**/ 12, 8, 4, 0,            /**/ -128, -128, -128, -128, /**/ -128, -128, -128, -128),
-			_mm_set_epi8(12, 8, 4, 0,            /**/ -128, -128, -128, -128, /**/ -128, -128, -128, -128, /**/ -128, -128, -128, -128),
-		};
-		__m128i _keepPixelMasks[4] =
-		{
-			_mm_set_epi8(0, 0, 0, 0,     /**/ 0, 0, 0, 0,     /**/ 0, 0, 0, 0,     /**/ -1, -1, -1, -1),
-			_mm_set_epi8(0, 0, 0, 0,     /**/ 0, 0, 0, 0,     /**/ -1, -1, -1, -1, /**/ 0, 0, 0, 0),
-			_mm_set_epi8(0, 0, 0, 0,     /**/ -1, -1, -1, -1, /**/ 0, 0, 0, 0,     /**/ 0, 0, 0, 0),
-			_mm_set_epi8(-1, -1, -1, -1, /**/ 0, 0, 0, 0,     /**/ 0, 0, 0, 0,     /**/ 0, 0, 0, 0),
-		};
-		__m128i _erasePixelMasks[4] = // We keep alpha here because contrast shouldn't change it
-		{
-			_mm_set_epi8(-1, -1, -1, -1, /**/ -1, -1, -1, -1, /**/ -1, -1, -1, -1, /**/ -1, 0, 0, 0),
-			_mm_set_epi8(-1, -1, -1, -1, /**/ -1, -1, -1, -1, /**/ -1, 0, 0, 0,    /**/ -1, -1, -1, -1),
-			_mm_set_epi8(-1, -1, -1, -1, /**/ -1, 0, 0, 0,    /**/ -1, -1, -1, -1, /**/ -1, -1, -1, -1),
-			_mm_set_epi8(-1, 0, 0, 0,    /**/ -1, -1, -1, -1, /**/ -1, -1, -1, -1, /**/ -1, -1, -1, -1),
-		};
-
-		__m128 _128 = _mm_set_ps1(128.0f);
-		__m128 _0 = _mm_set_ps1(0.0f);
-		__m128 _255 = _mm_set_ps1(255.0f);
-		__m128 _contrastFactor = _mm_set_ps1(contrastFactor);
-
-		// We load absolute value because we can't do unsigned + signed saturated operation, instead we use branching
-		__m128i _brightness = _mm_set1_epi8((char)abs(brightness));
-		// Get rid of alpha component
-		_brightness = _mm_and_epi32(_brightness, IMAGE_RGBA_RGB_MASK);
-
-		bool addBrightness = brightness >= 0;
-
-		int xmmGroupCount = pixelsXmm / 4;
-		for (int i = 0; i < xmmGroupCount; i++)
-		{
-			__m128i fourPixels;
-			fourPixels = _mm_loadu_epi8(pixels);
-
-			if (hasBrightness)
-			{
-				if (addBrightness)  fourPixels = _mm_adds_epu8(fourPixels, _brightness);
-				else				fourPixels = _mm_subs_epu8(fourPixels, _brightness);
-			}
-
-			if (hasContrast)
-			{
-				// We have to convert 16 pixels from U8 to floats
-				// 16 floats = 64 bytes = 512 bits
-				for (int k = 0; k < 4; k++)
-				{
-					__m128i contrastedPixel;
-					__m128  floatPixel;
-
-					// Mask out other pixels and shuffle every pixel U8 component to U32
-					contrastedPixel = _mm_and_epi32(fourPixels, _keepPixelMasks[k]);
-					contrastedPixel = _mm_shuffle_epi8(contrastedPixel, _bytesToFloatsShuffle[k]);
-
-					// Color = ContrastFactor * (Color - 128) + 128
-					floatPixel = _mm_cvtepi32_ps(contrastedPixel);
-					floatPixel = _mm_sub_ps(floatPixel, _128);
-					floatPixel = _mm_mul_ps(floatPixel, _contrastFactor);
-					floatPixel = _mm_add_ps(floatPixel, _128);
-
-					// Values must be clamped to 0-255 range
-					floatPixel = _mm_min_ps(floatPixel, _255);
-					floatPixel = _mm_max_ps(floatPixel, _0);
-
-					contrastedPixel = _mm_cvtps_epi32(floatPixel);
-					contrastedPixel = _mm_shuffle_epi8(contrastedPixel, _floatsToBytesShuffle[k]);
-					contrastedPixel = _mm_and_epi32(contrastedPixel, IMAGE_RGBA_RGB_MASK); // Mask alpha out
-
-					// Mask out source pixels and put new values in
-					fourPixels = _mm_and_epi32(fourPixels, _erasePixelMasks[k]);
-					fourPixels = _mm_or_epi32(fourPixels, contrastedPixel);
-				}
-			}
-
-			_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), fourPixels);
-			pixels += 4;
-		}
-	}
-
-#endif
-	// And then remainders without intrinsics
-	for (int i = 0; i < remainderPixels; i++)
-	{
-		pixels->R = (u8)std::clamp<float>(contrastFactor * (float)(pixels->R + brightness - 128) + 128, 0, 255);
-		pixels->G = (u8)std::clamp<float>(contrastFactor * (float)(pixels->G + brightness - 128) + 128, 0, 255);
-		pixels->B = (u8)std::clamp<float>(contrastFactor * (float)(pixels->B + brightness - 128) + 128, 0, 255);
-		pixels++;
-	}
-}
-
 void rageam::graphics::ImageCutoutAlphaRGBA(char* const pixelData, int width, int height, int threshold)
 {
 	EASY_FUNCTION();
@@ -1569,60 +1618,146 @@ void rageam::graphics::ImageScaleAlphaRGBA(char* pixelData, int width, int heigh
 	}
 }
 
-float rageam::graphics::ImageAlphaTestCoverageRGBA(char* pixelData, int width, int height, int threshold, float alphaScale)
+void rageam::graphics::ImageComputeAlphaHistogramRGBA(const char* pixelData, int width, int height, u32 outHistogram[256])
 {
-	ColorU32* pixels = reinterpret_cast<ColorU32*>(pixelData);
+	EASY_FUNCTION();
 
-	float alphaRef = static_cast<float>(threshold) / 255.0f;
+	// Incrementing the same bin back to back stalls on store-to-load forwarding (very common case for
+	// alpha because most pixels are either fully opaque or transparent), so we spread it over 4 tables
+	u32 histograms[4][256] = {};
 
+	const ColorU32* pixels = reinterpret_cast<const ColorU32*>(pixelData);
 	int totalPixels = width * height;
-	int testPixels = 0;
+
+#ifdef AM_IMAGE_USE_SIMD
+	int scalarPixels = totalPixels % 16;
+	int vectorizedBlocks = totalPixels / 16;
+	totalPixels = scalarPixels;
+
+	alignas(16) u8 alphas[16];
+	for (int i = 0; i < vectorizedBlocks; i++)
+	{
+		// Shift alpha down to the lowest byte of every pixel and pack 16 pixels into 16 bytes
+		__m128i p0 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels) + 0), 24);
+		__m128i p1 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels) + 1), 24);
+		__m128i p2 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels) + 2), 24);
+		__m128i p3 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels) + 3), 24);
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+		_mm_store_si128(reinterpret_cast<__m128i*>(alphas), packed);
+
+		for (int k = 0; k < 16; k += 4)
+		{
+			histograms[0][alphas[k + 0]]++;
+			histograms[1][alphas[k + 1]]++;
+			histograms[2][alphas[k + 2]]++;
+			histograms[3][alphas[k + 3]]++;
+		}
+
+		pixels += 16;
+	}
+#endif
+
 	for (int i = 0; i < totalPixels; i++)
 	{
-		float alpha = static_cast<float>(pixels[i].A) / 255.0f;
-		alpha *= alphaScale;
+		histograms[i % 4][pixels[i].A]++;
+	}
+
+	for (int i = 0; i < 256; i++)
+	{
+		outHistogram[i] = histograms[0][i] + histograms[1][i] + histograms[2][i] + histograms[3][i];
+	}
+}
+
+float rageam::graphics::ImageAlphaTestCoverageFromHistogram(const u32 histogram[256], int threshold, float alphaScale)
+{
+	u32 totalPixels = 0;
+	u32 testPixels = 0;
+	for (int i = 0; i < 256; i++)
+	{
+		totalPixels += histogram[i];
 
-		if (alpha > alphaRef)
-			testPixels++;
+		// Same as scaling is done in encoder, alpha is clamped and truncated back to byte
+		float scaledAlpha = static_cast<float>(i) * alphaScale;
+		if (scaledAlpha > 255.0f) scaledAlpha = 255.0f;
+		if (static_cast<int>(scaledAlpha) > threshold)
+			testPixels += histogram[i];
 	}
 
+	if (totalPixels == 0)
+		return 0.0f;
+
 	return static_cast<float>(testPixels) / static_cast<float>(totalPixels);
 }
 
-float rageam::graphics::ImageAlphaTestFindBestScaleRGBA(char* pixelData, int width, int height, int threshold, float desiredCoverage)
+float rageam::graphics::ImageAlphaTestFindBestScaleFromHistogram(const u32 histogram[256], int threshold, float desiredCoverage)
 {
-	EASY_FUNCTION();
+	// Max scale from NVTT, see https://github.com/castano/nvidia-texture-tools/blob/master/src/nvimage/FloatImage.cpp#L1453
+	static constexpr float MAX_ALPHA_SCALE = 4.0f;
+
+	// Nothing can pass the test, any scale is as good as others
+	if (threshold >= 255)
+		return 1.0f;
+
+	// Coverage is a step function of scale, scaled alpha passes the test if 'trunc(alpha * scale) > threshold',
+	// or 'alpha * scale >= threshold + 1'. If K is the smallest alpha that passes, coverage is equal to
+	// the number of pixels with alpha >= K, and any scale in range [(T + 1) / K, (T + 1) / (K - 1)) gives it.
+	// So we simply go through every K (256 means that no pixel passes) and pick the closest coverage
+	u32 totalPixels = 0;
+	for (int i = 0; i < 256; i++)
+		totalPixels += histogram[i];
 
-	// https://github.com/castano/nvidia-texture-tools/blob/master/src/nvimage/FloatImage.cpp#L1453
-	float minAlphaScale = 0.0f;
-	float maxAlphaScale = 4.0f;
-	float alphaScale = 1.0f;
+	if (totalPixels == 0)
+		return 1.0f;
+
+	float passValue = static_cast<float>(threshold + 1);
 	float bestAlphaScale = 1.0f;
 	float bestError = FLT_MAX;
-
-	for (int i = 0; i < 10; i++)
+	u32   passPixels = 0; // Number of pixels with alpha >= K
+	for (int k = 256; k >= 1; k--)
 	{
-		float coverage = ImageAlphaTestCoverageRGBA(pixelData, width, height, threshold, alphaScale);
+		if (k < 256)
+			passPixels += histogram[k];
+
+		// Lower bound of the scale range is too large, all smaller K's will be even larger
+		if (passValue / static_cast<float>(k) > MAX_ALPHA_SCALE)
+			break;
+
+		// K equal to threshold + 1 is the range that contains unscaled alpha, prefer it over others
+		float alphaScale;
+		if (k == threshold + 1)
+			alphaScale = 1.0f;
+		else // Take the middle of the range so float rounding doesn't put us into neighbour range
+			alphaScale = MIN(passValue / (static_cast<float>(k) - 0.5f), MAX_ALPHA_SCALE);
+
+		float coverage = static_cast<float>(passPixels) / static_cast<float>(totalPixels);
 		float error = fabsf(coverage - desiredCoverage);
-		if (error < bestError)
+		// On tie, prefer scale that changes alpha less
+		if (error < bestError || (error == bestError && fabsf(alphaScale - 1.0f) < fabsf(bestAlphaScale - 1.0f)))
 		{
 			bestAlphaScale = alphaScale;
 			bestError = error;
 		}
-
-		if (coverage > desiredCoverage)
-			maxAlphaScale = alphaScale;
-		else if (coverage < desiredCoverage)
-			minAlphaScale = alphaScale;
-		else
-			break;
-
-		alphaScale = (minAlphaScale + maxAlphaScale) * 0.5f;
 	}
 
 	return bestAlphaScale;
 }
 
+float rageam::graphics::ImageAlphaTestCoverageRGBA(char* pixelData, int width, int height, int threshold, float alphaScale)
+{
+	u32 histogram[256];
+	ImageComputeAlphaHistogramRGBA(pixelData, width, height, histogram);
+	return ImageAlphaTestCoverageFromHistogram(histogram, threshold, alphaScale);
+}
+
+float rageam::graphics::ImageAlphaTestFindBestScaleRGBA(char* pixelData, int width, int height, int threshold, float desiredCoverage)
+{
+	EASY_FUNCTION();
+
+	u32 histogram[256];
+	ImageComputeAlphaHistogramRGBA(pixelData, width, height, histogram);
+	return ImageAlphaTestFindBestScaleFromHistogram(histogram, threshold, desiredCoverage);
+}
+
 void rageam::graphics::PixelDataOwner::AddRef() const
 {
 	if (!m_RefCount) return;
@@ -1772,6 +1907,9 @@ u32 rageam::graphics::Image::ComputeHashKey() const
 {
 	// Descending by processing time...
 
+	if (m_ContentHash.HasValue())
+		return ImageHasher::Fold(m_ContentHash.GetValue());
+
 	if (m_FastHashKey.HasValue())
 		return m_FastHashKey.GetValue();
 
@@ -1782,6 +1920,17 @@ u32 rageam::graphics::Image::ComputeHashKey() const
 	return cache->ComputeImageHash(m_PixelData.Data(), ComputeTotalSizeWithMips());
 }
 
+u64 rageam::graphics::Image::ComputeContentHash()
+{
+	if (m_ContentHash.HasValue())
+		return m_ContentHash.GetValue();
+
+	u64 pixelHash = ImageHasher::Compute(m_PixelData.Data(), ComputeSlicePitch());
+	u64 contentHash = ImageComputeContentHash(pixelHash, m_Width, m_Height, m_PixelFormat);
+	m_ContentHash = contentHash;
+	return contentHash;
+}
+
 rageam::graphics::PixelDataOwner rageam::graphics::Image::GetPixelData(int mipIndex) const
 {
 	if (mipIndex == 0)
@@ -1820,6 +1969,8 @@ bool rageam::graphics::Image::EnsurePixelDataLoaded()
 	m_Height = cachedImage->m_Height;
 	m_MipCount = cachedImage->m_MipCount;
 	m_PixelFormat = cachedImage->m_PixelFormat;
+	if (cachedImage->m_ContentHash.HasValue())
+		m_ContentHash = cachedImage->m_ContentHash;
 	m_HasAlphaPixels.Reset();
 	return true;
 }
@@ -1956,7 +2107,7 @@ amPtr<rageam::graphics::Image> rageam::graphics::Image::ConvertPixelFormat(Image
 	return ImageFactory::Create(dataOwner, formatTo, m_Width, m_Height);
 }
 
-amPtr<rageam::graphics::Image> rageam::graphics::Image::GenerateMipMaps(ResizeFilter mipFilter)
+amPtr<rageam::graphics::Image> rageam::graphics::Image::GenerateMipMaps(ResizeFilter mipFilter, bool gammaCorrect)
 {
 	// Image already have mip maps or mips can't be generated (bc formats are loss and meant to be encoded only once)
 	if (ImageIsCompressedFormat(m_PixelFormat) || m_MipCount > 1)
@@ -1975,6 +2126,20 @@ amPtr<rageam::graphics::Image> rageam::graphics::Image::GenerateMipMaps(ResizeFi
 
 	PixelDataOwner mipPixelData = PixelDataOwner::AllocateForImage(m_Width, m_Height, m_PixelFormat, mipCount);
 	char* mipPixelBytes = mipPixelData.Data()->Bytes;
+
+	// Exact 2x reduction, whole chain is built at once
+	if (ImageCanGenerateMipChain(mipFilter, m_PixelFormat))
+	{
+		ImageMipChainOptions mipChainOptions;
+		mipChainOptions.Filter = mipFilter;
+		mipChainOptions.GammaCorrect = gammaCorrect;
+		// Same as stb resize does for images with alpha
+		mipChainOptions.AlphaWeighted = hasAlphaPixels;
+		memcpy(mipPixelBytes, GetPixelDataBytes(), ComputeSlicePitch());
+		ImageGenerateMipChainRGBA(mipPixelBytes, m_Width, m_Height, mipCount, mipChainOptions);
+		return std::make_shared<Image>(mipPixelData, m_PixelFormat, m_Width, m_Height, mipCount);
+	}
+
 	// We store pointer to previous mip to generate mip from it and not from the largest mip
 	char* prevMipPixelBytes = GetPixelDataBytes();
 
@@ -2236,7 +2401,8 @@ rageam::graphics::ImagePtr rageam::graphics::ImageFactory::TryLoadFromPath(Const
 	PixelDataOwner pixelData;
 	ImagePixelFormat pixelFormat;
 	int width, height, mipCount;
-	if (!ImageRead(path, width, height, mipCount, pixelFormat, nullptr, onlyMeta, &pixelData))
+	ImageHasher pixelHasher;
+	if (!ImageRead(path, width, height, mipCount, pixelFormat, nullptr, onlyMeta, &pixelData, onlyMeta ? nullptr : &pixelHasher))
 		return nullptr;
 
 	// Some DDS have mips up to 1x1... DX11 won't allow those
@@ -2249,6 +2415,14 @@ rageam::graphics::ImagePtr rageam::graphics::ImageFactory::TryLoadFromPath(Const
 	if (!VerifyImageSize(image))
 		return nullptr;
 
+	// Remember content hash for this file version so next time we can look up compressed image without decoding
+	if (!onlyMeta)
+	{
+		u64 contentHash = ImageComputeContentHash(pixelHasher.Digest(), width, height, pixelFormat);
+		image->m_ContentHash = contentHash;
+		ImageCache::GetInstance()->SetContentHash(path, contentHash);
+	}
+
 	return image;
 }
 
@@ -2358,7 +2532,7 @@ rageam::graphics::ImagePtr rageam::graphics::ImageFactory::LoadFromPathAndCompre
 {
 	EASY_FUNCTION();
 
-	if (GetImageKindFromPath(path) == ImageKind_DDS && !compOptions.AllowRecompress)
+	if (IsLoadedAsCompressed(path, compOptions))
 	{
 		ImagePtr compressedImage = LoadFromPath(path);
 		if (!compressedImage)
@@ -2377,15 +2551,51 @@ rageam::graphics::ImagePtr rageam::graphics::ImageFactory::LoadFromPathAndCompre
 		return compressedImage;
 	}
 
-	// We need only metadata so no reason to cache
-	ImagePtr metaImage = LoadFromPath(path, true);
-	if (!metaImage)
+	u32 pixelHash;
+	ImagePtr image = LoadFromPathForCompress(path, pixelHash);
+	if (!image)
 		return nullptr;
 
-	u32 fastHash = GetFastHashKey(path);
-
 	ImageCompressor compressor;
-	return compressor.Compress(metaImage, compOptions, &fastHash, outCompInfo, token);
+	return compressor.Compress(image, compOptions, &pixelHash, outCompInfo, token);
+}
+
+bool rageam::graphics::ImageFactory::IsLoadedAsCompressed(ConstWString path, const ImageCompressorOptions& compOptions)
+{
+	return GetImageKindFromPath(path) == ImageKind_DDS && !compOptions.AllowRecompress;
+}
+
+rageam::graphics::ImagePtr rageam::graphics::ImageFactory::LoadFromPathForCompress(ConstWString path, u32& outPixelHash)
+{
+	EASY_FUNCTION();
+
+	// Content hash of this file version is remembered, compressed image can be located in cache without decoding
+	ImageCache* cache = ImageCache::GetInstance();
+	ImagePtr	image;
+	u64			contentHash;
+	if (cache->GetContentHash(path, contentHash))
+	{
+		// We need only metadata so no reason to cache
+		image = LoadFromPath(path, true);
+		if (image) image->m_ContentHash = contentHash;
+	}
+	else
+	{
+		// File is new or was modified, content hash is computed while decoding. We need pixels anyway
+		// unless the same content was compressed before (for e.g. file was copied or only modify time changed)
+		image = LoadFromPath(path);
+		if (image)
+		{
+			if (!image->m_ContentHash.HasValue()) // Decoded image was taken from cache
+				cache->SetContentHash(path, image->ComputeContentHash());
+			contentHash = image->ComputeContentHash();
+		}
+	}
+	if (!image)
+		return nullptr;
+
+	outPixelHash = ImageHasher::Fold(contentHash);
+	return image;
 }
 
 bool rageam::graphics::ImageFactory::LoadIco(ConstWString path, List<ImagePtr>& icons)
@@ -9,6 +9,7 @@
 
 #include "am/system/enum.h"
 #include "am/graphics/color.h"
+#include "am/graphics/image/imagealloc.h"
 #include "am/system/nullable.h"
 #include "am/system/ptr.h"
 #include "am/types.h"
@@ -17,7 +18,6 @@
 
 // TODO:
 // - HSV / Levels
-// - Large allocator for images, currently we use malloc
 // - Alpha test coverage in encoder is done even if texture has no alpha
 //
 // Formats
@@ -30,6 +30,7 @@ namespace rageam::graphics
 	struct ImageCompressorOptions;
 	class PixelDataOwner;
 	class Image;
+	class ImageHasher;
 
 	// Enables mix of SSE and AVX2 image processing
 	// AVX2 (AM_IMAGE_USE_AVX2) is enabled if project is created with --avx2 options
@@ -41,15 +42,6 @@ namespace rageam::graphics
 	static constexpr size_t IMAGE_RGBA_PITCH = 4;
 	static constexpr size_t IMAGE_RGB_PITCH = 3;
 
-	// We use those memory allocation functions because system heap is limited and not suitable for this
-
-	pVoid ImageAlloc(u32 size);
-	pVoid ImageAllocTemp(u32 size);
-	pVoid ImageReAlloc(pVoid block, u32 newSize);
-	pVoid ImageReAllocTemp(pVoid block, u32 newSize);
-	void  ImageFree(pVoid block);
-	void  ImageFreeTemp(pVoid block);
-
 	enum ImageFileKind
 	{
 		ImageKind_None,
@@ -208,36 +200,54 @@ namespace rageam::graphics
 	bool ImageWriteDDS(ConstWString path, int w, int h, int mips, ImagePixelFormat fmt, pVoid data);
 	bool ImageWriteDDS(ConstWString path, int w, int h, int mips, DXGI_FORMAT fmt, pVoid data);
 
-	bool ImageReadStb(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels);
+	// If pixel hasher is given, pixels of the first mip are fed to it as they're decoded
+	bool ImageReadStb(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels, ImageHasher* pixelHasher = nullptr);
 	// Decoded format is always RGBA
-	bool ImageReadWebp(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels);
-	bool ImageReadDDS(ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels);
+	bool ImageReadWebp(ConstWString path, int& w, int& h, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels, ImageHasher* pixelHasher = nullptr);
+	// File is only mapped while reading, pixel data is always a copy so file can be overwritten right after
+	bool ImageReadDDS(ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, bool onlyMeta, PixelDataOwner* pixels, ImageHasher* pixelHasher = nullptr);
 
 	// Out pixels must not be NULL if onlyMeta is set to false
 	// NOTE: This function does not support ICO!
-	bool ImageRead(ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, ImageFileKind* outKind, bool onlyMeta, PixelDataOwner* outPixels);
+	bool ImageRead(
+		ConstWString path, int& w, int& h, int& mips, ImagePixelFormat& fmt, ImageFileKind* outKind, bool onlyMeta, PixelDataOwner* outPixels,
+		ImageHasher* pixelHasher = nullptr);
+	// Hash of the first mip pixel data mixed with image dimensions and format, key for caching images by content
+	u64 ImageComputeContentHash(u64 pixelHash, int w, int h, ImagePixelFormat fmt);
 	// NOTE: Image extension in path is ignored! Image type is picked based on 'kind' parameter
 	// Mip count is ignored for every format except DDS
 	bool ImageWrite(ConstWString path, int w, int h, int mips, ImagePixelFormat fmt, const PixelDataOwner& pixelData, ImageFileKind kind, float quality = 0.95f);
 
-	// Low level function to resize array of image pixels
-	// Images without alpha are faster to process because alpha channel is processed separately and can be ignored
+	// Low level function to resize array of image pixels, see ImageResample
+	// Images without alpha are faster to process because colors don't have to be weighted by alpha
 	void ImageResize(
 		pVoid dst, pVoid src, ResizeFilter filter, ImagePixelFormat fmt,
 		int xFrom, int yFrom, int xTo, int yTo, bool hasAlphaPixels);
 
+	struct ImageMipChainOptions
+	{
+		ResizeFilter Filter = ResizeFilter_Box;
+		bool		 GammaCorrect = false;	// Colors are averaged in linear space, pixels are treated as sRGB
+		bool		 AlphaWeighted = false;	// Colors are weighted by alpha, transparent pixels don't bleed into visible ones
+	};
+
+	// Mip chain generator only supports exact 2x box and tent (ResizeFilter_Triangle) filters on RGBA,
+	// other filters and formats must go through ImageResize
+	bool ImageCanGenerateMipChain(ResizeFilter filter, ImagePixelFormat fmt);
+	// Builds all mips in a single pass over the first one, first mip must be already in place and mips are placed right after it
+	// Row of the next mip is computed as soon as source rows it needs are ready, so they are sampled while still in cache
+	// Plain box filter works on 8 bit values (SSE2 / AVX2), gamma correct and alpha weighted averaging are done in floats
+	void ImageGenerateMipChainRGBA(char* pixels, int width, int height, int mipCount, const ImageMipChainOptions& options);
+
 	// Only for non-compressed formats
 	char* ImageGetPixel(char* pixelData, int x, int y, int width, ImagePixelFormat fmt);
 
 	// Converts any pixel format (including block compressed formats) color to RGBA32
 	ColorU32 ImageGetPixelColor(char* pixelData, int x, int y, int width, ImagePixelFormat fmt);
 
-	// Converts pixels from one format to another, BC formats are not supported
-	// Currently implemented:
-	// RGBA -> RGB
-	// RGB -> RGBA
-	// Gray Alpha -> RGBA
-	// Gray -> RGB
+	// Converts pixels between any of U32 / U24 / U16 / U8 / A8 formats, BC formats are not supported
+	// Conversion to and from RGBA is direct, other pairs go through RGBA in small chunks
+	// Gray is computed as Rec. 601 luma, expanding gray / alpha to RGBA gives the same color as ImageGetPixelColor
 	void ImageConvertPixelFormat(pVoid dst, pVoid src, ImagePixelFormat fromFmt, ImagePixelFormat toFmt, int width, int height);
 
 	// Flips image upside down
@@ -248,14 +258,24 @@ namespace rageam::graphics
 
 	// NOTE: Following functions with 'RGBA' postfix expect input pixels in RGBA 32 bit format
 
+	// Builds per channel mapping table, brightness is added (saturated) before contrast is applied
+	void ImageComputeBrightnessContrastLut(int brightness, int contrast, u8 outLut[256]);
+	// Maps RGB components through the table, alpha is left as is
+	void ImageApplyColorLutRGBA(char* pixelData, int width, int height, const u8 lut[256]);
 	void ImageAdjustBrightnessAndContrastRGBA(char* pixelData, int width, int height, int brightness, int contrast);
 	// Sets all pixels below threshold to 0 and all greater or equal to 255
 	// Threshold must be between 0 and 255
 	void ImageCutoutAlphaRGBA(char* pixelData, int width, int height, int threshold);
 	void ImageScaleAlphaRGBA(char* pixelData, int width, int height, float alphaScale);
+	// Counts number of pixels for every alpha value
+	void ImageComputeAlphaHistogramRGBA(const char* pixelData, int width, int height, u32 outHistogram[256]);
 	// http://the-witness.net/news/2010/09/computing-alpha-mipmaps/
+	// Pixel passes the test if alpha, scaled same way as encoder does it, is greater than threshold
+	float ImageAlphaTestCoverageFromHistogram(const u32 histogram[256], int threshold, float alphaScale = 1.0f);
 	float ImageAlphaTestCoverageRGBA(char* pixelData, int width, int height, int threshold, float alphaScale = 1.0f);
-	// Uses brute force method to find most optimal alpha scaling to achieve desired coverage, idea is taken from NVTT
+	// Finds alpha scale that gives the closest coverage to desired one (scale is limited to 4.0, as in NVTT)
+	// Solved exactly from the histogram, so only one pass over pixels is needed
+	float ImageAlphaTestFindBestScaleFromHistogram(const u32 histogram[256], int threshold, float desiredCoverage);
 	float ImageAlphaTestFindBestScaleRGBA(char* pixelData, int width, int height, int threshold, float desiredCoverage);
 
 	struct ImageInfo
@@ -346,6 +366,7 @@ namespace rageam::graphics
 
 		wstring			 m_DebugName;
 		Nullable<u32>	 m_FastHashKey;
+		Nullable<u64>	 m_ContentHash;		// Computed while decoding if image was loaded from file
 		file::WPath		 m_FilePath;		// In case if image was loaded from file
 		int				 m_Width;
 		int				 m_Height;
@@ -373,6 +394,8 @@ namespace rageam::graphics
 		u32 ComputeTotalSizeWithMips() const { return ImageComputeTotalSizeWithMips(m_Width, m_Height, m_MipCount, m_PixelFormat); }
 
 		u32 ComputeHashKey() const;
+		// See ImageComputeContentHash, pixel data is hashed only if hash was not computed during loading
+		u64 ComputeContentHash();
 
 		// Set to image file name with extension by default
 		// For memory images, 'None' is default
@@ -420,7 +443,8 @@ namespace rageam::graphics
 		// If format matches current, shallow clone is returned
 		amPtr<Image> ConvertPixelFormat(ImagePixelFormat formatTo) const;
 		// Will return existing pixel data if image already have more than 1 mip map or pixels are block compressed
-		amPtr<Image> GenerateMipMaps(ResizeFilter mipFilter = ResizeFilter_Box);
+		// Gamma correct averaging is only supported by box and triangle filters (see ImageGenerateMipChainRGBA)
+		amPtr<Image> GenerateMipMaps(ResizeFilter mipFilter = ResizeFilter_Box, bool gammaCorrect = false);
 		// Makes sure that image resolution is smaller equal to given constraint,
 		// If maximumResolution is set to 0, shallow clone is returned
 		amPtr<Image> FitMaximumResolution(int maximumResolution, ResizeFilter filter = ResizeFilter_Box);
@@ -466,6 +490,11 @@ namespace rageam::graphics
 		// NOTE: Pixels loaded from DDS, even uncompressed (for example RGBA) are returned as is, unless ImageCompressorOptions::AllowRecompress is set!
 		static ImagePtr LoadFromPathAndCompress(
 			ConstWString path, const ImageCompressorOptions& compOptions, CompressedImageInfo* outCompInfo = nullptr, ImageCompressorToken* token = nullptr);
+		// Whether LoadFromPathAndCompress returns pixels of the file as is, see note above
+		static bool IsLoadedAsCompressed(ConstWString path, const ImageCompressorOptions& compOptions);
+		// First part of LoadFromPathAndCompress, loads only metadata if content hash of the file is known
+		// Pixel hash must be passed to ImageCompressor::Compress (or BeginCompress) to locate image in cache
+		static ImagePtr LoadFromPathForCompress(ConstWString path, u32& outPixelHash);
 
 		// Exists as separate loader because format does not quite fit in existing architecture
 		// Only PNG and 32Bit BMP formats are supported
@@ -547,21 +576,35 @@ namespace rageam::graphics
 		6, 5, 4,
 		2, 1, 0
 	);
-#ifdef AM_IMAGE_USE_AVX2
-	static const __m256i IMAGE_RGBA_TO_RGB_SHUFFLE_256 = _mm256_set_epi8(
-		// Remainder from 8 alpha channels
-		0, 0, 0, 0,
-		0, 0, 0, 0,
 
-		30, 29, 28,
-		26, 25, 24,
-		22, 21, 20,
-		18, 17, 16,
-		14, 13, 12,
-		10, 9, 8,
-		6, 5, 4,
-		2, 1, 0
-	);
-#endif // AM_IMAGE_USE_AVX2
+	// 256 entry lookup with 16 byte shuffles, table is split in 16 parts by high nibble.
+	// Value is decremented by 16 on every step, it gets to 0 - 15 range only on step that matches high nibble,
+	// all other steps give value >= 16 which saturates to >= 0x80 after adding 0x70 and shuffle gives zero
+	inline __m128i ImageApplyLut16(__m128i values, const __m128i tables[16])
+	{
+		const __m128i bias = _mm_set1_epi8(0x70);
+		const __m128i step = _mm_set1_epi8(16);
+		__m128i result = _mm_setzero_si128();
+		for (int k = 0; k < 16; k++)
+		{
+			result = _mm_or_si128(result, _mm_shuffle_epi8(tables[k], _mm_adds_epu8(values, bias)));
+			values = _mm_sub_epi8(values, step);
+		}
+		return result;
+	}
+#ifdef AM_IMAGE_USE_AVX2
+	inline __m256i ImageApplyLut32(__m256i values, const __m256i tables[16])
+	{
+		const __m256i bias = _mm256_set1_epi8(0x70);
+		const __m256i step = _mm256_set1_epi8(16);
+		__m256i result = _mm256_setzero_si256();
+		for (int k = 0; k < 16; k++)
+		{
+			result = _mm256_or_si256(result, _mm256_shuffle_epi8(tables[k], _mm256_adds_epu8(values, bias)));
+			values = _mm256_sub_epi8(values, step);
+		}
+		return result;
+	}
+#endif
 #endif // AM_IMAGE_USE_SIMD
 }
@@ -0,0 +1,387 @@
+#include "imagealloc.h"
+
+#include "am/system/asserts.h"
+#include "common/logger.h"
+#include "helpers/align.h"
+#include "helpers/bits.h"
+#include "helpers/ranges.h"
+
+#include <Windows.h>
+#include <atomic>
+#include <mutex>
+
+namespace
+{
+	using namespace rageam;
+
+	enum : u32
+	{
+		IMAGE_BLOCK_HEAP = 0x494D4748,		// Process heap, for small blocks
+		IMAGE_BLOCK_POOL = 0x494D4750,		// Size class pool
+		IMAGE_BLOCK_SCRATCH = 0x494D4753,	// Thread scratch arena
+	};
+
+	// Placed right before every block we give out, this way any of Free / ReAlloc functions know where block came from
+	// Size is multiple of 16 so returned pointers are aligned for SSE
+	struct alignas(16) ImageBlockHeader
+	{
+		u32 Kind;
+		u32 SizeClass;	// Only for pool blocks
+		u64 Capacity;	// Usable size of the block, excluding header
+	};
+	static constexpr u64 IMAGE_BLOCK_HEADER_SIZE = sizeof(ImageBlockHeader);
+
+	// Each power of two is split in 4 classes, so at most 25% of the block is wasted on rounding
+	// All class sizes starting from 256KB are multiples of 64KB, which is virtual allocation granularity
+	static constexpr int SIZE_CLASS_STEPS_SHIFT = 2;
+	static constexpr int SIZE_CLASS_STEPS = 1 << SIZE_CLASS_STEPS_SHIFT;
+	static constexpr int SIZE_CLASS_COUNT = 64;
+
+	int GetRawSizeClass(u64 size)
+	{
+		u64 value = size - 1;
+		int msb = BitScanR64(value);
+		int step = static_cast<int>(value >> (msb - SIZE_CLASS_STEPS_SHIFT)) & (SIZE_CLASS_STEPS - 1);
+		return msb * SIZE_CLASS_STEPS + step;
+	}
+
+	u64 GetRawSizeClassSize(int rawClass)
+	{
+		int msb = rawClass / SIZE_CLASS_STEPS;
+		int step = rawClass % SIZE_CLASS_STEPS;
+		return static_cast<u64>(SIZE_CLASS_STEPS + step + 1) << (msb - SIZE_CLASS_STEPS_SHIFT);
+	}
+
+	int GetSizeClass(u64 size)
+	{
+		static const int firstRawClass = GetRawSizeClass(graphics::IMAGE_POOL_MIN_SIZE);
+		return GetRawSizeClass(MAX(size, static_cast<u64>(graphics::IMAGE_POOL_MIN_SIZE))) - firstRawClass;
+	}
+
+	u64 GetSizeClassSize(int sizeClass)
+	{
+		static const int firstRawClass = GetRawSizeClass(graphics::IMAGE_POOL_MIN_SIZE);
+		return GetRawSizeClassSize(sizeClass + firstRawClass);
+	}
+
+	struct ImagePool
+	{
+		std::mutex	Mutex;
+		// Intrusive singly linked lists of freed blocks, pointer to the next block is stored in the block itself
+		pVoid		FreeLists[SIZE_CLASS_COUNT] = {};
+		u64			SizeCached = 0;
+	};
+
+	ImagePool				s_Pool;
+	std::atomic_uint64_t	s_SizeCurrent = 0;
+	std::atomic_uint64_t	s_SizePeak = 0;
+	std::atomic_uint64_t	s_SizeScratch = 0;
+	std::atomic_uint64_t	s_PoolHits = 0;
+	std::atomic_uint64_t	s_PoolMisses = 0;
+
+	void AddUsage(u64 size)
+	{
+		u64 current = s_SizeCurrent.fetch_add(size) + size;
+		u64 peak = s_SizePeak;
+		while (current > peak && !s_SizePeak.compare_exchange_weak(peak, current)) {}
+	}
+
+	void RemoveUsage(u64 size)
+	{
+		s_SizeCurrent -= size;
+	}
+
+	ImageBlockHeader* GetBlockHeader(pVoid block)
+	{
+		return static_cast<ImageBlockHeader*>(block) - 1;
+	}
+
+	pVoid InitBlock(pVoid memory, u32 kind, u32 sizeClass, u64 capacity)
+	{
+		ImageBlockHeader* header = static_cast<ImageBlockHeader*>(memory);
+		header->Kind = kind;
+		header->SizeClass = sizeClass;
+		header->Capacity = capacity;
+		return header + 1;
+	}
+
+	void ReleaseCachedBlocks()
+	{
+		std::unique_lock lock(s_Pool.Mutex);
+		for (pVoid& freeList : s_Pool.FreeLists)
+		{
+			while (freeList)
+			{
+				pVoid next = *static_cast<pVoid*>(freeList);
+				VirtualFree(freeList, 0, MEM_RELEASE);
+				freeList = next;
+			}
+		}
+		s_Pool.SizeCached = 0;
+	}
+
+	pVoid PoolAlloc(u64 size)
+	{
+		int sizeClass = GetSizeClass(size + IMAGE_BLOCK_HEADER_SIZE);
+		AM_ASSERT(sizeClass < SIZE_CLASS_COUNT, "ImageAlloc() -> Size %llu is too large.", size);
+		u64 classSize = GetSizeClassSize(sizeClass);
+
+		pVoid memory = nullptr;
+		{
+			std::unique_lock lock(s_Pool.Mutex);
+			pVoid& freeList = s_Pool.FreeLists[sizeClass];
+			if (freeList)
+			{
+				memory = freeList;
+				freeList = *static_cast<pVoid*>(memory);
+				s_Pool.SizeCached -= classSize;
+			}
+		}
+
+		if (memory)
+		{
+			++s_PoolHits;
+		}
+		else
+		{
+			++s_PoolMisses;
+			memory = VirtualAlloc(NULL, classSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			// Address space may be taken by cached blocks of other size classes, give them back and try again
+			if (!memory)
+			{
+				ReleaseCachedBlocks();
+				memory = VirtualAlloc(NULL, classSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			}
+			if (!memory)
+			{
+				AM_ERRF("ImageAlloc() -> Failed to allocate %llu bytes, last error: %x", classSize, GetLastError());
+				return nullptr;
+			}
+		}
+
+		AddUsage(classSize);
+		return InitBlock(memory, IMAGE_BLOCK_POOL, sizeClass, classSize - IMAGE_BLOCK_HEADER_SIZE);
+	}
+
+	void PoolFree(ImageBlockHeader* header)
+	{
+		u64 classSize = GetSizeClassSize(static_cast<int>(header->SizeClass));
+		RemoveUsage(classSize);
+
+		{
+			std::unique_lock lock(s_Pool.Mutex);
+			if (s_Pool.SizeCached + classSize <= graphics::IMAGE_POOL_CACHE_BUDGET)
+			{
+				pVoid& freeList = s_Pool.FreeLists[header->SizeClass];
+				*reinterpret_cast<pVoid*>(header) = freeList;
+				freeList = header;
+				s_Pool.SizeCached += classSize;
+				return;
+			}
+		}
+
+		VirtualFree(header, 0, MEM_RELEASE);
+	}
+
+	pVoid HeapBlockAlloc(u64 size)
+	{
+		pVoid memory = malloc(size + IMAGE_BLOCK_HEADER_SIZE);
+		if (!memory)
+			return nullptr;
+
+		AddUsage(size + IMAGE_BLOCK_HEADER_SIZE);
+		return InitBlock(memory, IMAGE_BLOCK_HEAP, 0, size);
+	}
+
+	pVoid HeapBlockReAlloc(ImageBlockHeader* header, u64 newSize)
+	{
+		u64 oldSize = header->Capacity;
+		pVoid memory = realloc(header, newSize + IMAGE_BLOCK_HEADER_SIZE);
+		if (!memory)
+			return nullptr;
+
+		RemoveUsage(oldSize + IMAGE_BLOCK_HEADER_SIZE);
+		AddUsage(newSize + IMAGE_BLOCK_HEADER_SIZE);
+		return InitBlock(memory, IMAGE_BLOCK_HEAP, 0, newSize);
+	}
+
+	// Chunks are regular pool blocks, so memory is shared between threads once scope is closed
+	struct ImageScratchArena
+	{
+		List<pVoid>	Chunks;
+		u64			Offset = 0;	// In the last chunk
+		int			ScopeDepth = 0;
+	};
+
+	thread_local ImageScratchArena tl_Scratch;
+
+	void ScratchReleaseChunks(u32 keepCount)
+	{
+		while (tl_Scratch.Chunks.GetSize() > keepCount)
+		{
+			pVoid chunk = tl_Scratch.Chunks.Last();
+			s_SizeScratch -= GetBlockHeader(chunk)->Capacity;
+			PoolFree(GetBlockHeader(chunk));
+			tl_Scratch.Chunks.RemoveLast();
+		}
+	}
+
+	pVoid ScratchAlloc(u64 size)
+	{
+		u64 allocSize = ALIGN_16(size + IMAGE_BLOCK_HEADER_SIZE);
+
+		bool fits = tl_Scratch.Chunks.Any() &&
+			tl_Scratch.Offset + allocSize <= GetBlockHeader(tl_Scratch.Chunks.Last())->Capacity;
+		if (!fits)
+		{
+			pVoid chunk = PoolAlloc(MAX(allocSize, static_cast<u64>(graphics::IMAGE_SCRATCH_CHUNK_SIZE)));
+			if (!chunk)
+				return nullptr;
+
+			s_SizeScratch += GetBlockHeader(chunk)->Capacity;
+			tl_Scratch.Chunks.Add(chunk);
+			tl_Scratch.Offset = 0;
+		}
+
+		char* memory = static_cast<char*>(tl_Scratch.Chunks.Last()) + tl_Scratch.Offset;
+		tl_Scratch.Offset += allocSize;
+		return InitBlock(memory, IMAGE_BLOCK_SCRATCH, 0, allocSize - IMAGE_BLOCK_HEADER_SIZE);
+	}
+
+	pVoid MoveBlock(pVoid block, pVoid newBlock, u64 newSize)
+	{
+		if (!newBlock)
+			return nullptr;
+
+		memcpy(newBlock, block, MIN(GetBlockHeader(block)->Capacity, newSize));
+		graphics::ImageFree(block);
+		return newBlock;
+	}
+}
+
+pVoid rageam::graphics::ImageAlloc(u32 size)
+{
+	if (size + IMAGE_BLOCK_HEADER_SIZE < IMAGE_POOL_MIN_SIZE)
+		return HeapBlockAlloc(size);
+	return PoolAlloc(size);
+}
+
+pVoid rageam::graphics::ImageAllocTemp(u32 size)
+{
+	if (tl_Scratch.ScopeDepth > 0)
+		return ScratchAlloc(size);
+	return ImageAlloc(size);
+}
+
+pVoid rageam::graphics::ImageReAlloc(pVoid block, u32 newSize)
+{
+	if (!block)
+		return ImageAlloc(newSize);
+
+	ImageBlockHeader* header = GetBlockHeader(block);
+	bool newSizeIsSmall = newSize + IMAGE_BLOCK_HEADER_SIZE < IMAGE_POOL_MIN_SIZE;
+	switch (header->Kind)
+	{
+	case IMAGE_BLOCK_HEAP:
+		if (newSizeIsSmall)
+			return HeapBlockReAlloc(header, newSize);
+		break;
+
+	case IMAGE_BLOCK_POOL:
+		// Shrinking pool block to the same size class, keep it as is
+		if (!newSizeIsSmall && GetSizeClass(newSize + IMAGE_BLOCK_HEADER_SIZE) == static_cast<int>(header->SizeClass))
+			return block;
+		break;
+
+	case IMAGE_BLOCK_SCRATCH:
+		break;
+
+	default:
+		AM_UNREACHABLE("ImageReAlloc() -> Block %p was not allocated by ImageAlloc.", block);
+	}
+	return MoveBlock(block, ImageAlloc(newSize), newSize);
+}
+
+pVoid rageam::graphics::ImageReAllocTemp(pVoid block, u32 newSize)
+{
+	if (!block || GetBlockHeader(block)->Kind != IMAGE_BLOCK_SCRATCH)
+		return ImageReAlloc(block, newSize);
+
+	// Block is in scratch arena so there must be active scope, keep it there
+	if (newSize <= GetBlockHeader(block)->Capacity)
+		return block;
+	return MoveBlock(block, ImageAllocTemp(newSize), newSize);
+}
+
+void rageam::graphics::ImageFree(pVoid block)
+{
+	if (!block)
+		return;
+
+	ImageBlockHeader* header = GetBlockHeader(block);
+	switch (header->Kind)
+	{
+	case IMAGE_BLOCK_HEAP:
+		RemoveUsage(header->Capacity + IMAGE_BLOCK_HEADER_SIZE);
+		header->Kind = 0; // Catch double free
+		free(header);
+		break;
+
+	case IMAGE_BLOCK_POOL:
+		header->Kind = 0;
+		PoolFree(header);
+		break;
+
+	case IMAGE_BLOCK_SCRATCH:
+		// Released when scope ends
+		break;
+
+	default:
+		AM_UNREACHABLE("ImageFree() -> Block %p was not allocated by ImageAlloc.", block);
+	}
+}
+
+void rageam::graphics::ImageFreeTemp(pVoid block)
+{
+	ImageFree(block);
+}
+
+rageam::graphics::ImageAllocStats rageam::graphics::ImageGetAllocStats()
+{
+	ImageAllocStats stats;
+	stats.SizeCurrent = s_SizeCurrent;
+	stats.SizePeak = s_SizePeak;
+	stats.SizeScratch = s_SizeScratch;
+	stats.PoolHits = s_PoolHits;
+	stats.PoolMisses = s_PoolMisses;
+	{
+		std::unique_lock lock(s_Pool.Mutex);
+		stats.SizeCached = s_Pool.SizeCached;
+	}
+	return stats;
+}
+
+void rageam::graphics::ImageAllocResetPeak()
+{
+	s_SizePeak = s_SizeCurrent.load();
+}
+
+void rageam::graphics::ImageAllocTrim()
+{
+	ReleaseCachedBlocks();
+}
+
+rageam::graphics::ImageScratchScope::ImageScratchScope()
+{
+	m_ChunkCount = tl_Scratch.Chunks.GetSize();
+	m_Offset = tl_Scratch.Offset;
+	tl_Scratch.ScopeDepth++;
+}
+
+rageam::graphics::ImageScratchScope::~ImageScratchScope()
+{
+	// Everything allocated after scope was opened is gone now
+	ScratchReleaseChunks(m_ChunkCount);
+	tl_Scratch.Offset = m_Offset;
+	tl_Scratch.ScopeDepth--;
+}
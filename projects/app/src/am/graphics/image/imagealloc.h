@@ -0,0 +1,68 @@
+//
+// File: imagealloc.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "am/types.h"
+
+namespace rageam::graphics
+{
+	// Smaller blocks are taken from process heap, there's no point pooling scanlines and tiny mips
+	static constexpr u32 IMAGE_POOL_MIN_SIZE = 256u * 1024u;
+	// How many bytes of freed pool blocks we keep for reuse, everything above is given back to the system
+	static constexpr u64 IMAGE_POOL_CACHE_BUDGET = 512ull * 1024ull * 1024ull;
+	// Minimum size of a single scratch arena chunk, larger allocations get chunk of their own size
+	static constexpr u32 IMAGE_SCRATCH_CHUNK_SIZE = 4u * 1024u * 1024u;
+
+	struct ImageAllocStats
+	{
+		u64 SizeCurrent;	// Bytes taken by live blocks, pool blocks are counted with their size class
+		u64 SizePeak;		// Highest SizeCurrent since startup or last ImageAllocResetPeak call
+		u64 SizeCached;		// Freed pool blocks that are kept for reuse
+		u64 SizeScratch;	// Scratch arena chunks of all threads, part of SizeCurrent
+		u64 PoolHits;		// Pool allocations that reused cached block
+		u64 PoolMisses;		// Pool allocations that had to request memory from the system
+	};
+
+	// We use those memory allocation functions because system heap is limited and not suitable for this
+	// Large blocks are taken from size class pool backed by virtual memory, multi megabyte pixel buffers are
+	// reused between textures instead of fragmenting process heap
+	// NOTE: Functions are interchangeable, block can be freed / reallocated by any of them (stb mixes them)
+
+	pVoid ImageAlloc(u32 size);
+	// Allocates from thread scratch arena if there's active ImageScratchScope on current thread, otherwise same as ImageAlloc
+	pVoid ImageAllocTemp(u32 size);
+	pVoid ImageReAlloc(pVoid block, u32 newSize);
+	// Never moves block to scratch arena, stb uses it to grow pixel buffers that are returned to us
+	pVoid ImageReAllocTemp(pVoid block, u32 newSize);
+	void  ImageFree(pVoid block);
+	void  ImageFreeTemp(pVoid block);
+
+	ImageAllocStats ImageGetAllocStats();
+	void ImageAllocResetPeak();
+	// Gives all cached pool blocks back to the system
+	void ImageAllocTrim();
+
+	/**
+	 * \brief Routes ImageAllocTemp calls on current thread to thread local bump arena.
+	 * \remarks Everything allocated within the scope is released at once when scope ends, freeing such
+	 * block before that does nothing. Block allocated in scope must not outlive it!
+	 * Scopes can be nested, inner scope rewinds arena to the point where it was opened.
+	 */
+	class ImageScratchScope
+	{
+		u32 m_ChunkCount;
+		u64 m_Offset;
+
+	public:
+		ImageScratchScope();
+		~ImageScratchScope();
+
+		ImageScratchScope(const ImageScratchScope&) = delete;
+		ImageScratchScope& operator=(const ImageScratchScope&) = delete;
+	};
+}
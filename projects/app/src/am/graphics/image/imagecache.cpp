@@ -3,7 +3,6 @@
 #include "am/file/fileutils.h"
 #include "am/system/datamgr.h"
 #include "am/xml/doc.h"
-#include "am/xml/iterator.h"
 #include "helpers/format.h"
 #include "bc.h"
 
@@ -15,14 +14,14 @@ rageam::HashValue rageam::graphics::ImageCache::ComputeImageHash(ImagePixelData
 {
 	EASY_FUNCTION();
 	u32 hash;
-	hash = rage::atDataHash(imageData, imageDataSize);
+	hash = ComputeImageHash(imageData, imageDataSize);
 	hash = rage::atDataHash(&compInfo, sizeof CompressedImageInfo, hash);
 	return hash;
 }
 
 rageam::HashValue rageam::graphics::ImageCache::ComputeImageHash(ImagePixelData imageData, u32 imageDataSize) const
 {
-	return rage::atDataHash(imageData, imageDataSize);
+	return ImageHasher::Fold(ImageHasher::Compute(imageData, imageDataSize));
 }
 
 void rageam::graphics::ImageCache::SaveSettings(const file::WPath& path, const Settings& settings) const
@@ -114,84 +113,151 @@ bool rageam::graphics::ImageCache::GetInfoFromCachedImagePath(const file::WPath&
 	return swscanf_s(fileName.GetCStr(), L"%u_%u", &hash, &imageSize) > 0;
 }
 
-rageam::file::WPath rageam::graphics::ImageCache::GetCachedImagePath(u32 hash, u32 imageSize, ImageFileKind kind) const
+void rageam::graphics::ImageCache::DeleteLegacyCacheFiles() const
 {
-	file::WPath path = m_CacheDirectory / String::FormatTemp(L"%u_%u", hash, imageSize);
-	if (kind != ImageKind_None)
-	{
-		path += L".";
-		path += ImageKindToFileExtensionW[kind];
-	}
-	return path;
+	file::WPath listPath = m_CacheDirectory / LEGACY_CACHE_LIST_NAME;
+	if (!IsFileExists(listPath))
+		return;
+
+	AM_DEBUGF("ImageCache::DeleteLegacyCacheFiles() -> Removing images stored in old format");
+
+	file::EnumerateDirectory(m_CacheDirectory, false, [this](const WIN32_FIND_DATAW& findData, ConstWString fullPath)
+		{
+			u32 hash, imageSize;
+			if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && GetInfoFromCachedImagePath(fullPath, hash, imageSize))
+				DeleteFileW(fullPath);
+		});
+	DeleteFileW(listPath);
 }
 
-void rageam::graphics::ImageCache::MoveImageToFileSystem(CacheEntry& entry, u32 hash) const
+void rageam::graphics::ImageCache::MoveImageToFileSystem(CacheEntry& entry, u32 hash)
 {
-	// We don't need image kind here because file extension will be set by save function
-	file::WPath cachedImagePath = GetCachedImagePath(hash, entry.ImageSize, ImageKind_DDS);
-
-	// We don't actually remove images from file system cache when loading to ram,
-	// writing file is more expensive than deleting it when it is surely not needed anymore
-	if (!IsFileExists(cachedImagePath) && !ImageFactory::SaveImage(entry.Image, cachedImagePath))
+	// We don't actually remove images from file system store when loading to ram,
+	// writing image is more expensive than keeping it when it is surely not needed anymore
 	{
-		AM_ERRF(L"ImageCache::Cache() -> Failed to store image in file system '%ls'", cachedImagePath.GetCStr());
+		std::unique_lock storeLock(m_StoreMutex);
+		if (!m_Store.Store(hash, entry.Image, entry.ImageSize, entry.ImagePaddingUV2))
+		{
+			AM_ERRF("ImageCache::Cache() -> Failed to store image (hash: %x) in file system", hash);
+		}
 	}
 
 	// This does not guarantee that image will be unloaded from RAM, it still may be referenced somewhere
 	entry.Image = nullptr;
 }
 
-void rageam::graphics::ImageCache::CleanUpOldEntriesToFitBudget()
+void rageam::graphics::ImageCache::RemoveEntry(Shard& shard, CacheEntry* entry)
 {
-	// Move oldest image from ram to file system (or just unload if fs cache is not needed)
-	while (m_SizeRam > m_Settings.MemoryStoreBudget)
+	if (entry->Image)
 	{
-		u32 hash = m_NewToOldEntriesRAM.Last();
-		m_NewToOldEntriesRAM.RemoveLast();
-
-		CacheEntry& entry = m_Entries.GetAt(hash);
+		shard.EntriesRAM.Unlink(entry);
+		m_SizeRam -= entry->ImageSize;
+	}
+	else
+	{
+		shard.EntriesFS.Unlink(entry);
+		m_SizeFs -= entry->ImageSize;
+	}
+	shard.Entries.RemoveAt(entry->Hash);
+}
 
-		m_SizeRam -= entry.ImageSize;
+bool rageam::graphics::ImageCache::EvictOldest(EvictionTier tier)
+{
+	// Find shard with the oldest entry, every shard is locked only briefly and one at a time
+	u32 victimShardIndex = SHARD_COUNT;
+	u64 victimTick = UINT64_MAX;
+	for (u32 i = 0; i < SHARD_COUNT; i++)
+	{
+		Shard& shard = m_Shards[i];
+		std::unique_lock lock(shard.Mutex);
 
-		if (entry.Flags & ImageCacheEntryFlags_StoreInFileSystem)
+		u64 oldestTick;
+		switch (tier)
 		{
-			MoveImageToFileSystem(entry, hash);
-			m_SizeFs += entry.ImageSize;
-			m_NewToOldEntriesFS.Insert(0, hash);
-			IMAGE_CACHE_LOG("ImageCache::Cache() -> Image (hash: %x; size: %x or %s) was unloaded from memory to file",
-				hash, entry.ImageSize, FormatSize(entry.ImageSize));
+		case EvictionTier_RAM:	if (!shard.EntriesRAM.Oldest) continue;		 oldestTick = shard.EntriesRAM.Oldest->LastAccessTick;		break;
+		case EvictionTier_FS:	if (!shard.EntriesFS.Oldest) continue;		 oldestTick = shard.EntriesFS.Oldest->LastAccessTick;		break;
+		case EvictionTier_DX11: if (!shard.EntriesDX11List.Oldest) continue; oldestTick = shard.EntriesDX11List.Oldest->LastAccessTick; break;
 		}
-		else
+
+		if (oldestTick < victimTick)
 		{
-			IMAGE_CACHE_LOG("ImageCache::Cache() -> Image (hash: %x; size: %x or %s) was marked as memory only, removing completely",
-				hash, entry.ImageSize, FormatSize(entry.ImageSize));
-			m_Entries.RemoveAt(hash);
+			victimTick = oldestTick;
+			victimShardIndex = i;
 		}
 	}
 
-	// Note that we don't actually remove the file, see comment in MoveImageToFileSystem
-	while (m_SizeFs > m_Settings.FileSystemStoreBudget)
+	if (victimShardIndex == SHARD_COUNT)
+		return false;
+
+	// Entry may have been accessed or removed while shard was unlocked, evicting whatever is the oldest now is good enough
+	Shard& shard = m_Shards[victimShardIndex];
+	std::unique_lock lock(shard.Mutex);
+	switch (tier)
+	{
+	case EvictionTier_RAM:
 	{
-		u32 hash = m_NewToOldEntriesFS.Last();
-		m_NewToOldEntriesFS.RemoveLast();
+		CacheEntry* entry = shard.EntriesRAM.Oldest;
+		if (!entry)
+			break;
 
-		CacheEntry& entry = m_Entries.GetAt(hash);
-		m_SizeFs -= entry.ImageSize;
+		u32 hash = entry->Hash;
+		shard.EntriesRAM.Unlink(entry);
+		m_SizeRam -= entry->ImageSize;
 
-		file::WPath oldImagePath = GetCachedImagePath(hash, entry.ImageSize, entry.ImageKind);
-		if (!DeleteFileW(oldImagePath))
+		// Move oldest image from ram to file system (or just unload if fs cache is not needed)
+		if (entry->Flags & ImageCacheEntryFlags_StoreInFileSystem)
 		{
-			AM_WARNINGF("ImageCache::Cache() -> Image (hash: %x; size: %x or %s) failed to remove from file system",
-				hash, entry.ImageSize, FormatSize(entry.ImageSize));
+			MoveImageToFileSystem(*entry, hash);
+			entry->LastAccessTick = NextAccessTick();
+			shard.EntriesFS.PushNewest(entry);
+			m_SizeFs += entry->ImageSize;
+			IMAGE_CACHE_LOG("ImageCache::Cache() -> Image (hash: %x; size: %x or %s) was unloaded from memory to file",
+				hash, entry->ImageSize, FormatSize(entry->ImageSize));
 		}
 		else
 		{
-			IMAGE_CACHE_LOG("ImageCache::Cache() -> Image (hash: %x; size: %x or %s) was removed from file system",
-				hash, entry.ImageSize, FormatSize(entry.ImageSize));
+			IMAGE_CACHE_LOG("ImageCache::Cache() -> Image (hash: %x; size: %x or %s) was marked as memory only, removing completely",
+				hash, entry->ImageSize, FormatSize(entry->ImageSize));
+			shard.Entries.RemoveAt(hash);
 		}
+		break;
+	}
+	case EvictionTier_FS:
+	{
+		CacheEntry* entry = shard.EntriesFS.Oldest;
+		if (!entry)
+			break;
+
+		IMAGE_CACHE_LOG("ImageCache::Cache() -> Image (hash: %x; size: %x or %s) was removed from file system",
+			entry->Hash, entry->ImageSize, FormatSize(entry->ImageSize));
 
-		m_Entries.RemoveAt(hash);
+		// Image data stays in the store data file until it is compacted on next startup
+		{
+			std::unique_lock storeLock(m_StoreMutex);
+			m_Store.Remove(entry->Hash);
+		}
+		RemoveEntry(shard, entry);
+		break;
 	}
+	case EvictionTier_DX11:
+	{
+		CacheEntryDX11* entry = shard.EntriesDX11List.Oldest;
+		if (!entry)
+			break;
+
+		shard.EntriesDX11List.Unlink(entry);
+		shard.EntriesDX11.RemoveAt(entry->Hash);
+		--m_DX11ViewCount;
+		break;
+	}
+	}
+	return true;
+}
+
+void rageam::graphics::ImageCache::CleanUpOldEntriesToFitBudget()
+{
+	while (m_SizeRam > m_Settings.MemoryStoreBudget && EvictOldest(EvictionTier_RAM)) {}
+	while (m_SizeFs > m_Settings.FileSystemStoreBudget && EvictOldest(EvictionTier_FS)) {}
 }
 
 rageam::graphics::ImageCache::ImageCache()
@@ -206,55 +272,37 @@ rageam::graphics::ImageCache::ImageCache()
 	AM_ASSERT(CreateDirectoryW(m_CacheDirectory, NULL) != ERROR_PATH_NOT_FOUND,
 		L"ImageCompressorCache::LoadSettings() -> Failed to create cache directory '%ls'", m_CacheDirectory.GetCStr());
 
-	file::WPath listPath = m_CacheDirectory / CACHE_LIST_NAME;
-	// First load, no cache list is stored
-	if (!IsFileExists(listPath))
-		return;
-
-	// Load images from file system
-	try
-	{
-		XmlDoc xCacheList;
-		xCacheList.LoadFromFile(listPath);
-		XmlHandle xRoot = xCacheList.Root();
+	DeleteLegacyCacheFiles();
 
-		u32 totalSize;
-		xRoot.GetAttribute("TotalSize", totalSize);
-
-		for (const XmlHandle& item : XmlIterator(xRoot, "Item"))
-		{
-			ConstString fileName = item.GetText();
-			file::WPath filePath = m_CacheDirectory / file::PathConverter::Utf8ToWide(fileName);
-
-			u32 hash, imageSize;
-			ImageFileKind imageKind = ImageFactory::GetImageKindFromPath(filePath);
+	m_ContentHashMemo.Load(m_CacheDirectory / CONTENT_HASH_MEMO_NAME);
 
-			if (imageKind == ImageKind_None || !GetInfoFromCachedImagePath(filePath, hash, imageSize))
-			{
-				AM_ERRF(L"Cache -> File name is invalid '%ls'", filePath.GetCStr());
-				continue;
-			}
-
-			CacheEntry entry = {};
-			entry.ImageKind = imageKind;
-			entry.ImageSize = imageSize;
-			entry.Flags |= ImageCacheEntryFlags_StoreInFileSystem;
-
-			m_Entries.EmplaceAt(hash, std::move(entry));
-			m_NewToOldEntriesFS.Add(hash);
-		}
-
-		m_SizeFs = totalSize;
+	// Load images from file system, records are ordered from newest to oldest
+	List<ImageCacheStore::Record> records;
+	if (!m_Store.Open(m_CacheDirectory, records))
+		return;
 
-		// Budget was lower since last load images don't fit anymore...
-		if (m_SizeFs > m_Settings.FileSystemStoreBudget)
-		{
-			CleanUpOldEntriesToFitBudget();
-		}
+	// Give older records smaller ticks to preserve the order
+	u64 tick = records.GetSize();
+	m_AccessTick = tick;
+	for (const ImageCacheStore::Record& record : records)
+	{
+		CacheEntry newEntry = {};
+		newEntry.Hash = record.Hash;
+		newEntry.ImageSize = record.ImageSize;
+		newEntry.ImagePaddingUV2 = record.PaddingUV2;
+		newEntry.Flags |= ImageCacheEntryFlags_StoreInFileSystem;
+		newEntry.LastAccessTick = tick--;
+
+		Shard& shard = GetShard(record.Hash);
+		CacheEntry& entry = shard.Entries.EmplaceAt(record.Hash, std::move(newEntry));
+		shard.EntriesFS.PushOldest(&entry);
+		m_SizeFs += record.ImageSize;
 	}
-	catch (const XmlException& ex)
+
+	// Budget was lower since last load images don't fit anymore...
+	if (m_SizeFs > m_Settings.FileSystemStoreBudget)
 	{
-		ex.Print();
+		CleanUpOldEntriesToFitBudget();
 	}
 }
 
@@ -264,130 +312,134 @@ rageam::graphics::ImageCache::~ImageCache()
 #ifdef DEBUG
 	u64 sizeRam = 0;
 	u64 sizeFs = 0;
-	for (CacheEntry& entry : m_Entries)
+	for (Shard& shard : m_Shards)
 	{
-		if (entry.Image)
-			sizeRam += entry.ImageSize;
-		else
-			sizeFs += entry.ImageSize;
+		for (CacheEntry& entry : shard.Entries)
+		{
+			if (entry.Image)
+				sizeRam += entry.ImageSize;
+			else
+				sizeFs += entry.ImageSize;
+		}
 	}
 
-	AM_ASSERT(sizeRam == m_SizeRam, "ImageCache~ -> Ram size doesn't match (expected: %llu, actual: %llu)", sizeRam, m_SizeRam);
-	AM_ASSERT(sizeFs == m_SizeFs, "ImageCache~ -> Fs size doesn't match (expected: %llu, actual: %llu)", sizeFs, m_SizeFs);
+	AM_ASSERT(sizeRam == m_SizeRam, "ImageCache~ -> Ram size doesn't match (expected: %llu, actual: %llu)", sizeRam, m_SizeRam.load());
+	AM_ASSERT(sizeFs == m_SizeFs, "ImageCache~ -> Fs size doesn't match (expected: %llu, actual: %llu)", sizeFs, m_SizeFs.load());
 #endif
 
 	// Store all images in file system
-	for (u32 hash : m_NewToOldEntriesRAM)
+	List<CacheEntry*> entriesFS;
+	for (Shard& shard : m_Shards)
 	{
-		CacheEntry& entry = m_Entries.GetAt(hash);
-
-		if (entry.Flags & ImageCacheEntryFlags_StoreInFileSystem)
+		while (CacheEntry* entry = shard.EntriesRAM.Oldest)
 		{
-			MoveImageToFileSystem(entry, hash);
-			m_SizeFs += entry.ImageSize;
-			m_SizeRam -= entry.ImageSize;
-			m_NewToOldEntriesFS.Insert(0, hash);
+			shard.EntriesRAM.Unlink(entry);
+			m_SizeRam -= entry->ImageSize;
+
+			if (entry->Flags & ImageCacheEntryFlags_StoreInFileSystem)
+			{
+				MoveImageToFileSystem(*entry, entry->Hash);
+				shard.EntriesFS.PushNewest(entry);
+				m_SizeFs += entry->ImageSize;
+			}
+			else
+			{
+				shard.Entries.RemoveAt(entry->Hash);
+			}
 		}
 
-		entry.Image = nullptr;
+		for (CacheEntry* entry = shard.EntriesFS.Newest; entry; entry = entry->Older)
+			entriesFS.Add(entry);
 	}
 
-	// We keep list to easily search for cached files and preserve new/old order
-	XmlDoc xCacheList("CacheList");
-	XmlHandle xRoot = xCacheList.Root();
-	xRoot.SetAttribute("Version", CACHE_LIST_VERSION);
-	xRoot.SetAttribute("TotalSize", m_SizeFs); // To see if budget lowered and we need clean up on loading
-	for (u32 hash : m_NewToOldEntriesFS)
-	{
-		CacheEntry& entry = m_Entries.GetAt(hash);
-		file::WPath entryPath = GetCachedImagePath(hash, entry.ImageSize, entry.ImageKind);
-		entryPath = entryPath.GetFileName();
-		xRoot.AddChild("Item", file::PathConverter::WideToUtf8(entryPath));
-	}
-	try
-	{
-		file::WPath listPath = m_CacheDirectory / CACHE_LIST_NAME;
-		xCacheList.SaveToFile(listPath);
-	}
-	catch (const XmlException& ex)
-	{
-		ex.Print();
-	}
+	// Index preserves new/old order among all shards
+	entriesFS.Sort([](const CacheEntry* lhs, const CacheEntry* rhs)
+		{
+			return lhs->LastAccessTick > rhs->LastAccessTick;
+		});
+
+	List<u32> hashesFS;
+	hashesFS.Reserve(entriesFS.GetSize());
+	for (const CacheEntry* entry : entriesFS)
+		hashesFS.Add(entry->Hash);
+	m_Store.Save(hashesFS);
+
+	m_ContentHashMemo.Save(m_CacheDirectory / CONTENT_HASH_MEMO_NAME);
 }
 
 rageam::graphics::ImagePtr rageam::graphics::ImageCache::GetFromCache(u32 hash, Vec2S* outUV2)
 {
-	std::unique_lock lock(m_Mutex);
-
 	if (outUV2) *outUV2 = { 1.0f, 1.0f };
 
-	CacheEntry* entry = m_Entries.TryGetAt(hash);
-	if (!entry)
-		return nullptr;
-
-	entry->LastAccessTime = ImGui::GetTime();
-
-	// Image was unloaded to file system before, load it now
-	if (!entry->Image)
+	ImagePtr image;
+	bool	 loadedFromFs = false;
 	{
-		file::WPath cachedImagePath = GetCachedImagePath(hash, entry->ImageSize, entry->ImageKind);
+		Shard& shard = GetShard(hash);
+		std::unique_lock lock(shard.Mutex);
 
-		// Load without using cache here or it will cause recursion...
-		entry->Image = ImageFactory::LoadFromPath(cachedImagePath, false, false);
+		CacheEntry* entry = shard.Entries.TryGetAt(hash);
+		if (!entry)
+			return nullptr;
 
-		// Remove hash entry from file system history
-		for (u32 i = 0; i < m_NewToOldEntriesFS.GetSize(); i++)
-		{
-			if (m_NewToOldEntriesFS[i] == hash)
-			{
-				m_NewToOldEntriesFS.RemoveAt(i);
-				break;
-			}
-		}
-		m_SizeFs -= entry->ImageSize;
+		entry->LastAccessTime = ImGui::GetTime();
+		entry->LastAccessTick = NextAccessTick();
 
-		// Add image back to ram if it was loaded successfully
+		// Image was already loaded, we have to update it's position in history list
 		if (entry->Image)
 		{
-			m_SizeRam += entry->ImageSize;
-			m_NewToOldEntriesRAM.Insert(0, hash);
+			shard.EntriesRAM.MoveToNewest(entry);
 		}
+		// Image was unloaded to file system before, load it now
 		else
 		{
-			AM_ERRF("ImageCache::GetFromCache() -> Failed to reload image from file system...");
-			m_Entries.RemoveAt(hash);
-			return nullptr;
-		}
+			{
+				std::unique_lock storeLock(m_StoreMutex);
+				entry->Image = m_Store.Read(hash);
+			}
 
-		// Image was loaded from file system to memory, revalidate budget
-		CleanUpOldEntriesToFitBudget();
-	}
-	// Image was already loaded, we have to update it's position in history list
-	else if (m_NewToOldEntriesFS.Any() && m_NewToOldEntriesFS.First() != hash)
-	{
-		for (u32 i = 0; i < m_NewToOldEntriesFS.GetSize(); i++)
-		{
-			if (m_NewToOldEntriesFS[i] == hash)
+			shard.EntriesFS.Unlink(entry);
+			m_SizeFs -= entry->ImageSize;
+
+			// Add image back to ram if it was loaded successfully
+			if (!entry->Image)
 			{
-				m_NewToOldEntriesFS.RemoveAt(i);
-				m_NewToOldEntriesFS.Insert(0, hash);
-				break;
+				AM_ERRF("ImageCache::GetFromCache() -> Failed to reload image from file system...");
+				{
+					std::unique_lock storeLock(m_StoreMutex);
+					m_Store.Remove(hash);
+				}
+				shard.Entries.RemoveAt(hash);
+				return nullptr;
 			}
+
+			shard.EntriesRAM.PushNewest(entry);
+			m_SizeRam += entry->ImageSize;
+			loadedFromFs = true;
 		}
+
+		if (outUV2) *outUV2 = entry->ImagePaddingUV2;
+		image = entry->Image;
 	}
 
-	if (outUV2) *outUV2 = entry->ImagePaddingUV2;
-	return entry->Image;
+	// Image was loaded from file system to memory, revalidate budget
+	if (loadedFromFs)
+		CleanUpOldEntriesToFitBudget();
+
+	return image;
 }
 
 bool rageam::graphics::ImageCache::GetFromCacheDX11(
 	u32 hash, amComPtr<ID3D11ShaderResourceView>& outView, Vec2S* outUV2, amComPtr<ID3D11Texture2D>* tex)
 {
-	std::unique_lock lock(m_Mutex);
+	Shard& shard = GetShard(hash);
+	std::unique_lock lock(shard.Mutex);
 
-	CacheEntryDX11* entry = m_EntriesDX11.TryGetAt(hash);
+	CacheEntryDX11* entry = shard.EntriesDX11.TryGetAt(hash);
 	if (entry)
 	{
+		entry->LastAccessTick = NextAccessTick();
+		shard.EntriesDX11List.MoveToNewest(entry);
+
 		outView = entry->View;
 		if (tex) *tex = entry->Tex;
 		if (outUV2) *outUV2 = entry->PaddingUV2;
@@ -398,8 +450,6 @@ bool rageam::graphics::ImageCache::GetFromCacheDX11(
 
 void rageam::graphics::ImageCache::Cache(const ImagePtr& image, u32 hash, u32 imageSize, ImageCacheEntryFlags entryFlags, Vec2S uv2)
 {
-	std::unique_lock lock(m_Mutex);
-
 	bool storeFs = entryFlags & ImageCacheEntryFlags_StoreInFileSystem;
 	bool storeTemp = entryFlags & ImageCacheEntryFlags_Temp;
 	if (storeFs && storeTemp)
@@ -416,44 +466,61 @@ void rageam::graphics::ImageCache::Cache(const ImagePtr& image, u32 hash, u32 im
 		return;
 	}
 
-	CacheEntry entry;
-	entry.Hash = hash;
-	entry.Image = image;
-	entry.ImageSize = imageSize;
-	entry.ImageKind = ImageIsCompressedFormat(image->GetPixelFormat()) ? ImageKind_DDS : ImageKind_PNG;
-	entry.Flags = entryFlags;
-	entry.ImagePaddingUV2 = uv2;
-	entry.LastAccessTime = ImGui::GetTime();
-	m_Entries.EmplaceAt(hash, std::move(entry));
-
-	m_SizeRam += imageSize;
-	m_NewToOldEntriesRAM.Remove(hash);
-	m_NewToOldEntriesRAM.Insert(0, hash);
+	{
+		Shard& shard = GetShard(hash);
+		std::unique_lock lock(shard.Mutex);
+
+		// Image with the same hash is already cached, replace it. If it was stored in file system, data stays valid
+		CacheEntry* existingEntry = shard.Entries.TryGetAt(hash);
+		if (existingEntry)
+			RemoveEntry(shard, existingEntry);
+
+		CacheEntry newEntry;
+		newEntry.Hash = hash;
+		newEntry.Image = image;
+		newEntry.ImageSize = imageSize;
+		newEntry.Flags = entryFlags;
+		newEntry.ImagePaddingUV2 = uv2;
+		newEntry.LastAccessTime = ImGui::GetTime();
+		newEntry.LastAccessTick = NextAccessTick();
+
+		CacheEntry& entry = shard.Entries.EmplaceAt(hash, std::move(newEntry));
+		shard.EntriesRAM.PushNewest(&entry);
+		m_SizeRam += imageSize;
+	}
 
 	CleanUpOldEntriesToFitBudget();
 }
 
 void rageam::graphics::ImageCache::CacheDX11(u32 hash, const amComPtr<ID3D11ShaderResourceView>& view, const amComPtr<ID3D11Texture2D>& tex, Vec2S uv2)
 {
-	std::unique_lock lock(m_Mutex);
-
 	IMAGE_CACHE_LOG("ImageCache::CacheDX11() -> Adding to cache, hash: %x", hash);
 
-	CacheEntryDX11 entry;
-	entry.View = view;
-	entry.Tex = tex;
-	entry.PaddingUV2 = uv2;
+	{
+		Shard& shard = GetShard(hash);
+		std::unique_lock lock(shard.Mutex);
 
-	m_NewToOldEntriesDX11.Remove(hash);
-	m_NewToOldEntriesDX11.Insert(0, hash);
-	m_EntriesDX11.EmplaceAt(hash, std::move(entry));
+		CacheEntryDX11* existingEntry = shard.EntriesDX11.TryGetAt(hash);
+		if (existingEntry)
+		{
+			shard.EntriesDX11List.Unlink(existingEntry);
+			shard.EntriesDX11.RemoveAt(hash);
+			--m_DX11ViewCount;
+		}
 
-	if (m_NewToOldEntriesDX11.GetSize() > m_Settings.MaxDX11Views)
-	{
-		u32 oldestHash = m_NewToOldEntriesDX11.Last();
-		m_NewToOldEntriesDX11.RemoveLast();
-		m_EntriesDX11.RemoveAt(oldestHash);
+		CacheEntryDX11 newEntry;
+		newEntry.View = view;
+		newEntry.Tex = tex;
+		newEntry.PaddingUV2 = uv2;
+		newEntry.Hash = hash;
+		newEntry.LastAccessTick = NextAccessTick();
+
+		CacheEntryDX11& entry = shard.EntriesDX11.EmplaceAt(hash, std::move(newEntry));
+		shard.EntriesDX11List.PushNewest(&entry);
+		++m_DX11ViewCount;
 	}
+
+	while (m_DX11ViewCount > m_Settings.MaxDX11Views && EvictOldest(EvictionTier_DX11)) {}
 }
 
 void rageam::graphics::ImageCache::DeleteOldEntries()
@@ -463,67 +530,73 @@ void rageam::graphics::ImageCache::DeleteOldEntries()
 		return;
 	m_NextTempEntriesDeleteTime = time + TEMP_DELETE_INTERVAL;
 
-	struct EntryToRemove
+	List<CacheEntry*> entriesToRemove;
+	for (Shard& shard : m_Shards)
 	{
-		u32 Hash, ImageSize;
-	};
+		std::unique_lock lock(shard.Mutex);
 
-	List<EntryToRemove> entriesToRemove;
-	for (CacheEntry& entry : m_Entries)
-	{
-		if (!(entry.Flags & ImageCacheEntryFlags_Temp))
-			continue;
-
-		double deltaTime = time - entry.LastAccessTime;
-		if (deltaTime > TEMP_MIN_INACTIVITY_TIME)
+		entriesToRemove.Clear();
+		for (CacheEntry& entry : shard.Entries)
 		{
-			EntryToRemove entryToRemove;
-			entryToRemove.Hash = entry.Hash;
-			entryToRemove.ImageSize= entry.ImageSize;
-			entriesToRemove.Add(entryToRemove);
-		}
-	}
+			if (!(entry.Flags & ImageCacheEntryFlags_Temp))
+				continue;
 
-	for (EntryToRemove entry : entriesToRemove)
-	{
-		IMAGE_CACHE_LOG("ImageCache::DeleteOldEntries() -> Removing %u", entry.Hash);
+			double deltaTime = time - entry.LastAccessTime;
+			if (deltaTime > TEMP_MIN_INACTIVITY_TIME)
+				entriesToRemove.Add(&entry);
+		}
 
-		m_SizeRam -= entry.ImageSize;
-		m_NewToOldEntriesRAM.Remove(entry.Hash);
-		m_Entries.RemoveAt(entry.Hash);
+		for (CacheEntry* entry : entriesToRemove)
+		{
+			IMAGE_CACHE_LOG("ImageCache::DeleteOldEntries() -> Removing %u", entry->Hash);
+			RemoveEntry(shard, entry);
+		}
 	}
 }
 
 void rageam::graphics::ImageCache::Clear()
 {
-	std::unique_lock lock(m_Mutex);
+	// Always locked in the same order, other functions never hold more than one shard lock
+	for (Shard& shard : m_Shards)
+		shard.Mutex.lock();
 
-	for (u32 fsHash : m_NewToOldEntriesFS)
+	for (Shard& shard : m_Shards)
 	{
-		CacheEntry& fsEntry = m_Entries.GetAt(fsHash);
-		file::WPath fsPath = GetCachedImagePath(fsHash, fsEntry.ImageSize, fsEntry.ImageKind);
-		DeleteFileW(fsPath);
+		shard.EntriesDX11.Destroy();
+		shard.Entries.Destroy();
+		shard.EntriesRAM.Reset();
+		shard.EntriesFS.Reset();
+		shard.EntriesDX11List.Reset();
 	}
-
-	m_EntriesDX11.Destroy();
-	m_Entries.Destroy();
-	m_NewToOldEntriesRAM.Destroy();
-	m_NewToOldEntriesFS.Destroy();
 	m_SizeRam = 0;
 	m_SizeFs = 0;
+	m_DX11ViewCount = 0;
+
+	{
+		std::unique_lock storeLock(m_StoreMutex);
+		m_Store.Clear();
+	}
+	m_ContentHashMemo.Clear();
+
+	for (Shard& shard : m_Shards)
+		shard.Mutex.unlock();
 }
 
 rageam::graphics::ImageCacheState rageam::graphics::ImageCache::GetState()
 {
-	std::unique_lock lock(m_Mutex);
-
 	ImageCacheState state;
 	state.SizeRamUsed = m_SizeRam;
 	state.SizeRamBudget = m_Settings.MemoryStoreBudget;
 	state.SizeFsUsed = m_SizeFs;
 	state.SizeFsBudget = m_Settings.FileSystemStoreBudget;
-	state.ImageCountRam = m_NewToOldEntriesRAM.GetSize();
-	state.ImageCountFs = m_NewToOldEntriesFS.GetSize();
-	state.DX11ViewCount = m_NewToOldEntriesDX11.GetSize();
+	state.ImageCountRam = 0;
+	state.ImageCountFs = 0;
+	state.DX11ViewCount = m_DX11ViewCount;
+	for (Shard& shard : m_Shards)
+	{
+		std::unique_lock lock(shard.Mutex);
+		state.ImageCountRam += shard.EntriesRAM.Count;
+		state.ImageCountFs += shard.EntriesFS.Count;
+	}
 	return state;
 }
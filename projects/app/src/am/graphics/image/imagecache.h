@@ -1,8 +1,13 @@
 #pragma once
 
 #include "image.h"
+#include "imagecachestore.h"
+#include "imagehash.h"
 #include "am/system/singleton.h"
 
+#include <atomic>
+#include <mutex>
+
 namespace rageam::graphics
 {
 	// #define IMAGE_CACHE_ENABLE_LOG
@@ -35,6 +40,59 @@ namespace rageam::graphics
 	};
 	typedef int ImageCacheEntryFlags;
 
+	/**
+	 * \brief Intrusive doubly linked list of cache entries ordered from newest to oldest, all operations are O(1).
+	 * \remarks Entry must have Newer and Older pointers and can be only in one list at a time.
+	 */
+	template<typename TEntry>
+	struct ImageCacheRecencyList
+	{
+		TEntry* Newest = nullptr;
+		TEntry* Oldest = nullptr;
+		u32		Count = 0;
+
+		void PushNewest(TEntry* entry)
+		{
+			entry->Newer = nullptr;
+			entry->Older = Newest;
+			if (Newest) Newest->Newer = entry;
+			else		Oldest = entry;
+			Newest = entry;
+			Count++;
+		}
+
+		void PushOldest(TEntry* entry)
+		{
+			entry->Older = nullptr;
+			entry->Newer = Oldest;
+			if (Oldest) Oldest->Older = entry;
+			else		Newest = entry;
+			Oldest = entry;
+			Count++;
+		}
+
+		void Unlink(TEntry* entry)
+		{
+			if (entry->Newer) entry->Newer->Older = entry->Older;
+			else			  Newest = entry->Older;
+			if (entry->Older) entry->Older->Newer = entry->Newer;
+			else			  Oldest = entry->Newer;
+			entry->Newer = nullptr;
+			entry->Older = nullptr;
+			Count--;
+		}
+
+		void MoveToNewest(TEntry* entry)
+		{
+			if (Newest == entry)
+				return;
+			Unlink(entry);
+			PushNewest(entry);
+		}
+
+		void Reset() { *this = {}; }
+	};
+
 	/**
 	 * \brief Two level image cache - in memory and in file system.
 	 */
@@ -45,21 +103,27 @@ namespace rageam::graphics
 		static constexpr u32 DEFAULT_TIME_TO_CACHE_THRESHOLD = 25;						// Milliseconds
 		static constexpr u32 DEFAULT_DX11_VIEWS_MAX = 50;
 		static constexpr u32 SETTINGS_VERSION = 0;
-		static constexpr u32 CACHE_LIST_VERSION = 0;
 		static constexpr ConstWString DEFAULT_CACHE_DIRECTORY_NAME = L"CompressorCache";
-		static constexpr ConstWString CACHE_LIST_NAME = L"List.xml";
+		// Images used to be stored as separate files listed in this xml, we clean them up on first start
+		static constexpr ConstWString LEGACY_CACHE_LIST_NAME = L"List.xml";
+		static constexpr ConstWString CONTENT_HASH_MEMO_NAME = L"ContentHashes.bin";
 		static constexpr double TEMP_MIN_INACTIVITY_TIME = 60.0f;	// Temp textures are removed 60 seconds after they're accessed last time
 		static constexpr double TEMP_DELETE_INTERVAL = 10.0f;		// Every 10 seconds
+		// Entries are split between shards with separate locks so thumbnail loader and compressor don't fight for a single one
+		static constexpr u32 SHARD_COUNT = 16;
 
 		struct CacheEntry
 		{
 			u32                  Hash;
 			ImagePtr             Image;
 			u32                  ImageSize;
-			ImageFileKind        ImageKind;			// We store kind to get file extension when loading image from file system
 			Vec2S                ImagePaddingUV2;	// In case if image was padded, contains adjusted UV2
 			ImageCacheEntryFlags Flags = ImageCacheEntryFlags_None;
 			double               LastAccessTime = -1.0f;
+			u64					 LastAccessTick = 0;	// To find the oldest entry among all shards
+			// Links in RAM (if image is loaded) or FS recency list of the shard
+			CacheEntry*			 Newer = nullptr;
+			CacheEntry*			 Older = nullptr;
 		};
 
 		struct CacheEntryDX11
@@ -67,6 +131,31 @@ namespace rageam::graphics
 			amComPtr<ID3D11ShaderResourceView> View;
 			amComPtr<ID3D11Texture2D>		   Tex;
 			Vec2S							   PaddingUV2;
+			u32								   Hash;
+			u64								   LastAccessTick = 0;
+			CacheEntryDX11*					   Newer = nullptr;
+			CacheEntryDX11*					   Older = nullptr;
+		};
+
+		using EntryList = ImageCacheRecencyList<CacheEntry>;
+		using EntryListDX11 = ImageCacheRecencyList<CacheEntryDX11>;
+
+		// Entry node addresses in hash set are stable, so lists can point to them directly
+		struct Shard
+		{
+			std::mutex				Mutex;
+			HashSet<CacheEntry>		Entries;
+			HashSet<CacheEntryDX11>	EntriesDX11;
+			EntryList				EntriesRAM;
+			EntryList				EntriesFS;
+			EntryListDX11			EntriesDX11List;
+		};
+
+		enum EvictionTier
+		{
+			EvictionTier_RAM,
+			EvictionTier_FS,
+			EvictionTier_DX11,
 		};
 
 		struct Settings
@@ -80,17 +169,18 @@ namespace rageam::graphics
 
 		Settings				m_Settings = {};
 		file::WPath				m_CacheDirectory;
-		HashSet<CacheEntry>		m_Entries;
-		HashSet<CacheEntryDX11>	m_EntriesDX11;
-		// Hashes of entries ordered from newest (first) to oldest (last)
-		// Ordered this way because it's easier to remove entries from end than from beginning
-		List<u32>				m_NewToOldEntriesRAM;
-		List<u32>				m_NewToOldEntriesFS;
-		List<u32>				m_NewToOldEntriesDX11;
-		u64						m_SizeRam = 0;			// Bytes taken by images in memory
-		u64						m_SizeFs = 0;			// Bytes taken by images in file system
+		Shard					m_Shards[SHARD_COUNT];
+		ImageCacheStore			m_Store;
+		ImageContentHashMemo	m_ContentHashMemo;
+		std::mutex				m_StoreMutex;			// Always locked after shard mutex, never before
+		std::atomic_uint64_t	m_SizeRam = 0;			// Bytes taken by images in memory
+		std::atomic_uint64_t	m_SizeFs = 0;			// Bytes taken by images in file system
+		std::atomic_uint32_t	m_DX11ViewCount = 0;
+		std::atomic_uint64_t	m_AccessTick = 0;
 		double					m_NextTempEntriesDeleteTime = 0.0f;
-		std::mutex				m_Mutex;
+
+		Shard& GetShard(u32 hash) { return m_Shards[hash % SHARD_COUNT]; }
+		u64	   NextAccessTick() { return ++m_AccessTick; }
 
 		u32 BytesToMb(u32 bytes) const { return bytes / (1024u * 1024u); }
 		u32 MbToBytes(u32 mb) const { return mb * 1024u * 1024u; }
@@ -100,12 +190,17 @@ namespace rageam::graphics
 		void LoadSettings();
 
 		bool GetInfoFromCachedImagePath(const file::WPath& path, u32& hash, u32& imageSize) const;
-		// If image kind is none, no extension added
-		file::WPath GetCachedImagePath(u32 hash, u32 imageSize, ImageFileKind kind) const;
+		// Removes image files and list left from the old cache format
+		void DeleteLegacyCacheFiles() const;
 
 		// Does not account stats
-		void MoveImageToFileSystem(CacheEntry& entry, u32 hash) const;
+		void MoveImageToFileSystem(CacheEntry& entry, u32 hash);
+		// Unlinks entry from the list it's in and removes it from the shard, shard must be locked
+		void RemoveEntry(Shard& shard, CacheEntry* entry);
 
+		// Evicts the oldest entry of given tier among all shards, no shard must be locked by the caller
+		// Returns false if there's nothing to evict
+		bool EvictOldest(EvictionTier tier);
 		void CleanUpOldEntriesToFitBudget();
 
 	public:
@@ -124,6 +219,9 @@ namespace rageam::graphics
 		HashValue ComputeImageHash(ImagePixelData imageData, u32 imageDataSize, const CompressedImageInfo& compInfo) const;
 		// Computes unique hash based on only pixel data
 		HashValue ComputeImageHash(ImagePixelData	imageData, u32 imageDataSize) const;
+		// Content hash (see Image::ComputeContentHash) of image file that was decoded before, if file wasn't modified since then
+		bool GetContentHash(ConstWString path, u64& outContentHash) { return m_ContentHashMemo.TryGet(path, outContentHash); }
+		void SetContentHash(ConstWString path, u64 contentHash) { m_ContentHashMemo.Set(path, contentHash); }
 		// Checks if given time is greater than threshold
 		bool ShouldStore(u32 elapsedMilliseconds) const { return elapsedMilliseconds >= m_Settings.TimeToCacheThreshold; }
 
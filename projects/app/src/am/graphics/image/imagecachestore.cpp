@@ -0,0 +1,385 @@
+#include "imagecachestore.h"
+
+#include "am/file/fileutils.h"
+#include "common/logger.h"
+#include "helpers/align.h"
+#include "helpers/format.h"
+
+#include <zlib-ng.h>
+#include <easy/profiler.h>
+
+namespace
+{
+	bool ReadFileAt(HANDLE hFile, u64 offset, pVoid buffer, u32 size)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD bytesRead;
+		return ReadFile(hFile, buffer, size, &bytesRead, &overlapped) && bytesRead == size;
+	}
+
+	// Writing past the end of file extends it, gap is filled with zeros
+	bool WriteFileAt(HANDLE hFile, u64 offset, pConstVoid buffer, u32 size)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD bytesWritten;
+		return WriteFile(hFile, buffer, size, &bytesWritten, &overlapped) && bytesWritten == size;
+	}
+
+	bool SetFileSize(HANDLE hFile, u64 size)
+	{
+		LARGE_INTEGER distance;
+		distance.QuadPart = static_cast<LONGLONG>(size);
+		return SetFilePointerEx(hFile, distance, NULL, FILE_BEGIN) && SetEndOfFile(hFile);
+	}
+}
+
+bool rageam::graphics::ImageCacheStore::OpenDataFile()
+{
+	m_DataFile = CreateFileW(
+		m_DataPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_DataFile == INVALID_HANDLE_VALUE)
+	{
+		AM_ERRF(L"ImageCacheStore::OpenDataFile() -> Failed to open '%ls', last error: %u", m_DataPath.GetCStr(), GetLastError());
+		return false;
+	}
+	return true;
+}
+
+void rageam::graphics::ImageCacheStore::CloseDataFile()
+{
+	if (m_DataFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_DataFile);
+		m_DataFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+bool rageam::graphics::ImageCacheStore::Compact(List<Record>& records)
+{
+	EASY_FUNCTION();
+
+	AM_DEBUGF("ImageCacheStore::Compact() -> Compacting data file, %s of %s is used",
+		FormatSize(m_LiveDataSize), FormatSize(m_DataFileSize));
+
+	file::WPath tempPath = m_DataPath + L".tmp";
+	HANDLE hTempFile = CreateFileW(tempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hTempFile == INVALID_HANDLE_VALUE)
+	{
+		AM_ERRF(L"ImageCacheStore::Compact() -> Failed to create '%ls', last error: %u", tempPath.GetCStr(), GetLastError());
+		return false;
+	}
+
+	List<Record> newRecords;
+	newRecords.Reserve(records.GetSize());
+
+	u64  newDataFileSize = 0;
+	bool success = true;
+	for (const Record& record : records)
+	{
+		ImageScratchScope scratchScope;
+		pVoid buffer = ImageAllocTemp(record.DataSize);
+		u64   newOffset = ALIGN(newDataFileSize, DATA_ALIGNMENT);
+		if (!ReadFileAt(m_DataFile, record.DataOffset, buffer, record.DataSize) ||
+			!WriteFileAt(hTempFile, newOffset, buffer, record.DataSize))
+		{
+			success = false;
+			break;
+		}
+
+		Record& newRecord = newRecords.Add(record);
+		newRecord.DataOffset = newOffset;
+		newDataFileSize = newOffset + record.DataSize;
+	}
+	CloseHandle(hTempFile);
+
+	if (!success)
+	{
+		AM_ERRF("ImageCacheStore::Compact() -> Failed to copy image data, last error: %u", GetLastError());
+		DeleteFileW(tempPath);
+		return false;
+	}
+
+	CloseDataFile();
+	if (!MoveFileExW(tempPath, m_DataPath, MOVEFILE_REPLACE_EXISTING))
+	{
+		AM_ERRF("ImageCacheStore::Compact() -> Failed to replace data file, last error: %u", GetLastError());
+		DeleteFileW(tempPath);
+		return OpenDataFile();
+	}
+	if (!OpenDataFile())
+		return false;
+
+	records = std::move(newRecords);
+	m_DataFileSize = newDataFileSize;
+
+	// Old index points to the data that was moved, must be updated right away
+	return WriteIndex(records);
+}
+
+bool rageam::graphics::ImageCacheStore::WriteIndex(const List<Record>& records) const
+{
+	IndexHeader header = {};
+	header.Magic = INDEX_MAGIC;
+	header.Version = INDEX_VERSION;
+	header.RecordCount = records.GetSize();
+	header.DataFileSize = m_DataFileSize;
+
+	HANDLE hFile = file::CreateNew(m_IndexPath);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		AM_ERRF(L"ImageCacheStore::WriteIndex() -> Failed to create '%ls', last error: %u", m_IndexPath.GetCStr(), GetLastError());
+		return false;
+	}
+
+	bool success =
+		WriteFileAt(hFile, 0, &header, sizeof IndexHeader) &&
+		WriteFileAt(hFile, sizeof IndexHeader, records.GetItems(), records.GetSize() * sizeof Record);
+	CloseHandle(hFile);
+
+	if (!success)
+	{
+		AM_ERRF("ImageCacheStore::WriteIndex() -> Failed to write index, last error: %u", GetLastError());
+		DeleteFileW(m_IndexPath);
+	}
+	return success;
+}
+
+rageam::graphics::ImageCacheStore::~ImageCacheStore()
+{
+	CloseDataFile();
+}
+
+bool rageam::graphics::ImageCacheStore::Open(const file::WPath& directory, List<Record>& outRecords)
+{
+	EASY_FUNCTION();
+
+	m_IndexPath = directory / INDEX_FILE_NAME;
+	m_DataPath = directory / DATA_FILE_NAME;
+
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	m_AllocationGranularity = systemInfo.dwAllocationGranularity;
+
+	// Whole index is loaded in one go
+	List<Record> records;
+	u64			 dataFileSize = 0;
+	file::FileView indexView;
+	if (IsFileExists(m_IndexPath) && file::MapFileView(m_IndexPath, indexView))
+	{
+		const IndexHeader* header = reinterpret_cast<const IndexHeader*>(indexView.Data);
+		if (indexView.Size >= sizeof IndexHeader &&
+			header->Magic == INDEX_MAGIC &&
+			header->Version == INDEX_VERSION &&
+			indexView.Size == sizeof IndexHeader + static_cast<u64>(header->RecordCount) * sizeof Record)
+		{
+			const Record* indexRecords = reinterpret_cast<const Record*>(indexView.Data + sizeof IndexHeader);
+			records.Resize(header->RecordCount);
+			memcpy(records.GetItems(), indexRecords, header->RecordCount * sizeof Record);
+			dataFileSize = header->DataFileSize;
+		}
+		else
+		{
+			AM_WARNINGF("ImageCacheStore::Open() -> Index file is not valid, cache will be reset.");
+		}
+		file::UnmapFileView(indexView.Data);
+	}
+
+	if (!OpenDataFile())
+		return false;
+
+	LARGE_INTEGER actualDataFileSize;
+	if (!GetFileSizeEx(m_DataFile, &actualDataFileSize))
+		actualDataFileSize.QuadPart = 0;
+
+	// Data file was lost or modified externally, nothing can be trusted
+	if (static_cast<u64>(actualDataFileSize.QuadPart) < dataFileSize)
+	{
+		AM_WARNINGF("ImageCacheStore::Open() -> Data file is smaller than expected, cache will be reset.");
+		records.Clear();
+		dataFileSize = 0;
+	}
+
+	// We crashed after appending images last time, they are not in the index and can be dropped
+	if (static_cast<u64>(actualDataFileSize.QuadPart) > dataFileSize)
+		SetFileSize(m_DataFile, dataFileSize);
+
+	m_DataFileSize = dataFileSize;
+	m_LiveDataSize = 0;
+	for (const Record& record : records)
+		m_LiveDataSize += record.DataSize;
+
+	if (m_DataFileSize - m_LiveDataSize > COMPACT_MIN_WASTED_SIZE)
+		Compact(records);
+
+	for (const Record& record : records)
+		m_Records.InsertAt(record.Hash, record);
+
+	outRecords = std::move(records);
+	return true;
+}
+
+bool rageam::graphics::ImageCacheStore::Store(u32 hash, const ImagePtr& image, u32 imageSize, Vec2S paddingUV2)
+{
+	EASY_FUNCTION();
+
+	if (Contains(hash))
+		return true;
+
+	if (m_DataFile == INVALID_HANDLE_VALUE || !image->HasPixelData())
+		return false;
+
+	ImageInfo imageInfo = image->GetInfo();
+	u32       pixelDataSize = image->ComputeTotalSizeWithMips();
+	char*     pixelData = image->GetPixelDataBytes();
+
+	ImageScratchScope scratchScope;
+
+	// Only uncompressed pixels are worth compressing, block compressed ones are already dense
+	pConstVoid data = pixelData;
+	u32        dataSize = pixelDataSize;
+	bool       compressed = false;
+	if (!ImageIsCompressedFormat(imageInfo.PixelFormat))
+	{
+		size_t compressedSize = zng_compressBound(pixelDataSize);
+		pVoid  compressedData = ImageAllocTemp(static_cast<u32>(compressedSize));
+		int    zresult = zng_compress2(
+			static_cast<uint8_t*>(compressedData), &compressedSize, reinterpret_cast<uint8_t*>(pixelData), pixelDataSize, Z_BEST_SPEED);
+		if (zresult == Z_OK && compressedSize <= pixelDataSize - (pixelDataSize >> COMPRESSION_MIN_GAIN_SHIFT))
+		{
+			data = compressedData;
+			dataSize = static_cast<u32>(compressedSize);
+			compressed = true;
+		}
+	}
+
+	u64 dataOffset = ALIGN(m_DataFileSize, DATA_ALIGNMENT);
+	if (!WriteFileAt(m_DataFile, dataOffset, data, dataSize))
+	{
+		AM_ERRF("ImageCacheStore::Store() -> Failed to write image data, last error: %u", GetLastError());
+		return false;
+	}
+	m_DataFileSize = dataOffset + dataSize;
+	m_LiveDataSize += dataSize;
+
+	Record record = {};
+	record.Hash = hash;
+	record.ImageSize = imageSize;
+	record.DataOffset = dataOffset;
+	record.DataSize = dataSize;
+	record.PixelDataSize = pixelDataSize;
+	record.Width = static_cast<u16>(imageInfo.Width);
+	record.Height = static_cast<u16>(imageInfo.Height);
+	record.MipCount = static_cast<u8>(imageInfo.MipCount);
+	record.PixelFormat = static_cast<u8>(imageInfo.PixelFormat);
+	record.Compressed = compressed;
+	record.PaddingUV2 = paddingUV2;
+	m_Records.InsertAt(hash, record);
+
+	return true;
+}
+
+rageam::graphics::ImagePtr rageam::graphics::ImageCacheStore::Read(u32 hash, Vec2S* outPaddingUV2)
+{
+	EASY_FUNCTION();
+
+	const Record* record = m_Records.TryGetAt(hash);
+	if (!record)
+		return nullptr;
+
+	// Mapping is created for every read because data file grows and mapping size is fixed, it's cheap compared to image loading
+	HANDLE hMapping = CreateFileMappingW(m_DataFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (!hMapping)
+	{
+		AM_ERRF("ImageCacheStore::Read() -> Failed to create mapping, last error: %u", GetLastError());
+		return nullptr;
+	}
+
+	// View offset must be multiple of allocation granularity
+	u64 viewOffset = record->DataOffset & ~static_cast<u64>(m_AllocationGranularity - 1);
+	u64 dataOffsetInView = record->DataOffset - viewOffset;
+	char* view = static_cast<char*>(MapViewOfFile(hMapping, FILE_MAP_COPY,
+		static_cast<DWORD>(viewOffset >> 32), static_cast<DWORD>(viewOffset), dataOffsetInView + record->DataSize));
+	CloseHandle(hMapping);
+	if (!view)
+	{
+		AM_ERRF("ImageCacheStore::Read() -> Failed to map view, last error: %u", GetLastError());
+		return nullptr;
+	}
+
+	PixelDataOwner pixelData;
+	if (record->Compressed)
+	{
+		pixelData = PixelDataOwner::AllocateWithSize(record->PixelDataSize);
+		size_t pixelDataSize = record->PixelDataSize;
+		int zresult = zng_uncompress(
+			reinterpret_cast<uint8_t*>(pixelData.Data()->Bytes), &pixelDataSize,
+			reinterpret_cast<uint8_t*>(view + dataOffsetInView), record->DataSize);
+		UnmapViewOfFile(view);
+
+		if (zresult != Z_OK || pixelDataSize != record->PixelDataSize)
+		{
+			AM_ERRF("ImageCacheStore::Read() -> Failed to decompress image data (code %i), data file is corrupted.", zresult);
+			return nullptr;
+		}
+	}
+	else
+	{
+		// Pixels are used directly from the view, it is unmapped once image is released
+		amPtr<std::atomic_int> mappedViewCount = m_MappedViewCount;
+		++*mappedViewCount;
+		pixelData = PixelDataOwner::CreateOwned(view + dataOffsetInView);
+		pixelData.DeleteFn = [view, mappedViewCount](pVoid)
+			{
+				UnmapViewOfFile(view);
+				--*mappedViewCount;
+			};
+	}
+
+	if (outPaddingUV2) *outPaddingUV2 = record->PaddingUV2;
+
+	ImageInfo imageInfo;
+	imageInfo.PixelFormat = static_cast<ImagePixelFormat>(record->PixelFormat);
+	imageInfo.Width = record->Width;
+	imageInfo.Height = record->Height;
+	imageInfo.MipCount = record->MipCount;
+	return std::make_shared<Image>(pixelData, imageInfo);
+}
+
+void rageam::graphics::ImageCacheStore::Remove(u32 hash)
+{
+	const Record* record = m_Records.TryGetAt(hash);
+	if (!record)
+		return;
+
+	m_LiveDataSize -= record->DataSize;
+	m_Records.RemoveAt(hash);
+}
+
+void rageam::graphics::ImageCacheStore::Clear()
+{
+	m_Records.Destroy();
+	m_LiveDataSize = 0;
+
+	// File can't be truncated while there are mapped views, leave it for compaction on next startup
+	if (*m_MappedViewCount == 0 && SetFileSize(m_DataFile, 0))
+		m_DataFileSize = 0;
+
+	WriteIndex({});
+}
+
+void rageam::graphics::ImageCacheStore::Save(const List<u32>& hashes) const
+{
+	List<Record> records;
+	records.Reserve(hashes.GetSize());
+	for (u32 hash : hashes)
+	{
+		const Record* record = m_Records.TryGetAt(hash);
+		if (record)
+			records.Add(*record);
+	}
+	WriteIndex(records);
+}
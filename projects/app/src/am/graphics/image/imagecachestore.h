@@ -0,0 +1,102 @@
+//
+// File: imagecachestore.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "image.h"
+#include "am/file/path.h"
+
+#include <atomic>
+
+namespace rageam::graphics
+{
+	/**
+	 * \brief File system tier of ImageCache, all images are packed in a single append-only data file.
+	 * \remarks Index of fixed size records is loaded on startup with a single read and written back on shutdown.
+	 * While running, data file is only appended to; space taken by removed images is reclaimed by compacting
+	 * data file on next startup. Images are read through mapped views of data file, uncompressed ones without copying.
+	 * Not thread safe, ImageCache guards all calls with it's own mutex.
+	 */
+	class ImageCacheStore
+	{
+	public:
+		struct Record
+		{
+			u32	  Hash;
+			u32	  ImageSize;		// Size used to account cache budget, not the stored size
+			u64	  DataOffset;
+			u32	  DataSize;			// Stored size, less than pixel data size if compressed
+			u32	  PixelDataSize;
+			u16	  Width;
+			u16	  Height;
+			u8	  MipCount;
+			u8	  PixelFormat;
+			u8	  Compressed;
+			u8	  Reserved;
+			Vec2S PaddingUV2;
+		};
+		static_assert(sizeof(Record) == 40);
+
+	private:
+		static constexpr u32 INDEX_MAGIC = 0x43494D41; // AMIC
+		static constexpr u32 INDEX_VERSION = 0;
+		static constexpr ConstWString INDEX_FILE_NAME = L"Images.idx";
+		static constexpr ConstWString DATA_FILE_NAME = L"Images.bin";
+		// Entries are aligned in data file so mapped pixel data can be accessed with aligned SIMD loads
+		static constexpr u64 DATA_ALIGNMENT = 16;
+		// Data file is compacted on startup once removed images take more than this
+		static constexpr u64 COMPACT_MIN_WASTED_SIZE = 64ull * 1024ull * 1024ull;
+		// Compressed entry is stored only if it's at least 1/8 smaller, block compressed pixels almost never are
+		static constexpr u32 COMPRESSION_MIN_GAIN_SHIFT = 3;
+
+		struct IndexHeader
+		{
+			u32 Magic;
+			u32 Version;
+			u32 RecordCount;
+			u32 Reserved;
+			u64 DataFileSize;	// Data file may be larger if we crashed after appending, rest is garbage
+		};
+
+		file::WPath		m_IndexPath;
+		file::WPath		m_DataPath;
+		HANDLE			m_DataFile = INVALID_HANDLE_VALUE;
+		u64				m_DataFileSize = 0;
+		u64				m_LiveDataSize = 0;
+		HashSet<Record>	m_Records;
+		u32				m_AllocationGranularity = 0;
+		// Number of images that still reference data file views, file can't be truncated while there are any
+		// Shared because images may outlive the cache
+		amPtr<std::atomic_int> m_MappedViewCount = std::make_shared<std::atomic_int>(0);
+
+		bool OpenDataFile();
+		void CloseDataFile();
+		// Rewrites data file with only records that are in the index
+		bool Compact(List<Record>& records);
+		bool WriteIndex(const List<Record>& records) const;
+
+	public:
+		ImageCacheStore() = default;
+		~ImageCacheStore();
+
+		// Loads index from given directory, out records are ordered the same way they were passed to Save
+		bool Open(const file::WPath& directory, List<Record>& outRecords);
+
+		bool Contains(u32 hash) const { return m_Records.ContainsAt(hash); }
+		// Appends image pixel data to data file
+		bool Store(u32 hash, const ImagePtr& image, u32 imageSize, Vec2S paddingUV2);
+		ImagePtr Read(u32 hash, Vec2S* outPaddingUV2 = nullptr);
+		// Image data stays in data file until it is compacted
+		void Remove(u32 hash);
+		void Clear();
+		// Writes index with given records in given order, records that are not in the list are dropped
+		void Save(const List<u32>& hashes) const;
+
+		u64 GetDataFileSize() const { return m_DataFileSize; }
+		u64 GetLiveDataSize() const { return m_LiveDataSize; }
+	};
+}
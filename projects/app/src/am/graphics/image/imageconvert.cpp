@@ -0,0 +1,442 @@
+#include "image.h"
+
+#include "am/system/enum.h"
+
+#include <easy/profiler.h>
+
+namespace
+{
+	using namespace rageam::graphics;
+
+	// Formats other than RGBA are converted between each other through RGBA in chunks that fit in L1
+	constexpr int CONVERT_CHUNK_PIXELS = 1024;
+
+	// Rec. 601 luma in 8 bit fixed point, weights add up to 256 so gray stays exactly the same
+	constexpr int LUMA_R = 77;
+	constexpr int LUMA_G = 150;
+	constexpr int LUMA_B = 29;
+
+	using ConvertFn = void(*)(u8* dst, const u8* src, int count);
+
+	u8 ComputeLuma(const u8* pixel)
+	{
+		return static_cast<u8>((pixel[0] * LUMA_R + pixel[1] * LUMA_G + pixel[2] * LUMA_B + 128) >> 8);
+	}
+
+#ifdef AM_IMAGE_USE_SIMD
+	// Luma of 4 RGBA pixels as 32 bit integers
+	__m128i ComputeLuma4(__m128i pixels)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i weights = _mm_setr_epi16(LUMA_R, LUMA_G, LUMA_B, 0, LUMA_R, LUMA_G, LUMA_B, 0);
+		// [R * Wr + G * Wg, B * Wb] for every pixel, pairs are summed horizontally
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+		return _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), _mm_set1_epi32(128)), 8);
+	}
+#endif
+#ifdef AM_IMAGE_USE_AVX2
+	// Same as above for 8 pixels, pixels keep their order
+	__m256i ComputeLuma8(__m256i pixels)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i weights = _mm256_setr_epi16(
+			LUMA_R, LUMA_G, LUMA_B, 0, LUMA_R, LUMA_G, LUMA_B, 0,
+			LUMA_R, LUMA_G, LUMA_B, 0, LUMA_R, LUMA_G, LUMA_B, 0);
+		__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), weights);
+		__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), weights);
+		return _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), _mm256_set1_epi32(128)), 8);
+	}
+
+	// Packs four vectors of 8 32 bit values (0 - 255) to 32 bytes, in original order
+	__m256i PackBytes32(__m256i a, __m256i b, __m256i c, __m256i d)
+	{
+		// Pack works per 128 bit lane, giving [a0-3 b0-3 c0-3 d0-3 | a4-7 b4-7 c4-7 d4-7]
+		__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+		return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+	}
+#endif
+
+	// -- To RGBA --
+
+	void ConvertRGBToRGBA(u8* dst, const u8* src, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_AVX2
+		// Two groups of 4 RGB pixels in each lane, loads read 4 bytes past the group so last pixels are left for SSE / scalar
+		const __m256i shuffle256 = _mm256_broadcastsi128_si256(IMAGE_RGB_TO_RGBA_SHUFFLE);
+		const __m256i alpha256 = _mm256_broadcastsi128_si256(IMAGE_RGBA_ALPHA_MASK);
+		for (; i + 10 <= count; i += 8)
+		{
+			__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+			__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+			__m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+			pixels = _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle256), alpha256);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), pixels);
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		for (; i + 6 <= count; i += 4)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+			pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, IMAGE_RGB_TO_RGBA_SHUFFLE), IMAGE_RGBA_ALPHA_MASK);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), pixels);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			dst[i * 4 + 0] = src[i * 3 + 0];
+			dst[i * 4 + 1] = src[i * 3 + 1];
+			dst[i * 4 + 2] = src[i * 3 + 2];
+			dst[i * 4 + 3] = 255;
+		}
+	}
+
+	void ConvertGrayAlphaToRGBA(u8* dst, const u8* src, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_SIMD
+		const __m128i shuffleLo = _mm_setr_epi8(0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7);
+		const __m128i shuffleHi = _mm_setr_epi8(8, 8, 8, 9, 10, 10, 10, 11, 12, 12, 12, 13, 14, 14, 14, 15);
+#endif
+#ifdef AM_IMAGE_USE_AVX2
+		const __m256i shuffle256 = _mm256_inserti128_si256(_mm256_castsi128_si256(shuffleLo), shuffleHi, 1);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i pixels = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(pixels, shuffle256));
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(pixels, shuffleLo));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_shuffle_epi8(pixels, shuffleHi));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			dst[i * 4 + 0] = src[i * 2];
+			dst[i * 4 + 1] = src[i * 2];
+			dst[i * 4 + 2] = src[i * 2];
+			dst[i * 4 + 3] = src[i * 2 + 1];
+		}
+	}
+
+	// Gray is expanded to opaque RGB, alpha is expanded to all four components, same as in ImageGetPixelColor
+	template<bool IsAlpha>
+	void ConvertSingleChannelToRGBA(u8* dst, const u8* src, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_SIMD
+		const char a = IsAlpha ? 0 : -128; // Index of alpha byte, zeroed and set to 255 for gray
+		const __m128i alphaMask = IsAlpha ? _mm_setzero_si128() : IMAGE_RGBA_ALPHA_MASK;
+		const __m128i shuffles[4] =
+		{
+			_mm_setr_epi8(0, 0, 0, a, 1, 1, 1, a + 1, 2, 2, 2, a + 2, 3, 3, 3, a + 3),
+			_mm_setr_epi8(4, 4, 4, a + 4, 5, 5, 5, a + 5, 6, 6, 6, a + 6, 7, 7, 7, a + 7),
+			_mm_setr_epi8(8, 8, 8, a + 8, 9, 9, 9, a + 9, 10, 10, 10, a + 10, 11, 11, 11, a + 11),
+			_mm_setr_epi8(12, 12, 12, a + 12, 13, 13, 13, a + 13, 14, 14, 14, a + 14, 15, 15, 15, a + 15),
+		};
+#endif
+#ifdef AM_IMAGE_USE_AVX2
+		const __m256i alphaMask256 = _mm256_broadcastsi128_si256(alphaMask);
+		const __m256i shuffles256[2] =
+		{
+			_mm256_inserti128_si256(_mm256_castsi128_si256(shuffles[0]), shuffles[1], 1),
+			_mm256_inserti128_si256(_mm256_castsi128_si256(shuffles[2]), shuffles[3], 1),
+		};
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i pixels = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+			for (int k = 0; k < 2; k++)
+			{
+				__m256i expanded = _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffles256[k]), alphaMask256);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4 + k * 32), expanded);
+			}
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			for (int k = 0; k < 4; k++)
+			{
+				__m128i expanded = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffles[k]), alphaMask);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + k * 16), expanded);
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			dst[i * 4 + 0] = src[i];
+			dst[i * 4 + 1] = src[i];
+			dst[i * 4 + 2] = src[i];
+			dst[i * 4 + 3] = IsAlpha ? src[i] : 255;
+		}
+	}
+
+	// -- From RGBA --
+
+	void ConvertRGBAToRGB(u8* dst, const u8* src, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_AVX2
+		// Shuffle packs 12 bytes in each lane, then lanes are joined. Store writes 8 bytes past 8 pixels
+		const __m256i shuffle256 = _mm256_broadcastsi128_si256(IMAGE_RGBA_TO_RGB_SHUFFLE);
+		const __m256i joinLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+		for (; i + 11 <= count; i += 8)
+		{
+			__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+			pixels = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pixels, shuffle256), joinLanes);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 3), pixels);
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		// Store writes 4 bytes past 4 pixels
+		for (; i + 6 <= count; i += 4)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm_shuffle_epi8(pixels, IMAGE_RGBA_TO_RGB_SHUFFLE));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			dst[i * 3 + 0] = src[i * 4 + 0];
+			dst[i * 3 + 1] = src[i * 4 + 1];
+			dst[i * 3 + 2] = src[i * 4 + 2];
+		}
+	}
+
+	void ConvertRGBAToGrayAlpha(u8* dst, const u8* src, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_AVX2
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i pixels0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+			__m256i pixels1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4 + 32));
+			__m256i luma = _mm256_packs_epi32(ComputeLuma8(pixels0), ComputeLuma8(pixels1));
+			__m256i alpha = _mm256_packs_epi32(_mm256_srli_epi32(pixels0, 24), _mm256_srli_epi32(pixels1, 24));
+			// Per lane [L0-3 L8-11 A0-3 A8-11 | L4-7 L12-15 A4-7 A12-15], interleaved to [GA0-3 GA8-11 | GA4-7 GA12-15]
+			__m256i packed = _mm256_packus_epi16(luma, alpha);
+			packed = _mm256_unpacklo_epi8(packed, _mm256_srli_si256(packed, 8));
+			packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), packed);
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i pixels0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			__m128i pixels1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 16));
+			__m128i luma = _mm_packs_epi32(ComputeLuma4(pixels0), ComputeLuma4(pixels1));
+			__m128i alpha = _mm_packs_epi32(_mm_srli_epi32(pixels0, 24), _mm_srli_epi32(pixels1, 24));
+			__m128i packed = _mm_packus_epi16(luma, alpha); // [L0-7 A0-7]
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), _mm_unpacklo_epi8(packed, _mm_srli_si128(packed, 8)));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			dst[i * 2 + 0] = ComputeLuma(src + i * 4);
+			dst[i * 2 + 1] = src[i * 4 + 3];
+		}
+	}
+
+	void ConvertRGBAToGray(u8* dst, const u8* src, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_AVX2
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i luma[4];
+			for (int k = 0; k < 4; k++)
+				luma[k] = ComputeLuma8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4 + k * 32)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), PackBytes32(luma[0], luma[1], luma[2], luma[3]));
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i luma[4];
+			for (int k = 0; k < 4; k++)
+				luma[k] = ComputeLuma4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + k * 16)));
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(luma[0], luma[1]), _mm_packs_epi32(luma[2], luma[3]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+		}
+#endif
+		for (; i < count; i++)
+			dst[i] = ComputeLuma(src + i * 4);
+	}
+
+	void ConvertRGBAToAlpha(u8* dst, const u8* src, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_AVX2
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i alpha[4];
+			for (int k = 0; k < 4; k++)
+				alpha[k] = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4 + k * 32)), 24);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), PackBytes32(alpha[0], alpha[1], alpha[2], alpha[3]));
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i alpha[4];
+			for (int k = 0; k < 4; k++)
+				alpha[k] = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + k * 16)), 24);
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(alpha[0], alpha[1]), _mm_packs_epi32(alpha[2], alpha[3]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+		}
+#endif
+		for (; i < count; i++)
+			dst[i] = src[i * 4 + 3];
+	}
+
+	ConvertFn GetConvertToRGBA(ImagePixelFormat fmt)
+	{
+		switch (fmt)
+		{
+		case ImagePixelFormat_U24:	return ConvertRGBToRGBA;
+		case ImagePixelFormat_U16:	return ConvertGrayAlphaToRGBA;
+		case ImagePixelFormat_U8:	return ConvertSingleChannelToRGBA<false>;
+		case ImagePixelFormat_A8:	return ConvertSingleChannelToRGBA<true>;
+
+		default: AM_UNREACHABLE("ConvertImagePixels() -> Conversion from '%s' is not implemented.", Enum::GetName(fmt));
+		}
+	}
+
+	ConvertFn GetConvertFromRGBA(ImagePixelFormat fmt)
+	{
+		switch (fmt)
+		{
+		case ImagePixelFormat_U24:	return ConvertRGBAToRGB;
+		case ImagePixelFormat_U16:	return ConvertRGBAToGrayAlpha;
+		case ImagePixelFormat_U8:	return ConvertRGBAToGray;
+		case ImagePixelFormat_A8:	return ConvertRGBAToAlpha;
+
+		default: AM_UNREACHABLE("ConvertImagePixels() -> Conversion to '%s' is not implemented.", Enum::GetName(fmt));
+		}
+	}
+}
+
+void rageam::graphics::ImageConvertPixelFormat(pVoid dst, pVoid src, ImagePixelFormat fromFmt, ImagePixelFormat toFmt, int width, int height)
+{
+	EASY_FUNCTION();
+
+	AM_ASSERT(!ImageIsCompressedFormat(fromFmt) && !ImageIsCompressedFormat(toFmt), "ConvertImagePixels() -> BC Formats are not supported!");
+
+	u8* dstBytes = static_cast<u8*>(dst);
+	u8* srcBytes = static_cast<u8*>(src);
+	int totalPixels = width * height;
+
+	if (fromFmt == toFmt)
+	{
+		memcpy(dst, src, ImageComputeSlicePitch(width, height, fromFmt));
+		return;
+	}
+
+	if (toFmt == ImagePixelFormat_U32)
+	{
+		GetConvertToRGBA(fromFmt)(dstBytes, srcBytes, totalPixels);
+		return;
+	}
+
+	if (fromFmt == ImagePixelFormat_U32)
+	{
+		GetConvertFromRGBA(toFmt)(dstBytes, srcBytes, totalPixels);
+		return;
+	}
+
+	// Any other pair goes through RGBA, chunk by chunk
+	ConvertFn toRGBA = GetConvertToRGBA(fromFmt);
+	ConvertFn fromRGBA = GetConvertFromRGBA(toFmt);
+	u32 srcPixelPitch = ImagePixelFormatBitsPerPixel[fromFmt] / 8;
+	u32 dstPixelPitch = ImagePixelFormatBitsPerPixel[toFmt] / 8;
+	alignas(32) u8 chunk[CONVERT_CHUNK_PIXELS * IMAGE_RGBA_PITCH];
+	for (int i = 0; i < totalPixels; i += CONVERT_CHUNK_PIXELS)
+	{
+		int count = MIN(CONVERT_CHUNK_PIXELS, totalPixels - i);
+		toRGBA(chunk, srcBytes + static_cast<size_t>(i) * srcPixelPitch, count);
+		fromRGBA(dstBytes + static_cast<size_t>(i) * dstPixelPitch, chunk, count);
+	}
+}
+
+void rageam::graphics::ImageComputeBrightnessContrastLut(int brightness, int contrast, u8 outLut[256])
+{
+	// Contrast equation:
+	// ContrastFactor = (259 * (Color + 255)) / (255 * (259 -c))
+	// Color = ContrastFactor * (Color - 128) + 128
+	float contrastFactor = 259.0f * (static_cast<float>(contrast) + 255.0f) / (255.0f * (259.0f - static_cast<float>(contrast)));
+
+	for (int i = 0; i < 256; i++)
+	{
+		// Brightness is saturated first, as it was done by SIMD path before
+		int value = std::clamp(i + brightness, 0, 255);
+		if (contrast != 0)
+		{
+			float contrasted = contrastFactor * static_cast<float>(value - 128) + 128.0f;
+			value = std::clamp(static_cast<int>(roundf(contrasted)), 0, 255);
+		}
+		outLut[i] = static_cast<u8>(value);
+	}
+}
+
+void rageam::graphics::ImageApplyColorLutRGBA(char* pixelData, int width, int height, const u8 lut[256])
+{
+	EASY_FUNCTION();
+
+	u8* pixels = reinterpret_cast<u8*>(pixelData);
+	int totalBytes = width * height * static_cast<int>(IMAGE_RGBA_PITCH);
+	int i = 0;
+
+#ifdef AM_IMAGE_USE_SIMD
+	__m128i tables[16];
+	for (int k = 0; k < 16; k++)
+		tables[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + k * 16));
+#endif
+#ifdef AM_IMAGE_USE_AVX2
+	__m256i tables256[16];
+	for (int k = 0; k < 16; k++)
+		tables256[k] = _mm256_broadcastsi128_si256(tables[k]);
+	const __m256i alphaMask256 = _mm256_broadcastsi128_si256(IMAGE_RGBA_ALPHA_MASK);
+	for (; i + 32 <= totalBytes; i += 32)
+	{
+		__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i));
+		__m256i mapped = ImageApplyLut32(values, tables256);
+		// Alpha is never changed
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), _mm256_blendv_epi8(mapped, values, alphaMask256));
+	}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+	for (; i + 16 <= totalBytes; i += 16)
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		__m128i mapped = ImageApplyLut16(values, tables);
+		mapped = _mm_or_si128(_mm_and_si128(mapped, IMAGE_RGBA_RGB_MASK), _mm_and_si128(values, IMAGE_RGBA_ALPHA_MASK));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), mapped);
+	}
+#endif
+	for (; i < totalBytes; i += 4)
+	{
+		pixels[i + 0] = lut[pixels[i + 0]];
+		pixels[i + 1] = lut[pixels[i + 1]];
+		pixels[i + 2] = lut[pixels[i + 2]];
+	}
+}
+
+void rageam::graphics::ImageAdjustBrightnessAndContrastRGBA(char* pixelData, int width, int height, int brightness, int contrast)
+{
+	EASY_FUNCTION();
+
+	if (brightness == 0 && contrast == 0)
+		return;
+
+	// Mapping is the same for every channel value, there's no point computing it for every pixel
+	u8 lut[256];
+	ImageComputeBrightnessContrastLut(brightness, contrast, lut);
+	ImageApplyColorLutRGBA(pixelData, width, height, lut);
+}
@@ -0,0 +1,299 @@
+#include "imagehash.h"
+
+#include "am/file/fileutils.h"
+#include "common/logger.h"
+#include "helpers/ranges.h"
+#include "helpers/win32.h"
+
+namespace
+{
+	constexpr u64 PRIME64_1 = 0x9E3779B185EBCA87ull;
+	constexpr u64 PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+	constexpr u64 PRIME64_3 = 0x165667B19E3779F9ull;
+	constexpr u64 PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+	constexpr u64 PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+	u64 RotL(u64 value, int shift)
+	{
+		return (value << shift) | (value >> (64 - shift));
+	}
+
+	u64 Read64(const u8* data)
+	{
+		u64 value;
+		memcpy(&value, data, sizeof u64);
+		return value;
+	}
+
+	u32 Read32(const u8* data)
+	{
+		u32 value;
+		memcpy(&value, data, sizeof u32);
+		return value;
+	}
+
+	u64 Round(u64 acc, u64 input)
+	{
+		acc += input * PRIME64_2;
+		acc = RotL(acc, 31);
+		return acc * PRIME64_1;
+	}
+
+	u64 MergeRound(u64 acc, u64 value)
+	{
+		acc ^= Round(0, value);
+		return acc * PRIME64_1 + PRIME64_4;
+	}
+
+	// Consumes whole stripes, returns pointer to the first byte that didn't fit
+	const u8* ConsumeStripes(u64 acc[4], const u8* data, const u8* end)
+	{
+		u64 acc0 = acc[0], acc1 = acc[1], acc2 = acc[2], acc3 = acc[3];
+		while (end - data >= 32)
+		{
+			acc0 = Round(acc0, Read64(data + 0));
+			acc1 = Round(acc1, Read64(data + 8));
+			acc2 = Round(acc2, Read64(data + 16));
+			acc3 = Round(acc3, Read64(data + 24));
+			data += 32;
+		}
+		acc[0] = acc0; acc[1] = acc1; acc[2] = acc2; acc[3] = acc3;
+		return data;
+	}
+}
+
+void rageam::graphics::ImageHasher::Reset(u64 seed)
+{
+	m_Seed = seed;
+	m_Acc[0] = seed + PRIME64_1 + PRIME64_2;
+	m_Acc[1] = seed + PRIME64_2;
+	m_Acc[2] = seed;
+	m_Acc[3] = seed - PRIME64_1;
+	m_TotalSize = 0;
+	m_BufferSize = 0;
+}
+
+void rageam::graphics::ImageHasher::Update(pConstVoid data, u64 size)
+{
+	const u8* bytes = static_cast<const u8*>(data);
+	const u8* end = bytes + size;
+	m_TotalSize += size;
+
+	// Complete stripe that was left from previous update
+	if (m_BufferSize > 0)
+	{
+		u32 toCopy = static_cast<u32>(MIN(size, static_cast<u64>(STRIPE_SIZE - m_BufferSize)));
+		memcpy(m_Buffer + m_BufferSize, bytes, toCopy);
+		m_BufferSize += toCopy;
+		bytes += toCopy;
+
+		if (m_BufferSize < STRIPE_SIZE)
+			return;
+
+		ConsumeStripes(m_Acc, m_Buffer, m_Buffer + STRIPE_SIZE);
+		m_BufferSize = 0;
+	}
+
+	bytes = ConsumeStripes(m_Acc, bytes, end);
+
+	m_BufferSize = static_cast<u32>(end - bytes);
+	memcpy(m_Buffer, bytes, m_BufferSize);
+}
+
+u64 rageam::graphics::ImageHasher::Digest() const
+{
+	u64 hash;
+	if (m_TotalSize >= STRIPE_SIZE)
+	{
+		hash = RotL(m_Acc[0], 1) + RotL(m_Acc[1], 7) + RotL(m_Acc[2], 12) + RotL(m_Acc[3], 18);
+		hash = MergeRound(hash, m_Acc[0]);
+		hash = MergeRound(hash, m_Acc[1]);
+		hash = MergeRound(hash, m_Acc[2]);
+		hash = MergeRound(hash, m_Acc[3]);
+	}
+	else
+	{
+		hash = m_Seed + PRIME64_5;
+	}
+	hash += m_TotalSize;
+
+	// Remaining bytes that didn't fill the stripe
+	const u8* data = m_Buffer;
+	const u8* end = m_Buffer + m_BufferSize;
+	while (end - data >= 8)
+	{
+		hash ^= Round(0, Read64(data));
+		hash = RotL(hash, 27) * PRIME64_1 + PRIME64_4;
+		data += 8;
+	}
+	if (end - data >= 4)
+	{
+		hash ^= static_cast<u64>(Read32(data)) * PRIME64_1;
+		hash = RotL(hash, 23) * PRIME64_2 + PRIME64_3;
+		data += 4;
+	}
+	while (data < end)
+	{
+		hash ^= *data * PRIME64_5;
+		hash = RotL(hash, 11) * PRIME64_1;
+		data++;
+	}
+
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+u64 rageam::graphics::ImageHasher::Compute(pConstVoid data, u64 size, u64 seed)
+{
+	ImageHasher hasher(seed);
+	hasher.Update(data, size);
+	return hasher.Digest();
+}
+
+u64 rageam::graphics::ImageContentHashMemo::ComputePathHash(ConstWString path)
+{
+	file::WPath normalized = file::WPath(path).Normalized();
+
+	ImageHasher hasher;
+	for (ConstWString c = normalized.GetCStr(); *c; c++)
+	{
+		wchar_t lower = towlower(*c);
+		hasher.Update(&lower, sizeof lower);
+	}
+	return hasher.Digest();
+}
+
+bool rageam::graphics::ImageContentHashMemo::GetFileStamp(ConstWString path, u64& outModifyTime, u64& outFileSize)
+{
+	// Single call instead of opening file handle, memo is queried for every image in texture dictionary
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attributes))
+		return false;
+
+	outModifyTime = TODWORD64(attributes.ftLastWriteTime.dwLowDateTime, attributes.ftLastWriteTime.dwHighDateTime);
+	outFileSize = TODWORD64(attributes.nFileSizeLow, attributes.nFileSizeHigh);
+	return true;
+}
+
+void rageam::graphics::ImageContentHashMemo::Load(const file::WPath& path)
+{
+	std::unique_lock lock(m_Mutex);
+
+	m_Records.Destroy();
+	m_Dirty = false;
+
+	if (!IsFileExists(path))
+		return;
+
+	file::FileView view;
+	if (!file::MapFileView(path, view))
+		return;
+
+	const Header* header = reinterpret_cast<const Header*>(view.Data);
+	if (view.Size >= sizeof Header &&
+		header->Magic == MAGIC &&
+		header->Version == VERSION &&
+		header->RecordCount <= MAX_ENTRIES &&
+		view.Size == sizeof Header + static_cast<u64>(header->RecordCount) * sizeof Record)
+	{
+		const Record* records = reinterpret_cast<const Record*>(view.Data + sizeof Header);
+		m_Records.InitAndAllocate(static_cast<u16>(header->RecordCount));
+		for (u32 i = 0; i < header->RecordCount; i++)
+			m_Records.InsertAt(ImageHasher::Fold(records[i].PathHash), records[i]);
+	}
+	else
+	{
+		AM_WARNINGF("ImageContentHashMemo::Load() -> File is not valid, memo will be reset.");
+	}
+	file::UnmapFileView(view.Data);
+}
+
+void rageam::graphics::ImageContentHashMemo::Save(const file::WPath& path)
+{
+	std::unique_lock lock(m_Mutex);
+
+	if (!m_Dirty)
+		return;
+
+	List<Record> records;
+	records.Reserve(m_Records.GetNumUsedSlots());
+	for (const Record& record : m_Records)
+		records.Add(record);
+
+	Header header = {};
+	header.Magic = MAGIC;
+	header.Version = VERSION;
+	header.RecordCount = records.GetSize();
+
+	HANDLE hFile = file::CreateNew(path);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		AM_ERRF(L"ImageContentHashMemo::Save() -> Failed to create '%ls', last error: %u", path.GetCStr(), GetLastError());
+		return;
+	}
+
+	DWORD headerWritten, recordsWritten;
+	DWORD recordsSize = records.GetSize() * sizeof Record;
+	bool success =
+		WriteFile(hFile, &header, sizeof Header, &headerWritten, NULL) && headerWritten == sizeof Header &&
+		WriteFile(hFile, records.GetItems(), recordsSize, &recordsWritten, NULL) && recordsWritten == recordsSize;
+	CloseHandle(hFile);
+
+	if (!success)
+	{
+		AM_ERRF("ImageContentHashMemo::Save() -> Failed to write memo, last error: %u", GetLastError());
+		DeleteFileW(path);
+		return;
+	}
+	m_Dirty = false;
+}
+
+void rageam::graphics::ImageContentHashMemo::Clear()
+{
+	std::unique_lock lock(m_Mutex);
+	m_Records.Destroy();
+	m_Dirty = true;
+}
+
+bool rageam::graphics::ImageContentHashMemo::TryGet(ConstWString imagePath, u64& outContentHash)
+{
+	u64 pathHash = ComputePathHash(imagePath);
+	u64 modifyTime, fileSize;
+	if (!GetFileStamp(imagePath, modifyTime, fileSize))
+		return false;
+
+	std::unique_lock lock(m_Mutex);
+	const Record* record = m_Records.TryGetAt(ImageHasher::Fold(pathHash));
+	if (!record || record->PathHash != pathHash || record->ModifyTime != modifyTime || record->FileSize != fileSize)
+		return false;
+
+	outContentHash = record->ContentHash;
+	return true;
+}
+
+void rageam::graphics::ImageContentHashMemo::Set(ConstWString imagePath, u64 contentHash)
+{
+	Record record = {};
+	record.PathHash = ComputePathHash(imagePath);
+	record.ContentHash = contentHash;
+	if (!GetFileStamp(imagePath, record.ModifyTime, record.FileSize))
+		return;
+
+	u32 key = ImageHasher::Fold(record.PathHash);
+
+	std::unique_lock lock(m_Mutex);
+	if (m_Records.GetNumUsedSlots() >= MAX_ENTRIES && !m_Records.ContainsAt(key))
+		m_Records.Destroy();
+
+	Record* existing = m_Records.TryGetAt(key);
+	if (existing)
+		*existing = record;
+	else
+		m_Records.InsertAt(key, record);
+	m_Dirty = true;
+}
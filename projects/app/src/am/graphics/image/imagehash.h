@@ -0,0 +1,92 @@
+//
+// File: imagehash.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "am/types.h"
+#include "am/file/path.h"
+
+#include <mutex>
+
+namespace rageam::graphics
+{
+	/**
+	 * \brief Streaming 64 bit hash (XXH64), data can be fed in any number of pieces of any size.
+	 * \remarks Four independent accumulators are updated per 32 byte stripe so it runs close to memory bandwidth,
+	 * which is order of magnitude faster than atDataHash that processes one byte at a time.
+	 * Result is the same regardless of how data was split between Update calls.
+	 */
+	class ImageHasher
+	{
+		static constexpr u32 STRIPE_SIZE = 32;
+
+		u64 m_Acc[4];
+		u64 m_Seed;
+		u64 m_TotalSize = 0;
+		u8  m_Buffer[STRIPE_SIZE];	// Tail of the previous update that didn't fill the whole stripe
+		u32 m_BufferSize = 0;
+
+	public:
+		ImageHasher(u64 seed = 0) { Reset(seed); }
+
+		void Reset(u64 seed = 0);
+		void Update(pConstVoid data, u64 size);
+		u64  Digest() const;
+
+		static u64 Compute(pConstVoid data, u64 size, u64 seed = 0);
+		// Image cache keys are 32 bit
+		static u32 Fold(u64 hash) { return static_cast<u32>(hash ^ (hash >> 32)); }
+	};
+
+	/**
+	 * \brief Persistent map of image file path, modify time and size to hash of decoded pixel data.
+	 * \remarks Allows to locate compressed image in cache by content without decoding source image file,
+	 * entry is ignored once file is modified. Thread safe.
+	 */
+	class ImageContentHashMemo
+	{
+		static constexpr u32 MAGIC = 0x48434D41; // AMCH
+		static constexpr u32 VERSION = 1;
+		// Hash set can't hold more, memo is reset once it's full and entries will be re-added as images are decoded
+		static constexpr u32 MAX_ENTRIES = 32768;
+
+		// Set is keyed by folded path hash, full 64 bit hash is compared on lookup so colliding paths never share the entry
+		struct Record
+		{
+			u64 PathHash;
+			u64 ModifyTime;
+			u64 FileSize;
+			u64 ContentHash;
+		};
+
+		struct Header
+		{
+			u32 Magic;
+			u32 Version;
+			u32 RecordCount;
+			u32 Reserved;
+		};
+
+		std::mutex		m_Mutex;
+		HashSet<Record>	m_Records;
+		bool			m_Dirty = false;
+
+		// Case insensitive, separators are normalized
+		static u64 ComputePathHash(ConstWString path);
+		// Returns false if file doesn't exist
+		static bool GetFileStamp(ConstWString path, u64& outModifyTime, u64& outFileSize);
+
+	public:
+		void Load(const file::WPath& path);
+		// Does nothing if memo was not modified since loading
+		void Save(const file::WPath& path);
+		void Clear();
+
+		bool TryGet(ConstWString imagePath, u64& outContentHash);
+		void Set(ConstWString imagePath, u64 contentHash);
+	};
+}
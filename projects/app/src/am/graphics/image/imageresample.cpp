@@ -0,0 +1,514 @@
+#include "imageresample.h"
+
+#include "am/system/enum.h"
+#include "am/system/worker.h"
+
+#include <easy/profiler.h>
+#include <mutex>
+
+namespace
+{
+	using namespace rageam;
+	using namespace rageam::graphics;
+
+	constexpr int RESAMPLE_WEIGHT_ONE = 1 << IMAGE_RESAMPLE_WEIGHT_BITS;
+	constexpr int RESAMPLE_WEIGHT_ROUND = RESAMPLE_WEIGHT_ONE / 2;
+	constexpr int RESAMPLE_VALUE_ONE = 1 << IMAGE_RESAMPLE_VALUE_BITS;
+
+	struct ResampleKernelCache
+	{
+		std::mutex						Mutex;
+		HashSet<ImageResampleKernelPtr>	Kernels;
+
+		static ResampleKernelCache& Get()
+		{
+			static ResampleKernelCache s_Cache;
+			return s_Cache;
+		}
+	};
+
+	// Radius of the filter in destination pixels
+	float GetFilterSupport(ResizeFilter filter)
+	{
+		switch (filter)
+		{
+		case ResizeFilter_Box:			return 0.5f;
+		case ResizeFilter_Triangle:		return 1.0f;
+		case ResizeFilter_CubicBSpline:
+		case ResizeFilter_CatmullRom:
+		case ResizeFilter_Mitchell:		return 2.0f;
+
+		default: AM_UNREACHABLE("ImageGetResampleKernel() -> Filter %s has no support radius.", Enum::GetName(filter));
+		}
+	}
+
+	// https://en.wikipedia.org/wiki/Mitchell%E2%80%93Netravali_filters
+	float EvaluateCubic(float x, float b, float c)
+	{
+		x = fabsf(x);
+		if (x < 1.0f)
+			return ((12.0f - 9.0f * b - 6.0f * c) * x * x * x + (-18.0f + 12.0f * b + 6.0f * c) * x * x + (6.0f - 2.0f * b)) / 6.0f;
+		if (x < 2.0f)
+			return ((-b - 6.0f * c) * x * x * x + (6.0f * b + 30.0f * c) * x * x + (-12.0f * b - 48.0f * c) * x + (8.0f * b + 24.0f * c)) / 6.0f;
+		return 0.0f;
+	}
+
+	float EvaluateFilter(ResizeFilter filter, float x)
+	{
+		switch (filter)
+		{
+		case ResizeFilter_Triangle:		return MAX(0.0f, 1.0f - fabsf(x));
+		case ResizeFilter_CubicBSpline:	return EvaluateCubic(x, 1.0f, 0.0f);
+		case ResizeFilter_CatmullRom:	return EvaluateCubic(x, 0.0f, 0.5f);
+		case ResizeFilter_Mitchell:		return EvaluateCubic(x, 1.0f / 3.0f, 1.0f / 3.0f);
+
+		default: AM_UNREACHABLE("ImageGetResampleKernel() -> Filter %s can't be evaluated.", Enum::GetName(filter));
+		}
+	}
+
+	// Computes float weights of source pixels [outFirst, outFirst + outWeights.size) for single destination pixel
+	void ComputeWindow(ResizeFilter filter, int srcSize, float scale, int dstIndex, int& outFirst, List<float>& outWeights)
+	{
+		float center = (static_cast<float>(dstIndex) + 0.5f) / scale;
+
+		// Nearest neighbour, box is the same when magnifying
+		if (filter == ResizeFilter_Point || (filter == ResizeFilter_Box && scale >= 1.0f))
+		{
+			outFirst = std::clamp(static_cast<int>(center), 0, srcSize - 1);
+			outWeights.Resize(1);
+			outWeights[0] = 1.0f;
+			return;
+		}
+
+		// Filter is stretched over source pixels when minifying
+		float filterScale = MIN(scale, 1.0f);
+		float radius = GetFilterSupport(filter) / filterScale;
+		int	  first = static_cast<int>(floorf(center - radius));
+		int	  last = static_cast<int>(ceilf(center + radius));
+
+		// Out of bounds taps are clamped to the edge
+		int clampedFirst = std::clamp(first, 0, srcSize - 1);
+		int clampedLast = std::clamp(last, 0, srcSize - 1);
+		outFirst = clampedFirst;
+		outWeights.Resize(clampedLast - clampedFirst + 1);
+		for (float& weight : outWeights)
+			weight = 0.0f;
+
+		for (int i = first; i <= last; i++)
+		{
+			float weight;
+			if (filter == ResizeFilter_Box)
+			{
+				// Exact coverage of the source pixel by destination pixel footprint
+				float overlapMin = MAX(static_cast<float>(i), center - radius);
+				float overlapMax = MIN(static_cast<float>(i + 1), center + radius);
+				weight = MAX(0.0f, overlapMax - overlapMin);
+			}
+			else
+			{
+				weight = EvaluateFilter(filter, (static_cast<float>(i) + 0.5f - center) * filterScale);
+			}
+			outWeights[std::clamp(i, 0, srcSize - 1) - clampedFirst] += weight;
+		}
+
+		// Trim zero weights on window edges, they only make tap count larger
+		u32 trimFirst = 0;
+		u32 trimLast = outWeights.GetSize();
+		while (trimFirst + 1 < trimLast && outWeights[trimFirst] == 0.0f) trimFirst++;
+		while (trimLast - 1 > trimFirst && outWeights[trimLast - 1] == 0.0f) trimLast--;
+		if (trimFirst != 0 || trimLast != outWeights.GetSize())
+		{
+			for (u32 i = trimFirst; i < trimLast; i++)
+				outWeights[i - trimFirst] = outWeights[i];
+			outWeights.Resize(trimLast - trimFirst);
+			outFirst += static_cast<int>(trimFirst);
+		}
+	}
+
+	amPtr<ImageResampleKernel> BuildKernel(int srcSize, int dstSize, ResizeFilter filter)
+	{
+		EASY_FUNCTION();
+
+		float scale = static_cast<float>(dstSize) / static_cast<float>(srcSize);
+
+		// Windows are computed twice, first time to find out the widest one
+		List<float> window;
+		int			tapCount = 1;
+		for (int i = 0; i < dstSize; i++)
+		{
+			int first;
+			ComputeWindow(filter, srcSize, scale, i, first, window);
+			tapCount = MAX(tapCount, static_cast<int>(window.GetSize()));
+		}
+		// SIMD passes multiply-add pairs of taps
+		if (tapCount % 2 != 0 && tapCount < srcSize)
+			tapCount++;
+
+		auto kernel = std::make_shared<ImageResampleKernel>();
+		kernel->SrcSize = srcSize;
+		kernel->DstSize = dstSize;
+		kernel->Filter = filter;
+		kernel->TapCount = tapCount;
+		kernel->TapFirst.Resize(dstSize);
+		kernel->Weights.Resize(dstSize * tapCount);
+
+		for (int i = 0; i < dstSize; i++)
+		{
+			int first;
+			ComputeWindow(filter, srcSize, scale, i, first, window);
+
+			// Move window back if padding went past the last source pixel
+			int tapFirst = MAX(0, MIN(first, srcSize - tapCount));
+			int tapOffset = first - tapFirst;
+			kernel->TapFirst[i] = tapFirst;
+
+			float weightSum = 0.0f;
+			for (float weight : window)
+				weightSum += weight;
+
+			// Quantize normalized weights and give rounding error to the largest one, so flat color stays exactly the same
+			s16* weights = kernel->Weights.GetItems() + static_cast<size_t>(i) * tapCount;
+			memset(weights, 0, sizeof(s16) * tapCount);
+			int quantizedSum = 0;
+			int largestTap = tapOffset;
+			for (u32 k = 0; k < window.GetSize(); k++)
+			{
+				int tap = tapOffset + static_cast<int>(k);
+				int weight = static_cast<int>(roundf(window[k] / weightSum * RESAMPLE_WEIGHT_ONE));
+				weights[tap] = static_cast<s16>(weight);
+				quantizedSum += weight;
+				if (weight > weights[largestTap])
+					largestTap = tap;
+			}
+			weights[largestTap] = static_cast<s16>(weights[largestTap] + RESAMPLE_WEIGHT_ONE - quantizedSum);
+		}
+
+		return kernel;
+	}
+
+	s16 ClampS16(int value)
+	{
+		return static_cast<s16>(std::clamp(value, INT16_MIN, INT16_MAX));
+	}
+
+	int LoadPairWeights(const s16* weights)
+	{
+		int pair;
+		memcpy(&pair, weights, sizeof(int));
+		return pair;
+	}
+
+	// Expands 8 bit pixels to fixed point, colors are multiplied by alpha (last channel) if premultiplyAlpha is set
+	void LoadRow(s16* dst, const u8* src, int channelCount, int width, bool premultiplyAlpha)
+	{
+		int count = width * channelCount;
+		if (premultiplyAlpha)
+		{
+			for (int x = 0; x < count; x += channelCount)
+			{
+				int alpha = src[x + channelCount - 1];
+				for (int c = 0; c < channelCount - 1; c++)
+					dst[x + c] = static_cast<s16>((src[x + c] * alpha * RESAMPLE_VALUE_ONE + 127) / 255);
+				dst[x + channelCount - 1] = static_cast<s16>(alpha * RESAMPLE_VALUE_ONE);
+			}
+			return;
+		}
+
+		int i = 0;
+#ifdef AM_IMAGE_USE_SIMD
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i lo = _mm_slli_epi16(_mm_unpacklo_epi8(pixels, zero), IMAGE_RESAMPLE_VALUE_BITS);
+			__m128i hi = _mm_slli_epi16(_mm_unpackhi_epi8(pixels, zero), IMAGE_RESAMPLE_VALUE_BITS);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), hi);
+		}
+#endif
+		for (; i < count; i++)
+			dst[i] = static_cast<s16>(src[i] << IMAGE_RESAMPLE_VALUE_BITS);
+	}
+
+	// Rounds fixed point values back to 8 bits, colors are divided by alpha if they were premultiplied
+	void StoreRow(u8* dst, const s16* src, int channelCount, int width, bool premultiplyAlpha)
+	{
+		int count = width * channelCount;
+		if (premultiplyAlpha)
+		{
+			for (int x = 0; x < count; x += channelCount)
+			{
+				int alpha = src[x + channelCount - 1];
+				for (int c = 0; c < channelCount - 1; c++)
+					dst[x + c] = alpha > 0 ? static_cast<u8>(std::clamp((src[x + c] * 255 + alpha / 2) / alpha, 0, 255)) : 0;
+				dst[x + channelCount - 1] = static_cast<u8>(std::clamp((alpha + RESAMPLE_VALUE_ONE / 2) >> IMAGE_RESAMPLE_VALUE_BITS, 0, 255));
+			}
+			return;
+		}
+
+		int i = 0;
+#ifdef AM_IMAGE_USE_SIMD
+		const __m128i round = _mm_set1_epi16(RESAMPLE_VALUE_ONE / 2);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+			lo = _mm_srai_epi16(_mm_adds_epi16(lo, round), IMAGE_RESAMPLE_VALUE_BITS);
+			hi = _mm_srai_epi16(_mm_adds_epi16(hi, round), IMAGE_RESAMPLE_VALUE_BITS);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+		}
+#endif
+		for (; i < count; i++)
+			dst[i] = static_cast<u8>(std::clamp((src[i] + RESAMPLE_VALUE_ONE / 2) >> IMAGE_RESAMPLE_VALUE_BITS, 0, 255));
+	}
+
+	void ResampleRowHorizontal(s16* dst, const s16* src, int channelCount, const ImageResampleKernel& kernel)
+	{
+		int tapCount = kernel.TapCount;
+
+#ifdef AM_IMAGE_USE_SIMD
+		// Two RGBA pixels [r0 g0 b0 a0 r1 g1 b1 a1] are interleaved to [r0 r1 g0 g1 b0 b1 a0 a1],
+		// single madd with weight pair gives weighted sum of both taps for every channel
+		if (channelCount == 4 && tapCount % 2 == 0)
+		{
+			const __m128i round = _mm_set1_epi32(RESAMPLE_WEIGHT_ROUND);
+			for (int x = 0; x < kernel.DstSize; x++)
+			{
+				const s16* pixels = src + static_cast<size_t>(kernel.TapFirst[x]) * 4;
+				const s16* weights = kernel.Weights.GetItems() + static_cast<size_t>(x) * tapCount;
+
+				__m128i sum = _mm_setzero_si128();
+				int k = 0;
+#ifdef AM_IMAGE_USE_AVX2
+				// Same with four taps, pairs in each 128 bit lane
+				const __m256i laneWeights = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+				__m256i sum256 = _mm256_setzero_si256();
+				for (; k + 4 <= tapCount; k += 4)
+				{
+					__m256i fourPixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + k * 4));
+					__m256i pairs = _mm256_unpacklo_epi16(fourPixels, _mm256_srli_si256(fourPixels, 8));
+					__m256i weightPairs = _mm256_permutevar8x32_epi32(
+						_mm256_castsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + k))), laneWeights);
+					sum256 = _mm256_add_epi32(sum256, _mm256_madd_epi16(pairs, weightPairs));
+				}
+				sum = _mm_add_epi32(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1));
+#endif
+				for (; k < tapCount; k += 2)
+				{
+					__m128i twoPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + k * 4));
+					__m128i pairs = _mm_unpacklo_epi16(twoPixels, _mm_srli_si128(twoPixels, 8));
+					sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, _mm_set1_epi32(LoadPairWeights(weights + k))));
+				}
+
+				sum = _mm_srai_epi32(_mm_add_epi32(sum, round), IMAGE_RESAMPLE_WEIGHT_BITS);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + static_cast<size_t>(x) * 4), _mm_packs_epi32(sum, sum));
+			}
+			return;
+		}
+#endif
+
+		for (int x = 0; x < kernel.DstSize; x++)
+		{
+			const s16* pixels = src + static_cast<size_t>(kernel.TapFirst[x]) * channelCount;
+			const s16* weights = kernel.Weights.GetItems() + static_cast<size_t>(x) * tapCount;
+			for (int c = 0; c < channelCount; c++)
+			{
+				int sum = 0;
+				for (int k = 0; k < tapCount; k++)
+					sum += pixels[k * channelCount + c] * weights[k];
+				dst[x * channelCount + c] = ClampS16((sum + RESAMPLE_WEIGHT_ROUND) >> IMAGE_RESAMPLE_WEIGHT_BITS);
+			}
+		}
+	}
+
+	// Row layout doesn't matter here, values at the same position in source rows are simply weighted
+	// Rows and weights go in pairs, odd tap count is padded with the last row with zero weight
+	void ResampleRowVertical(s16* dst, const s16* const* rows, const s16* weights, int pairCount, int count)
+	{
+		int i = 0;
+#ifdef AM_IMAGE_USE_AVX2
+		const __m256i round256 = _mm256_set1_epi32(RESAMPLE_WEIGHT_ROUND);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i sumLo = _mm256_setzero_si256();
+			__m256i sumHi = _mm256_setzero_si256();
+			for (int k = 0; k < pairCount; k++)
+			{
+				__m256i row0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k * 2] + i));
+				__m256i row1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k * 2 + 1] + i));
+				__m256i weightPair = _mm256_set1_epi32(LoadPairWeights(weights + k * 2));
+				sumLo = _mm256_add_epi32(sumLo, _mm256_madd_epi16(_mm256_unpacklo_epi16(row0, row1), weightPair));
+				sumHi = _mm256_add_epi32(sumHi, _mm256_madd_epi16(_mm256_unpackhi_epi16(row0, row1), weightPair));
+			}
+			sumLo = _mm256_srai_epi32(_mm256_add_epi32(sumLo, round256), IMAGE_RESAMPLE_WEIGHT_BITS);
+			sumHi = _mm256_srai_epi32(_mm256_add_epi32(sumHi, round256), IMAGE_RESAMPLE_WEIGHT_BITS);
+			// Unpack and pack both work per 128 bit lane, so values end up in original order
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packs_epi32(sumLo, sumHi));
+		}
+#endif
+#ifdef AM_IMAGE_USE_SIMD
+		const __m128i round = _mm_set1_epi32(RESAMPLE_WEIGHT_ROUND);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i sumLo = _mm_setzero_si128();
+			__m128i sumHi = _mm_setzero_si128();
+			for (int k = 0; k < pairCount; k++)
+			{
+				__m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k * 2] + i));
+				__m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k * 2 + 1] + i));
+				__m128i weightPair = _mm_set1_epi32(LoadPairWeights(weights + k * 2));
+				sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(_mm_unpacklo_epi16(row0, row1), weightPair));
+				sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(_mm_unpackhi_epi16(row0, row1), weightPair));
+			}
+			sumLo = _mm_srai_epi32(_mm_add_epi32(sumLo, round), IMAGE_RESAMPLE_WEIGHT_BITS);
+			sumHi = _mm_srai_epi32(_mm_add_epi32(sumHi, round), IMAGE_RESAMPLE_WEIGHT_BITS);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(sumLo, sumHi));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			int sum = 0;
+			for (int k = 0; k < pairCount * 2; k++)
+				sum += rows[k][i] * weights[k];
+			dst[i] = ClampS16((sum + RESAMPLE_WEIGHT_ROUND) >> IMAGE_RESAMPLE_WEIGHT_BITS);
+		}
+	}
+
+	struct ResampleState
+	{
+		u8*							Dst;
+		const u8*					Src;
+		int							ChannelCount;
+		int							SrcWidth;
+		int							DstWidth;
+		bool						PremultiplyAlpha;
+		const ImageResampleKernel*	KernelX;
+		const ImageResampleKernel*	KernelY;
+	};
+
+	// Resamples destination rows [firstRow, firstRow + rowCount), source rows that band needs are filtered horizontally once
+	void ResampleBand(const ResampleState& state, int firstRow, int rowCount)
+	{
+		ImageScratchScope scratchScope;
+
+		const ImageResampleKernel& kernelY = *state.KernelY;
+		// Windows are not always monotonic, zero weight taps are trimmed from edges (Catmull-Rom on odd integer upscale)
+		int srcFirstRow = kernelY.TapFirst[firstRow];
+		int srcLastRow = srcFirstRow + kernelY.TapCount;
+		for (int y = firstRow + 1; y < firstRow + rowCount; y++)
+		{
+			srcFirstRow = MIN(srcFirstRow, kernelY.TapFirst[y]);
+			srcLastRow = MAX(srcLastRow, kernelY.TapFirst[y] + kernelY.TapCount);
+		}
+		int srcRowCount = srcLastRow - srcFirstRow;
+
+		size_t srcRowSize = static_cast<size_t>(state.SrcWidth) * state.ChannelCount;
+		size_t dstRowSize = static_cast<size_t>(state.DstWidth) * state.ChannelCount;
+		s16* loadedRow = static_cast<s16*>(ImageAllocTemp(static_cast<u32>(srcRowSize * sizeof(s16))));
+		s16* resultRow = static_cast<s16*>(ImageAllocTemp(static_cast<u32>(dstRowSize * sizeof(s16))));
+		s16* filteredRows = static_cast<s16*>(ImageAllocTemp(static_cast<u32>(dstRowSize * srcRowCount * sizeof(s16))));
+		int pairCount = (kernelY.TapCount + 1) / 2;
+		const s16** rows = static_cast<const s16**>(ImageAllocTemp(pairCount * 2 * sizeof(s16*)));
+		s16* weights = static_cast<s16*>(ImageAllocTemp(pairCount * 2 * sizeof(s16)));
+
+		for (int y = 0; y < srcRowCount; y++)
+		{
+			const u8* srcRow = state.Src + srcRowSize * (srcFirstRow + y);
+			LoadRow(loadedRow, srcRow, state.ChannelCount, state.SrcWidth, state.PremultiplyAlpha);
+			ResampleRowHorizontal(filteredRows + dstRowSize * y, loadedRow, state.ChannelCount, *state.KernelX);
+		}
+
+		for (int y = firstRow; y < firstRow + rowCount; y++)
+		{
+			int tapFirst = kernelY.TapFirst[y] - srcFirstRow;
+			const s16* tapWeights = kernelY.Weights.GetItems() + static_cast<size_t>(y) * kernelY.TapCount;
+			for (int k = 0; k < pairCount * 2; k++)
+			{
+				bool isPadding = k >= kernelY.TapCount;
+				rows[k] = filteredRows + dstRowSize * (tapFirst + (isPadding ? k - 1 : k));
+				weights[k] = isPadding ? static_cast<s16>(0) : tapWeights[k];
+			}
+
+			ResampleRowVertical(resultRow, rows, weights, pairCount, static_cast<int>(dstRowSize));
+			StoreRow(state.Dst + dstRowSize * y, resultRow, state.ChannelCount, state.DstWidth, state.PremultiplyAlpha);
+		}
+	}
+}
+
+rageam::graphics::ImageResampleKernelPtr rageam::graphics::ImageGetResampleKernel(int srcSize, int dstSize, ResizeFilter filter)
+{
+	AM_ASSERT(srcSize > 0 && dstSize > 0, "ImageGetResampleKernel() -> Invalid size %i -> %i", srcSize, dstSize);
+
+	u32 hash = DataHash(&srcSize, sizeof(int));
+	hash = DataHash(&dstSize, sizeof(int), hash);
+	hash = DataHash(&filter, sizeof(ResizeFilter), hash);
+
+	ResampleKernelCache& cache = ResampleKernelCache::Get();
+	{
+		std::unique_lock lock(cache.Mutex);
+		ImageResampleKernelPtr* cachedKernel = cache.Kernels.TryGetAt(hash);
+		if (cachedKernel)
+		{
+			const ImageResampleKernel& kernel = **cachedKernel;
+			if (kernel.SrcSize == srcSize && kernel.DstSize == dstSize && kernel.Filter == filter)
+				return *cachedKernel;
+			// Hash collision, kernel is built but not cached
+			lock.unlock();
+			return BuildKernel(srcSize, dstSize, filter);
+		}
+	}
+
+	// Built outside of lock, there's a tiny chance that other thread builds the same kernel at the same time but that's fine
+	ImageResampleKernelPtr kernel = BuildKernel(srcSize, dstSize, filter);
+
+	std::unique_lock lock(cache.Mutex);
+	if (cache.Kernels.TryGetAt(hash))
+		return kernel;
+	if (cache.Kernels.GetNumUsedSlots() >= IMAGE_RESAMPLE_KERNEL_CACHE_MAX)
+		cache.Kernels.Clear();
+	cache.Kernels.InsertAt(hash, kernel);
+	return kernel;
+}
+
+void rageam::graphics::ImageResample(
+	u8* dst, const u8* src, int channelCount,
+	int xFrom, int yFrom, int xTo, int yTo,
+	ResizeFilter filter, bool premultiplyAlpha)
+{
+	EASY_FUNCTION();
+
+	AM_ASSERT(channelCount >= 1 && channelCount <= 4, "ImageResample() -> Channel count %i is not supported.", channelCount);
+
+	ImageResampleKernelPtr kernelX = ImageGetResampleKernel(xFrom, xTo, filter);
+	ImageResampleKernelPtr kernelY = ImageGetResampleKernel(yFrom, yTo, filter);
+
+	ResampleState state;
+	state.Dst = dst;
+	state.Src = src;
+	state.ChannelCount = channelCount;
+	state.SrcWidth = xFrom;
+	state.DstWidth = xTo;
+	state.PremultiplyAlpha = premultiplyAlpha && (channelCount == 2 || channelCount == 4);
+	state.KernelX = kernelX.get();
+	state.KernelY = kernelY.get();
+
+	// Small image, process on calling thread
+	int pixelCount = MAX(xFrom * yFrom, xTo * yTo);
+	if (pixelCount < IMAGE_RESAMPLE_MULTITHREAD_MIN_PIXELS || yTo <= IMAGE_RESAMPLE_BAND_SIZE)
+	{
+		ResampleBand(state, 0, yTo);
+		return;
+	}
+
+	Tasks bandTasks;
+	for (int y = 0; y < yTo; y += IMAGE_RESAMPLE_BAND_SIZE)
+	{
+		int rowCount = MIN(IMAGE_RESAMPLE_BAND_SIZE, yTo - y);
+		bandTasks.Emplace(BackgroundWorker::Run([&state, y, rowCount]
+			{
+				ResampleBand(state, y, rowCount);
+				return true;
+			}));
+	}
+	BackgroundWorker::WaitFor(bandTasks);
+}
@@ -0,0 +1,50 @@
+//
+// File: imageresample.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "image.h"
+
+namespace rageam::graphics
+{
+	static constexpr int IMAGE_RESAMPLE_WEIGHT_BITS = 14;	// Fraction bits of fixed point filter weights
+	static constexpr int IMAGE_RESAMPLE_VALUE_BITS = 6;		// Fraction bits of intermediate pixel values, 8.6 leaves room for filter overshoot in S16
+	static constexpr int IMAGE_RESAMPLE_BAND_SIZE = 32;		// Num of destination rows per one task
+	// Smaller images are resampled on calling thread, compared against the larger of source / destination pixel count
+	static constexpr int IMAGE_RESAMPLE_MULTITHREAD_MIN_PIXELS = 512 * 512;
+	// Kernels are tiny but we don't want to grow cache forever, it is reset once it's full
+	static constexpr u32 IMAGE_RESAMPLE_KERNEL_CACHE_MAX = 256;
+
+	/**
+	 * \brief Precomputed 1D filter coefficients for resampling line of srcSize pixels to dstSize pixels.
+	 * \remarks Every destination pixel has the same number of taps, shorter windows are padded with zero weights.
+	 * Taps are always within source bounds, edge pixels take weights of taps that fell outside (clamp edge mode).
+	 */
+	struct ImageResampleKernel
+	{
+		int				SrcSize;
+		int				DstSize;
+		ResizeFilter	Filter;
+		int				TapCount;	// Even unless source is too narrow to pad window
+		List<int>		TapFirst;	// Index of the first source pixel for every destination pixel
+		List<s16>		Weights;	// DstSize * TapCount, weights of single destination pixel add up to exactly 1 << IMAGE_RESAMPLE_WEIGHT_BITS
+	};
+	using ImageResampleKernelPtr = amPtr<const ImageResampleKernel>;
+
+	// Kernels are cached by (srcSize, dstSize, filter), same resize operations are very common (presets, thumbnails, padding)
+	// Thread safe
+	ImageResampleKernelPtr ImageGetResampleKernel(int srcSize, int dstSize, ResizeFilter filter);
+
+	// Separable fixed point resampler for 8 bit pixels with 1 - 4 channels, rows are resampled horizontally first and then vertically
+	// If alpha is premultiplied, last channel is treated as alpha and colors are weighted by it, transparent pixels don't bleed
+	// Horizontal pass of RGBA and vertical pass of all formats are done with SSE2 / AVX2 multiply-add,
+	// large images are split in bands of destination rows that are processed in parallel
+	void ImageResample(
+		u8* dst, const u8* src, int channelCount,
+		int xFrom, int yFrom, int xTo, int yTo,
+		ResizeFilter filter, bool premultiplyAlpha);
+}
@@ -0,0 +1,170 @@
+#include "pixelbenchmark.h"
+
+#include "am/system/enum.h"
+#include "am/system/timer.h"
+#include "am/system/worker.h"
+#include "am/xml/doc.h"
+#include "am/xml/exception.h"
+
+#include <random>
+
+namespace
+{
+	using namespace rageam;
+	using namespace rageam::graphics;
+
+	constexpr ImagePixelFormat BENCHMARK_FORMATS[] =
+	{
+		ImagePixelFormat_U32, ImagePixelFormat_U24, ImagePixelFormat_U16, ImagePixelFormat_U8, ImagePixelFormat_A8,
+	};
+
+	PixelDataOwner CreateRandomPixels(int width, int height, ImagePixelFormat fmt)
+	{
+		PixelDataOwner pixelData = PixelDataOwner::AllocateForImage(width, height, fmt);
+		std::mt19937 random(fmt);
+		u32 size = ImageComputeSlicePitch(width, height, fmt);
+		u8* bytes = reinterpret_cast<u8*>(pixelData.Data()->Bytes);
+		for (u32 i = 0; i < size; i++)
+			bytes[i] = static_cast<u8>(random());
+		return pixelData;
+	}
+
+	template<typename TKernel>
+	u64 MeasureFastestRun(int runCount, TKernel kernel)
+	{
+		u64 elapsed = UINT64_MAX;
+		for (int run = 0; run < MAX(runCount, 1); run++)
+		{
+			Timer timer = Timer::StartNew();
+			kernel();
+			timer.Stop();
+			elapsed = MIN(elapsed, timer.GetElapsedMicroseconds());
+		}
+		return elapsed;
+	}
+}
+
+double rageam::graphics::ImagePixelBenchmarkResult::GetMegaPixelsPerSecond() const
+{
+	if (ElapsedMicroseconds == 0)
+		return 0.0;
+	// Pixels per microsecond is the same as megapixels per second
+	return static_cast<double>(PixelCount) / static_cast<double>(ElapsedMicroseconds);
+}
+
+double rageam::graphics::ImagePixelBenchmarkResult::GetGigaBytesPerSecond() const
+{
+	if (ElapsedMicroseconds == 0)
+		return 0.0;
+	return static_cast<double>(ByteCount) / static_cast<double>(ElapsedMicroseconds) / 1000.0;
+}
+
+void rageam::graphics::ImagePixelBenchmark::Run(const ImagePixelBenchmarkOptions& options)
+{
+	m_Results.Clear();
+
+	int width = options.Width;
+	int height = options.Height;
+	u64 pixelCount = static_cast<u64>(width) * height;
+
+	// Resizer splits large images in bands, keep everything on a single thread so kernels are comparable
+	BackgroundWorker worker("PixelBenchmark", 1);
+	BackgroundWorker::Push(&worker);
+
+	PixelDataOwner srcPixels[std::size(BENCHMARK_FORMATS)];
+	for (size_t i = 0; i < std::size(BENCHMARK_FORMATS); i++)
+		srcPixels[i] = CreateRandomPixels(width, height, BENCHMARK_FORMATS[i]);
+	PixelDataOwner dstPixels = PixelDataOwner::AllocateForImage(width, height, ImagePixelFormat_U32);
+
+	auto addResult = [&](ImagePixelKernel kernel, ImagePixelFormat fromFmt, ImagePixelFormat toFmt, ResizeFilter filter, u64 byteCount, u64 elapsed)
+		{
+			ImagePixelBenchmarkResult result = {};
+			result.Kernel = kernel;
+			result.FromFormat = fromFmt;
+			result.ToFormat = toFmt;
+			result.Filter = filter;
+			result.PixelCount = pixelCount;
+			result.ByteCount = byteCount;
+			result.ElapsedMicroseconds = elapsed;
+
+			AM_TRACEF("%s %s -> %s: %.2f MP/s, %.2f GB/s",
+				Enum::GetName(kernel), ImagePixelFormatToName[fromFmt], ImagePixelFormatToName[toFmt],
+				result.GetMegaPixelsPerSecond(), result.GetGigaBytesPerSecond());
+
+			m_Results.Add(result);
+		};
+
+	for (size_t from = 0; from < std::size(BENCHMARK_FORMATS); from++)
+	{
+		for (size_t to = 0; to < std::size(BENCHMARK_FORMATS); to++)
+		{
+			if (from == to)
+				continue;
+
+			ImagePixelFormat fromFmt = BENCHMARK_FORMATS[from];
+			ImagePixelFormat toFmt = BENCHMARK_FORMATS[to];
+			u64 elapsed = MeasureFastestRun(options.RunCount, [&]
+				{
+					ImageConvertPixelFormat(dstPixels.Data(), srcPixels[from].Data(), fromFmt, toFmt, width, height);
+				});
+			u64 byteCount = ImageComputeSlicePitch(width, height, fromFmt) + ImageComputeSlicePitch(width, height, toFmt);
+			addResult(ImagePixelKernel_ConvertPixelFormat, fromFmt, toFmt, ResizeFilter_Box, byteCount, elapsed);
+		}
+	}
+
+	// Pixels are adjusted in place, copy source to keep values random between runs
+	u32 rgbaSize = ImageComputeSlicePitch(width, height, ImagePixelFormat_U32);
+	u64 elapsed = MeasureFastestRun(options.RunCount, [&]
+		{
+			memcpy(dstPixels.Data()->Bytes, srcPixels[0].Data()->Bytes, rgbaSize);
+			ImageAdjustBrightnessAndContrastRGBA(dstPixels.Data()->Bytes, width, height, 20, 40);
+		});
+	addResult(ImagePixelKernel_BrightnessContrast, ImagePixelFormat_U32, ImagePixelFormat_U32, ResizeFilter_Box, rgbaSize * 2ull, elapsed);
+
+	int halfWidth = MAX(width / 2, 1);
+	int halfHeight = MAX(height / 2, 1);
+	for (ResizeFilter filter : { ResizeFilter_Box, ResizeFilter_Triangle, ResizeFilter_Mitchell })
+	{
+		elapsed = MeasureFastestRun(options.RunCount, [&]
+			{
+				ImageResize(dstPixels.Data(), srcPixels[0].Data(), filter, ImagePixelFormat_U32, width, height, halfWidth, halfHeight, false);
+			});
+		u64 byteCount = rgbaSize + ImageComputeSlicePitch(halfWidth, halfHeight, ImagePixelFormat_U32);
+		addResult(ImagePixelKernel_Resize, ImagePixelFormat_U32, ImagePixelFormat_U32, filter, byteCount, elapsed);
+	}
+
+	BackgroundWorker::Pop();
+}
+
+bool rageam::graphics::ImagePixelBenchmark::SaveResults(ConstWString path) const
+{
+	try
+	{
+		XmlDoc xDoc("PixelBenchmark");
+		XmlHandle xRoot = xDoc.Root();
+		xRoot.SetAttribute("Version", 0);
+
+		for (const ImagePixelBenchmarkResult& result : m_Results)
+		{
+			XmlHandle xResult = xRoot.AddChild("Result");
+			xResult.SetAttribute("Kernel", result.Kernel);
+			xResult.SetAttribute("FromFormat", result.FromFormat);
+			xResult.SetAttribute("ToFormat", result.ToFormat);
+			if (result.Kernel == ImagePixelKernel_Resize)
+				xResult.SetAttribute("Filter", result.Filter);
+			xResult.SetAttribute("PixelCount", result.PixelCount);
+			xResult.SetAttribute("ByteCount", result.ByteCount);
+			xResult.SetAttribute("ElapsedMicroseconds", result.ElapsedMicroseconds);
+			xResult.SetAttribute("MegaPixelsPerSecond", result.GetMegaPixelsPerSecond());
+			xResult.SetAttribute("GigaBytesPerSecond", result.GetGigaBytesPerSecond());
+		}
+
+		xDoc.SaveToFile(path);
+	}
+	catch (const XmlException& ex)
+	{
+		ex.Print();
+		return false;
+	}
+	return true;
+}
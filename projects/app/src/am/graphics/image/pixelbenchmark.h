@@ -0,0 +1,57 @@
+//
+// File: pixelbenchmark.h
+//
+// Copyright (C) 2023-2024 ranstar74. All rights violated.
+//
+// Part of "Rage Am" Research Project.
+//
+#pragma once
+
+#include "image.h"
+
+namespace rageam::graphics
+{
+	enum ImagePixelKernel
+	{
+		ImagePixelKernel_ConvertPixelFormat,	// ImageConvertPixelFormat
+		ImagePixelKernel_BrightnessContrast,	// ImageAdjustBrightnessAndContrastRGBA
+		ImagePixelKernel_Resize,				// ImageResize to half resolution
+	};
+
+	struct ImagePixelBenchmarkOptions
+	{
+		int Width = 4096;
+		int Height = 4096;
+		int RunCount = 5;	// Every kernel is executed this many times and the fastest run is reported
+	};
+
+	struct ImagePixelBenchmarkResult
+	{
+		ImagePixelKernel Kernel;
+		ImagePixelFormat FromFormat;
+		ImagePixelFormat ToFormat;		// Same as FromFormat if kernel does not convert pixels
+		ResizeFilter	 Filter;		// Only for ImagePixelKernel_Resize
+		u64				 PixelCount;	// Source pixels processed in a single run
+		u64				 ByteCount;		// Source + destination bytes touched in a single run
+		u64				 ElapsedMicroseconds;
+
+		double GetMegaPixelsPerSecond() const;
+		double GetGigaBytesPerSecond() const;
+	};
+
+	/**
+	 * \brief Measures single threaded throughput of per-pixel kernels on random pixels.
+	 * \remarks Build with and without AM_IMAGE_USE_SIMD / AM_IMAGE_USE_AVX2 to compare scalar and vector paths.
+	 */
+	class ImagePixelBenchmark
+	{
+		List<ImagePixelBenchmarkResult> m_Results;
+
+	public:
+		void Run(const ImagePixelBenchmarkOptions& options);
+
+		const List<ImagePixelBenchmarkResult>& GetResults() const { return m_Results; }
+		// Writes results to XML file, one element per result
+		bool SaveResults(ConstWString path) const;
+	};
+}
@@ -9,6 +9,7 @@
 #include "exception/handler.h"
 #include "dispatcher.h"
 #include "am/crypto/cipher.h"
+#include "helpers/ranges.h"
 
 #ifdef AM_INTEGRATED
 #include "am/integration/memory/hook.h"
@@ -16,6 +17,7 @@
 
 #include <easy/profiler.h>
 #include <Tracy.hpp>
+#include <thread>
 
 void rageam::System::LoadDataFromXML()
 {
@@ -126,7 +128,6 @@ void rageam::System::Destroy()
 	asset::TxdAsset::ShutdownClass();
 	asset::AssetFactory::Shutdown();
 	ui::AssetWindowFactory::Shutdown();
-	graphics::ImageCompressor::ShutdownClass();
 	m_MainWorker = nullptr;
 	ExceptionHandler::Shutdown();
 
@@ -155,7 +156,9 @@ void rageam::System::Init(bool withUI)
 	AM_STANDALONE_ONLY(EASY_THREAD("Main Thread"));
 
 	// Core
-	m_MainWorker = std::make_unique<BackgroundWorker>("System", 8);
+	// Image compressor schedules its block regions on the system worker too, so use every core we have
+	int workerThreadCount = MAX(static_cast<int>(std::thread::hardware_concurrency()), 8);
+	m_MainWorker = std::make_unique<BackgroundWorker>("System", workerThreadCount);
 	BackgroundWorker::SetMainInstance(m_MainWorker.get());
 	AM_INTEGRATED_ONLY(Hook::Init());
 	AM_INTEGRATED_ONLY(m_AddressCache = std::make_unique<gmAddressCache>());
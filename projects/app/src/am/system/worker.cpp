@@ -6,6 +6,22 @@
 
 thread_local rage::atFixedArray<rageam::BackgroundWorker*, 8> rageam::BackgroundWorker::sm_Stack;
 
+void rageam::BackgroundTask::Wait() const
+{
+	if (IsFinished())
+		return;
+
+	BackgroundWorker::HelpUntilFinished(*this);
+
+	// Nothing left to do on this thread, task is being processed by someone else
+	eBackgroundTaskState state = m_State;
+	while (state != TASK_STATE_SUCCESS && state != TASK_STATE_FAILED)
+	{
+		m_State.wait(state);
+		state = m_State;
+	}
+}
+
 DWORD rageam::BackgroundWorker::ThreadProc(LPVOID lpParam)
 {
 	ThreadProcArg*     arg = static_cast<ThreadProcArg*>(lpParam);
@@ -14,6 +30,9 @@ DWORD rageam::BackgroundWorker::ThreadProc(LPVOID lpParam)
 	delete arg;
 	arg = nullptr;
 
+	tl_Worker = worker;
+	tl_WorkerID = workerID;
+
 	// Add thread name so it can be seen in debugger
 	{
 		wchar_t nameBuffer[64];
@@ -25,66 +44,154 @@ DWORD rageam::BackgroundWorker::ThreadProc(LPVOID lpParam)
 
 	while (!worker->m_WeAreClosing)
 	{
-		// Wait for the next job
-		amUPtr<BackgroundJob> job;
+		// Our own jobs first, then ones scheduled from outside and only then other threads jobs
+		amUPtr<BackgroundJob> job = worker->PopLocalJob(workerID);
+		if (!job) job = worker->PopGlobalJob();
+		if (!job) job = worker->StealJob(workerID);
+
+		if (!job)
 		{
+			// Nothing to do, park until new job is scheduled
 			std::unique_lock lock(worker->m_Mutex);
 			worker->m_Condition.wait(lock, [&]
 				{
-					return worker->m_Jobs.Any() || worker->m_WeAreClosing;
+					return worker->m_PendingJobCount > 0 || worker->m_WeAreClosing;
 				});
-
-			if (worker->m_WeAreClosing)
-				break;
-
-			job = std::move(worker->m_Jobs.First());
-			worker->m_Jobs.RemoveAt(0);
+			continue;
 		}
 
-		Timer timer = Timer::StartNew();
-		auto& task = job->GetTask();
-		task->m_WorkerID = workerID;
-		task->m_State = TASK_STATE_RUNNING;
-		bool success = job->GetLambda()();
-		task->m_Result = std::move(tl_Result);
-		task->m_State = success ? TASK_STATE_SUCCESS : TASK_STATE_FAILED;
-		timer.Stop();
-
-		wchar_t buffer[256];
-		if (String::IsNullOrEmpty(job->GetName()))
-			swprintf_s(buffer, 256, L"%hs, %llu ms", success ? "OK" : "FAIL", timer.GetElapsedMilliseconds());
-		else
-			swprintf_s(buffer, 256, L"[%ls] %hs, %llu ms", job->GetName(), success ? "OK" : "FAIL", timer.GetElapsedMilliseconds());
-
-#ifdef WORKER_ENABLE_LOGGING
-		 AM_TRACEF(L"[W: %hs] wID:%i, %s", worker->m_Name, workerID, buffer);
-#endif
-
-		 if (worker->TaskCallback)
-		 	worker->TaskCallback(buffer);
+		worker->ExecuteJob(job, workerID);
 	}
 	return 0;
 }
 
 amPtr<rageam::BackgroundTask> rageam::BackgroundWorker::RunVA(const TLambda& lambda, ConstWString fmt, va_list args)
 {
-	std::unique_lock lock(m_Mutex);
-
 	amPtr<BackgroundTask> task = std::make_shared<BackgroundTask>();
 	task->m_State = TASK_STATE_PENDING;
 
 	wchar_t buffer[256];
 	vswprintf_s(buffer, 256, fmt, args);
 
-	m_Jobs.Construct(new BackgroundJob(task, lambda, buffer));
+	amUPtr<BackgroundJob> job = std::make_unique<BackgroundJob>(task, lambda, buffer);
 
+	// Scheduled from one of our threads, keep job local so it can be picked up by the same thread when waiting
+	WorkerQueue& queue = tl_Worker == this ? *m_Queues[tl_WorkerID] : m_GlobalQueue;
+	{
+		std::unique_lock lock(queue.Mutex);
+		queue.Jobs.emplace_back(std::move(job));
+	}
+	++m_PendingJobCount;
+
+	// Lock is required to not miss the notification while thread is going to park
+	{
+		std::unique_lock lock(m_Mutex);
+	}
 	m_Condition.notify_one();
 	return task;
 }
 
+amUPtr<rageam::BackgroundWorker::BackgroundJob> rageam::BackgroundWorker::PopLocalJob(int workerID)
+{
+	WorkerQueue& queue = *m_Queues[workerID];
+	std::unique_lock lock(queue.Mutex);
+	if (queue.Jobs.empty())
+		return nullptr;
+
+	amUPtr<BackgroundJob> job = std::move(queue.Jobs.back());
+	queue.Jobs.pop_back();
+	--m_PendingJobCount;
+	return job;
+}
+
+amUPtr<rageam::BackgroundWorker::BackgroundJob> rageam::BackgroundWorker::PopGlobalJob()
+{
+	std::unique_lock lock(m_GlobalQueue.Mutex);
+	if (m_GlobalQueue.Jobs.empty())
+		return nullptr;
+
+	amUPtr<BackgroundJob> job = std::move(m_GlobalQueue.Jobs.front());
+	m_GlobalQueue.Jobs.pop_front();
+	--m_PendingJobCount;
+	return job;
+}
+
+amUPtr<rageam::BackgroundWorker::BackgroundJob> rageam::BackgroundWorker::StealJob(int thiefID)
+{
+	int queueCount = m_Queues.GetSize();
+	for (int i = 1; i < queueCount; i++)
+	{
+		// Start from neighbour thread so all threads don't fight over the same queue
+		WorkerQueue& queue = *m_Queues[(thiefID + i) % queueCount];
+		std::unique_lock lock(queue.Mutex);
+		if (queue.Jobs.empty())
+			continue;
+
+		amUPtr<BackgroundJob> job = std::move(queue.Jobs.front());
+		queue.Jobs.pop_front();
+		--m_PendingJobCount;
+		return job;
+	}
+	return nullptr;
+}
+
+void rageam::BackgroundWorker::ExecuteJob(amUPtr<BackgroundJob>& job, int workerID) const
+{
+	// Job may be executed while another one on this thread is waiting, we must not override its result
+	std::any outerResult = std::move(tl_Result);
+	tl_Result.reset();
+
+	Timer timer = Timer::StartNew();
+	auto& task = job->GetTask();
+	task->m_WorkerID = workerID;
+	task->m_State = TASK_STATE_RUNNING;
+	bool success = job->GetLambda()();
+	task->m_Result = std::move(tl_Result);
+	task->m_State = success ? TASK_STATE_SUCCESS : TASK_STATE_FAILED;
+	task->m_State.notify_all();
+	timer.Stop();
+
+	tl_Result = std::move(outerResult);
+
+	wchar_t buffer[256];
+	if (String::IsNullOrEmpty(job->GetName()))
+		swprintf_s(buffer, 256, L"%hs, %llu ms", success ? "OK" : "FAIL", timer.GetElapsedMilliseconds());
+	else
+		swprintf_s(buffer, 256, L"[%ls] %hs, %llu ms", job->GetName(), success ? "OK" : "FAIL", timer.GetElapsedMilliseconds());
+
+#ifdef WORKER_ENABLE_LOGGING
+	AM_TRACEF(L"[W: %hs] wID:%i, %s", m_Name, workerID, buffer);
+#endif
+
+	if (TaskCallback)
+		TaskCallback(buffer);
+}
+
+void rageam::BackgroundWorker::HelpUntilFinished(const BackgroundTask& task)
+{
+	BackgroundWorker* worker = tl_Worker;
+	if (!worker)
+		return;
+
+	// We only execute jobs from our own queue: those are scheduled by this thread (the ones we're most likely waiting for)
+	// Taking foreign jobs is not safe because they may wait on resource that is held by the job we're currently in
+	while (!task.IsFinished())
+	{
+		amUPtr<BackgroundJob> job = worker->PopLocalJob(tl_WorkerID);
+		if (!job)
+			break;
+
+		worker->ExecuteJob(job, tl_WorkerID);
+	}
+}
+
 rageam::BackgroundWorker::BackgroundWorker(ConstString name, int threadCount)
 {
 	m_Name = name;
+	m_Queues.Reserve(threadCount);
+	for (int i = 0; i < threadCount; i++)
+		m_Queues.Construct(new WorkerQueue());
+
 	m_ThreadPool.Resize(threadCount);
 	for (u64 i = 0; i < threadCount; i++)
 	{
@@ -97,7 +204,10 @@ rageam::BackgroundWorker::BackgroundWorker(ConstString name, int threadCount)
 
 rageam::BackgroundWorker::~BackgroundWorker()
 {
-	m_WeAreClosing = true;
+	{
+		std::unique_lock lock(m_Mutex);
+		m_WeAreClosing = true;
+	}
 	m_Condition.notify_all();
 
 	for (HANDLE thread : m_ThreadPool)
@@ -133,8 +243,10 @@ amPtr<rageam::BackgroundTask> rageam::BackgroundWorker::Run(const TLambda& lambd
 bool rageam::BackgroundWorker::WaitFor(const Tasks& tasks)
 {
 	bool success = true;
-	for (amPtr<BackgroundTask>& task : tasks)
+	// Wait in reverse order, most recently scheduled jobs are on top of our local queue
+	for (u32 i = tasks.GetSize(); i > 0; i--)
 	{
+		const amPtr<BackgroundTask>& task = tasks[i - 1];
 		task->Wait();
 		if (!task->IsSuccess())
 			success = false;
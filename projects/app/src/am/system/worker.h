@@ -13,6 +13,7 @@
 
 #include <functional>
 #include <mutex>
+#include <deque>
 #include <Windows.h>
 #include <any>
 
@@ -47,7 +48,9 @@ namespace rageam
 		bool IsSuccess()  const { return m_State == TASK_STATE_SUCCESS; }
 		bool IsFinished() const { return m_State == TASK_STATE_SUCCESS || m_State == TASK_STATE_FAILED; }
 
-		void Wait() const { while (!IsFinished()) { /* ... */ } }
+		// Blocks until task is finished. If called from worker thread, pending jobs
+		// scheduled by this thread are executed while waiting instead of blocking
+		void Wait() const;
 
 		// This value can be safely accessed if IsSuccess returns True.
 		template<typename T>
@@ -66,9 +69,12 @@ namespace rageam
 
 	/**
 	 * \brief Dispatcher of long-running background tasks.
+	 * \remarks Every thread has its own job queue, idle threads steal jobs from others.
 	 */
 	class BackgroundWorker
 	{
+		friend class BackgroundTask;
+
 		using TLambda = std::function<bool()>;
 
 		class BackgroundJob
@@ -97,24 +103,46 @@ namespace rageam
 			int				  WorkerID;
 		};
 
+		// Jobs scheduled from worker thread are pushed in its own queue, owner takes jobs from
+		// the back (most recent first) and other threads steal from the front (oldest first)
+		struct WorkerQueue
+		{
+			std::mutex						  Mutex;
+			std::deque<amUPtr<BackgroundJob>> Jobs;
+		};
+
 		ConstString					m_Name;
 		List<HANDLE>                m_ThreadPool;
-		List<amUPtr<BackgroundJob>> m_Jobs;
-		std::mutex                  m_Mutex;
+		List<amUPtr<WorkerQueue>>	m_Queues;			// One per thread
+		WorkerQueue					m_GlobalQueue;		// Jobs scheduled from non-worker threads
+		std::atomic_int				m_PendingJobCount = 0;
+		std::mutex                  m_Mutex;			// Only used for parking idle threads
 		std::condition_variable     m_Condition;
 		std::atomic_bool			m_WeAreClosing = false;
 
 		static thread_local rage::atFixedArray<BackgroundWorker*, 8> sm_Stack;
 		static inline thread_local std::any tl_Result; // Per-worker unique result value, set from lambda function
+		static inline thread_local BackgroundWorker* tl_Worker = nullptr; // Worker that owns current thread, if any
+		static inline thread_local int tl_WorkerID = -1;
 		static inline BackgroundWorker* sm_MainInstance = nullptr;
 
 		static DWORD ThreadProc(LPVOID lpParam);
 		amPtr<BackgroundTask> RunVA(const TLambda& lambda, ConstWString fmt, va_list args);
 
+		amUPtr<BackgroundJob> PopLocalJob(int workerID);
+		amUPtr<BackgroundJob> PopGlobalJob();
+		amUPtr<BackgroundJob> StealJob(int thiefID);
+		void				  ExecuteJob(amUPtr<BackgroundJob>& job, int workerID) const;
+
+		// Runs jobs from current thread queue until given task is finished or queue is empty
+		static void HelpUntilFinished(const BackgroundTask& task);
+
 	public:
 		BackgroundWorker(ConstString name, int threadCount);
 		~BackgroundWorker();
 
+		int GetThreadCount() const { return m_ThreadPool.GetSize(); }
+
 		WPRINTF_ATTR(2, 3) static amPtr<BackgroundTask> Run(const TLambda& lambda, ConstString  fmt, ...);
 		PRINTF_ATTR(2, 3)  static amPtr<BackgroundTask> Run(const TLambda& lambda, ConstWString fmt, ...);
 		static amPtr<BackgroundTask>                    Run(const TLambda& lambda);
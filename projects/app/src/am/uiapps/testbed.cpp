@@ -309,5 +309,21 @@ void rageam::ui::TestbedApp::OnRender()
 		ImGui::Unindent();
 	}
 
+	if (ImGui::CollapsingHeader("ImageAlloc", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		graphics::ImageAllocStats ias = graphics::ImageGetAllocStats();
+
+		ImGui::BulletText("Current: %s", FormatSize(ias.SizeCurrent));
+		ImGui::BulletText("Peak: %s", FormatSize(ias.SizePeak));
+		ImGui::BulletText("Cached: %s", FormatSize(ias.SizeCached));
+		ImGui::BulletText("Scratch: %s", FormatSize(ias.SizeScratch));
+		ImGui::BulletText("Pool hits / misses: %llu / %llu", ias.PoolHits, ias.PoolMisses);
+		if (ImGui::Button("Trim"))
+			graphics::ImageAllocTrim();
+		ImGui::SameLine();
+		if (ImGui::Button("Reset Peak"))
+			graphics::ImageAllocResetPeak();
+	}
+
 	ImGui::End();
 }
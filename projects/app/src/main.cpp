@@ -6,8 +6,12 @@
 #include "am/asset/factory.h"
 #include "am/asset/types/txd.h"
 #include "am/file/iterator.h"
+#include "am/graphics/image/batchcompressor.h"
+#include "am/graphics/image/encoderbenchmark.h"
+#include "am/graphics/image/pixelbenchmark.h"
 #include "am/system/system.h"
 #include "am/system/cli.h"
+#include "helpers/format.h"
 #include "helpers/compiler.h"
 #include "rage/paging/builder/builder.h"
 
@@ -23,6 +27,84 @@ namespace cli
 		asset->CompileToFile();
 	}
 
+	// Source may be either directory with images or texture dictionary asset (.itd),
+	// for dictionaries options from texture tunes / presets are used
+	void CompressImages(ConstWString srcPath, ConstWString dstDir, const rageam::graphics::ImageCompressorOptions& options)
+	{
+		using namespace rageam;
+
+		graphics::ImageBatchCompressor batch;
+		if (ImmutableWString(srcPath).EndsWith(asset::ASSET_ITD_EXT))
+		{
+			asset::AssetPtr asset = asset::AssetFactory::LoadFromPath(srcPath);
+			if (!asset || asset->GetType() != asset::AssetType_Txd)
+			{
+				AM_ERRF(L"CompressImages() -> '%ls' is not a texture dictionary.", srcPath);
+				return;
+			}
+
+			CreateDirectoryW(dstDir, NULL);
+
+			asset::TxdAsset* txd = static_cast<asset::TxdAsset*>(asset.get());
+			for (asset::TextureTune& tune : txd->GetTextureTunes())
+			{
+				file::WPath dstPath = dstDir;
+				dstPath /= file::GetFileName(tune.GetFilePath());
+				dstPath = dstPath.GetFilePathWithoutExtension() + L".dds";
+				batch.AddImage(tune.GetFilePath(), dstPath, tune.GetCustomOptionsOrFromPreset().CompressorOptions);
+			}
+		}
+		else
+		{
+			batch.AddDirectory(srcPath, dstDir, options);
+		}
+
+		AM_TRACEF(L"Compressing %u images from '%ls'...", batch.GetItemCount(), srcPath);
+
+		graphics::ImageBatchStats stats;
+		batch.Run(&stats);
+
+		AM_TRACEF("Done in %.2f seconds, %u/%u failed", 
+			static_cast<double>(stats.ElapsedMicroseconds) / 1000000.0, stats.FailedCount, stats.ImageCount);
+		AM_TRACEF("%.2f megapixels, %.2f MP/s, %.0f blocks/s",
+			static_cast<double>(stats.PixelCount) / 1000000.0, stats.GetMegaPixelsPerSecond(), stats.GetBlocksPerSecond());
+
+		graphics::ImageAllocStats allocStats = graphics::ImageGetAllocStats();
+		AM_TRACEF("Image memory peak %s, pool hits %llu, misses %llu",
+			FormatSize(allocStats.SizePeak), allocStats.PoolHits, allocStats.PoolMisses);
+	}
+
+	void BenchmarkEncoders(ConstWString corpusDir, ConstWString resultsPath, const rageam::graphics::ImageEncoderBenchmarkOptions& options)
+	{
+		using namespace rageam;
+
+		graphics::ImageEncoderBenchmark benchmark;
+		benchmark.AddDirectory(corpusDir);
+		benchmark.Run(options);
+
+		if (!benchmark.SaveResults(resultsPath))
+		{
+			AM_ERRF(L"BenchmarkEncoders() -> Failed to save results to '%ls'", resultsPath);
+			return;
+		}
+		AM_TRACEF(L"Results saved to '%ls'", resultsPath);
+	}
+
+	void BenchmarkPixelKernels(ConstWString resultsPath, const rageam::graphics::ImagePixelBenchmarkOptions& options)
+	{
+		using namespace rageam;
+
+		graphics::ImagePixelBenchmark benchmark;
+		benchmark.Run(options);
+
+		if (!benchmark.SaveResults(resultsPath))
+		{
+			AM_ERRF(L"BenchmarkPixelKernels() -> Failed to save results to '%ls'", resultsPath);
+			return;
+		}
+		AM_TRACEF(L"Results saved to '%ls'", resultsPath);
+	}
+
 	void ExportYtds(ConstWString searchDir, ConstWString outDir)
 	{
 		/*rageam::file::WPath path = searchDir;
@@ -63,6 +145,16 @@ void ParseAndExecuteArguments(int argc, wchar_t** argv)
 			AM_TRACEF("--help");
 			AM_TRACEF("-b, --build\t\tCompiles assets passed in the next arguments.");
 			AM_TRACEF("-txde, --txdexport\t\tExports YTD's located in dir specified by #1 arg to #2 arg dir");
+			AM_TRACEF("-c, --compress\t\tCompresses images from dir or .itd specified by #1 arg to #2 arg dir as DDS.");
+			AM_TRACEF("\t--format\t\tBlock format for images in dir: bc1, bc3, bc4, bc5, bc7 (default), rgba");
+			AM_TRACEF("\t--quality\t\tEncoder quality from 0.0 (fastest) to 1.0 (best)");
+			AM_TRACEF("-bench, --benchmark\t\tEncodes images from dir specified by #1 arg with every encoder and writes XML report to #2 arg file.");
+			AM_TRACEF("\t--threads\t\tMax thread count, all hardware threads by default");
+			AM_TRACEF("\t--qualitysteps\t\tNumber of quality steps from 0.0 to 1.0, 5 by default");
+			AM_TRACEF("\t--runs\t\tNumber of runs per configuration, fastest is reported, 3 by default");
+			AM_TRACEF("-pbench, --pixelbenchmark\t\tMeasures pixel format conversion, adjustment and resize kernels and writes XML report to #1 arg file.");
+			AM_TRACEF("\t--size\t\tWidth and height of test image, 4096 by default");
+			AM_TRACEF("\t--runs\t\tNumber of runs per kernel, fastest is reported, 5 by default");
 			continue;
 		}
 
@@ -83,6 +175,115 @@ void ParseAndExecuteArguments(int argc, wchar_t** argv)
 			continue;
 		}
 
+		if (args.Current() == L"--compress" || args.Current() == L"-c")
+		{
+			args.Next();
+			rageam::file::WPath srcPath(args.Current());
+			args.Next();
+			rageam::file::WPath dstDir(args.Current());
+
+			rageam::graphics::ImageCompressorOptions options;
+			while (args.Next())
+			{
+				if (args.Current() == L"--format")
+				{
+					args.Next();
+					ImmutableWString format = args.Current();
+					if (format == L"bc1")		options.Format = rageam::graphics::BlockFormat_BC1;
+					else if (format == L"bc3")	options.Format = rageam::graphics::BlockFormat_BC3;
+					else if (format == L"bc4")	options.Format = rageam::graphics::BlockFormat_BC4;
+					else if (format == L"bc5")	options.Format = rageam::graphics::BlockFormat_BC5;
+					else if (format == L"bc7")	options.Format = rageam::graphics::BlockFormat_BC7;
+					else if (format == L"rgba")	options.Format = rageam::graphics::BlockFormat_None;
+					else AM_WARNINGF(L"Unknown block format '%ls', using BC7", static_cast<ConstWString>(format));
+					continue;
+				}
+
+				if (args.Current() == L"--quality")
+				{
+					args.Next();
+					options.Quality = std::clamp(static_cast<float>(_wtof(args.Current())), 0.0f, 1.0f);
+					continue;
+				}
+
+				args.GoBack();
+				break;
+			}
+
+			cli::CompressImages(srcPath, dstDir, options);
+			continue;
+		}
+
+		if (args.Current() == L"--benchmark" || args.Current() == L"-bench")
+		{
+			args.Next();
+			rageam::file::WPath corpusDir(args.Current());
+			args.Next();
+			rageam::file::WPath resultsPath(args.Current());
+
+			rageam::graphics::ImageEncoderBenchmarkOptions options;
+			while (args.Next())
+			{
+				if (args.Current() == L"--threads")
+				{
+					args.Next();
+					options.MaxThreadCount = _wtoi(args.Current());
+					continue;
+				}
+
+				if (args.Current() == L"--qualitysteps")
+				{
+					args.Next();
+					options.QualityStepCount = _wtoi(args.Current());
+					continue;
+				}
+
+				if (args.Current() == L"--runs")
+				{
+					args.Next();
+					options.RunCount = _wtoi(args.Current());
+					continue;
+				}
+
+				args.GoBack();
+				break;
+			}
+
+			cli::BenchmarkEncoders(corpusDir, resultsPath, options);
+			continue;
+		}
+
+		if (args.Current() == L"--pixelbenchmark" || args.Current() == L"-pbench")
+		{
+			args.Next();
+			rageam::file::WPath resultsPath(args.Current());
+
+			rageam::graphics::ImagePixelBenchmarkOptions options;
+			while (args.Next())
+			{
+				if (args.Current() == L"--size")
+				{
+					args.Next();
+					options.Width = std::clamp(_wtoi(args.Current()), 1, rageam::graphics::IMAGE_MAX_RESOLUTION);
+					options.Height = options.Width;
+					continue;
+				}
+
+				if (args.Current() == L"--runs")
+				{
+					args.Next();
+					options.RunCount = _wtoi(args.Current());
+					continue;
+				}
+
+				args.GoBack();
+				break;
+			}
+
+			cli::BenchmarkPixelKernels(resultsPath, options);
+			continue;
+		}
+
 		if (state == STATE_BUILDING)
 		{
 			if (args.Current().StartsWith('-'))
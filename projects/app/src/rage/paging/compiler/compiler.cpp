@@ -1,11 +1,14 @@
 #include "compiler.h"
 #include "rage/paging/paging.h"
 
-void rage::pgRscCompiler::FixupReferences(const datPackedChunks& pack, const pgSnapshotAllocator& allocator) const
+void rage::pgRscCompiler::FixupReferences(const datPackedChunks& pack, pgSnapshotAllocator& allocator) const
 {
 	if (pack.IsEmpty)
 		return;
 
+	// New address of every block is resolved first, then all references are patched in a single pass
+	atArray<u64> blockAddresses(allocator.GetBlockCount());
+
 	// We accumulate file offset while iterating through all packed blocks
 	u32 fileOffset = 0;
 	u32 chunkSize = PG_MIN_CHUNK_SIZE << pack.SizeShift;
@@ -19,8 +22,7 @@ void rage::pgRscCompiler::FixupReferences(const datPackedChunks& pack, const pgS
 			u32 inChunkOffset = 0;
 			for (u16 blockIndex : chunk)
 			{
-				u64 newAddress = allocator.GetBaseAddress() | static_cast<u64>(fileOffset + inChunkOffset);
-				allocator.FixupBlockReferences(blockIndex, newAddress);
+				blockAddresses[blockIndex] = allocator.GetBaseAddress() | static_cast<u64>(fileOffset + inChunkOffset);
 
 				inChunkOffset += allocator.GetBlockSize(blockIndex);
 			}
@@ -29,4 +31,6 @@ void rage::pgRscCompiler::FixupReferences(const datPackedChunks& pack, const pgS
 		}
 		chunkSize /= 2;
 	}
+
+	allocator.FixupReferences(blockAddresses);
 }
@@ -33,7 +33,7 @@ namespace rage
 		pgBase* m_RootResourceAllocation = nullptr;
 
 		// Replaces pointers on file offsets
-		void FixupReferences(const datPackedChunks& pack, const pgSnapshotAllocator& allocator) const;
+		void FixupReferences(const datPackedChunks& pack, pgSnapshotAllocator& allocator) const;
 
 		template<typename TPaged>
 		TPaged* DoSnapshot(const TPaged* pPaged)
@@ -4,14 +4,25 @@
 #include "rage/math/math.h"
 #include "rage/paging/resourceinfo.h"
 
-void rage::pgRscPacker::GetInitialBucketAndSizeShift(u32 largestBlock, u8& bucket, u8& shift)
+namespace
 {
-	u32 chunkSize = datResourceInfo::GetChunkSize(largestBlock);
-	u32 index = BitScanR32(chunkSize) - PG_MIN_CHUNK_SIZE_SHIFT;
+	// Size shift is encoded in 4 bits (see datResourceInfo), but size of the first bucket chunk with the last one doesn't fit in
+	// 32 bits that writer and fixup use. It wouldn't be picked anyway, every bucket usable with it is usable with previous shift
+	constexpr u8 PG_MAX_SIZE_SHIFT = rage::PG_MIN_SIZE_SHIFT + 0xE;
 
-	u8 data = sm_BucketAndSizeShift[index];
-	bucket = data >> BUCKET_SHIFT & BUCKET_SIZE;
-	shift = data & SIZE_SHIFT_MASK;
+	u64 GetBucketChunkSize(u8 sizeShift, u8 bucket)
+	{
+		// Largest shift overflows 32 bits for the first bucket
+		return static_cast<u64>(rage::PG_MIN_CHUNK_SIZE) << sizeShift >> bucket;
+	}
+
+	// Chunks smaller than buddy allocator block won't save any memory and
+	// chunks larger than streamer limit can't be loaded at all
+	bool IsBucketUsable(u8 sizeShift, u8 bucket)
+	{
+		u64 chunkSize = GetBucketChunkSize(sizeShift, bucket);
+		return chunkSize >= rage::PG_MIN_CHUNK_SIZE && chunkSize < rage::PG_MAX_CHUNK_SIZE;
+	}
 }
 
 void rage::pgRscPacker::ResetBuckets()
@@ -48,6 +59,7 @@ void rage::pgRscPacker::CopyAndSortBlocks(const pgSnapshotAllocator& allocator)
 	if (allocator.IsVirtual())
 	{
 		// With virtual chunks we have one more rule - main chunk always has to be the first one
+		m_PinFirstBlock = true;
 		std::sort(
 			m_SortedBlocks.begin() + 1 /* Pin first block */,
 			m_SortedBlocks.end(),
@@ -67,215 +79,168 @@ void rage::pgRscPacker::CopyAndSortBlocks(const pgSnapshotAllocator& allocator)
 		m_LargestBlock = m_SortedBlocks[0].Size;
 	}
 
-	AM_DEBUGF("pgRscPacker(%s) -> %u blocks to pack, largest block: %#x", allocator.GetDebugName(), m_SortedBlocks.GetSize(), m_LargestBlock);
-}
-
-void rage::pgRscPacker::PrintPackedInfo(const datPackedChunks& chunks) const
-{
-#ifdef _DEBUG
-	AM_DEBUG("pgRscPacker::PrintPackedInfo() -> Buckets:");
-
-	// NOTE: -10 is left-justify flag, for table alignment
-	// (Index, Block Count, Packed Chunk Count, Max Chunk Count, Used / Total, Used Size, Bucket Size, Chunk Size)
-	AM_DEBUGF("%-6s %-12s %-19s %-16s %-7s %-10s %-12s %-11s",
-		"Index", "Block Count", "Packed Chunk Count", "Max Chunk Count", "Used %", "Used Size", "Bucket Size", "Chunk Size");
-
-	u32 resourceUsedSize = 0;
-	u32 resourceAllocatedSize = 0;
-
-	u32 chunkSize = PG_MIN_CHUNK_SIZE << chunks.SizeShift;
-	for (u8 i = 0; i < PG_MAX_BUCKETS; i++)
+	m_RemainingSizes.Resize(m_SortedBlocks.GetSize());
+	u32 remainingSize = 0;
+	for (u16 i = m_SortedBlocks.GetSize(); i > 0; i--)
 	{
-		u16 chunkCount = chunks.BucketCounts[i];
-		u32 bucketSize = chunkSize * chunkCount;
-		u16 bucketBlockCount = 0; // Total number of blocks in this bucket
-		u32 bucketBlocksSize = 0; // Total size of blocks in this bucket
-		for (atArray<u16>& chunkBlockIndices : m_Buckets[i])
-		{
-			u16 blockCount = chunkBlockIndices.GetSize();
-			bucketBlockCount += blockCount;
-			for (u16 index : chunkBlockIndices)
-			{
-				bucketBlocksSize += m_Allocator->GetBlockSize(index);
-			}
-		}
-
-		// This shows us how much memory in chunk is actually used, and how much is wasted (internal fragmentation)
-		// This value is average per all chunks in bucket
-		double useRatio = 0;
-		if (bucketSize > 0) useRatio = (double)bucketBlocksSize / (double)bucketSize * 100;
-
-		resourceUsedSize += bucketBlocksSize;
-		resourceAllocatedSize += bucketSize;
-
-		u8 maxChunkCount = datResourceInfo::GetMaxChunkCountInBucket(i);
-		AM_DEBUGF("%-6i %-12u %-19u %-16u %-7.0f %#-10x %#-12x %#-11x",
-			i,						// Bucket Index
-			bucketBlockCount,		// Block Count 
-			chunkCount,				// Packed Chunk Count
-			maxChunkCount,			// Max Chunk Count
-			useRatio,				// Used %
-			bucketBlocksSize,		// Used Size
-			bucketSize,				// Bucket Size
-			chunkSize);				// Chunk Size
-
-		chunkSize /= 2;
+		remainingSize += m_SortedBlocks[i - 1].Size;
+		m_RemainingSizes[i - 1] = remainingSize;
 	}
 
-	// To see total unused memory in the resource
-	AM_DEBUGF("Used Size: %u Alloc Size: %u Fragmented: %u", 
-		resourceUsedSize, resourceAllocatedSize, resourceAllocatedSize - resourceUsedSize);
-#endif
-}
-
-u32 rage::pgRscPacker::GetTotalBlockSize(u8 bucket, u16 startIndex) const
-{
-	u32 size = 0;
-	for (u16 i = startIndex; i < m_SortedBlocks.GetSize(); i++)
-		size += m_SortedBlocks[i].Size;
-	return size;
+	AM_DEBUGF("pgRscPacker(%s) -> %u blocks to pack, largest block: %#x", allocator.GetDebugName(), m_SortedBlocks.GetSize(), m_LargestBlock);
 }
 
-u32 rage::pgRscPacker::GetTotalChunkCount() const
+void rage::pgRscPacker::CalculateChunkCountInBuckets(datPackedChunks& pack) const
 {
-	u8 chunkCount = 0;
-	for (const auto& m_Bucket : m_Buckets)
+	pack.ChunkCount = 0;
+	for (u8 i = 0; i < PG_MAX_BUCKETS; i++)
 	{
 		u8 bucketChunkCount = 0;
-		for (auto& chunk : m_Bucket)
+		for (auto& chunk : m_Buckets[i])
 		{
 			// We need at least one block in chunk to consider it as used
 			if (chunk.Any()) bucketChunkCount++;
 			else break; // If we don't have any block in this chunk, there won't be in next ones either
 		}
-		chunkCount += bucketChunkCount;
+
+		pack.BucketCounts[i] = bucketChunkCount;
+		pack.ChunkCount += bucketChunkCount;
 	}
-	return chunkCount + m_ReservedChunks;
 }
 
-void rage::pgRscPacker::CalculateChunkCountInBuckets(datPackedChunks& pack) const
+void rage::pgRscPacker::ComputePackInfo(const datPackedChunks& pack, u8 viableSizeShiftCount)
 {
-	pack.ChunkCount = 0;
+	m_PackInfo = {};
+	m_PackInfo.SizeShift = pack.SizeShift;
+	m_PackInfo.ViableSizeShiftCount = viableSizeShiftCount;
+	m_PackInfo.ChunkCount = pack.ChunkCount;
+
 	for (u8 i = 0; i < PG_MAX_BUCKETS; i++)
 	{
-		u8 bucketChunkCount = 0;
-		for (auto& chunk : m_Buckets[i])
+		pgRscPackBucketInfo& bucketInfo = m_PackInfo.Buckets[i];
+		bucketInfo.MaxChunkCount = datResourceInfo::GetMaxChunkCountInBucket(i);
+		if (!IsBucketUsable(pack.SizeShift, i))
+			continue;
+
+		bucketInfo.ChunkSize = static_cast<u32>(GetBucketChunkSize(pack.SizeShift, i));
+		bucketInfo.ChunkCount = pack.BucketCounts[i];
+
+		for (u8 k = 0; k < bucketInfo.ChunkCount; k++)
 		{
-			// We need at least one block in chunk to consider it as used
-			if (chunk.Any()) bucketChunkCount++;
-			else break; // If we don't have any block in this chunk, there won't be in next ones either
+			u32 chunkUsedSize = 0;
+			for (u16 index : m_Buckets[i][k])
+				chunkUsedSize += m_Allocator->GetBlockSize(index);
+
+			bucketInfo.BlockCount += m_Buckets[i][k].GetSize();
+			bucketInfo.UsedSize += chunkUsedSize;
+			bucketInfo.AllocatedSize += bucketInfo.ChunkSize;
+			bucketInfo.LargestFreeSize = Max(bucketInfo.LargestFreeSize, bucketInfo.ChunkSize - chunkUsedSize);
 		}
 
-		pack.BucketCounts[i] = bucketChunkCount;
-		pack.ChunkCount += bucketChunkCount;
+		m_PackInfo.BlockCount += bucketInfo.BlockCount;
+		m_PackInfo.UsedSize += bucketInfo.UsedSize;
+		m_PackInfo.AllocatedSize += bucketInfo.AllocatedSize;
 	}
 }
 
-u8 rage::pgRscPacker::TryPack(u8 startBucket, u8 sizeShift)
+bool rage::pgRscPacker::TryPack(u8 sizeShift, PackAttempt& attempt) const
 {
-	ResetBuckets();
+	attempt.SizeShift = sizeShift;
+	attempt.AllocatedSize = 0;
+	attempt.ChunkCount = 0;
+	attempt.BlockChunks.Resize(m_SortedBlocks.GetSize());
 
-	u8 bucket = startBucket;
+	u32 maxChunkCount = m_ReservedChunks < PG_MAX_CHUNKS ? PG_MAX_CHUNKS - m_ReservedChunks : 0;
 
-	u32 chunkSize = PG_MIN_CHUNK_SIZE << sizeShift >> bucket; // Initial chunk size
-	u32 packedSize = 0; // Sum of all block sizes packed in current bucket
-	u16 chunkIndex = 0; // Amount of packed chunks in current bucket
+	// Buckets are ordered by chunk size descending, usable ones go in a row
+	u8 firstBucket = PG_MAX_BUCKETS;
+	u8 lastBucket = 0;
+	for (u8 i = 0; i < PG_MAX_BUCKETS; i++)
+	{
+		if (!IsBucketUsable(sizeShift, i))
+			continue;
+		firstBucket = Min(firstBucket, i);
+		lastBucket = i;
+	}
+	if (firstBucket == PG_MAX_BUCKETS || m_LargestBlock > GetBucketChunkSize(sizeShift, firstBucket))
+		return false;
 
+	u8  bucketChunkCounts[PG_MAX_BUCKETS] = {};
+	u8  minBucket = firstBucket;
+	u32 openFreeSize = 0; // Free space in all opened chunks
 	for (u16 i = 0; i < m_SortedBlocks.GetSize(); i++)
 	{
-		const SortedBlock& block = m_SortedBlocks[i];
+		u32 blockSize = m_SortedBlocks[i].Size;
 
-		// Not enough free space in chunk, we have to move to either next chunk or next bucket
-		if (packedSize + block.Size > chunkSize)
+		// Best fit - put block in the chunk that will have the least space left, so larger gaps stay for larger blocks
+		u32 bestChunk = attempt.ChunkCount;
+		u32 bestFreeSize = UINT32_MAX;
+		for (u32 k = 0; k < attempt.ChunkCount; k++)
 		{
-			if (bucket + 1 < PG_MAX_BUCKETS)
-			{
-				packedSize = 0;
-				chunkIndex++;
-
-				// No more free chunks in this bucket, move to next (smaller) one
-				if (chunkIndex == datResourceInfo::GetMaxChunkCountInBucket(bucket))
-				{
-					bucket++;
-					chunkIndex = 0;
-					chunkSize /= 2;
-				}
-			}
-			else
+			u32 freeSize = attempt.Chunks[k].FreeSize;
+			if (freeSize >= blockSize && freeSize < bestFreeSize)
 			{
-				AM_DEBUG("pgRscPacker::TryPack() -> Can't go to lower bucket! retrying with next size shift");
-				return TryPack(startBucket, sizeShift + 1);
+				bestChunk = k;
+				bestFreeSize = freeSize;
 			}
 		}
 
-		// Fitting in buckets with specific size makes this task much more complicated to do optimally
-		// Here's the deal: We get initial bucket / size shift from largest memory block,
-		// assuming that other blocks will be at least twice smaller to fit in remaining buckets
-		// This is not true in some cases (for example when we need to pack two large memory blocks of the same size)
-		// Our solution is to simply increment size shift, which will double chunk size and try to pack again
-		if (block.Size > chunkSize)
+		// Nothing fits, open a new chunk
+		if (bestChunk == attempt.ChunkCount)
 		{
-			AM_DEBUG("pgRscPacker::TryPack() -> Chunk is too small... retrying with next size shift");
-			return TryPack(startBucket, sizeShift + 1);
-		}
+			if (attempt.ChunkCount == maxChunkCount)
+				return false;
 
-		// We have to make sure that we don't put small blocks in large chunks,
-		// causing unreasonably large internal fragmentation (unused space inside chunk).
-		// To prevent that, we check if we can fit remaining blocks in next (smaller) bucket
-		u8 oldBucket = bucket;
-		while (true)
-		{
-			if (bucket + 1 == PG_MAX_BUCKETS)
-				break;
-
-			u32 remainingSize = GetTotalBlockSize(bucket, i);
-			u32 nextChunkSize = chunkSize / 2;
-
-			// Though chunks with size smaller that minimum will be parsed and allocated properly, it won't make any difference
-			if (nextChunkSize < PG_MIN_CHUNK_SIZE)
-				break;
-
-			// We simply can't fit remaining blocks in next chunk.
-			// While some of blocks may fit separately, it's too expensive to calculate.
-			if (remainingSize > nextChunkSize)
-				break;
-
-			// Is it even rational to move to next bucket? If we can fit everything into current chunk,
-			// we better do that, because every new chunk is one more allocation
-			// To make it reasonable, amount of fragmentation in current bucket chunk must be higher than in next (smaller) one.
-			u32 currentBucketLeftSpace = chunkSize - (packedSize + remainingSize);
-			u32 nextBucketLeftSpace = nextChunkSize - remainingSize;
-			if (currentBucketLeftSpace <= nextBucketLeftSpace)
-				break;
-
-			bucket++;
-			chunkIndex = 0;
-			chunkSize /= 2;
-		}
+			// New chunk should fit the rest of blocks that won't go in free space of opened chunks, but not more than that.
+			// Take the smallest chunk that does it, or if there's none - the largest one, the rest will go to next chunks
+			u32 remainingSize = m_RemainingSizes[i];
+			u32 neededSize = remainingSize > openFreeSize ? remainingSize - openFreeSize : blockSize;
+			neededSize = Max(neededSize, blockSize);
 
-		// See 'move to next bucket' optimization in while loop above (the last one)
-		if (bucket != oldBucket)
-			AM_DEBUGF("pgRscPacker::TryPack() -> Moving by %u bucket(s) to reduce fragmentation...", bucket - oldBucket);
+			u8 bucket = PG_MAX_BUCKETS;
+			for (u8 k = lastBucket + 1; k > minBucket; k--)
+			{
+				u8 candidate = k - 1;
+				u64 chunkSize = GetBucketChunkSize(sizeShift, candidate);
+				if (bucketChunkCounts[candidate] == datResourceInfo::GetMaxChunkCountInBucket(candidate) || chunkSize < blockSize)
+					continue;
+
+				bucket = candidate;
+				if (chunkSize >= neededSize)
+					break;
+			}
+			if (bucket == PG_MAX_BUCKETS)
+				return false;
+
+			u32 chunkSize = static_cast<u32>(GetBucketChunkSize(sizeShift, bucket));
+			attempt.Chunks[attempt.ChunkCount] = PackChunk(bucket, bucketChunkCounts[bucket]++, chunkSize);
+			attempt.ChunkCount++;
+			attempt.AllocatedSize += chunkSize;
+			openFreeSize += chunkSize;
+
+			// Chunks in larger buckets are placed before, main chunk won't be the first one anymore
+			if (i == 0 && m_PinFirstBlock)
+				minBucket = bucket;
+		}
 
-		packedSize += block.Size;
-		m_Buckets[bucket][chunkIndex].Add(block.Index);
-		m_BucketsDirty = true;
+		attempt.Chunks[bestChunk].FreeSize -= blockSize;
+		attempt.BlockChunks[i] = static_cast<u8>(bestChunk);
+		openFreeSize -= blockSize;
+	}
+	return true;
+}
 
-		// TODO: We need to account max chunk count from other packer
-		// We have total maximum of 128 chunks (both virtual & physical), so same as with block size not fitting in chunk,
-		// we have to increase size shift and try again
-		u32 chunkCount = GetTotalChunkCount();
-		if (chunkCount > 128)
-		{
-			AM_DEBUGF("pgRscPacker::TryPack() -> Out of chunks... (%u) retrying with next size shift", chunkCount);
-			return TryPack(startBucket, sizeShift + 1);
-		}
+void rage::pgRscPacker::StoreAttempt(const PackAttempt& attempt)
+{
+	ResetBuckets();
 
-		// Well, we can't really do anything here, maximum allowed streamed chunk size is 100MB
-		if (chunkSize >= PG_MAX_CHUNK_SIZE)
-			return 255;
+	// Blocks are added in sorted order, so pinned block stays the first one in its chunk
+	for (u16 i = 0; i < m_SortedBlocks.GetSize(); i++)
+	{
+		const PackChunk& chunk = attempt.Chunks[attempt.BlockChunks[i]];
+		m_Buckets[chunk.Bucket][chunk.IndexInBucket].Add(m_SortedBlocks[i].Index);
 	}
-	return sizeShift;
+	m_BucketsDirty = true;
 }
 
 rage::pgRscPacker::pgRscPacker(const pgSnapshotAllocator& allocator, u32 reservedChunks) : m_SortedBlocks(0)
@@ -291,6 +256,7 @@ bool rage::pgRscPacker::Pack(datPackedChunks& outPack)
 	outPack.Buckets = m_Buckets;
 	outPack.SizeShift = PG_MIN_SIZE_SHIFT;
 	outPack.IsEmpty = true;
+	m_PackInfo = {};
 
 	// Physical allocator often has nothing to pack whatsoever, handle that properly
 	if (!m_SortedBlocks.Any())
@@ -298,9 +264,6 @@ bool rage::pgRscPacker::Pack(datPackedChunks& outPack)
 
 	outPack.IsEmpty = false;
 
-	// Packing strategy explained in details in ::TryPack
-	u8	startBucket;
-	u8	startShift;
 	u32 largestChunk = datResourceInfo::GetChunkSize(m_LargestBlock);
 
 	// Maximum allowed by pgStreamer size is 100MB
@@ -308,24 +271,38 @@ bool rage::pgRscPacker::Pack(datPackedChunks& outPack)
 	if (!AM_VERIFY(largestChunk < PG_MAX_CHUNK_SIZE, "pgRscPacker::Pack() -> Block size %u is too large and exceeds 100MB limit", m_LargestBlock))
 		return false;
 
-	GetInitialBucketAndSizeShift(m_LargestBlock, startBucket, startShift);
-
-	AM_DEBUGF("pgRscPacker::Pack() -> Starting at bucket %u with size shift %u (%#x)",
-		startBucket, startShift, PG_MIN_CHUNK_SIZE << startShift);
-
-	// Do packing and calculate number of chunks in every bucket
-	u8 resultSizeShift = TryPack(startBucket, startShift);
+	// There are only 15 size shifts and every pass is linear in block count, so we simply try all of them and pick one that
+	// allocates the least memory. Larger shift is not always worse - two large blocks of the same size for example fit only
+	// in a pair of larger chunks, while smaller blocks may end up in more tightly fitting chunks with smaller shift
+	PackAttempt attempts[2];
+	PackAttempt* bestAttempt = nullptr;
+	u8 viableSizeShiftCount = 0;
+	for (u8 sizeShift = PG_MIN_SIZE_SHIFT; sizeShift <= PG_MAX_SIZE_SHIFT; sizeShift++)
+	{
+		PackAttempt& attempt = bestAttempt == &attempts[0] ? attempts[1] : attempts[0];
+		if (!TryPack(sizeShift, attempt))
+			continue;
+
+		viableSizeShiftCount++;
+		if (!bestAttempt ||
+			attempt.AllocatedSize < bestAttempt->AllocatedSize ||
+			attempt.AllocatedSize == bestAttempt->AllocatedSize && attempt.ChunkCount < bestAttempt->ChunkCount)
+		{
+			bestAttempt = &attempt;
+		}
+	}
 
-	if (!AM_VERIFY(resultSizeShift != 255, "pgRscPacker::Pack() -> Resource cannot be packed because largest chunk size exceeds 100MB limit."))
+	if (!AM_VERIFY(bestAttempt != nullptr, "pgRscPacker::Pack() -> Resource cannot be packed, blocks don't fit in %u chunks.",
+		m_ReservedChunks < PG_MAX_CHUNKS ? PG_MAX_CHUNKS - m_ReservedChunks : 0))
 		return false;
 
-	outPack.SizeShift = resultSizeShift;
-
+	StoreAttempt(*bestAttempt);
+	outPack.SizeShift = bestAttempt->SizeShift;
 	CalculateChunkCountInBuckets(outPack);
+	ComputePackInfo(outPack, viableSizeShiftCount);
 
-	AM_DEBUGF("pgRscPacker::Pack() -> Packed with size shift: %u (%x)",
-		outPack.SizeShift, PG_MIN_CHUNK_SIZE << outPack.SizeShift);
-
-	PrintPackedInfo(outPack);
+	AM_DEBUGF("pgRscPacker::Pack() -> Packed %u blocks in %u chunks with size shift %u (%#llx) out of %u viable; Used: %#x, Allocated: %#x, Wasted: %.1f%%",
+		m_PackInfo.BlockCount, m_PackInfo.ChunkCount, outPack.SizeShift, GetBucketChunkSize(outPack.SizeShift, 0), viableSizeShiftCount,
+		m_PackInfo.UsedSize, m_PackInfo.AllocatedSize, m_PackInfo.GetWasteRatio() * 100.0);
 	return true;
 }
@@ -25,6 +25,41 @@ namespace rage
 		bool IsEmpty; // Whether there's any packed block
 	};
 
+	/**
+	 * \brief Memory use of chunks in a single size bucket.
+	 */
+	struct pgRscPackBucketInfo
+	{
+		u32 ChunkSize;			// Zero if bucket can't be used with packed size shift
+		u8	ChunkCount;
+		u8	MaxChunkCount;
+		u32 BlockCount;
+		u32 UsedSize;			// Sum of block sizes
+		u32 AllocatedSize;		// Sum of chunk sizes
+		u32 LargestFreeSize;	// Largest unused space in a single chunk
+
+		u32 GetWastedSize() const { return AllocatedSize - UsedSize; }
+	};
+
+	/**
+	 * \brief Summary of packed chunks, memory that is allocated for chunks but not used by blocks is wasted (internal fragmentation).
+	 */
+	struct pgRscPackInfo
+	{
+		u8	SizeShift;
+		u8	ViableSizeShiftCount;	// Number of size shifts blocks could be packed with, the one with least allocated size is picked
+		u32 BlockCount;
+		u32 ChunkCount;
+		u32 UsedSize;
+		u32 AllocatedSize;
+
+		pgRscPackBucketInfo Buckets[PG_MAX_BUCKETS];
+
+		u32 GetWastedSize() const { return AllocatedSize - UsedSize; }
+		// From 0 to 1, part of allocated memory that is not used by blocks
+		double GetWasteRatio() const { return AllocatedSize == 0 ? 0.0 : static_cast<double>(GetWastedSize()) / AllocatedSize; }
+	};
+
 	/**
 	 * \brief Packs memory blocks from snapshot allocator into chunks.
 	 */
@@ -44,42 +79,23 @@ namespace rage
 			u16 Index;
 		};
 
-		static constexpr u8 sm_BucketAndSizeShift[] =
+		// Chunk opened while packing with some size shift
+		struct PackChunk
 		{
-			// Index is the most significant bit starting from 0x2000, see ::GetInitialBucketAndSizeShift
-			// Bucket is stored in 4 high bits and shift is in the 4 low bits
-			// Size shift begins with 4 (DAT_MIN_SIZE_SHIFT), dev who did this was clearly drunk.
-
-			4 << 4 | 4,		// 0x2000
-			3 << 4 | 4,		// 0x4000
-			2 << 4 | 4,		// 0x8000
-			1 << 4 | 4,		// 0x10000
-			0 << 4 | 4,		// 0x20000
-			0 << 4 | 5,		// 0x40000
-			0 << 4 | 6,		// 0x80000
-			0 << 4 | 7,		// 0x100000
-			0 << 4 | 8,		// 0x200000
-			0 << 4 | 9,		// 0x400000
-			0 << 4 | 10,	// 0x800000
-			0 << 4 | 11,	// 0x1000000
-			0 << 4 | 12,	// 0x2000000
-			0 << 4 | 13,	// 0x4000000
-
-			// Shifts below exceed maximum allowed chunk size of 100MB
-
-			0 << 4 | 14,	// 0x8000000
-			0 << 4 | 15,	// 0x10000000
-			0 << 4 | 16,	// 0x20000000
-			0 << 4 | 17,	// 0x40000000
-			0 << 4 | 18,	// 0x80000000
-			0 << 4 | 19,	// 0x100000000 
+			u8	Bucket;
+			u8	IndexInBucket;
+			u32 FreeSize;
 		};
-		static constexpr u32 BUCKET_SIZE = 0xF;
-		static constexpr u32 BUCKET_SHIFT = 4;
-		static constexpr u32 SIZE_SHIFT_MASK = 0xF;
 
-		// Gets optimal starting bucket / shift to start packing with
-		static void GetInitialBucketAndSizeShift(u32 largestBlock, u8& bucket, u8& shift);
+		// Result of packing with single size shift, before it is stored in buckets
+		struct PackAttempt
+		{
+			u8			SizeShift;
+			u32			AllocatedSize;
+			u32			ChunkCount;
+			PackChunk	Chunks[PG_MAX_CHUNKS];
+			atArray<u8>	BlockChunks; // Index in Chunks for every block in m_SortedBlocks
+		};
 
 		// Since we have max limit of 128 chunks for both virtual and physical segments,
 		// we have to take into account number of chunks packed by previous packer (well it's always the virtual one)
@@ -87,8 +103,11 @@ namespace rage
 
 		const pgSnapshotAllocator* m_Allocator;
 
+		// With virtual chunks we have one more rule - main chunk always has to be the first one
+		bool					m_PinFirstBlock = false;
 		u32						m_LargestBlock;
 		atArray<SortedBlock>	m_SortedBlocks;
+		atArray<u32>			m_RemainingSizes; // Size of sorted blocks starting from index to the end, to not re-sum them every time
 		atArray<atArray<u16>>	m_Buckets[PG_MAX_BUCKETS] = // 1, 3, 15, 63, 127, 1, 1, 1, 1
 		{
 			// (one or more) Bucket -> (one or more) Chunks -> (one or more) Blocks
@@ -108,24 +127,25 @@ namespace rage
 		};
 		bool m_BucketsDirty = false; // To clear all indices before re-packing
 
+		pgRscPackInfo m_PackInfo = {};
+
 		void ResetBuckets();
 		void CopyAndSortBlocks(const pgSnapshotAllocator& allocator);
-		void PrintPackedInfo(const datPackedChunks& chunks) const;
-
-		u32	GetTotalBlockSize(u8 bucket, u16 startIndex) const;
-
-		// Gets number of total currently packed chunks.
-		u32 GetTotalChunkCount() const;
 
 		// Updates datPackedChunks::BucketCounts (chunk count per bucket) and datPackedChunks::ChunkCount (total chunk count)
 		void CalculateChunkCountInBuckets(datPackedChunks& pack) const;
+		void ComputePackInfo(const datPackedChunks& pack, u8 viableSizeShiftCount);
 
-		// Tries to pack blocks with given min chunk size, if not successful, retries with larger min chunk size.
-		// Returns packed size shift, or 255 if wasn't able to pack.
-		u8 TryPack(u8 startBucket, u8 sizeShift);
+		// Packs blocks with given size shift (best fit decreasing), returns false if blocks can't fit in chunk limits.
+		bool TryPack(u8 sizeShift, PackAttempt& attempt) const;
+		// Moves block indices from packing attempt to buckets
+		void StoreAttempt(const PackAttempt& attempt);
 	public:
 		pgRscPacker(const pgSnapshotAllocator& allocator, u32 reservedChunks);
 
 		bool Pack(datPackedChunks& outPack);
+
+		// Valid after successful ::Pack
+		const pgRscPackInfo& GetPackInfo() const { return m_PackInfo; }
 	};
 }
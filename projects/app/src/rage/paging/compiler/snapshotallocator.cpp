@@ -3,6 +3,8 @@
 #include "helpers/ranges.h"
 #include "rage/paging/paging.h"
 
+#include <algorithm>
+
 #ifdef ENABLE_SNAPSHOT_OVERRUN_DETECTION
 #include <breakpoint.h>
 #endif
@@ -27,10 +29,12 @@ void rage::pgSnapshotAllocator::Node::AssertGuard() const
 	AM_ASSERT(VerifyGuard(), "SnapshotAllocator::Node::AssertGuard() -> Guard was trashed!");
 }
 
-rage::pgSnapshotAllocator::Node::Node(u32 size)
+rage::pgSnapshotAllocator::Node::Node(u32 size, u32 index)
 {
 	Guard = CreateGuard();
 	Size = size;
+	Index = index;
+	Padding = 0;
 
 #ifdef ENABLE_SNAPSHOT_OVERRUN_DETECTION
 	// Protect from array overrun
@@ -45,22 +49,6 @@ rage::pgSnapshotAllocator::Node::~Node()
 #endif
 }
 
-void rage::pgSnapshotAllocator::Node::FixupRefs(u64 newAddress) const
-{
-	AM_DEBUGF("SnapshotAllocator::Node::FixupRefs() -> %u refs from: %#llx to: %#llx",
-		Refs.GetSize(), (u64)GetBlock(), newAddress);
-
-	for (void** pRef : Refs)
-	{
-		*pRef = reinterpret_cast<void*>(newAddress);
-	}
-
-	for (OffsetRef& offsetRef : OffsetRefs)
-	{
-		*offsetRef.Ref = reinterpret_cast<void*>(newAddress + offsetRef.Offset);
-	}
-}
-
 char* rage::pgSnapshotAllocator::Node::GetBlock() const
 {
 	return (char*)this + sizeof(Node); // NOLINT(clang-diagnostic-cast-qual)
@@ -84,36 +72,22 @@ rage::pgSnapshotAllocator::Node* rage::pgSnapshotAllocator::GetNodeFromBlock(pVo
 
 rage::pgSnapshotAllocator::Node* rage::pgSnapshotAllocator::FindBlockThatContainsPointer(pVoid ptr) const
 {
-	Node* node = GetRootNode();
-	while (node)
-	{
-		if (IS_WITHIN(ptr, node->GetBlock(), node->Size))
-			return node;
-		node = node->GetNext();
-	}
+	// Find the last node that starts before given pointer
+	Node* const* it = std::upper_bound(m_Nodes.begin(), m_Nodes.end(), ptr,
+		[](pVoid value, const Node* node) { return (u64)value < (u64)node->GetBlock(); });
+	if (it == m_Nodes.begin())
+		return nullptr;
+
+	Node* node = *(it - 1);
+	if (IS_WITHIN(ptr, node->GetBlock(), node->Size))
+		return node;
 	return nullptr;
 }
 
 rage::pgSnapshotAllocator::Node* rage::pgSnapshotAllocator::GetNodeFromBlockIndex(u32 index) const
 {
-	u32 i = 0;
-	Node* node = GetRootNode();
-	while (node)
-	{
-		if (i++ == index)
-			return node;
-		node = node->GetNext();
-	}
-	AM_ASSERT(false, "SnapshotAllocator::GetNodeFromBlockIndex() -> Block index %i is not valid.", index);
-	return nullptr; // Assert won't return
-}
-
-rage::pgSnapshotAllocator::Node* rage::pgSnapshotAllocator::GetRootNode() const
-{
-	Node* node = (Node*)m_Heap;
-	if (node->VerifyGuard())
-		return node;
-	return nullptr;
+	AM_ASSERT(index < m_Nodes.GetSize(), "SnapshotAllocator::GetNodeFromBlockIndex() -> Block index %i is not valid.", index);
+	return m_Nodes[static_cast<u16>(index)];
 }
 
 void rage::pgSnapshotAllocator::SanityCheck() const
@@ -135,7 +109,7 @@ void rage::pgSnapshotAllocator::SanityCheck() const
 #endif
 }
 
-rage::pgSnapshotAllocator::pgSnapshotAllocator(u32 size, bool isVirtual)
+rage::pgSnapshotAllocator::pgSnapshotAllocator(u32 size, bool isVirtual) : m_Nodes(0), m_Refs(0)
 {
 	m_HeapSize = size;
 	m_Heap = GetMultiAllocator()->Allocate(size);
@@ -148,13 +122,8 @@ rage::pgSnapshotAllocator::pgSnapshotAllocator(u32 size, bool isVirtual)
 rage::pgSnapshotAllocator::~pgSnapshotAllocator()
 {
 	// We have to destruct nodes manually because they were constructed via new placement
-	Node* node = GetRootNode();
-	while (node)
-	{
-		Node* toDestruct = node;
-		node = node->GetNext();
-		toDestruct->~Node();
-	}
+	for (Node* node : m_Nodes)
+		node->~Node();
 
 	GetMultiAllocator()->Free(m_Heap);
 	m_Heap = nullptr;
@@ -170,7 +139,8 @@ pVoid rage::pgSnapshotAllocator::Allocate(u32 size)
 	size = ALIGN_16(size);
 
 	pVoid block = (pVoid)((u64)m_Heap + m_Offset);
-	Node* header = new (block) Node(size);
+	Node* header = new (block) Node(size, m_NodeCount);
+	m_Nodes.Add(header);
 
 	m_Offset += size + sizeof(Node);
 	m_NodeCount++;
@@ -182,17 +152,24 @@ pVoid rage::pgSnapshotAllocator::Allocate(u32 size)
 
 void rage::pgSnapshotAllocator::GetBlockSizes(atArray<u32>& outSizes) const
 {
-	Node* node = GetRootNode();
-	while (node)
-	{
+	for (const Node* node : m_Nodes)
 		outSizes.Add(node->Size);
-		node = node->GetNext();
-	}
 }
 
-void rage::pgSnapshotAllocator::FixupBlockReferences(u16 blockIndex, u64 newAddress) const
+void rage::pgSnapshotAllocator::FixupReferences(const atArray<u64>& blockAddresses)
 {
-	GetNodeFromBlockIndex(blockIndex)->FixupRefs(newAddress);
+	AM_ASSERT(blockAddresses.GetSize() == m_NodeCount,
+		"SnapshotAllocator::FixupReferences() -> Got %u addresses for %u blocks.", blockAddresses.GetSize(), m_NodeCount);
+
+	// Slots are patched in memory order, refs were added in snapshot order which jumps between blocks
+	std::ranges::sort(m_Refs, [](const Ref& left, const Ref& right) { return left.Slot < right.Slot; });
+
+	for (const Ref& ref : m_Refs)
+	{
+		*ref.Slot = reinterpret_cast<void*>(blockAddresses[static_cast<u16>(ref.Block)] + ref.Offset);
+	}
+
+	AM_DEBUGF("SnapshotAllocator::FixupReferences() -> Fixed up %u refs on %u blocks", m_Refs.GetSize(), m_NodeCount);
 }
 
 u64 rage::pgSnapshotAllocator::GetBaseAddress() const
@@ -27,44 +27,46 @@ namespace rage
 	{
 		struct Node
 		{
-			// Currently its used only for grmShaderGroup container block, it uses singe allocation
-			// to store atArray + grmShader's and pointers to them
-			// So generally it allows to have reference on address within the snapshot block
-			struct OffsetRef
-			{
-				void** Ref;
-				u32 Offset;
-			};
-
-			u32					Guard;
-			u32					Size;
-			atArray<void**>		Refs;
-			atArray<OffsetRef>	OffsetRefs;
-			u32					Padding; // For multiple of 16 size
+			u32	Guard;
+			u32	Size;
+			u32 Index;
+			u32	Padding; // For multiple of 16 size
 
-			Node(u32 size);
+			Node(u32 size, u32 index);
 			~Node();
 
 			u32	CreateGuard() const;
 			bool VerifyGuard() const;
 			void AssertGuard() const;
 
-			void FixupRefs(u64 newAddress) const;
-
 			char* GetBlock() const;
 			Node* GetNext() const;
 		};
+		static_assert(sizeof(Node) % 16 == 0, "Node size must keep blocks aligned");
+
+		// Pointer to snapshot block, slot is patched during fixup
+		struct Ref
+		{
+			void**	Slot;
+			u32		Block;
+			// Non-zero for reference on address within the block, currently its used only for grmShaderGroup container block,
+			// it uses singe allocation to store atArray + grmShader's and pointers to them
+			u32		Offset;
+		};
 
 		bool m_IsVirtual;
 		pVoid m_Heap;
 		u32	m_Offset = 0;
 		u32 m_HeapSize = 0;
 		u16 m_NodeCount = 0;
+		// Nodes in allocation order, so they're sorted by address too
+		atArray<Node*> m_Nodes;
+		// References on blocks of this allocator from all snapshot blocks, appended as they're added
+		atArray<Ref, u32> m_Refs;
 
 		Node* GetNodeFromBlock(pVoid block) const;
 		Node* FindBlockThatContainsPointer(pVoid ptr) const; // Used for offset ref
 		Node* GetNodeFromBlockIndex(u32 index) const;
-		Node* GetRootNode() const;
 
 		void SanityCheck() const;
 	public:
@@ -77,11 +79,10 @@ namespace rage
 		 * \brief After memory blocks are packed, we have to 'fixup' every reference on them.
 		 * For example - m_Items field in pgArray will be set to new address (file offset).
 		 *
-		 * \param blockIndex	Index of memory block (relative to ::GetBlockSizes array indices)
-		 * \param newAddress	New address that will be set to every reference on given memory block.
+		 * \param blockAddresses	New address of every memory block (relative to ::GetBlockSizes array indices).
 		 * \remarks See ::AddRef.
 		 */
-		void FixupBlockReferences(u16 blockIndex, u64 newAddress) const;
+		void FixupReferences(const atArray<u64>& blockAddresses);
 
 		/**
 		 * \brief Gets base address for file offset (0x5... for virtual and 0x6... for physical allocator's)
@@ -119,7 +120,7 @@ namespace rage
 		/**
 		 * \brief Adds reference to given block.
 		 * \param block	Structure field.
-		 * \remarks See ::FixupBlockReferences for more info.
+		 * \remarks See ::FixupReferences for more info.
 		 */
 		template<typename T>
 		void AddRef(T*& block)
@@ -131,17 +132,17 @@ namespace rage
 			Node* node = GetNodeFromBlock((pVoid)block);
 			if (node)
 			{
-				node->Refs.Add(ref);
+				m_Refs.Add(Ref(ref, node->Index, 0));
 				AM_DEBUGF("SnapshotAllocator::AddRef<%s>() -> %#llx", typeid(T).name(), (u64)block);
 				return;
 			}
 
-			// Check for a possible 'Offset Ref' (see description above)
+			// Check for a possible 'Offset Ref' (see Ref::Offset)
 			node = FindBlockThatContainsPointer((pVoid)block);
 			if (node)
 			{
 				u32 offset = DISTANCE(node->GetBlock(), block);
-				node->OffsetRefs.Add(Node::OffsetRef(ref, offset));
+				m_Refs.Add(Ref(ref, node->Index, offset));
 				AM_DEBUGF("SnapshotAllocator::AddRef<%s>() -> %#llx with offset %u", typeid(T).name(), (u64)block, offset);
 				return;
 			}
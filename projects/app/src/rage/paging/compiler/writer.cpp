@@ -8,7 +8,9 @@
 #include "rage/zlib/stream.h"
 
 #include "snapshotallocator.h"
+#include "am/file/asyncwriter.h"
 #include "am/file/fileutils.h"
+#include "am/system/worker.h"
 
 rage::datResourceHeader rage::datCompileData::GetHeader() const
 {
@@ -49,21 +51,10 @@ bool rage::pgRscWriter::WriteHeader() const
 	return AM_VERIFY(dwBytesWritten == sizeof datResourceHeader, "pgRscWriter::WriteHeader() -> Failed to write file!");
 }
 
-bool rage::pgRscWriter::WriteData(const datPackedChunks& packedPage, const pgSnapshotAllocator* pAllocator)
+void rage::pgRscWriter::GatherPageRanges(const datPackedChunks& packedPage, const pgSnapshotAllocator* pAllocator, pgRscPageRanges& outRanges)
 {
-	if (packedPage.IsEmpty)
-		return true;
-
 	u32 chunkSize = PG_MIN_CHUNK_SIZE << packedPage.SizeShift;
-
-	// Allocate buffer that is large enough to compress all chunks in single pass (it is much faster)
-	u32 bufferSize = ComputeUsedSize(packedPage);
-	char* buffer = new char[bufferSize];
-	memset(buffer, 0, bufferSize);
-
-	AM_DEBUGF("pgRscWriter::WriteData() -> Using %u as buffer size", bufferSize);
-
-	u32 bufferOffset = 0;
+	u32 pageOffset = 0;
 	for (u8 i = 0; i < PG_MAX_BUCKETS; i++)
 	{
 		// Each bucket has different amount of chunks (from 1 to 127),
@@ -74,52 +65,161 @@ bool rage::pgRscWriter::WriteData(const datPackedChunks& packedPage, const pgSna
 			if (!chunk.Any())
 				continue;
 
-			// Copy every block data to chunk buffer
 			u32 chunkOffset = 0;
 			for (u16 index : chunk)
 			{
-				pVoid block = pAllocator->GetBlock(index);
 				u32 blockSize = pAllocator->GetBlockSize(index);
-
-				m_RawSize += blockSize;
-
-				memcpy(buffer + bufferOffset + chunkOffset, block, blockSize);
+				outRanges.Add({ static_cast<const char*>(pAllocator->GetBlock(index)), pageOffset + chunkOffset, blockSize });
 				chunkOffset += blockSize;
+				m_RawSize += blockSize;
 			}
 
-			bufferOffset += chunkSize;
+			// Rest of the chunk is filled with zeros
+			if (chunkOffset < chunkSize)
+				outRanges.Add({ nullptr, pageOffset + chunkOffset, chunkSize - chunkOffset });
+
+			pageOffset += chunkSize;
 			m_AllocSize += chunkSize;
 		}
 		chunkSize /= 2;
 	}
+}
+
+bool rage::pgRscWriter::WriteData(const datPackedChunks& packedPage, const pgSnapshotAllocator* pAllocator)
+{
+	if (packedPage.IsEmpty)
+		return true;
+
+	// Compressor reads blocks straight from the allocator, there's no page sized staging buffer
+	u32 pageSize = ComputeUsedSize(packedPage);
+	pgRscPageRanges ranges;
+	GatherPageRanges(packedPage, pAllocator, ranges);
 
-	bool success = CompressAndWrite(buffer, bufferSize);
-	delete[] buffer;
-	return success;
+	AM_DEBUGF("pgRscWriter::WriteData() -> Page size is %u, %u ranges", pageSize, ranges.GetSize());
+
+	return CompressAndWrite(ranges, pageSize);
 }
 
-bool rage::pgRscWriter::CompressAndWrite(pVoid data, u32 dataSize)
+namespace
 {
-	DWORD dwBytesWritten;
+	// Source for zero padding, fed to compressor in pieces
+	constexpr u32 ZERO_PADDING_SIZE = 0x10000;
+	constexpr char s_ZeroPadding[ZERO_PADDING_SIZE] = {};
 
-	bool done = false;
-	while (!done)
+	// Invokes fn(data, size) for every piece of page data in [offset, offset + size), padding is given as zero buffer
+	template<typename TFn>
+	void ForEachPageRangeIn(const rage::pgRscPageRanges& ranges, u32 offset, u32 size, TFn fn)
 	{
-		pVoid compressedBuffer;
-		u32	compressedSize;
+		// Ranges are sorted by offset, find the first one that ends after given offset
+		const rage::pgRscPageRange* range = std::upper_bound(ranges.begin(), ranges.end(), offset,
+			[](u32 value, const rage::pgRscPageRange& r) { return value < r.Offset + r.Size; });
 
-		done = m_Compressor.Compress(data, dataSize, compressedBuffer, compressedSize);
-		m_FileSize += compressedSize;
-		AM_DEBUGF("pgRscWriter::CompressAndWrite() -> Compressed %u to %u", dataSize, compressedSize);
+		u32 end = offset + size;
+		for (; range != ranges.end() && range->Offset < end; ++range)
+		{
+			u32 from = MAX(offset, range->Offset);
+			u32 to = MIN(end, range->Offset + range->Size);
+			if (range->Data)
+			{
+				fn(range->Data + (from - range->Offset), to - from);
+				continue;
+			}
+
+			for (u32 padding = from; padding < to; padding += ZERO_PADDING_SIZE)
+				fn(s_ZeroPadding, MIN(ZERO_PADDING_SIZE, to - padding));
+		}
+	}
+}
 
-		WriteFile(m_File, compressedBuffer, compressedSize, &dwBytesWritten, NULL);
-		if (!AM_VERIFY(dwBytesWritten == compressedSize, 
-			"pgRscWriter::CompressAndWrite() -> Tried to write %u bytes, but only %u been written!",
-			compressedSize, dwBytesWritten))
+bool rage::pgRscWriter::CompressAndWrite(const pgRscPageRanges& ranges, u32 dataSize)
+{
+	// Segments are compressed in parallel (like pigz does), every segment is primed with the tail of data before it as
+	// dictionary, so compression ratio stays close to single stream. Segments end with sync flush and have no final
+	// block, concatenated they form single raw deflate stream, same as one compressor would produce
+	u32 segmentCount = (dataSize + COMPRESS_SEGMENT_SIZE - 1) / COMPRESS_SEGMENT_SIZE;
+	u32 segmentBound = zLibCompressor::ComputeSegmentBound(COMPRESS_SEGMENT_SIZE);
+
+	// Compressed segments go to a ring of slots, slot is reused for the next segment as soon as it's written, so disk
+	// write of one segment overlaps compression of the following ones and memory use doesn't depend on resource size
+	u32 slotCount = MIN(segmentCount, COMPRESS_SLOT_COUNT);
+	amUPtr<char[]> compressedBuffer = std::make_unique<char[]>(static_cast<size_t>(segmentBound) * slotCount);
+	auto getSlot = [&](u32 segment) { return compressedBuffer.get() + static_cast<size_t>(segmentBound) * (segment % slotCount); };
+
+	rageam::List<u32> compressedSizes;
+	compressedSizes.Resize(segmentCount);
+
+	auto compressSegment = [&](u32 i)
+		{
+			return rageam::BackgroundWorker::Run([&, i]
+				{
+					u32 offset = i * COMPRESS_SEGMENT_SIZE;
+					u32 size = MIN(COMPRESS_SEGMENT_SIZE, dataSize - offset);
+
+					// Dictionary may span multiple blocks, it's the only data that has to be gathered
+					u32  dictionarySize = MIN(offset, ZLIB_DICTIONARY_SIZE);
+					char dictionary[ZLIB_DICTIONARY_SIZE];
+					u32  dictionaryOffset = 0;
+					ForEachPageRangeIn(ranges, offset - dictionarySize, dictionarySize, [&](const char* piece, u32 pieceSize)
+						{
+							memcpy(dictionary + dictionaryOffset, piece, pieceSize);
+							dictionaryOffset += pieceSize;
+						});
+
+					zLibCompressor compressor(getSlot(i), segmentBound);
+					compressor.BeginSegment(dictionary, dictionarySize);
+					ForEachPageRangeIn(ranges, offset, size, [&](const char* piece, u32 pieceSize)
+						{
+							compressor.AppendSegment(piece, pieceSize);
+						});
+					compressedSizes[i] = compressor.EndSegment();
+					return true;
+				});
+		};
+
+	// One task per slot, task of segment i is at i % slotCount
+	rageam::Tasks segmentTasks;
+	for (u32 i = 0; i < slotCount; i++)
+		segmentTasks.Emplace(compressSegment(i));
+
+	bool written = true;
+	{
+		rageam::file::AsyncWriter writer(m_File);
+		rageam::file::AsyncWriter::Ticket prevTicket = 0;
+		for (u32 i = 0; i < segmentCount; i++)
 		{
-			return false;
+			segmentTasks[i % slotCount]->Wait();
+
+			u32 compressedSize = compressedSizes[i];
+			m_FileSize += compressedSize;
+			rageam::file::AsyncWriter::Ticket ticket = writer.Write(getSlot(i), compressedSize);
+
+			// Slot of the previous segment is free once it's on disk, it goes to the first segment that wasn't scheduled yet
+			if (i > 0)
+			{
+				if (!writer.WaitFor(prevTicket))
+				{
+					written = false;
+					break;
+				}
+
+				u32 nextSegment = i - 1 + slotCount;
+				if (nextSegment < segmentCount)
+					segmentTasks[nextSegment % slotCount] = compressSegment(nextSegment);
+			}
+			prevTicket = ticket;
 		}
+
+		if (written && !writer.Flush())
+			written = false;
 	}
+
+	// Tasks reference buffers on this stack frame, they must be done even if write failed
+	rageam::BackgroundWorker::WaitFor(segmentTasks);
+
+	if (!AM_VERIFY(written, "pgRscWriter::CompressAndWrite() -> Failed to write compressed data!"))
+		return false;
+
+	AM_DEBUGF("pgRscWriter::CompressAndWrite() -> Compressed %u in %u segments", dataSize, segmentCount);
 	return true;
 }
 
@@ -10,6 +10,7 @@
 #include "packer.h"
 #include "common/types.h"
 #include "am/system/ptr.h"
+#include "am/types.h"
 #include "rage/paging/resourceheader.h"
 #include "rage/zlib/stream.h"
 
@@ -30,6 +31,17 @@ namespace rage
 		datResourceHeader GetHeader() const;
 	};
 
+	/**
+	 * \brief Continuous range of page data as it is laid out in resource file.
+	 */
+	struct pgRscPageRange
+	{
+		const char* Data;	// NULL for zero padding after the last block of chunk
+		u32			Offset;	// From the beginning of the page
+		u32			Size;
+	};
+	using pgRscPageRanges = rageam::List<pgRscPageRange>;
+
 	/**
 	 * \brief Writes and compresses resource from compiler streams.
 	 */
@@ -44,17 +56,22 @@ namespace rage
 		// Size of compressed resource file on disk.
 		u32 m_FileSize;
 
-		HANDLE m_File;
+		// Data is split in segments of this size that are compressed in parallel, see CompressAndWrite
+		static constexpr u32 COMPRESS_SEGMENT_SIZE = 1024 * 1024;
+		// Number of compressed segment buffers, segments are compressed ahead while previous ones are written to disk
+		static constexpr u32 COMPRESS_SLOT_COUNT = 16;
 
-		zLibCompressor m_Compressor = { 30 * 1024u * 1024u }; // 30MB~ buffer
+		HANDLE m_File;
 
 		const datCompileData* m_WriteData;
 		const wchar_t* m_Path;
 
 		u32 ComputeUsedSize(const datPackedChunks& packedPage) const;
+		// Lists blocks of every used chunk and padding after them, blocks are referenced directly in the allocator
+		void GatherPageRanges(const datPackedChunks& packedPage, const pgSnapshotAllocator* pAllocator, pgRscPageRanges& outRanges);
 		bool WriteHeader() const;
 		bool WriteData(const datPackedChunks& packedPage, const pgSnapshotAllocator* pAllocator);
-		bool CompressAndWrite(pVoid data, u32 dataSize);
+		bool CompressAndWrite(const pgRscPageRanges& ranges, u32 dataSize);
 
 		bool OpenResource();
 		void CloseResource() const;
@@ -17,6 +17,9 @@ typedef Bytef* zBuffer_t;
 #define Z_DEFLATE_INIT2 deflateInit2
 #define Z_DEFLATE_END deflateEnd
 #define Z_DEFLATE deflate
+#define Z_DEFLATE_RESET deflateReset
+#define Z_DEFLATE_BOUND deflateBound
+#define Z_DEFLATE_SET_DICTIONARY deflateSetDictionary
 #define Z_INFLATE_INIT2 inflateInit2
 #define Z_INFLATE_END inflateEnd
 #define Z_INFLATE inflate
@@ -27,6 +30,9 @@ typedef Bytef* zBuffer_t;
 #define Z_DEFLATE_INIT2 zng_deflateInit2
 #define Z_DEFLATE_END zng_deflateEnd
 #define Z_DEFLATE zng_deflate
+#define Z_DEFLATE_RESET zng_deflateReset
+#define Z_DEFLATE_BOUND zng_deflateBound
+#define Z_DEFLATE_SET_DICTIONARY zng_deflateSetDictionary
 #define Z_INFLATE_INIT2 zng_inflateInit2
 #define Z_INFLATE_END zng_inflateEnd
 #define Z_INFLATE zng_inflate
@@ -37,6 +43,10 @@ typedef Bytef* zBuffer_t;
 #define Z_DEFLATE_INIT2 mz_deflateInit2
 #define Z_DEFLATE_END mz_deflateEnd
 #define Z_DEFLATE mz_deflate
+#define Z_DEFLATE_RESET mz_deflateReset
+#define Z_DEFLATE_BOUND mz_deflateBound
+// Not supported by miniz, segments are compressed without history of previous ones
+#define Z_DEFLATE_SET_DICTIONARY(stream, dictionary, size) Z_OK
 #define Z_INFLATE_INIT2 mz_inflateInit2
 #define Z_INFLATE_END mz_inflateEnd
 #define Z_INFLATE mz_inflate
@@ -47,6 +57,7 @@ typedef Bytef* zBuffer_t;
 static constexpr int ZLIB_WINDOW_BITS = -15;
 static constexpr int ZLIB_COMPRESSION_LEVEL = 5;
 static constexpr int ZLIB_MEMORY_LEVEL = 8;
+static constexpr u32 ZLIB_DICTIONARY_SIZE = 32 * 1024; // Deflate can't look further back than this
 
 class zLibCompressor
 {
@@ -131,6 +142,75 @@ public:
 		return done;
 	}
 
+	// Size of compressed buffer that is enough for any data of given size to be compressed with single CompressSegment call
+	static u32 ComputeSegmentBound(u32 dataSize)
+	{
+		// Bound without stream is the most conservative one, it does not include sync flush marker (empty stored block)
+		return static_cast<u32>(Z_DEFLATE_BOUND(nullptr, dataSize)) + 16;
+	}
+
+	/**
+	 * \brief Starts compressing segment of larger raw deflate stream independently from other segments,
+	 * allowing to compress them in parallel on multiple compressors and concatenate the output.
+	 * Segment data is given in any number of AppendSegment calls, output is placed in internal buffer (see constructor),
+	 * which must be at least ComputeSegmentBound of the whole segment data size.
+	 *
+	 * \param dictionary		Data of the stream right before this segment (up to ZLIB_DICTIONARY_SIZE), may be NULL for the first segment.
+	 * \param dictionarySize	Size of dictionary data.
+	 */
+	void BeginSegment(pConstVoid dictionary, u32 dictionarySize)
+	{
+		AM_ASSERT(!m_Started, "zLibCompressor::BeginSegment() -> Streamed compression is in progress.");
+
+		int status = Z_DEFLATE_RESET(&m_Stream);
+		AM_ASSERT(status >= 0, "zLibCompressor::BeginSegment() -> Reset failed with status %i", status);
+
+		if (dictionary && dictionarySize > 0)
+		{
+			status = Z_DEFLATE_SET_DICTIONARY(&m_Stream, static_cast<const Bytef*>(dictionary), dictionarySize);
+			AM_ASSERT(status >= 0, "zLibCompressor::BeginSegment() -> Set dictionary failed with status %i", status);
+		}
+
+		m_Stream.next_out = m_Buffer;
+		m_Stream.avail_out = m_BufferSize;
+	}
+
+	void AppendSegment(pConstVoid data, u32 dataSize)
+	{
+		m_Stream.next_in = static_cast<zBuffer_t>(const_cast<pVoid>(data));
+		m_Stream.avail_in = dataSize;
+
+		int status = Z_DEFLATE(&m_Stream, Z_NO_FLUSH);
+		AM_ASSERT(status >= 0, "zLibCompressor::AppendSegment() -> Failed with status %i", status);
+		AM_ASSERT(m_Stream.avail_in == 0,
+			"zLibCompressor::AppendSegment() -> Output buffer (%u) is too small", m_BufferSize);
+	}
+
+	/**
+	 * \brief Flushes the rest of segment data.
+	 * \return Size of compressed segment in internal buffer.
+	 * \remarks Segment ends with sync flush (on byte boundary) and has no final block, exactly like streamed Compress output.
+	 */
+	u32 EndSegment()
+	{
+		m_Stream.avail_in = 0;
+
+		int status = Z_DEFLATE(&m_Stream, Z_SYNC_FLUSH);
+		AM_ASSERT(status >= 0, "zLibCompressor::EndSegment() -> Failed with status %i", status);
+		// Deflate leaves the rest of sync flush pending if output buffer is full
+		AM_ASSERT(m_Stream.avail_out != 0, "zLibCompressor::EndSegment() -> Output buffer (%u) is too small", m_BufferSize);
+
+		return m_BufferSize - m_Stream.avail_out;
+	}
+
+	// Shortcut for segment with continuous data
+	u32 CompressSegment(pConstVoid dictionary, u32 dictionarySize, pConstVoid data, u32 dataSize)
+	{
+		BeginSegment(dictionary, dictionarySize);
+		AppendSegment(data, dataSize);
+		return EndSegment();
+	}
+
 	void CompressAll(pVoid data, u32 dataSize, void writeFn(pVoid compressedBuffer, u32 compressedSize))
 	{
 		bool done = false;
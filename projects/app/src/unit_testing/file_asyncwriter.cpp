@@ -0,0 +1,73 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "am/file/asyncwriter.h"
+
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rageam::file;
+
+	TEST_CLASS(AsyncWriterTests)
+	{
+	public:
+		TEST_METHOD(VerifyWritesInOrder)
+		{
+			static constexpr u32 BUFFER_COUNT = 64;
+
+			// Sink runs on writer thread where assert can't fail the test, values are checked after flush
+			std::vector<u32> written;
+			std::vector<u32> writtenSizes;
+			u32 buffers[BUFFER_COUNT];
+			{
+				AsyncWriter writer([&](const char* data, u32 size)
+					{
+						writtenSizes.push_back(size);
+						written.push_back(*reinterpret_cast<const u32*>(data));
+						return true;
+					});
+
+				AsyncWriter::Ticket prevTicket = 0;
+				for (u32 i = 0; i < BUFFER_COUNT; i++)
+				{
+					buffers[i] = i;
+					AsyncWriter::Ticket ticket = writer.Write(reinterpret_cast<const char*>(&buffers[i]), sizeof u32);
+					Assert::IsTrue(ticket > prevTicket);
+					prevTicket = ticket;
+				}
+				Assert::IsTrue(writer.Flush());
+				Assert::AreEqual<size_t>(BUFFER_COUNT, written.size());
+			}
+
+			for (u32 i = 0; i < BUFFER_COUNT; i++)
+			{
+				Assert::AreEqual<u32>(sizeof u32, writtenSizes[i]);
+				Assert::AreEqual(i, written[i]);
+			}
+		}
+
+		// Everything after failed write must be dropped, otherwise file would have a gap
+		TEST_METHOD(VerifyFailureDropsQueue)
+		{
+			u32 writeCount = 0;
+			AsyncWriter writer([&](const char*, u32)
+				{
+					return ++writeCount < 3;
+				});
+
+			char data = 0;
+			AsyncWriter::Ticket firstTicket = writer.Write(&data, 1);
+			Assert::IsTrue(writer.WaitFor(firstTicket));
+			for (int i = 0; i < 8; i++)
+				writer.Write(&data, 1);
+			Assert::IsFalse(writer.Flush());
+			Assert::IsTrue(writer.HasFailed());
+			Assert::AreEqual(3u, writeCount);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "am/graphics/image/imagealloc.h"
+#include "helpers/ranges.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rageam::graphics;
+
+	TEST_CLASS(ImageAllocTests)
+	{
+		static constexpr u32 SMALL_SIZE = 1000;
+		static constexpr u32 POOL_SIZE = IMAGE_POOL_MIN_SIZE + 4096;
+		static constexpr u32 POOL_SIZE_SAME_CLASS = IMAGE_POOL_MIN_SIZE + 1024; // 320KB class together with POOL_SIZE
+		static constexpr u32 POOL_SIZE_LARGE = IMAGE_POOL_MIN_SIZE * 3;
+
+		static void Fill(pVoid block, u32 size)
+		{
+			u8* bytes = static_cast<u8*>(block);
+			for (u32 i = 0; i < size; i++)
+				bytes[i] = static_cast<u8>(i * 31 + 7);
+		}
+
+		static void Verify(pVoid block, u32 size)
+		{
+			const u8* bytes = static_cast<const u8*>(block);
+			for (u32 i = 0; i < size; i++)
+				Assert::AreEqual(static_cast<u8>(i * 31 + 7), bytes[i]);
+		}
+
+		// Block must keep contents when moved between heap, pool and scratch, and must be freeable by ImageFree after
+		static void VerifyReAlloc(pVoid block, u32 size, u32 newSize, bool tempRealloc = false)
+		{
+			Fill(block, size);
+			pVoid newBlock = tempRealloc ? ImageReAllocTemp(block, newSize) : ImageReAlloc(block, newSize);
+			Assert::IsNotNull(newBlock);
+			Verify(newBlock, MIN(size, newSize));
+			Fill(newBlock, newSize); // Entire new size must be writable
+			ImageFree(newBlock);
+		}
+
+	public:
+		TEST_METHOD(VerifyReAllocKinds)
+		{
+			ImageAllocStats statsBefore = ImageGetAllocStats();
+
+			VerifyReAlloc(ImageAlloc(SMALL_SIZE), SMALL_SIZE, SMALL_SIZE * 2);		// Heap -> Heap
+			VerifyReAlloc(ImageAlloc(SMALL_SIZE), SMALL_SIZE, POOL_SIZE);			// Heap -> Pool
+			VerifyReAlloc(ImageAlloc(POOL_SIZE), POOL_SIZE, SMALL_SIZE);			// Pool -> Heap
+			VerifyReAlloc(ImageAlloc(POOL_SIZE), POOL_SIZE, POOL_SIZE_LARGE);		// Pool -> Pool
+			VerifyReAlloc(nullptr, 0, SMALL_SIZE);									// Null acts like ImageAlloc
+
+			// Shrinking within the same size class must keep the block
+			pVoid block = ImageAlloc(POOL_SIZE);
+			Assert::IsTrue(block == ImageReAlloc(block, POOL_SIZE_SAME_CLASS));
+			ImageFree(block);
+
+			{
+				ImageScratchScope scope;
+				VerifyReAlloc(ImageAllocTemp(SMALL_SIZE), SMALL_SIZE, POOL_SIZE);			// Scratch -> Pool
+				VerifyReAlloc(ImageAllocTemp(POOL_SIZE), POOL_SIZE, SMALL_SIZE);			// Scratch -> Heap
+				VerifyReAlloc(ImageAllocTemp(SMALL_SIZE), SMALL_SIZE, POOL_SIZE, true);	// Scratch -> Scratch
+
+				// Temp reallocation that fits in the block must keep it
+				block = ImageAllocTemp(SMALL_SIZE);
+				Assert::IsTrue(block == ImageReAllocTemp(block, SMALL_SIZE / 2));
+
+				// Block moved out of scratch arena by ImageReAlloc must outlive the scope
+				block = ImageAllocTemp(SMALL_SIZE);
+				Fill(block, SMALL_SIZE);
+				block = ImageReAlloc(block, SMALL_SIZE * 2);
+			}
+			Verify(block, SMALL_SIZE);
+			ImageFree(block);
+
+			// Heap and pool blocks outside of the scope go through ImageReAllocTemp the same way as ImageReAlloc
+			VerifyReAlloc(ImageAllocTemp(SMALL_SIZE), SMALL_SIZE, POOL_SIZE, true);
+
+			// Everything was freed, pool blocks are only cached
+			Assert::AreEqual(statsBefore.SizeCurrent, ImageGetAllocStats().SizeCurrent);
+		}
+
+		TEST_METHOD(VerifyScratchScopeRewind)
+		{
+			ImageAllocStats statsBefore = ImageGetAllocStats();
+			{
+				ImageScratchScope scope;
+				pVoid first = ImageAllocTemp(SMALL_SIZE);
+				Fill(first, SMALL_SIZE);
+				// Arena is empty outside of the scope, first allocation takes a chunk
+				ImageAllocStats statsFirst = ImageGetAllocStats();
+				Assert::IsTrue(statsFirst.SizeScratch >= statsBefore.SizeScratch + IMAGE_SCRATCH_CHUNK_SIZE);
+
+				pVoid second;
+				{
+					ImageScratchScope innerScope;
+					second = ImageAllocTemp(SMALL_SIZE);
+					Assert::IsTrue(first != second);
+
+					// Freeing scratch block does nothing, memory is not reused until scope ends
+					ImageFree(second);
+					Assert::IsTrue(second != ImageAllocTemp(SMALL_SIZE));
+
+					// Doesn't fit in the chunk, gets chunk of its own size
+					pVoid large = ImageAllocTemp(IMAGE_SCRATCH_CHUNK_SIZE * 2);
+					Fill(large, IMAGE_SCRATCH_CHUNK_SIZE * 2);
+					Assert::IsTrue(ImageGetAllocStats().SizeScratch >= statsFirst.SizeScratch + IMAGE_SCRATCH_CHUNK_SIZE * 2);
+				}
+
+				// Inner scope rewound the arena to where it was opened and released the large chunk
+				Assert::AreEqual(statsFirst.SizeScratch, ImageGetAllocStats().SizeScratch);
+				Assert::IsTrue(second == ImageAllocTemp(SMALL_SIZE));
+				Verify(first, SMALL_SIZE);
+			}
+
+			Assert::AreEqual(statsBefore.SizeScratch, ImageGetAllocStats().SizeScratch);
+			Assert::AreEqual(statsBefore.SizeCurrent, ImageGetAllocStats().SizeCurrent);
+
+			// Chunk was given back to the pool, next scope takes it from cache
+			u64 poolHits = ImageGetAllocStats().PoolHits;
+			{
+				ImageScratchScope scope;
+				ImageAllocTemp(SMALL_SIZE);
+			}
+			Assert::IsTrue(ImageGetAllocStats().PoolHits > poolHits);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "am/graphics/image/image.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rageam::graphics;
+
+	TEST_CLASS(ImageAlphaTests)
+	{
+		static constexpr int WIDTH = 37; // Not multiple of 16 to test scalar remainder
+		static constexpr int HEIGHT = 5;
+
+		// Alpha gradient with most pixels being transparent, typical for downsampled foliage
+		static void FillPixels(ColorU32* pixels)
+		{
+			for (int i = 0; i < WIDTH * HEIGHT; i++)
+			{
+				u8 alpha = i % 3 == 0 ? static_cast<u8>(i * 7 % 256) : 0;
+				pixels[i] = ColorU32(255, 255, 255, alpha);
+			}
+		}
+
+		static float ComputeCoverageDirect(const ColorU32* pixels, int threshold, float alphaScale)
+		{
+			int testPixels = 0;
+			for (int i = 0; i < WIDTH * HEIGHT; i++)
+			{
+				float scaledAlpha = static_cast<float>(pixels[i].A) * alphaScale;
+				if (scaledAlpha > 255.0f) scaledAlpha = 255.0f;
+				if (static_cast<int>(scaledAlpha) > threshold)
+					testPixels++;
+			}
+			return static_cast<float>(testPixels) / static_cast<float>(WIDTH * HEIGHT);
+		}
+
+	public:
+		TEST_METHOD(VerifyHistogram)
+		{
+			ColorU32 pixels[WIDTH * HEIGHT];
+			FillPixels(pixels);
+
+			u32 expected[256] = {};
+			for (ColorU32 pixel : pixels)
+				expected[pixel.A]++;
+
+			u32 histogram[256];
+			ImageComputeAlphaHistogramRGBA(reinterpret_cast<char*>(pixels), WIDTH, HEIGHT, histogram);
+
+			for (int i = 0; i < 256; i++)
+				Assert::AreEqual(expected[i], histogram[i]);
+		}
+
+		TEST_METHOD(VerifyBestScaleMatchesCoverage)
+		{
+			ColorU32 pixels[WIDTH * HEIGHT];
+			FillPixels(pixels);
+
+			u32 histogram[256];
+			ImageComputeAlphaHistogramRGBA(reinterpret_cast<char*>(pixels), WIDTH, HEIGHT, histogram);
+
+			for (int threshold : { 0, 64, 127, 170, 254 })
+			{
+				for (float desiredCoverage : { 0.0f, 0.1f, 0.2f, 0.33f, 1.0f })
+				{
+					float scale = ImageAlphaTestFindBestScaleFromHistogram(histogram, threshold, desiredCoverage);
+					Assert::IsTrue(scale >= 0.0f && scale <= 4.0f);
+
+					// Coverage computed from histogram must match what encoder will actually output
+					float coverage = ImageAlphaTestCoverageFromHistogram(histogram, threshold, scale);
+					Assert::AreEqual(ComputeCoverageDirect(pixels, threshold, scale), coverage);
+
+					// No other scale in allowed range may give closer coverage
+					float error = fabsf(coverage - desiredCoverage);
+					for (float otherScale = 0.0f; otherScale <= 4.0f; otherScale += 1.0f / 64.0f)
+					{
+						float otherError = fabsf(ComputeCoverageDirect(pixels, threshold, otherScale) - desiredCoverage);
+						Assert::IsTrue(error <= otherError);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(VerifyUnscaledIsPreferred)
+		{
+			ColorU32 pixels[WIDTH * HEIGHT];
+			FillPixels(pixels);
+
+			u32 histogram[256];
+			ImageComputeAlphaHistogramRGBA(reinterpret_cast<char*>(pixels), WIDTH, HEIGHT, histogram);
+
+			// Desired coverage is exactly the one we already have, alpha must not be changed
+			float coverage = ImageAlphaTestCoverageFromHistogram(histogram, 170, 1.0f);
+			Assert::AreEqual(1.0f, ImageAlphaTestFindBestScaleFromHistogram(histogram, 170, coverage));
+		}
+	};
+}
+#endif
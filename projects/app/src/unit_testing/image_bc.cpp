@@ -0,0 +1,365 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "am/graphics/image/bc.h"
+
+#include <rgbcx.h>
+#include <bc7decomp.h>
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rageam::graphics;
+
+	TEST_CLASS(ImageBCDecodeTests)
+	{
+		static constexpr int BLOCK_COUNT = 4096;
+		static constexpr int ROW_BLOCKS = 5; // Destination is wider than decoded row to test row pitch
+		static constexpr u32 DST_ROW_PITCH = (ROW_BLOCKS + 1) * IMAGE_BC_BLOCK_ROW_PITCH;
+
+		// Random blocks cover both interpolation modes of BC1 and BC4
+		static void VerifyFormat(ImagePixelFormat format, u32 blockSize, void(*decodeReference)(const u8* block, u8* pixels))
+		{
+			std::mt19937 random(format);
+			for (int i = 0; i < BLOCK_COUNT / ROW_BLOCKS; i++)
+			{
+				u8 blocks[ROW_BLOCKS * 16];
+				for (u8& byte : blocks)
+					byte = static_cast<u8>(random());
+
+				u8 decoded[4][DST_ROW_PITCH];
+				memset(decoded, 0xCD, sizeof decoded);
+				ImageDecodeBCBlockRow(reinterpret_cast<char*>(blocks), ROW_BLOCKS, reinterpret_cast<char*>(decoded), DST_ROW_PITCH, format);
+
+				for (int k = 0; k < ROW_BLOCKS; k++)
+				{
+					u8 expected[IMAGE_BC_BLOCK_SLICE_PITCH] = {};
+					decodeReference(blocks + k * blockSize, expected);
+					for (int y = 0; y < 4; y++)
+					{
+						Assert::AreEqual(0, memcmp(
+							decoded[y] + k * IMAGE_BC_BLOCK_ROW_PITCH, expected + y * IMAGE_BC_BLOCK_ROW_PITCH, IMAGE_BC_BLOCK_ROW_PITCH));
+					}
+				}
+
+				// Padding after the row must stay untouched
+				for (int y = 0; y < 4; y++)
+					Assert::AreEqual(u8(0xCD), decoded[y][ROW_BLOCKS * IMAGE_BC_BLOCK_ROW_PITCH]);
+			}
+		}
+
+		static void SetOpaqueAlpha(u8* pixels)
+		{
+			for (int i = 0; i < 16; i++)
+				pixels[i * 4 + 3] = 255;
+		}
+
+	public:
+		TEST_CLASS_INITIALIZE(Init)
+		{
+			rgbcx::init();
+		}
+
+		TEST_METHOD(VerifyBC1)
+		{
+			VerifyFormat(ImagePixelFormat_BC1, 8, [](const u8* block, u8* pixels) { rgbcx::unpack_bc1(block, pixels); });
+		}
+
+		TEST_METHOD(VerifyBC4)
+		{
+			VerifyFormat(ImagePixelFormat_BC4, 8, [](const u8* block, u8* pixels)
+				{
+					SetOpaqueAlpha(pixels);
+					rgbcx::unpack_bc4(block, pixels);
+				});
+		}
+
+		TEST_METHOD(VerifyBC5)
+		{
+			VerifyFormat(ImagePixelFormat_BC5, 16, [](const u8* block, u8* pixels)
+				{
+					SetOpaqueAlpha(pixels);
+					rgbcx::unpack_bc5(block, pixels);
+				});
+		}
+
+		TEST_METHOD(VerifyBC7)
+		{
+			VerifyFormat(ImagePixelFormat_BC7, 16, [](const u8* block, u8* pixels)
+				{
+					bc7decomp_ref::unpack_bc7(block, reinterpret_cast<bc7decomp::color_rgba*>(pixels));
+				});
+		}
+	};
+
+	TEST_CLASS(ImageBCRdoTests)
+	{
+		static constexpr int BLOCK_COUNT = 1024;
+
+		static u32 ComputeError(const char* blocks, const u8* srcBlocks)
+		{
+			u32 error = 0;
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				u8 decoded[IMAGE_BC_BLOCK_SLICE_PITCH];
+				ImageDecodeBCBlockRow(blocks + i * 8, 1, reinterpret_cast<char*>(decoded), IMAGE_BC_BLOCK_ROW_PITCH, ImagePixelFormat_BC1);
+				for (int k = 0; k < 16; k++)
+				{
+					for (int c = 0; c < 3; c++)
+					{
+						int diff = decoded[k * 4 + c] - srcBlocks[i * IMAGE_BC_BLOCK_SLICE_PITCH + k * 4 + c];
+						error += diff * diff;
+					}
+				}
+			}
+			return error;
+		}
+
+	public:
+		TEST_CLASS_INITIALIZE(Init)
+		{
+			rgbcx::init();
+		}
+
+		// Zero lambda must never trade quality, non-zero lambda must shrink deflated size of noisy gradient
+		TEST_METHOD(VerifyBC1)
+		{
+			std::mt19937 random(0);
+			amUPtr<u8[]> srcBlocks = amUPtr<u8[]>(new u8[BLOCK_COUNT * IMAGE_BC_BLOCK_SLICE_PITCH]);
+			for (int i = 0; i < BLOCK_COUNT * 16; i++)
+			{
+				u8* pixel = srcBlocks.get() + i * 4;
+				pixel[0] = static_cast<u8>(i / 64 + random() % 4);
+				pixel[1] = static_cast<u8>(128 + random() % 4);
+				pixel[2] = static_cast<u8>(255 - i / 64);
+				pixel[3] = 255;
+			}
+
+			char blocks[BLOCK_COUNT * 8];
+			for (int i = 0; i < BLOCK_COUNT; i++)
+				rgbcx::encode_bc1(rgbcx::MAX_LEVEL, blocks + i * 8, srcBlocks.get() + i * IMAGE_BC_BLOCK_SLICE_PITCH, true, false);
+
+			u32 error = ComputeError(blocks, srcBlocks.get());
+			u32 deflatedSize = ImageComputeDeflatedSize(blocks, sizeof blocks);
+
+			char rdoBlocks[BLOCK_COUNT * 8];
+			memcpy(rdoBlocks, blocks, sizeof blocks);
+			ImageRdoBCBlocks(rdoBlocks, reinterpret_cast<char*>(srcBlocks.get()), BLOCK_COUNT, ImagePixelFormat_BC1, 0.0f, 256);
+			Assert::IsTrue(ComputeError(rdoBlocks, srcBlocks.get()) <= error);
+
+			memcpy(rdoBlocks, blocks, sizeof blocks);
+			ImageRdoBCBlocks(rdoBlocks, reinterpret_cast<char*>(srcBlocks.get()), BLOCK_COUNT, ImagePixelFormat_BC1, 2.0f, 256);
+			Assert::IsTrue(ImageComputeDeflatedSize(rdoBlocks, sizeof rdoBlocks) < deflatedSize);
+		}
+
+		// Opaque image mixes 4 color blocks that use selector 3 with 3 color blocks that don't, endpoints of both are
+		// nearly black so copying endpoints of 3 color block would cost almost no color error while selector 3 turns transparent
+		TEST_METHOD(VerifyBC1StaysOpaque)
+		{
+			static constexpr u16 DARK_COLOR = 0x0821;	// R1 G1 B1
+			static constexpr u16 DARKER_COLOR = 0x0841;	// R1 G2 B1
+
+			std::mt19937 random(0);
+			char blocks[BLOCK_COUNT * 8];
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				bool isThreeColor = i % 2 == 0;
+				u16 endpoints[2] = { DARKER_COLOR, DARK_COLOR };
+				if (isThreeColor)
+					std::swap(endpoints[0], endpoints[1]);
+
+				u32 selectors = 0;
+				for (int k = 0; k < 16; k++)
+					selectors |= (isThreeColor ? random() % 3 : random() % 4) << (k * 2);
+
+				memcpy(blocks + i * 8, endpoints, sizeof endpoints);
+				memcpy(blocks + i * 8 + 4, &selectors, sizeof selectors);
+			}
+
+			amUPtr<u8[]> srcBlocks = amUPtr<u8[]>(new u8[BLOCK_COUNT * IMAGE_BC_BLOCK_SLICE_PITCH]);
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				ImageDecodeBCBlockRow(blocks + i * 8, 1,
+					reinterpret_cast<char*>(srcBlocks.get() + i * IMAGE_BC_BLOCK_SLICE_PITCH), IMAGE_BC_BLOCK_ROW_PITCH, ImagePixelFormat_BC1);
+			}
+			for (int i = 0; i < BLOCK_COUNT * 16; i++)
+				Assert::AreEqual<u8>(255, srcBlocks[i * 4 + 3]);
+
+			ImageRdoBCBlocks(blocks, reinterpret_cast<char*>(srcBlocks.get()), BLOCK_COUNT, ImagePixelFormat_BC1, 8.0f, 256);
+
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				u8 decoded[IMAGE_BC_BLOCK_SLICE_PITCH];
+				ImageDecodeBCBlockRow(blocks + i * 8, 1, reinterpret_cast<char*>(decoded), IMAGE_BC_BLOCK_ROW_PITCH, ImagePixelFormat_BC1);
+				for (int k = 0; k < 16; k++)
+					Assert::AreEqual<u8>(255, decoded[k * 4 + 3]);
+			}
+		}
+
+		// Both blocks are in 3 color mode with the same nearly black endpoints, one uses selector 3 (transparent black) and
+		// one doesn't, so swapping selectors between them would cost almost no color error
+		TEST_METHOD(VerifyBC1KeepsPunchThroughAlpha)
+		{
+			static constexpr u16 DARK_COLOR = 0x0821;	// R1 G1 B1
+			static constexpr u16 DARKER_COLOR = 0x0841;	// R1 G2 B1
+
+			std::mt19937 random(0);
+			char blocks[BLOCK_COUNT * 8];
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				bool isCutout = i % 2 == 0;
+				u16 endpoints[2] = { DARK_COLOR, DARKER_COLOR };
+
+				u32 selectors = 0;
+				for (int k = 0; k < 16; k++)
+					selectors |= (isCutout ? random() % 4 : random() % 3) << (k * 2);
+
+				memcpy(blocks + i * 8, endpoints, sizeof endpoints);
+				memcpy(blocks + i * 8 + 4, &selectors, sizeof selectors);
+			}
+
+			amUPtr<u8[]> srcBlocks = amUPtr<u8[]>(new u8[BLOCK_COUNT * IMAGE_BC_BLOCK_SLICE_PITCH]);
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				ImageDecodeBCBlockRow(blocks + i * 8, 1,
+					reinterpret_cast<char*>(srcBlocks.get() + i * IMAGE_BC_BLOCK_SLICE_PITCH), IMAGE_BC_BLOCK_ROW_PITCH, ImagePixelFormat_BC1);
+			}
+
+			ImageRdoBCBlocks(blocks, reinterpret_cast<char*>(srcBlocks.get()), BLOCK_COUNT, ImagePixelFormat_BC1, 8.0f, 256);
+
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				u8 decoded[IMAGE_BC_BLOCK_SLICE_PITCH];
+				ImageDecodeBCBlockRow(blocks + i * 8, 1, reinterpret_cast<char*>(decoded), IMAGE_BC_BLOCK_ROW_PITCH, ImagePixelFormat_BC1);
+				for (int k = 0; k < 16; k++)
+					Assert::AreEqual(srcBlocks[i * IMAGE_BC_BLOCK_SLICE_PITCH + k * 4 + 3], decoded[k * 4 + 3]);
+			}
+		}
+	};
+
+	TEST_CLASS(ImageBCPreEncodeTests)
+	{
+		// Odd counts test SIMD remainder, the last one is wider than encoder block group
+		static constexpr int BLOCK_COUNTS[] = { 1, 3, 13, 65 };
+		static constexpr int CUTOUT_THRESHOLD = 100;
+
+		struct Params
+		{
+			int		Brightness;
+			int		Contrast;
+			bool	Cutout;
+			float	AlphaScale;
+			bool	Swizzle;
+		};
+
+	public:
+		// Fused SIMD path in encoder must match RGBA functions exactly, including rounding of brightness/contrast table
+		TEST_METHOD(VerifyMatchesRGBA)
+		{
+			static constexpr Params PARAMS[] =
+			{
+				{ 0, 40, false, 1.0f, false },
+				{ -30, 0, false, 1.0f, false },
+				{ 25, -60, true, 1.0f, false },
+				{ 100, 127, false, 0.7f, true },
+				{ -255, 200, true, 1.6f, true },
+			};
+
+			std::mt19937 random(0);
+			for (int blockCount : BLOCK_COUNTS)
+			{
+				for (const Params& params : PARAMS)
+				{
+					int width = blockCount * 4;
+					u32 rowPitch = width * 4;
+					std::vector<char> src(rowPitch * 4);
+					for (char& value : src)
+						value = static_cast<char>(random());
+
+					CompressedImageInfo encodeInfo = {};
+					encodeInfo.Brightness = params.Brightness;
+					encodeInfo.Contrast = params.Contrast;
+					encodeInfo.CutoutAlpha = params.Cutout;
+					encodeInfo.CutoutAlphaThreshold = CUTOUT_THRESHOLD;
+					encodeInfo.AlphaTestCoverage = params.AlphaScale != 1.0f;
+					encodeInfo.SwizzleR = params.Swizzle ? ImageSwizzle_B : ImageSwizzle_R;
+					encodeInfo.SwizzleG = params.Swizzle ? ImageSwizzle_A : ImageSwizzle_G;
+					encodeInfo.SwizzleB = params.Swizzle ? ImageSwizzle_R : ImageSwizzle_B;
+					encodeInfo.SwizzleA = params.Swizzle ? ImageSwizzle_G : ImageSwizzle_A;
+
+					std::vector<char> blocks(blockCount * IMAGE_BC_BLOCK_SLICE_PITCH);
+					ImagePreEncodeBlockRow(blocks.data(), src.data(), rowPitch, blockCount, encodeInfo, params.AlphaScale);
+
+					std::vector<char> expected = src;
+					ImageAdjustBrightnessAndContrastRGBA(expected.data(), width, 4, params.Brightness, params.Contrast);
+					if (params.Cutout)
+						ImageCutoutAlphaRGBA(expected.data(), width, 4, CUTOUT_THRESHOLD);
+					if (params.AlphaScale != 1.0f)
+						ImageScaleAlphaRGBA(expected.data(), width, 4, params.AlphaScale);
+					ImageDoSwizzle(expected.data(), width, 4, encodeInfo.SwizzleR, encodeInfo.SwizzleG, encodeInfo.SwizzleB, encodeInfo.SwizzleA);
+
+					for (int k = 0; k < blockCount; k++)
+					{
+						for (int y = 0; y < 4; y++)
+						{
+							Assert::AreEqual(0, memcmp(
+								blocks.data() + k * IMAGE_BC_BLOCK_SLICE_PITCH + y * IMAGE_BC_BLOCK_ROW_PITCH,
+								expected.data() + y * rowPitch + k * IMAGE_BC_BLOCK_ROW_PITCH, IMAGE_BC_BLOCK_ROW_PITCH));
+						}
+					}
+				}
+			}
+		}
+	};
+
+	TEST_CLASS(ImageBCComplexityTests)
+	{
+		static ImageBlockComplexity Estimate(ImagePixelFormat format, u8(*pixel)(int index, int channel))
+		{
+			u8 block[IMAGE_BC_BLOCK_SLICE_PITCH];
+			for (int i = 0; i < 16; i++)
+			{
+				for (int c = 0; c < 4; c++)
+					block[i * 4 + c] = pixel(i, c);
+			}
+			return ImageEstimateBlockComplexity(reinterpret_cast<char*>(block), ImageGetBlockComplexityParams(format, 2.0f));
+		}
+
+	public:
+		TEST_METHOD(VerifyFlat)
+		{
+			Assert::AreEqual<int>(ImageBlockComplexity_Flat, Estimate(ImagePixelFormat_BC7,
+				[](int i, int c) { return static_cast<u8>(c == 0 ? 100 + i % 3 : 50 * c); }));
+			// BC1 does not store alpha
+			Assert::AreEqual<int>(ImageBlockComplexity_Flat, Estimate(ImagePixelFormat_BC1,
+				[](int i, int c) { return static_cast<u8>(c == 3 ? i * 16 : 77); }));
+		}
+
+		// Channels go in opposite directions, so line must not be the bounding box diagonal
+		TEST_METHOD(VerifySmoothGradient)
+		{
+			Assert::AreEqual<int>(ImageBlockComplexity_Smooth, Estimate(ImagePixelFormat_BC7,
+				[](int i, int c)
+				{
+					static constexpr int start[] = { 10, 240, 30, 255 };
+					static constexpr int step[] = { 10, -12, 5, 0 };
+					return static_cast<u8>(start[c] + step[c] * i);
+				}));
+		}
+
+		TEST_METHOD(VerifyDetailed)
+		{
+			// Two independent axes
+			Assert::AreEqual<int>(ImageBlockComplexity_Detailed, Estimate(ImagePixelFormat_BC7,
+				[](int i, int c) { return static_cast<u8>(c == 0 ? (i < 8 ? 0 : 255) : c == 1 ? (i % 2 ? 0 : 255) : 255); }));
+			// Single channel formats are never smooth
+			Assert::AreEqual<int>(ImageBlockComplexity_Detailed, Estimate(ImagePixelFormat_BC4,
+				[](int i, int c) { return static_cast<u8>(i * 10); }));
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "am/graphics/image/imagehash.h"
+#include "helpers/ranges.h"
+
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rageam::graphics;
+
+	TEST_CLASS(ImageHasherTests)
+	{
+	public:
+		// Reference XXH64 values
+		TEST_METHOD(VerifyKnownValues)
+		{
+			Assert::AreEqual<u64>(0xEF46DB3751D8E999, ImageHasher::Compute(nullptr, 0));
+			Assert::AreEqual<u64>(0x44BC2CF5AD770999, ImageHasher::Compute("abc", 3));
+		}
+
+		// Chunks are smaller, equal and larger than 32 byte stripe and split data at every offset within stripe
+		TEST_METHOD(VerifyStreamingMatchesOneShot)
+		{
+			static constexpr int CHUNK_SIZES[] = { 1, 3, 7, 31, 32, 33, 64, 100 };
+
+			std::mt19937 random(0);
+			std::vector<u8> data(1031);
+			for (u8& value : data)
+				value = static_cast<u8>(random());
+
+			for (u64 size : { 0ull, 5ull, 31ull, 32ull, 63ull, 1031ull })
+			{
+				u64 expected = ImageHasher::Compute(data.data(), size, 7);
+				for (int chunkSize : CHUNK_SIZES)
+				{
+					ImageHasher hasher(7);
+					for (u64 offset = 0; offset < size; offset += chunkSize)
+						hasher.Update(data.data() + offset, MIN(static_cast<u64>(chunkSize), size - offset));
+					Assert::AreEqual(expected, hasher.Digest());
+				}
+
+				// Random chunks, including empty ones
+				ImageHasher hasher(7);
+				for (u64 offset = 0; offset < size;)
+				{
+					u64 chunkSize = MIN(static_cast<u64>(random() % 80), size - offset);
+					hasher.Update(data.data() + offset, chunkSize);
+					offset += chunkSize;
+				}
+				Assert::AreEqual(expected, hasher.Digest());
+			}
+		}
+	};
+}
+
+#endif
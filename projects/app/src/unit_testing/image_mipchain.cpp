@@ -0,0 +1,179 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "am/graphics/image/image.h"
+#include "helpers/ranges.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rageam::graphics;
+
+	TEST_CLASS(ImageMipChainTests)
+	{
+		// Odd sizes clamp the last tap to the edge, widths are not multiple of 8 to test SIMD remainder,
+		// 1 pixel wide / tall images keep one side fixed while the other one goes down
+		static constexpr int SIZES[][2] =
+		{
+			{ 256, 256 },
+			{ 64, 16 },
+			{ 37, 23 },
+			{ 100, 7 },
+			{ 1, 9 },
+			{ 13, 1 },
+		};
+
+		static constexpr float ALPHA_WEIGHT_BIAS = 1.0f / 256.0f;
+
+		static int ComputeMipCount(int width, int height)
+		{
+			int mipCount = 1;
+			while ((width >> mipCount) > 0 || (height >> mipCount) > 0)
+				mipCount++;
+			return MIN(mipCount, IMAGE_MAX_MIP_MAPS);
+		}
+
+		static float SrgbToLinear(float c) { return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f); }
+		static float LinearToSrgb(float c) { return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f; }
+
+		// Straightforward 2D version of what generator does, every destination pixel is computed from all its taps at once
+		static void Downsample(u8* dst, const u8* src, int srcWidth, int srcHeight, const ImageMipChainOptions& options)
+		{
+			int dstWidth = MAX(srcWidth >> 1, 1);
+			int dstHeight = MAX(srcHeight >> 1, 1);
+
+			bool isTent = options.Filter == ResizeFilter_Triangle;
+			int tapCount = isTent ? 4 : 2;
+			int tapOffset = isTent ? -1 : 0;
+			static constexpr double TENT_WEIGHTS[] = { 1.0 / 8.0, 3.0 / 8.0, 3.0 / 8.0, 1.0 / 8.0 };
+			static constexpr double BOX_WEIGHTS[] = { 1.0 / 2.0, 1.0 / 2.0 };
+			const double* weights = isTent ? TENT_WEIGHTS : BOX_WEIGHTS;
+
+			for (int y = 0; y < dstHeight; y++)
+			{
+				for (int x = 0; x < dstWidth; x++)
+				{
+					double sum[4] = {};
+					for (int ty = 0; ty < tapCount; ty++)
+					{
+						int srcY = std::clamp(y * 2 + tapOffset + ty, 0, srcHeight - 1);
+						for (int tx = 0; tx < tapCount; tx++)
+						{
+							int srcX = std::clamp(x * 2 + tapOffset + tx, 0, srcWidth - 1);
+							const u8* pixel = src + (static_cast<size_t>(srcY) * srcWidth + srcX) * 4;
+
+							// Kept in 0-255 range, weights are multiples of 1/64 so sum of plain values is exact
+							double value[4];
+							for (int c = 0; c < 4; c++)
+								value[c] = pixel[c];
+							if (options.GammaCorrect)
+							{
+								for (int c = 0; c < 3; c++)
+									value[c] = SrgbToLinear(pixel[c] / 255.0f) * 255.0;
+							}
+							if (options.AlphaWeighted)
+							{
+								for (int c = 0; c < 3; c++)
+									value[c] *= pixel[3] / 255.0 + ALPHA_WEIGHT_BIAS;
+							}
+
+							for (int c = 0; c < 4; c++)
+								sum[c] += value[c] * weights[tx] * weights[ty];
+						}
+					}
+
+					if (options.AlphaWeighted)
+					{
+						for (int c = 0; c < 3; c++)
+							sum[c] /= sum[3] / 255.0 + ALPHA_WEIGHT_BIAS;
+					}
+					if (options.GammaCorrect)
+					{
+						for (int c = 0; c < 3; c++)
+							sum[c] = LinearToSrgb(std::clamp(static_cast<float>(sum[c] / 255.0), 0.0f, 1.0f)) * 255.0;
+					}
+
+					u8* pixel = dst + (static_cast<size_t>(y) * dstWidth + x) * 4;
+					for (int c = 0; c < 4; c++)
+						pixel[c] = static_cast<u8>(std::clamp(static_cast<int>(sum[c] + 0.5), 0, 255));
+				}
+			}
+		}
+
+		// Every mip is compared against reference downsample of the previous mip generated by the chain, so error doesn't
+		// add up over the levels. Plain box works on integers and must match exactly, float paths may be off by one
+		static void VerifyChain(const ImageMipChainOptions& options, int tolerance)
+		{
+			std::mt19937 random(0);
+			for (const int* size : SIZES)
+			{
+				int width = size[0];
+				int height = size[1];
+				int mipCount = ComputeMipCount(width, height);
+
+				size_t totalSize = 0;
+				for (int i = 0; i < mipCount; i++)
+					totalSize += static_cast<size_t>(MAX(width >> i, 1)) * MAX(height >> i, 1) * 4;
+
+				// Mostly opaque with a few transparent and translucent pixels so alpha weighting has something to do
+				std::vector<u8> pixels(totalSize, 0xCD);
+				for (int i = 0; i < width * height; i++)
+				{
+					for (int c = 0; c < 3; c++)
+						pixels[i * 4 + c] = static_cast<u8>(random());
+					int alpha = random() % 4;
+					pixels[i * 4 + 3] = static_cast<u8>(alpha == 0 ? 0 : alpha == 1 ? random() : 255);
+				}
+
+				ImageGenerateMipChainRGBA(reinterpret_cast<char*>(pixels.data()), width, height, mipCount, options);
+
+				const u8* src = pixels.data();
+				for (int i = 1; i < mipCount; i++)
+				{
+					int srcWidth = MAX(width >> (i - 1), 1);
+					int srcHeight = MAX(height >> (i - 1), 1);
+					int dstCount = MAX(width >> i, 1) * MAX(height >> i, 1);
+					const u8* dst = src + static_cast<size_t>(srcWidth) * srcHeight * 4;
+
+					std::vector<u8> expected(dstCount * 4);
+					Downsample(expected.data(), src, srcWidth, srcHeight, options);
+					for (int k = 0; k < dstCount * 4; k++)
+						Assert::IsTrue(abs(expected[k] - dst[k]) <= tolerance);
+
+					src = dst;
+				}
+			}
+		}
+
+	public:
+		TEST_METHOD(VerifyBox)
+		{
+			VerifyChain({ ResizeFilter_Box, false, false }, 0);
+		}
+
+		TEST_METHOD(VerifyTent)
+		{
+			VerifyChain({ ResizeFilter_Triangle, false, false }, 1);
+		}
+
+		TEST_METHOD(VerifyGammaCorrect)
+		{
+			VerifyChain({ ResizeFilter_Box, true, false }, 1);
+			VerifyChain({ ResizeFilter_Triangle, true, false }, 1);
+		}
+
+		TEST_METHOD(VerifyAlphaWeighted)
+		{
+			VerifyChain({ ResizeFilter_Box, false, true }, 1);
+			VerifyChain({ ResizeFilter_Triangle, true, true }, 1);
+		}
+	};
+}
+
+#endif
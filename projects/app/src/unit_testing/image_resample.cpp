@@ -0,0 +1,151 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "am/graphics/image/imageresample.h"
+
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rageam::graphics;
+
+	TEST_CLASS(ImageResampleTests)
+	{
+		static constexpr ResizeFilter FILTERS[] =
+		{
+			ResizeFilter_Box, ResizeFilter_Triangle, ResizeFilter_CubicBSpline,
+			ResizeFilter_CatmullRom, ResizeFilter_Mitchell, ResizeFilter_Point,
+		};
+
+		// Sizes are not multiple of 16 to test scalar remainder, last one is split in bands
+		static constexpr int SIZES[][4] =
+		{
+			{ 37, 23, 11, 7 },
+			{ 100, 80, 256, 300 },
+			{ 5, 5, 3, 9 },
+			{ 1, 1, 4, 4 },
+			{ 1024, 768, 128, 96 },
+		};
+
+	public:
+		TEST_METHOD(VerifyKernelWeights)
+		{
+			for (ResizeFilter filter : FILTERS)
+			{
+				for (const int* size : SIZES)
+				{
+					ImageResampleKernelPtr kernel = ImageGetResampleKernel(size[0], size[2], filter);
+					Assert::IsTrue(kernel == ImageGetResampleKernel(size[0], size[2], filter)); // Must be cached
+					for (int i = 0; i < kernel->DstSize; i++)
+					{
+						int tapFirst = kernel->TapFirst[i];
+						Assert::IsTrue(tapFirst >= 0 && tapFirst + kernel->TapCount <= kernel->SrcSize);
+
+						int weightSum = 0;
+						for (int k = 0; k < kernel->TapCount; k++)
+							weightSum += kernel->Weights[i * kernel->TapCount + k];
+						Assert::AreEqual(1 << IMAGE_RESAMPLE_WEIGHT_BITS, weightSum);
+					}
+				}
+			}
+		}
+
+		// RGBA goes through SIMD horizontal pass, single channel through scalar one, results must be identical
+		TEST_METHOD(VerifyRGBAMatchesSingleChannel)
+		{
+			std::mt19937 random(0);
+			for (ResizeFilter filter : FILTERS)
+			{
+				for (const int* size : SIZES)
+				{
+					int srcCount = size[0] * size[1];
+					int dstCount = size[2] * size[3];
+
+					std::vector<u8> src(srcCount * 4);
+					for (u8& value : src)
+						value = static_cast<u8>(random());
+
+					std::vector<u8> dst(dstCount * 4);
+					ImageResample(dst.data(), src.data(), 4, size[0], size[1], size[2], size[3], filter, false);
+
+					for (int c = 0; c < 4; c++)
+					{
+						std::vector<u8> srcChannel(srcCount);
+						std::vector<u8> dstChannel(dstCount);
+						for (int i = 0; i < srcCount; i++)
+							srcChannel[i] = src[i * 4 + c];
+
+						ImageResample(dstChannel.data(), srcChannel.data(), 1, size[0], size[1], size[2], size[3], filter, false);
+						for (int i = 0; i < dstCount; i++)
+							Assert::AreEqual(dstChannel[i], dst[i * 4 + c]);
+					}
+				}
+			}
+		}
+
+		// Catmull-Rom is zero at integer distance, on odd integer upscale zero taps are trimmed and TapFirst goes back by one
+		// in the middle of a band. Large image is split in bands, every column resized separately goes through a single band.
+		// Width is not changed so horizontal pass is exact and columns can be compared
+		TEST_METHOD(VerifyBandsMatchSingleBand)
+		{
+			static constexpr int WIDTH = 512;
+			static constexpr int HEIGHT_FROM = 200;
+			static constexpr int HEIGHT_TO = 600;
+			Assert::IsTrue(WIDTH * HEIGHT_TO >= IMAGE_RESAMPLE_MULTITHREAD_MIN_PIXELS);
+
+			std::mt19937 random(0);
+			std::vector<u8> src(WIDTH * HEIGHT_FROM);
+			for (u8& value : src)
+				value = static_cast<u8>(random());
+
+			std::vector<u8> dst(WIDTH * HEIGHT_TO);
+			ImageResample(dst.data(), src.data(), 1, WIDTH, HEIGHT_FROM, WIDTH, HEIGHT_TO, ResizeFilter_CatmullRom, false);
+
+			std::vector<u8> srcColumn(HEIGHT_FROM);
+			std::vector<u8> dstColumn(HEIGHT_TO);
+			for (int x = 0; x < WIDTH; x++)
+			{
+				for (int y = 0; y < HEIGHT_FROM; y++)
+					srcColumn[y] = src[y * WIDTH + x];
+
+				ImageResample(dstColumn.data(), srcColumn.data(), 1, 1, HEIGHT_FROM, 1, HEIGHT_TO, ResizeFilter_CatmullRom, false);
+				for (int y = 0; y < HEIGHT_TO; y++)
+					Assert::AreEqual(dstColumn[y], dst[y * WIDTH + x]);
+			}
+		}
+
+		// Flat color must stay the same regardless of filter and alpha
+		TEST_METHOD(VerifyFlatColorWithAlpha)
+		{
+			for (ResizeFilter filter : FILTERS)
+			{
+				for (const int* size : SIZES)
+				{
+					int srcCount = size[0] * size[1];
+					int dstCount = size[2] * size[3];
+
+					std::vector<ColorU32> src(srcCount);
+					for (int i = 0; i < srcCount; i++)
+						src[i] = ColorU32(200, 13, 0, i % 2 ? 255 : 128);
+
+					std::vector<ColorU32> dst(dstCount);
+					ImageResample(
+						reinterpret_cast<u8*>(dst.data()), reinterpret_cast<const u8*>(src.data()), 4,
+						size[0], size[1], size[2], size[3], filter, true);
+
+					for (ColorU32 color : dst)
+					{
+						Assert::AreEqual<int>(200, color.R);
+						Assert::AreEqual<int>(13, color.G);
+						Assert::AreEqual<int>(0, color.B);
+					}
+				}
+			}
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "rage/paging/compiler/packer.h"
+#include "rage/paging/compiler/snapshotallocator.h"
+#include "rage/paging/resourceinfo.h"
+
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rage;
+
+	TEST_CLASS(pgRscPackerTests)
+	{
+		static constexpr u32 ALLOCATOR_SIZE = 32 * 1024 * 1024;
+
+		// Every block must be packed exactly once, chunks must not overflow and main block must be the first one
+		static void VerifyPack(const pgSnapshotAllocator& allocator, u32 reservedChunks)
+		{
+			pgRscPacker packer(allocator, reservedChunks);
+			datPackedChunks pack = {};
+			Assert::IsTrue(packer.Pack(pack));
+
+			std::vector<int> packCounts(allocator.GetBlockCount());
+			u64 usedSize = 0;
+			u32 chunkCount = 0;
+			u64 chunkSize = static_cast<u64>(PG_MIN_CHUNK_SIZE) << pack.SizeShift;
+			for (u8 i = 0; i < PG_MAX_BUCKETS; i++)
+			{
+				Assert::IsTrue(pack.BucketCounts[i] <= datResourceInfo::GetMaxChunkCountInBucket(i));
+				for (u8 k = 0; k < pack.BucketCounts[i]; k++)
+				{
+					const atArray<u16>& chunk = pack.Buckets[i][k];
+					if (allocator.IsVirtual() && chunkCount == 0)
+						Assert::AreEqual<u16>(0, chunk[0]);
+
+					u64 chunkUsedSize = 0;
+					for (u16 index : chunk)
+					{
+						packCounts[index]++;
+						chunkUsedSize += allocator.GetBlockSize(index);
+					}
+					Assert::IsTrue(chunkUsedSize <= chunkSize);
+					Assert::IsTrue(chunkSize >= PG_MIN_CHUNK_SIZE && chunkSize < PG_MAX_CHUNK_SIZE);
+
+					usedSize += chunkUsedSize;
+					chunkCount++;
+				}
+				chunkSize /= 2;
+			}
+
+			for (int packCount : packCounts)
+				Assert::AreEqual(1, packCount);
+			Assert::AreEqual<u32>(pack.ChunkCount, chunkCount);
+			Assert::IsTrue(chunkCount + reservedChunks <= PG_MAX_CHUNKS);
+
+			const pgRscPackInfo& info = packer.GetPackInfo();
+			Assert::AreEqual<u64>(usedSize, info.UsedSize);
+			Assert::AreEqual(chunkCount, info.ChunkCount);
+			Assert::IsTrue(info.AllocatedSize >= info.UsedSize);
+		}
+
+	public:
+		TEST_METHOD(VerifyRandomBlocks)
+		{
+			std::mt19937 random(0);
+			for (int i = 0; i < 20; i++)
+			{
+				bool isVirtual = i % 2 == 0;
+				pgSnapshotAllocator allocator(ALLOCATOR_SIZE, isVirtual);
+
+				// Mostly small blocks, like arrays of bounds and shaders, with few large ones
+				int blockCount = 1 + random() % 1000;
+				for (int k = 0; k < blockCount; k++)
+				{
+					u32 size = random() % 8 == 0 ? 16 + random() % 0x8000 : 16 + random() % 0x400;
+					allocator.Allocate(size);
+				}
+
+				VerifyPack(allocator, isVirtual ? 0 : random() % 64);
+			}
+		}
+
+		// Large blocks don't fit in the first bucket together with smaller size shift, the best is to put them in one chunk
+		// and small block in the smallest chunk available with that size shift (0x800000 >> 8)
+		TEST_METHOD(VerifyEqualLargeBlocks)
+		{
+			pgSnapshotAllocator allocator(ALLOCATOR_SIZE, false);
+			allocator.Allocate(0x400000);
+			allocator.Allocate(0x400000);
+			allocator.Allocate(0x1000);
+
+			VerifyPack(allocator, 0);
+
+			pgRscPacker packer(allocator, 0);
+			datPackedChunks pack = {};
+			Assert::IsTrue(packer.Pack(pack));
+			Assert::AreEqual<u32>(0x800000 + 0x8000, packer.GetPackInfo().AllocatedSize);
+		}
+	};
+}
+
+#endif
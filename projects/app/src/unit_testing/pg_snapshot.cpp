@@ -0,0 +1,61 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "rage/paging/compiler/snapshotallocator.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	using namespace rage;
+
+	TEST_CLASS(pgSnapshotAllocatorTests)
+	{
+		struct TestBlock
+		{
+			int*		Items;
+			char*		Inner;	// Points within another block
+			TestBlock*	Other;
+		};
+
+	public:
+		TEST_METHOD(VerifyFixupReferences)
+		{
+			static constexpr int BLOCK_COUNT = 100;
+			static constexpr u64 BLOCK_STRIDE = 0x1000;
+
+			pgSnapshotAllocator allocator(1024 * 1024, true);
+
+			TestBlock* blocks[BLOCK_COUNT];
+			for (TestBlock*& block : blocks)
+				block = static_cast<TestBlock*>(allocator.Allocate(sizeof TestBlock));
+
+			// Refs are added out of address order, items are allocated after all test blocks
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				TestBlock* block = blocks[i];
+				allocator.AllocateRefArray(block->Items, 10);
+				block->Inner = reinterpret_cast<char*>(blocks[i * 7 % BLOCK_COUNT]) + 8;
+				allocator.AddRef(block->Inner);
+				block->Other = blocks[BLOCK_COUNT - 1 - i];
+				allocator.AddRef(block->Other);
+			}
+			Assert::AreEqual<u16>(BLOCK_COUNT * 2, allocator.GetBlockCount());
+
+			atArray<u64> blockAddresses(allocator.GetBlockCount());
+			for (u16 i = 0; i < allocator.GetBlockCount(); i++)
+				blockAddresses[i] = allocator.GetBaseAddress() | i * BLOCK_STRIDE;
+			allocator.FixupReferences(blockAddresses);
+
+			for (int i = 0; i < BLOCK_COUNT; i++)
+			{
+				const TestBlock* block = blocks[i];
+				Assert::AreEqual(blockAddresses[static_cast<u16>(BLOCK_COUNT + i)], reinterpret_cast<u64>(block->Items));
+				Assert::AreEqual(blockAddresses[static_cast<u16>(i * 7 % BLOCK_COUNT)] + 8, reinterpret_cast<u64>(block->Inner));
+				Assert::AreEqual(blockAddresses[static_cast<u16>(BLOCK_COUNT - 1 - i)], reinterpret_cast<u64>(block->Other));
+			}
+		}
+	};
+}
+
+#endif
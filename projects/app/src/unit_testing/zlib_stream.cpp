@@ -0,0 +1,57 @@
+#ifdef AM_UNIT_TESTS
+
+#include "CppUnitTest.h"
+#include "rage/zlib/stream.h"
+
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace unit_testing
+{
+	TEST_CLASS(zLibStreamTests)
+	{
+	public:
+		// Independently compressed segments must inflate as one stream, the same way resource loader reads them
+		TEST_METHOD(VerifySegmentsFormSingleStream)
+		{
+			static constexpr u32 SEGMENT_SIZE = 100000;
+
+			// Repeating noise gives matches across segment boundaries, so dictionary is actually used
+			std::mt19937 random(0);
+			std::vector<char> pattern(20000);
+			for (char& value : pattern)
+				value = static_cast<char>(random());
+			std::vector<char> data;
+			for (int i = 0; i < 23; i++)
+				data.insert(data.end(), pattern.begin(), pattern.end());
+			u32 dataSize = static_cast<u32>(data.size());
+
+			u32 segmentBound = zLibCompressor::ComputeSegmentBound(SEGMENT_SIZE);
+			std::vector<char> segmentBuffer(segmentBound);
+			std::vector<char> compressed;
+			for (u32 offset = 0; offset < dataSize; offset += SEGMENT_SIZE)
+			{
+				u32 size = MIN(SEGMENT_SIZE, dataSize - offset);
+				u32 dictionarySize = MIN(offset, ZLIB_DICTIONARY_SIZE);
+
+				zLibCompressor compressor(segmentBuffer.data(), segmentBound);
+				u32 compressedSize = compressor.CompressSegment(
+					data.data() + offset - dictionarySize, dictionarySize, data.data() + offset, size);
+				compressed.insert(compressed.end(), segmentBuffer.begin(), segmentBuffer.begin() + compressedSize);
+			}
+			// Without dictionary every segment would contain at least one full copy of the pattern
+			Assert::IsTrue(compressed.size() < pattern.size() * 2);
+
+			std::vector<char> decompressed(dataSize);
+			zLibDecompressor decompressor;
+			u32 leftSize;
+			Assert::IsTrue(decompressor.Decompress(
+				decompressed.data(), dataSize, compressed.data(), static_cast<u32>(compressed.size()), leftSize));
+			Assert::IsTrue(decompressed == data);
+		}
+	};
+}
+
+#endif